@@ -0,0 +1,36 @@
+// Cas limites de MUL, DIV, MOD, SHL, SHR et SAR
+
+        TEXT    30
+        EQU     *
+
+        LOAD    R01, #1
+        SHL     R01, #31        // INT32_MIN
+        STORE   R01, @min
+        LOAD    R02, @min
+        DIV     R02, #-1        // INT32_MIN / -1 = INT32_MIN (modulo 2^32)
+        LOAD    R03, @min
+        MOD     R03, #-1        // 0
+        LOAD    R04, #-7
+        DIV     R04, #2         // quotient tronqué vers zéro : -3
+        LOAD    R05, #-7
+        MOD     R05, #2         // du signe du dividende : -1
+        LOAD    R06, #7
+        MOD     R06, #-2        // 1
+        LOAD    R07, #-8
+        SAR     R07, #1         // -4
+        LOAD    R08, #-1
+        SAR     R08, #31        // -1
+        LOAD    R09, #-1
+        SHR     R09, #28        // 15
+        LOAD    R10, #65536
+        MUL     R10, #65536     // 2^32 modulo 2^32 : 0
+        LOAD    R11, #-3
+        MUL     R11, #5         // -15
+        LOAD    R12, #1
+        SHL     R12, #33        // décalage modulo 32 : 2
+        HALT
+        END
+
+        DATA    10
+min     WORD    0
+        END
@@ -0,0 +1,40 @@
+// Instructions de bloc : copie, comparaison, remplissage, recouvrement
+
+        TEXT    40
+        EQU     *
+
+        LOAD    R01, #4         // longueur des blocs
+        LOAD    R02, #0         // adresse de src
+        BMOVE   R01, @4, R02    // dst <- src
+        BCMP    R01, @4, R02    // égaux : CC Z
+        BRANCH  NE, @diff1
+        LOAD    R08, #1
+diff1   LOAD    R03, #-7
+        BFILL   R01, @8, R03    // fill <- -7
+        LOAD    R04, #8         // adresse de fill
+        BCMP    R01, @4, R04    // dst > fill : CC P
+        BRANCH  LE, @diff2
+        LOAD    R09, #1
+diff2   LOAD    R05, #3
+        LOAD    R06, #4         // adresse de dst
+        BMOVE   R05, 1[R06], R06 // recouvrement : dst[1..3] <- dst[0..2]
+        LOAD    R07, #0
+        BFILL   R07, @0, R03    // bloc vide : rien n'est écrit
+        BCMP    R07, @0, R04    // blocs vides égaux : CC Z
+        HALT
+        END
+
+        DATA    30
+src     WORD    1
+        WORD    2
+        WORD    3
+        WORD    4
+dst     WORD    0
+        WORD    0
+        WORD    0
+        WORD    0
+fill    WORD    0
+        WORD    0
+        WORD    0
+        WORD    0
+        END
@@ -0,0 +1,14 @@
+// Bloc débordant du segment de données : une seule vérification, rien n'est écrit
+
+        TEXT    10
+        EQU     *
+
+        LOAD    R01, #32
+        LOAD    R02, #-1
+        BFILL   R01, @0, R02    // 32 mots à partir de 0 : au-delà du segment, ERR_SEGDATA
+        HALT
+        END
+
+        DATA    10
+        WORD    5
+        END
@@ -0,0 +1,13 @@
+// Division par zéro : ERR_DIVZERO, le registre n'est pas modifié
+
+        TEXT    10
+        EQU     *
+
+        LOAD    R01, #5
+        DIV     R01, @zero
+        HALT
+        END
+
+        DATA    10
+zero    WORD    0
+        END
@@ -0,0 +1,14 @@
+// Boucle infinie dont l'état alterne : ERR_LOOP avec regress -L
+
+        TEXT    10
+        EQU     *
+
+loop    LOAD    R01, @x
+        XOR     R01, #1
+        STORE   R01, @x
+        BRANCH  NC, @loop
+        END
+
+        DATA    10
+x       WORD    0
+        END
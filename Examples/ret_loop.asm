@@ -0,0 +1,12 @@
+// Boucle fermée par un RET vers une adresse inférieure : ERR_LOOP avec regress -L
+
+        TEXT    10
+        EQU     *
+
+loop    PUSH    @target
+        RET
+        END
+
+        DATA    10
+target  WORD    0               // adresse de loop
+        END
@@ -2,12 +2,13 @@
 
 //! Test un operateur inconnu
 /*
- * Il y a totalement douze operateurs. Quand on fait cop=12, il y a un erreur.
+ * Le code operation tient sur 6 bits mais seuls les premiers sont definis
+ * (jusqu'a SAR). Quand on fait cop=63, il y a un erreur.
 */
 Instruction text[] = {
 //   type                cop	imm     ind     regcond	operand
 //-------------------------------------------------------------
-    {.instr_immediate =  {12, 	 false, false, 	0, 	0	}},  // 0
+    {.instr_immediate =  {63, 	 false, false, 	0, 	0	}},  // 0
  
 };
 
@@ -0,0 +1,104 @@
+/*!
+ * \file assemble.c
+ * \brief Assembleur (outil autonome).
+ *
+ * Usage : <tt>assemble [-o sortie] [-S] [-y symboles] [-s pile] source.asm</tt>
+ *
+ * Le source est assemblé (voir assembler.h) et le programme écrit au format
+ * lu par read_program() : format historique par défaut, format sectionné
+ * (avec la table des symboles) avec \c -S. La sortie par défaut est le nom du
+ * source avec l'extension \c .bin. Avec \c -y, les étiquettes sont aussi
+ * écrites dans un fichier texte, une par ligne :
+ * <tt>adresse (hexadécimal) T|D nom</tt>.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // getopt()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "machine.h"
+#include "assembler.h"
+
+//! Affichage de l'usage et fin
+static void usage(const char *prog) {
+    printf("Usage: %s [-o sortie] [-S] [-y symboles] [-s pile] source.asm\n", prog);
+    exit(1);
+}
+
+//! Écriture du fichier des symboles
+static void write_symbols(const Assembly *assembly, const char *file) {
+    FILE *f = fopen(file, "w");
+    if (f == NULL) {
+        printf("Erreur: %s: création impossible\n", file);
+        exit(1);
+    }
+    for (unsigned i = 0; i < assembly->_nsymbols; i++)
+        fprintf(f, "%04x %c %s\n", assembly->_symbols[i]._address,
+                assembly->_symbols[i]._text ? 'T' : 'D', assembly->_symbols[i]._name);
+    fclose(f);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL, *symfile = NULL;
+    Program_Format format = FORMAT_RAW;
+    unsigned stacksize = ASM_STACKSIZE;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:Sy:s:")) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case 'S':
+            format = FORMAT_SECTIONED;
+            break;
+        case 'y':
+            symfile = optarg;
+            break;
+        case 's':
+            stacksize = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1)
+        usage(argv[0]);
+    const char *source = argv[optind];
+
+    char *defname = NULL;
+    if (output == NULL) { // source.asm -> source.bin
+        size_t len = strlen(source);
+        defname = malloc(len + 5);
+        strcpy(defname, source);
+        char *dot = strrchr(defname, '.');
+        if (dot != NULL && strchr(dot, '/') == NULL)
+            *dot = '\0';
+        strcat(defname, ".bin");
+        output = defname;
+    }
+
+    Assembly assembly;
+    if (!assemble_file(source, stacksize, &assembly)) {
+        printf("%s: %u erreur(s), pas de fichier produit\n", source, assembly._errors);
+        return 1;
+    }
+
+    Machine mach;
+    load_program(&mach, assembly._textsize, assembly._text,
+                 assembly._datasize, assembly._data, assembly._dataend);
+    mach._symbols = assembly._symbols;
+    mach._nsymbols = assembly._nsymbols;
+    write_program(&mach, output, format);
+    if (symfile != NULL)
+        write_symbols(&assembly, symfile);
+
+    printf("%s -> %s : %u lignes, %u instructions, %u mots de données (%u statiques)\n",
+           source, output, assembly._lines, assembly._textsize,
+           assembly._datasize, assembly._dataend);
+    assembly_free(&assembly);
+    free(defname);
+    return 0;
+}
@@ -0,0 +1,745 @@
+/*!
+ * \file assembler.c
+ * \brief Assembleur pour le dialecte des sources .asm (voir Examples/).
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mmap()
+
+#include "assembler.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Directives (à la suite des codes opérations dans la table des mots réservés)
+enum
+{
+    DIR_TEXT = 64,	//!< Début du segment de texte
+    DIR_DATA,		//!< Début du segment de données
+    DIR_END,		//!< Fin du segment courant
+    DIR_EQU,		//!< Définition d'une constante
+    DIR_WORD,		//!< Mots de données
+};
+
+//! Segment en cours d'assemblage
+typedef enum
+{
+    SEG_NONE = 0,	//!< Hors segment
+    SEG_TEXT,		//!< Texte
+    SEG_DATA,		//!< Données
+} Segment;
+
+//! Nature d'un symbole
+typedef enum
+{
+    SYM_UNDEFINED = 0,	//!< Référencé mais pas (encore) défini
+    SYM_TEXT,		//!< Étiquette du texte
+    SYM_DATA,		//!< Étiquette des données
+    SYM_CONST,		//!< Constante (EQU)
+} Symbol_Kind;
+
+//! Champ à corriger par une référence en avant
+typedef enum
+{
+    FIX_IMMEDIATE,	//!< Valeur immédiate (20 bits signés)
+    FIX_ABSOLUTE,	//!< Adresse absolue (20 bits)
+    FIX_OFFSET,		//!< Déplacement indexé (16 bits signés)
+    FIX_BLOCK_ABSOLUTE,	//!< Adresse absolue d'une instruction de bloc (12 bits)
+    FIX_BLOCK_OFFSET,	//!< Déplacement d'une instruction de bloc (12 bits signés)
+    FIX_WORD,		//!< Mot de données
+} Fixup_Kind;
+
+//! Symbole de la table de hachage
+typedef struct
+{
+    const char *_name;		//!< Nom (dans le source, non terminé par un zéro)
+    unsigned _len;		//!< Longueur du nom
+    uint32_t _hash;		//!< Valeur de hachage du nom
+    Symbol_Kind _kind;		//!< Nature
+    int64_t _value;		//!< Valeur ou adresse
+    unsigned _line;		//!< Ligne de définition (ou de première référence)
+} Asm_Symbol;
+
+//! Référence en avant à corriger en fin d'assemblage
+typedef struct
+{
+    unsigned _symbol;		//!< Indice du symbole
+    Fixup_Kind _kind;		//!< Champ à corriger
+    unsigned _index;		//!< Indice de l'instruction ou du mot de données
+    int64_t _addend;		//!< Constante ajoutée à la valeur du symbole
+    unsigned _line;		//!< Ligne de la référence
+} Fixup;
+
+//! État de l'assembleur
+typedef struct
+{
+    const char *_filename;	//!< Nom du source
+    unsigned _line;		//!< Ligne courante
+    Segment _segment;		//!< Segment courant
+    Assembly *_out;		//!< Résultat
+
+    Instruction *_text;		//!< Texte assemblé
+    unsigned _ntext, _textcap;	//!< Nombre d'instructions, capacité
+    unsigned _textmin;		//!< Taille minimale du texte (TEXT n)
+    Word *_data;		//!< Données assemblées
+    unsigned _ndata, _datacap;	//!< Nombre de mots, capacité
+    unsigned _datamin;		//!< Taille minimale des données (DATA n)
+
+    Asm_Symbol *_symbols;	//!< Symboles
+    unsigned _nsymbols, _symcap;//!< Nombre de symboles, capacité
+    int *_buckets;		//!< Table de hachage (indices de symboles, -1 si vide)
+    unsigned _nbuckets;		//!< Taille de la table (puissance de 2)
+
+    Fixup *_fixups;		//!< Références en avant
+    unsigned _nfixups, _fixcap;	//!< Nombre de références, capacité
+} Assembler;
+
+//! Table des mots réservés (codes opérations et directives)
+static struct
+{
+    const char *_name;		//!< Mot réservé
+    int _code;			//!< Code opération ou directive
+} reserved[128];
+
+//! Valeur de hachage (FNV-1a) d'un nom
+static uint32_t hash_name(const char *name, unsigned len) {
+    uint32_t h = 2166136261u;
+    for (unsigned i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//! Initialisation de la table des mots réservés
+static void init_reserved(void) {
+    static const char *directives[] = { "TEXT", "DATA", "END", "EQU", "WORD" };
+    static bool initialized = false;
+    if (initialized)
+        return;
+    initialized = true;
+    for (unsigned code = 0; code <= LAST_COP + 5; code++) {
+        const char *name = code <= LAST_COP ? cop_names[code] : directives[code - LAST_COP - 1];
+        unsigned h = hash_name(name, strlen(name)) & 127;
+        while (reserved[h]._name != NULL)
+            h = (h + 1) & 127;
+        reserved[h]._name = name;
+        reserved[h]._code = code <= LAST_COP ? (int)code : DIR_TEXT + (int)(code - LAST_COP - 1);
+    }
+}
+
+//! Recherche d'un mot réservé (-1 si le nom n'en est pas un)
+static int find_reserved(const char *name, unsigned len) {
+    for (unsigned h = hash_name(name, len) & 127; reserved[h]._name != NULL; h = (h + 1) & 127)
+        if (strncmp(reserved[h]._name, name, len) == 0 && reserved[h]._name[len] == '\0')
+            return reserved[h]._code;
+    return -1;
+}
+
+//! Signalement d'une erreur à la ligne courante
+static void asm_error(Assembler *a, unsigned line, const char *format, ...) {
+    if (++a->_out->_errors > ASM_MAXERRORS)
+        return;
+    printf("%s:%u: erreur: ", a->_filename, line);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    if (a->_out->_errors == ASM_MAXERRORS)
+        printf("%s: trop d'erreurs, les suivantes ne sont pas signalées\n", a->_filename);
+}
+
+//! Agrandissement d'un tableau dynamique (capacité doublée)
+static void *grow(void *array, unsigned *cap, size_t elemsize) {
+    *cap = *cap == 0 ? 1024 : 2 * *cap;
+    array = realloc(array, *cap * elemsize);
+    if (array == NULL) {
+        printf("Erreur: mémoire insuffisante\n");
+        exit(1);
+    }
+    return array;
+}
+
+//! Recherche d'un symbole, créé (non défini) s'il est absent
+static unsigned lookup(Assembler *a, const char *name, unsigned len) {
+    if (2 * (a->_nsymbols + 1) > a->_nbuckets) { // facteur de charge au plus 1/2
+        free(a->_buckets);
+        a->_nbuckets = a->_nbuckets == 0 ? 1024 : 2 * a->_nbuckets;
+        a->_buckets = malloc(a->_nbuckets * sizeof(int));
+        memset(a->_buckets, -1, a->_nbuckets * sizeof(int));
+        for (unsigned i = 0; i < a->_nsymbols; i++) {
+            unsigned h = a->_symbols[i]._hash & (a->_nbuckets - 1);
+            while (a->_buckets[h] >= 0)
+                h = (h + 1) & (a->_nbuckets - 1);
+            a->_buckets[h] = i;
+        }
+    }
+    uint32_t hash = hash_name(name, len);
+    unsigned h = hash & (a->_nbuckets - 1);
+    for (; a->_buckets[h] >= 0; h = (h + 1) & (a->_nbuckets - 1)) {
+        Asm_Symbol *s = &a->_symbols[a->_buckets[h]];
+        if (s->_hash == hash && s->_len == len && memcmp(s->_name, name, len) == 0)
+            return a->_buckets[h];
+    }
+    if (a->_nsymbols == a->_symcap)
+        a->_symbols = grow(a->_symbols, &a->_symcap, sizeof(Asm_Symbol));
+    Asm_Symbol *s = &a->_symbols[a->_nsymbols];
+    s->_name = name;
+    s->_len = len;
+    s->_hash = hash;
+    s->_kind = SYM_UNDEFINED;
+    s->_value = 0;
+    s->_line = a->_line;
+    a->_buckets[h] = a->_nsymbols;
+    return a->_nsymbols++;
+}
+
+//! Définition d'un symbole
+static void define(Assembler *a, const char *name, unsigned len, Symbol_Kind kind, int64_t value) {
+    unsigned index = lookup(a, name, len); // peut agrandir la table
+    Asm_Symbol *s = &a->_symbols[index];
+    if (s->_kind != SYM_UNDEFINED) {
+        asm_error(a, a->_line, "symbole « %.*s » déjà défini ligne %u", (int)len, name, s->_line);
+        return;
+    }
+    s->_kind = kind;
+    s->_value = value;
+    s->_line = a->_line;
+}
+
+// ---------------------------------------------------------------------------
+// Analyse lexicale d'une ligne (de p à end, commentaire exclu)
+// ---------------------------------------------------------------------------
+
+//! Caractère de début d'identificateur ?
+static bool ident_start(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c == '.';
+}
+
+//! Caractère d'identificateur ?
+static bool ident_char(char c) {
+    return ident_start(c) || (c >= '0' && c <= '9');
+}
+
+//! Passage des blancs
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        p++;
+    return p;
+}
+
+//! Longueur de l'identificateur commençant en p
+static unsigned ident_len(const char *p, const char *end) {
+    const char *q = p;
+    if (q < end && ident_start(*q))
+        for (q++; q < end && ident_char(*q); q++)
+            ;
+    return q - p;
+}
+
+//! Valeur d'un chiffre dans la base donnée (-1 sinon)
+static int digit_value(char c, unsigned base) {
+    int d = c >= '0' && c <= '9' ? c - '0'
+          : c >= 'a' && c <= 'f' ? c - 'a' + 10
+          : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 99;
+    return d < (int)base ? d : -1;
+}
+
+//! Lecture d'un nombre non signé (décimal, 0x hexadécimal, ou hexadécimal si hex)
+static bool parse_number(const char **pp, const char *end, bool hex, int64_t *value) {
+    const char *p = *pp;
+    unsigned base = hex ? 16 : 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && digit_value(p[2], 16) >= 0) {
+        base = 16;
+        p += 2;
+    }
+    if (p >= end || digit_value(*p, base) < 0)
+        return false;
+    int64_t v = 0;
+    for (int d; p < end && (d = digit_value(*p, base)) >= 0; p++)
+        if ((v = v * base + d) > UINT32_MAX)
+            return false;
+    if (p < end && ident_char(*p))
+        return false;
+    *pp = p;
+    *value = v;
+    return true;
+}
+
+//! Opérande en cours d'analyse : valeur connue ou référence à un symbole
+typedef struct
+{
+    int64_t _value;		//!< Valeur (ou constante ajoutée au symbole)
+    int _symbol;		//!< Symbole non encore défini (-1 si valeur connue)
+} Expr;
+
+//! Lecture d'une expression : [signe] (nombre | symbole | *) [(+|-) nombre]
+static bool parse_expr(Assembler *a, const char **pp, const char *end, bool hex, Expr *e) {
+    const char *p = skip_blanks(*pp, end);
+    int64_t sign = 1;
+    if (p < end && (*p == '+' || *p == '-')) {
+        sign = *p == '-' ? -1 : 1;
+        p = skip_blanks(p + 1, end);
+    }
+    e->_symbol = -1;
+    unsigned len = ident_len(p, end);
+    if (p < end && *p == '*') {
+        e->_value = a->_segment == SEG_DATA ? a->_ndata : a->_ntext;
+        p++;
+    } else if (len > 0 && sign == 1) {
+        unsigned s = lookup(a, p, len);
+        if (a->_symbols[s]._kind == SYM_UNDEFINED) {
+            e->_symbol = s;
+            e->_value = 0;
+        } else {
+            e->_value = a->_symbols[s]._value;
+        }
+        p += len;
+    } else if (parse_number(&p, end, hex, &e->_value)) {
+        e->_value *= sign;
+    } else {
+        return false;
+    }
+    const char *q = skip_blanks(p, end);
+    if (q < end && (*q == '+' || *q == '-')) { // constante ajoutée
+        int64_t v;
+        const char *r = skip_blanks(q + 1, end);
+        if (!parse_number(&r, end, false, &v))
+            return false;
+        e->_value += *q == '-' ? -v : v;
+        p = r;
+    }
+    *pp = p;
+    return true;
+}
+
+//! Lecture d'un registre Rnn
+static bool parse_register(const char **pp, const char *end, unsigned *reg) {
+    const char *p = skip_blanks(*pp, end);
+    unsigned len = ident_len(p, end);
+    if (len < 2 || len > 3 || (p[0] != 'R' && p[0] != 'r'))
+        return false;
+    unsigned r = 0;
+    for (unsigned i = 1; i < len; i++) {
+        if (p[i] < '0' || p[i] > '9')
+            return false;
+        r = 10 * r + (p[i] - '0');
+    }
+    if (r >= NREGISTERS)
+        return false;
+    *reg = r;
+    *pp = p + len;
+    return true;
+}
+
+//! Lecture d'une virgule (facultative si optional)
+static bool parse_comma(const char **pp, const char *end, bool optional) {
+    const char *p = skip_blanks(*pp, end);
+    if (p < end && *p == ',') {
+        *pp = p + 1;
+        return true;
+    }
+    return optional;
+}
+
+// ---------------------------------------------------------------------------
+// Production du code
+// ---------------------------------------------------------------------------
+
+//! Affectation d'une valeur à un champ, avec vérification de sa taille
+static void set_field(Assembler *a, Fixup_Kind kind, unsigned index, int64_t v, unsigned line) {
+    Instruction *in = kind == FIX_WORD ? NULL : &a->_text[index];
+    switch (kind) {
+    case FIX_IMMEDIATE:
+        if (v < -(1 << 19) || v >= (1 << 19))
+            asm_error(a, line, "valeur immédiate %lld hors de [-524288, 524287]", (long long)v);
+        in->instr_immediate._value = v;
+        break;
+    case FIX_ABSOLUTE:
+        if (v < 0 || v >= (1 << 20))
+            asm_error(a, line, "adresse %lld hors de [0, 0xfffff]", (long long)v);
+        in->instr_absolute._address = v;
+        break;
+    case FIX_OFFSET:
+        if (v < -(1 << 15) || v >= (1 << 15))
+            asm_error(a, line, "déplacement %lld hors de [-32768, 32767]", (long long)v);
+        in->instr_indexed._offset = v;
+        break;
+    case FIX_BLOCK_ABSOLUTE:
+        if (v < 0 || v >= (1 << 12))
+            asm_error(a, line, "adresse de bloc %lld hors de [0, 0xfff]", (long long)v);
+        in->instr_block._offset = v;
+        break;
+    case FIX_BLOCK_OFFSET:
+        if (v < -(1 << 11) || v >= (1 << 11))
+            asm_error(a, line, "déplacement de bloc %lld hors de [-2048, 2047]", (long long)v);
+        in->instr_block._offset = v;
+        break;
+    case FIX_WORD:
+        if (v < INT32_MIN || v > UINT32_MAX)
+            asm_error(a, line, "valeur %lld hors des 32 bits", (long long)v);
+        a->_data[index] = (Word)v;
+        break;
+    }
+}
+
+//! Affectation d'une expression à un champ (différée si le symbole n'est pas défini)
+static void emit_field(Assembler *a, Fixup_Kind kind, unsigned index, const Expr *e) {
+    if (e->_symbol < 0) {
+        set_field(a, kind, index, e->_value, a->_line);
+        return;
+    }
+    if (a->_nfixups == a->_fixcap)
+        a->_fixups = grow(a->_fixups, &a->_fixcap, sizeof(Fixup));
+    Fixup *f = &a->_fixups[a->_nfixups++];
+    f->_symbol = e->_symbol;
+    f->_kind = kind;
+    f->_index = index;
+    f->_addend = e->_value;
+    f->_line = a->_line;
+}
+
+//! Ajout d'une instruction au texte
+static unsigned emit_instruction(Assembler *a, Instruction instr) {
+    if (a->_ntext == a->_textcap)
+        a->_text = grow(a->_text, &a->_textcap, sizeof(Instruction));
+    a->_text[a->_ntext] = instr;
+    return a->_ntext++;
+}
+
+//! Ajout d'un mot aux données
+static unsigned emit_word(Assembler *a, Word w) {
+    if (a->_ndata == a->_datacap)
+        a->_data = grow(a->_data, &a->_datacap, sizeof(Word));
+    a->_data[a->_ndata] = w;
+    return a->_ndata++;
+}
+
+//! Lecture et production de l'opérande d'une instruction (#, @, indexé ou expression seule)
+/*!
+ * \param block instruction de bloc (champs de 12 bits, pas d'immédiat)
+ */
+static bool parse_operand(Assembler *a, const char **pp, const char *end, unsigned index, bool block) {
+    const char *p = skip_blanks(*pp, end);
+    Instruction *in = &a->_text[index];
+    Expr e;
+    if (p < end && *p == '#') {
+        p++;
+        if (block || !parse_expr(a, &p, end, false, &e))
+            return false;
+        in->instr_generic._immediate = true;
+        emit_field(a, FIX_IMMEDIATE, index, &e);
+    } else if (p < end && *p == '@') {
+        p++;
+        if (!parse_expr(a, &p, end, true, &e))
+            return false;
+        emit_field(a, block ? FIX_BLOCK_ABSOLUTE : FIX_ABSOLUTE, index, &e);
+    } else {
+        unsigned reg;
+        if (!parse_expr(a, &p, end, false, &e))
+            return false;
+        p = skip_blanks(p, end);
+        if (p >= end || *p != '[') { // expression seule : adresse absolue
+            emit_field(a, block ? FIX_BLOCK_ABSOLUTE : FIX_ABSOLUTE, index, &e);
+            *pp = p;
+            return true;
+        }
+        p++;
+        if (!parse_register(&p, end, &reg))
+            return false;
+        p = skip_blanks(p, end);
+        if (p >= end || *p != ']')
+            return false;
+        p++;
+        in->instr_generic._indexed = true;
+        if (block)
+            in->instr_block._rindex = reg;
+        else
+            in->instr_indexed._rindex = reg;
+        emit_field(a, block ? FIX_BLOCK_OFFSET : FIX_OFFSET, index, &e);
+    }
+    *pp = p;
+    return true;
+}
+
+//! Lecture d'une condition (NC, EQ...)
+static bool parse_condition(const char **pp, const char *end, unsigned *cond) {
+    const char *p = skip_blanks(*pp, end);
+    unsigned len = ident_len(p, end);
+    for (unsigned c = 0; c <= LAST_CONDITION; c++)
+        if (len == 2 && strncmp(p, condition_names[c], 2) == 0) {
+            *cond = c;
+            *pp = p + len;
+            return true;
+        }
+    return false;
+}
+
+//! Assemblage des opérandes d'une instruction
+static bool parse_instruction(Assembler *a, Code_Op cop, const char **pp, const char *end) {
+    Instruction instr;
+    instr._raw = 0;
+    instr.instr_generic._cop = cop;
+    unsigned index = emit_instruction(a, instr);
+    unsigned reg, cond;
+    switch (cop) {
+    case ILLOP: case NOP: case RET: case HALT:
+        return true;
+    case BRANCH: case CALL:
+        if (!parse_condition(pp, end, &cond) || !parse_comma(pp, end, true))
+            return false;
+        a->_text[index].instr_generic._regcond = cond;
+        return parse_operand(a, pp, end, index, false);
+    case PUSH: case POP:
+        return parse_operand(a, pp, end, index, false);
+    case BMOVE: case BFILL: case BCMP:
+        if (!parse_register(pp, end, &reg) || !parse_comma(pp, end, false))
+            return false;
+        a->_text[index].instr_block._regcond = reg;
+        if (!parse_operand(a, pp, end, index, true) || !parse_comma(pp, end, false)
+            || !parse_register(pp, end, &reg))
+            return false;
+        a->_text[index].instr_block._rsource = reg;
+        return true;
+    default: // LOAD, STORE, opérations arithmétiques et logiques
+        if (!parse_register(pp, end, &reg) || !parse_comma(pp, end, false))
+            return false;
+        a->_text[index].instr_generic._regcond = reg;
+        return parse_operand(a, pp, end, index, false);
+    }
+}
+
+//! Assemblage d'une ligne (commentaire compris)
+static void parse_line(Assembler *a, const char *p, const char *end) {
+    // Le commentaire éventuel termine la ligne
+    for (const char *q = p; q + 1 < end; q++)
+        if (q[0] == '/' && q[1] == '/') {
+            end = q;
+            break;
+        }
+    p = skip_blanks(p, end);
+    if (p == end)
+        return;
+
+    unsigned len = ident_len(p, end);
+    if (len == 0) {
+        asm_error(a, a->_line, "caractère inattendu « %c »", *p);
+        return;
+    }
+    const char *label = NULL;
+    unsigned labellen = 0;
+    int code = find_reserved(p, len);
+    if (code < 0) { // étiquette
+        label = p;
+        labellen = len;
+        p += len;
+        if (p < end && *p == ':')
+            p++;
+        p = skip_blanks(p, end);
+        len = ident_len(p, end);
+        if (p < end && len == 0) {
+            asm_error(a, a->_line, "caractère inattendu « %c »", *p);
+            return;
+        }
+        code = p == end ? -2 : find_reserved(p, len);
+        if (code == -1) {
+            asm_error(a, a->_line, "instruction ou directive inconnue « %.*s » (après l'étiquette « %.*s »)",
+                      (int)len, p, (int)labellen, label);
+            return;
+        }
+    }
+    p += len;
+
+    if (code == DIR_EQU) {
+        Expr e;
+        const char *q = skip_blanks(p, end);
+        bool here = q < end && *q == '*';
+        if (!parse_expr(a, &p, end, false, &e) || e._symbol >= 0) {
+            asm_error(a, a->_line, "EQU : expression invalide ou symbole non encore défini");
+            return;
+        }
+        if (label != NULL) {
+            Symbol_Kind kind = !here ? SYM_CONST : a->_segment == SEG_DATA ? SYM_DATA : SYM_TEXT;
+            define(a, label, labellen, kind, e._value);
+        }
+    } else if (label != NULL) {
+        if (a->_segment == SEG_NONE)
+            asm_error(a, a->_line, "étiquette « %.*s » hors d'un segment", (int)labellen, label);
+        else if (a->_segment == SEG_TEXT)
+            define(a, label, labellen, SYM_TEXT, a->_ntext);
+        else
+            define(a, label, labellen, SYM_DATA, a->_ndata);
+    }
+
+    bool ok = true;
+    switch (code) {
+    case -2: // étiquette seule
+    case DIR_EQU:
+        break;
+    case DIR_TEXT:
+    case DIR_DATA: {
+        Expr e = { 0, -1 };
+        const char *q = skip_blanks(p, end);
+        if (q < end && !parse_expr(a, &p, end, false, &e))
+            ok = false;
+        else if (e._symbol >= 0 || e._value < 0)
+            ok = false;
+        else if (a->_segment != SEG_NONE)
+            asm_error(a, a->_line, "segment précédent non terminé par END");
+        else if (code == DIR_TEXT) {
+            a->_segment = SEG_TEXT;
+            if (e._value > a->_textmin)
+                a->_textmin = e._value;
+        } else {
+            a->_segment = SEG_DATA;
+            if (e._value > a->_datamin)
+                a->_datamin = e._value;
+        }
+        break;
+    }
+    case DIR_END:
+        if (a->_segment == SEG_NONE)
+            asm_error(a, a->_line, "END hors d'un segment");
+        a->_segment = SEG_NONE;
+        break;
+    case DIR_WORD:
+        if (a->_segment != SEG_DATA) {
+            asm_error(a, a->_line, "WORD hors du segment de données");
+            return;
+        }
+        do {
+            Expr e;
+            if (!parse_expr(a, &p, end, false, &e)) {
+                ok = false;
+                break;
+            }
+            emit_field(a, FIX_WORD, emit_word(a, 0), &e);
+        } while (parse_comma(&p, end, false));
+        break;
+    default:
+        if (a->_segment != SEG_TEXT) {
+            asm_error(a, a->_line, "instruction hors du segment de texte");
+            return;
+        }
+        ok = parse_instruction(a, code, &p, end);
+        break;
+    }
+    if (!ok) {
+        asm_error(a, a->_line, "opérandes invalides");
+        return;
+    }
+    p = skip_blanks(p, end);
+    if (p < end)
+        asm_error(a, a->_line, "texte inattendu « %.*s »", (int)(end - p), p);
+}
+
+//! Correction des références en avant
+static void resolve_fixups(Assembler *a) {
+    for (unsigned i = 0; i < a->_nfixups; i++) {
+        Fixup *f = &a->_fixups[i];
+        Asm_Symbol *s = &a->_symbols[f->_symbol];
+        if (s->_kind == SYM_UNDEFINED)
+            asm_error(a, f->_line, "symbole « %.*s » non défini", (int)s->_len, s->_name);
+        else
+            set_field(a, f->_kind, f->_index, s->_value + f->_addend, f->_line);
+    }
+}
+
+bool assemble(const char *source, size_t size, const char *filename,
+              unsigned stacksize, Assembly *out) {
+    init_reserved();
+    memset(out, 0, sizeof(Assembly));
+    Assembler a;
+    memset(&a, 0, sizeof(a));
+    a._filename = filename;
+    a._out = out;
+
+    const char *p = source, *end = source + size;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL)
+            eol = end;
+        a._line++;
+        parse_line(&a, p, eol);
+        p = eol + 1;
+    }
+    if (a._segment != SEG_NONE)
+        asm_error(&a, a._line, "segment non terminé par END");
+    resolve_fixups(&a);
+
+    // Segments définitifs : texte complété par des ILLOP, données par la pile
+    out->_textsize = a._ntext > a._textmin ? a._ntext : a._textmin;
+    out->_text = calloc(out->_textsize + 1, sizeof(Instruction));
+    memcpy(out->_text, a._text, a._ntext * sizeof(Instruction));
+    out->_dataend = a._ndata;
+    uint64_t datasize = (uint64_t)a._ndata + stacksize;
+    if (datasize < a._datamin)
+        datasize = a._datamin;
+    if (datasize > UINT32_MAX) {
+        asm_error(&a, a._line, "segment de données trop grand");
+        datasize = a._ndata;
+    }
+    out->_datasize = datasize;
+    out->_data = calloc(out->_datasize + 1, sizeof(Word));
+    memcpy(out->_data, a._data, a._ndata * sizeof(Word));
+
+    // Étiquettes exportées (les constantes EQU ne le sont pas)
+    out->_symbols = malloc(a._nsymbols * sizeof(Symbol) + 1);
+    for (unsigned i = 0; i < a._nsymbols; i++) {
+        Asm_Symbol *s = &a._symbols[i];
+        if (s->_kind != SYM_TEXT && s->_kind != SYM_DATA)
+            continue;
+        char *name = malloc(s->_len + 1);
+        memcpy(name, s->_name, s->_len);
+        name[s->_len] = '\0';
+        Symbol *sym = &out->_symbols[out->_nsymbols++];
+        sym->_name = name;
+        sym->_address = s->_value;
+        sym->_text = s->_kind == SYM_TEXT;
+    }
+    out->_lines = a._line;
+
+    free(a._text);
+    free(a._data);
+    free(a._symbols);
+    free(a._buckets);
+    free(a._fixups);
+    return out->_errors == 0;
+}
+
+bool assemble_file(const char *filename, unsigned stacksize, Assembly *out) {
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        printf("Erreur: %s: ouverture impossible\n", filename);
+        exit(1);
+    }
+    const char *source = "";
+    if (st.st_size > 0) {
+        source = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (source == MAP_FAILED) {
+            printf("Erreur: %s: projection impossible\n", filename);
+            exit(1);
+        }
+    }
+    close(fd);
+    bool ok = assemble(source, st.st_size, filename, stacksize, out);
+    if (st.st_size > 0)
+        munmap((void *)source, st.st_size);
+    return ok;
+}
+
+void assembly_free(Assembly *assembly) {
+    for (unsigned i = 0; i < assembly->_nsymbols; i++)
+        free((char *)assembly->_symbols[i]._name);
+    free(assembly->_symbols);
+    free(assembly->_text);
+    free(assembly->_data);
+    memset(assembly, 0, sizeof(Assembly));
+}
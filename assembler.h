@@ -0,0 +1,95 @@
+#ifndef _ASSEMBLER_H_
+#define _ASSEMBLER_H_
+
+/*!
+ * \file assembler.h
+ * \brief Assembleur pour le dialecte des sources .asm (voir Examples/).
+ *
+ * Syntaxe, une instruction ou directive par ligne (les commentaires commencent
+ * par \c //) :
+ *
+ *   - <tt>[étiquette[:]] MNÉMONIQUE opérandes</tt> : une étiquette est tout
+ *   identificateur en tête de ligne qui n'est ni un code opération ni une
+ *   directive ; elle prend l'adresse courante du segment ;
+ *
+ *   - <tt>TEXT n</tt> / <tt>DATA n</tt> ... \c END : segments de texte et de
+ *   données ; \a n est la taille minimale du segment (le texte est complété
+ *   par des \c ILLOP, le segment de données contient en plus une pile de
+ *   \a stacksize mots) ;
+ *
+ *   - <tt>étiquette EQU expr</tt> : définition d'une constante ; \c * désigne
+ *   l'adresse courante ;
+ *
+ *   - <tt>WORD expr[, expr...]</tt> : mots de données initialisés.
+ *
+ * Opérandes : registres \c R00 à \c R15, conditions \c NC, \c EQ... (la
+ * virgule qui suit une condition est facultative), valeur immédiate
+ * <tt>\#expr</tt>, adresse absolue <tt>\@expr</tt> (un nombre y est lu en
+ * hexadécimal, comme l'affiche le désassembleur) ou \a expr seule (nombre
+ * décimal), adressage indexé <tt>expr[Rnn]</tt>. Les instructions de bloc s'écrivent
+ * <tt>BMOVE Rlong, destination, Rsource</tt>. Une expression est un nombre
+ * (décimal ou \c 0x hexadécimal) ou un symbole, éventuellement suivi de
+ * <tt>+n</tt> ou <tt>-n</tt>.
+ *
+ * Le source est lu en une seule passe : les symboles sont rangés dans une
+ * table de hachage et les références en avant sont notées puis corrigées à
+ * la fin. Les erreurs sont signalées avec leur numéro de ligne et
+ * l'assemblage continue pour les signaler toutes (jusqu'à \c ASM_MAXERRORS).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "machine.h"
+
+//! Taille par défaut de la pile ajoutée au segment de données (en mots)
+#define ASM_STACKSIZE 20
+
+//! Nombre maximal d'erreurs signalées
+#define ASM_MAXERRORS 20
+
+//! Résultat d'un assemblage
+typedef struct
+{
+    Instruction *_text;		//!< Segment de texte
+    unsigned _textsize;		//!< Taille du segment de texte
+    Word *_data;		//!< Segment de données (pile comprise)
+    unsigned _datasize;		//!< Taille du segment de données
+    unsigned _dataend;		//!< Première adresse libre après les données statiques
+    Symbol *_symbols;		//!< Étiquettes du texte et des données
+    unsigned _nsymbols;		//!< Nombre d'étiquettes
+    unsigned _lines;		//!< Nombre de lignes lues
+    unsigned _errors;		//!< Nombre d'erreurs
+} Assembly;
+
+//! Assemblage d'un source en mémoire
+/*!
+ * \param source le texte du source (pas forcément terminé par un zéro)
+ * \param size sa taille en octets
+ * \param filename le nom du source (pour les messages d'erreur)
+ * \param stacksize la taille de la pile (en mots)
+ * \param out le résultat (à libérer par assembly_free())
+ * \return vrai en l'absence d'erreur
+ */
+bool assemble(const char *source, size_t size, const char *filename,
+              unsigned stacksize, Assembly *out);
+
+//! Assemblage d'un fichier source
+/*!
+ * Le fichier est projeté en mémoire ; s'il est illisible, c'est une erreur
+ * fatale.
+ *
+ * \param filename le nom du source
+ * \param stacksize la taille de la pile (en mots)
+ * \param out le résultat (à libérer par assembly_free())
+ * \return vrai en l'absence d'erreur
+ */
+bool assemble_file(const char *filename, unsigned stacksize, Assembly *out);
+
+//! Libération du résultat d'un assemblage
+/*!
+ * \param assembly le résultat
+ */
+void assembly_free(Assembly *assembly);
+
+#endif
@@ -0,0 +1,430 @@
+/*!
+ * \file binfile.c
+ * \brief Format de fichier binaire sectionné et versionné.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // pread(), mmap(), sysconf()
+#define _DEFAULT_SOURCE          // MAP_ANONYMOUS
+
+#include "binfile.h"
+#include "memory.h"
+#include "region.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//! Nombre maximal de sections acceptées dans un fichier
+#define MAXSECTIONS 64
+
+uint32_t binfile_checksum(const void *buf, size_t size, uint32_t hash) {
+    const unsigned char *p = buf;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//! Inversion de l'ordre des octets d'un mot de 32 bits
+static uint32_t swap32(uint32_t x) {
+    return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+//! Inversion de l'ordre des octets d'un mot de 64 bits
+static uint64_t swap64(uint64_t x) {
+    return ((uint64_t)swap32(x) << 32) | swap32(x >> 32);
+}
+
+//! Erreur fatale de lecture du fichier
+#ifdef __GNUC__
+static void binfile_error(const char *programfile, const char *msg) __attribute__((noreturn));
+#endif
+static void binfile_error(const char *programfile, const char *msg) {
+    printf("Erreur: %s: %s\n", programfile, msg);
+    exit(1);
+}
+
+//! Copie d'un tableau de mots avec inversion de l'ordre des octets
+static void *swapped_copy(const void *src, size_t nwords) {
+    uint32_t *dst = malloc(nwords * sizeof(uint32_t) + 1);
+    const uint32_t *s = src;
+    for (size_t i = 0; i < nwords; i++)
+        dst[i] = swap32(s[i]);
+    return dst;
+}
+
+bool binfile_detect(const void *header, size_t size) {
+    return size >= 4 && memcmp(header, BINFILE_MAGIC, 4) == 0;
+}
+
+void binfile_load(Machine *pmach, int fd, size_t filesize, const char *programfile) {
+    // Projection de tout le fichier en lecture seule : le texte, les symboles
+    // et les sections pré-calculées sont utilisés sur place.
+    const char *image = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED)
+        binfile_error(programfile, "projection impossible");
+
+    Binfile_Header header;
+    if (filesize < sizeof(header))
+        binfile_error(programfile, "en-tête tronqué");
+    memcpy(&header, image, sizeof(header));
+
+    bool swapped;
+    if (header._endian == BINFILE_ENDIAN)
+        swapped = false;
+    else if (header._endian == swap32(BINFILE_ENDIAN) >> 16)
+        swapped = true;
+    else
+        binfile_error(programfile, "marque d'ordre des octets invalide");
+
+    uint32_t version = header._version;
+    uint32_t nsections = header._nsections;
+    uint32_t dataend = header._dataend;
+    uint32_t stored = header._checksum;
+    if (swapped) {
+        version = swap32(version) >> 16;
+        nsections = swap32(nsections);
+        dataend = swap32(dataend);
+        stored = swap32(stored);
+    }
+    if (version < BINFILE_VERSION_MIN || version > BINFILE_VERSION) {
+        printf("Erreur: %s: version %u non supportée (attendue %u à %u)\n",
+               programfile, version, BINFILE_VERSION_MIN, BINFILE_VERSION);
+        exit(1);
+    }
+    if (nsections > MAXSECTIONS
+        || sizeof(header) + (uint64_t)nsections * sizeof(Binfile_Section) > filesize)
+        binfile_error(programfile, "table des sections tronquée");
+
+    // Somme de contrôle de l'en-tête (champ _checksum à 0) et de la table
+    Binfile_Section table[MAXSECTIONS];
+    memcpy(table, image + sizeof(header), nsections * sizeof(Binfile_Section));
+    header._checksum = 0;
+    uint32_t sum = binfile_checksum(&header, sizeof(header), CHECKSUM_INIT);
+    sum = binfile_checksum(table, nsections * sizeof(Binfile_Section), sum);
+    if (sum != stored)
+        binfile_error(programfile, "somme de contrôle de l'en-tête incorrecte");
+
+    // Analyse et vérification des sections
+    const char *env = getenv(BINFILE_VERIFY_ENV);
+    bool verify = env != NULL && env[0] != '\0' && strcmp(env, "0") != 0;
+    const Binfile_Section *sections[SECTION_REGIONS + 1] = { NULL };
+    for (unsigned i = 0; i < nsections; i++) {
+        Binfile_Section *s = &table[i];
+        if (swapped) {
+            s->_type = swap32(s->_type);
+            s->_count = swap32(s->_count);
+            s->_offset = swap64(s->_offset);
+            s->_size = swap64(s->_size);
+            s->_checksum = swap32(s->_checksum);
+        }
+        if (s->_offset > filesize || s->_size > filesize - s->_offset)
+            binfile_error(programfile, "section hors du fichier");
+        // Texte et données, utilisés sur place, ne sont relus que sur demande
+        bool in_place = s->_type == SECTION_TEXT || s->_type == SECTION_DATA;
+        if ((verify || !in_place)
+            && binfile_checksum(image + s->_offset, s->_size, CHECKSUM_INIT) != s->_checksum)
+            binfile_error(programfile, "somme de contrôle d'une section incorrecte");
+        if (s->_type < SECTION_TEXT || s->_type > SECTION_REGIONS)
+            continue; // Section inconnue : ignorée
+        if (sections[s->_type] != NULL)
+            binfile_error(programfile, "section dupliquée");
+        sections[s->_type] = s;
+    }
+
+    const Binfile_Section *text = sections[SECTION_TEXT];
+    const Binfile_Section *data = sections[SECTION_DATA];
+    const Binfile_Section *bss = sections[SECTION_BSS];
+    const Binfile_Section *symbols = sections[SECTION_SYMBOLS];
+    // Version 1 : instructions pré-décodées sans registre source, ignorées
+    // (timing.c décode alors les instructions au besoin)
+    const Binfile_Section *decoded = version >= 2 ? sections[SECTION_DECODED] : NULL;
+    const Binfile_Section *regions = sections[SECTION_REGIONS];
+
+    if (text == NULL || text->_size != (uint64_t)text->_count * sizeof(Instruction))
+        binfile_error(programfile, "section de texte absente ou incohérente");
+    if (data != NULL && data->_size != (uint64_t)data->_count * sizeof(Word))
+        binfile_error(programfile, "section de données incohérente");
+    if (bss != NULL && bss->_size != 0)
+        binfile_error(programfile, "section BSS incohérente");
+    if (decoded != NULL && (decoded->_count != text->_count
+            || decoded->_size != (uint64_t)decoded->_count * sizeof(Decoded_Instruction)))
+        binfile_error(programfile, "section de pré-décodage incohérente");
+    if (symbols != NULL && symbols->_size < (uint64_t)symbols->_count * sizeof(Binfile_Symbol))
+        binfile_error(programfile, "section des symboles incohérente");
+    if (regions != NULL && regions->_size < (uint64_t)regions->_count * sizeof(Binfile_Region))
+        binfile_error(programfile, "section des régions incohérente");
+
+    unsigned textsize = text->_count;
+    uint64_t ndata = data ? data->_count : 0;
+    uint64_t datasize = ndata + (bss ? bss->_count : 0);
+    if (datasize > UINT32_MAX)
+        binfile_error(programfile, "segment de données trop grand");
+    if (dataend > datasize) {
+        printf("Erreur: %s: dataend (%u) > datasize (%llu)\n",
+               programfile, dataend, (unsigned long long)datasize);
+        exit(1);
+    }
+
+    // Texte : sur place en lecture seule (copie convertie si ordre inversé)
+    Instruction *textseg = (Instruction *)(image + text->_offset);
+    if (swapped)
+        textseg = swapped_copy(textseg, textsize);
+
+    // Données : zone anonyme (nulle, donc BSS gratuit) recouverte par une
+    // projection privée des pages entières du contenu initial si son
+    // alignement le permet. La fin de la dernière page du fichier contient
+    // les sections suivantes : la fin du contenu est copiée.
+    Word *dataseg = NULL;
+    if (datasize > 0) {
+        dataseg = mmap(NULL, datasize * sizeof(Word), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (dataseg == MAP_FAILED)
+            binfile_error(programfile, "allocation du segment de données impossible");
+        long pagesize = sysconf(_SC_PAGESIZE);
+        uint64_t mapped = 0; // mots projetés
+        if (ndata > 0 && !swapped && data->_offset % pagesize == 0) {
+            uint64_t bytes = data->_size / pagesize * pagesize;
+            if (bytes > 0 && mmap(dataseg, bytes, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_FIXED, fd, data->_offset) == MAP_FAILED)
+                binfile_error(programfile, "projection du segment de données impossible");
+            mapped = bytes / sizeof(Word);
+        }
+        const uint32_t *src = (const uint32_t *)(image + (ndata ? data->_offset : 0));
+        for (uint64_t i = mapped; i < ndata; i++)
+            dataseg[i] = swapped ? swap32(src[i]) : src[i];
+    }
+
+    load_program(pmach, textsize, textseg, datasize, dataseg, dataend);
+
+    // Sections facultatives
+    if (decoded != NULL) {
+        Decoded_Instruction *d = (Decoded_Instruction *)(image + decoded->_offset);
+        if (swapped) {
+            d = malloc(textsize * sizeof(Decoded_Instruction) + 1);
+            memcpy(d, image + decoded->_offset, decoded->_size);
+            for (unsigned i = 0; i < textsize; i++)
+                d[i]._operand = swap32(d[i]._operand);
+        }
+        // Les numéros de registre servent d'indices (timing.c)
+        for (unsigned i = 0; i < textsize; i++)
+            if (d[i]._regcond >= NREGISTERS || d[i]._rindex >= NREGISTERS
+                || d[i]._rsource >= NREGISTERS)
+                binfile_error(programfile, "instruction pré-décodée invalide");
+        pmach->_decoded = d;
+    }
+    if (symbols != NULL && symbols->_count > 0) {
+        const Binfile_Symbol *entries = (const Binfile_Symbol *)(image + symbols->_offset);
+        const char *names = (const char *)(entries + symbols->_count);
+        size_t namesize = symbols->_size - (uint64_t)symbols->_count * sizeof(Binfile_Symbol);
+        Symbol *syms = malloc(symbols->_count * sizeof(Symbol));
+        for (unsigned i = 0; i < symbols->_count; i++) {
+            uint32_t address = entries[i]._address, istext = entries[i]._text;
+            uint32_t name = entries[i]._name;
+            if (swapped) {
+                address = swap32(address);
+                istext = swap32(istext);
+                name = swap32(name);
+            }
+            if (name >= namesize || memchr(names + name, '\0', namesize - name) == NULL)
+                binfile_error(programfile, "nom de symbole invalide");
+            syms[i]._name = names + name;
+            syms[i]._address = address;
+            syms[i]._text = istext != 0;
+        }
+        pmach->_symbols = syms;
+        pmach->_nsymbols = symbols->_count;
+    }
+    if (regions != NULL) {
+        const Binfile_Region *entries = (const Binfile_Region *)(image + regions->_offset);
+        const char *strings = (const char *)(entries + regions->_count);
+        size_t strsize = regions->_size - (uint64_t)regions->_count * sizeof(Binfile_Region);
+        for (unsigned i = 0; i < regions->_count; i++) {
+            Binfile_Region r = entries[i];
+            if (swapped) {
+                r._base = swap32(r._base);
+                r._size = swap32(r._size);
+                r._mode = swap32(r._mode);
+                r._name = swap32(r._name);
+                r._path = swap32(r._path);
+            }
+            if (r._name >= strsize || memchr(strings + r._name, '\0', strsize - r._name) == NULL
+                || r._path >= strsize || memchr(strings + r._path, '\0', strsize - r._path) == NULL
+                || r._mode > REGION_OUTPUT)
+                binfile_error(programfile, "région invalide");
+            region_map(pmach, strings + r._name, r._mode, r._base, r._size, strings + r._path);
+        }
+    }
+}
+
+//! Section en cours de construction pour l'écriture
+typedef struct
+{
+    Binfile_Section _entry;	//!< Entrée de la table
+    const void *_content;	//!< Contenu (NULL si vide)
+    const void *_extra;		//!< Contenu complémentaire (noms des symboles)
+    size_t _extrasize;		//!< Taille du contenu complémentaire
+} Pending_Section;
+
+//! Ajout d'une section à écrire
+static void add_section(Pending_Section *s, unsigned *n, Section_Type type, uint32_t count,
+                        const void *content, size_t size, const void *extra, size_t extrasize) {
+    Pending_Section *p = &s[(*n)++];
+    memset(p, 0, sizeof(*p));
+    p->_entry._type = type;
+    p->_entry._count = count;
+    p->_entry._size = size + extrasize;
+    p->_entry._checksum = binfile_checksum(extra, extrasize, binfile_checksum(content, size, CHECKSUM_INIT));
+    p->_content = content;
+    p->_extra = extra;
+    p->_extrasize = extrasize;
+}
+
+void binfile_write(Machine *pmach, const char *programfile) {
+    unsigned textsize = pmach->_textsize;
+
+    // Données : les mots nuls de fin (au-delà de dataend) vont en BSS. Les
+    // régions projetées comptent comme nulles : elles ne sont pas stockées.
+    unsigned ndata = pmach->_datasize;
+    while (ndata > pmach->_dataend) {
+        Region *r = pmach->_regions;
+        while (r != NULL && !(ndata - 1 >= r->_base && ndata - 1 < r->_base + r->_size))
+            r = r->_next;
+        if (r != NULL)
+            ndata = r->_base > pmach->_dataend ? r->_base : pmach->_dataend;
+        else if (read_data(pmach, ndata - 1) == 0)
+            ndata--;
+        else
+            break;
+    }
+    Word *data = pmach->_data;
+    if (data == NULL || pmach->_regions != NULL) {
+        data = malloc(ndata * sizeof(Word) + 1);
+        read_block(pmach, 0, data, ndata);
+        for (Region *r = pmach->_regions; r != NULL; r = r->_next)
+            if (r->_base < ndata)
+                memset(data + r->_base, 0,
+                       ((r->_base + r->_size < ndata ? r->_base + r->_size : ndata) - r->_base)
+                       * sizeof(Word));
+    }
+
+    // Sections pré-calculées
+    Decoded_Instruction *decoded = malloc(textsize * sizeof(Decoded_Instruction) + 1);
+    for (unsigned i = 0; i < textsize; i++)
+        decoded[i] = decode_instruction(pmach->_text[i]);
+
+    // Symboles : table puis noms
+    Binfile_Symbol *symbols = malloc(pmach->_nsymbols * sizeof(Binfile_Symbol) + 1);
+    size_t namesize = 0;
+    for (unsigned i = 0; i < pmach->_nsymbols; i++)
+        namesize += strlen(pmach->_symbols[i]._name) + 1;
+    char *names = malloc(namesize + 1);
+    namesize = 0;
+    for (unsigned i = 0; i < pmach->_nsymbols; i++) {
+        size_t len = strlen(pmach->_symbols[i]._name) + 1;
+        symbols[i]._address = pmach->_symbols[i]._address;
+        symbols[i]._text = pmach->_symbols[i]._text;
+        symbols[i]._name = namesize;
+        memcpy(names + namesize, pmach->_symbols[i]._name, len);
+        namesize += len;
+    }
+
+    // Régions : table puis noms et chemins
+    unsigned nregions = 0;
+    size_t strsize = 0;
+    for (Region *r = pmach->_regions; r != NULL; r = r->_next) {
+        nregions++;
+        strsize += strlen(r->_name) + strlen(r->_path) + 2;
+    }
+    Binfile_Region *regions = malloc(nregions * sizeof(Binfile_Region) + 1);
+    char *strings = malloc(strsize + 1);
+    strsize = 0;
+    nregions = 0;
+    for (Region *r = pmach->_regions; r != NULL; r = r->_next) {
+        Binfile_Region *e = &regions[nregions++];
+        e->_base = r->_base;
+        e->_size = r->_size;
+        e->_mode = r->_mode;
+        e->_name = strsize;
+        strcpy(strings + strsize, r->_name);
+        strsize += strlen(r->_name) + 1;
+        e->_path = strsize;
+        strcpy(strings + strsize, r->_path);
+        strsize += strlen(r->_path) + 1;
+    }
+
+    Pending_Section sections[SECTION_REGIONS];
+    unsigned nsections = 0;
+    add_section(sections, &nsections, SECTION_TEXT, textsize,
+                pmach->_text, textsize * sizeof(Instruction), NULL, 0);
+    add_section(sections, &nsections, SECTION_DATA, ndata,
+                data, ndata * sizeof(Word), NULL, 0);
+    add_section(sections, &nsections, SECTION_BSS, pmach->_datasize - ndata, NULL, 0, NULL, 0);
+    if (pmach->_nsymbols > 0)
+        add_section(sections, &nsections, SECTION_SYMBOLS, pmach->_nsymbols,
+                    symbols, pmach->_nsymbols * sizeof(Binfile_Symbol), names, namesize);
+    add_section(sections, &nsections, SECTION_DECODED, textsize,
+                decoded, textsize * sizeof(Decoded_Instruction), NULL, 0);
+    if (nregions > 0)
+        add_section(sections, &nsections, SECTION_REGIONS, nregions,
+                    regions, nregions * sizeof(Binfile_Region), strings, strsize);
+
+    // Placement : chaque contenu non vide est aligné sur BINFILE_ALIGN
+    uint64_t offset = sizeof(Binfile_Header) + nsections * sizeof(Binfile_Section);
+    Binfile_Section table[SECTION_REGIONS];
+    for (unsigned i = 0; i < nsections; i++) {
+        if (sections[i]._entry._size > 0) {
+            offset = (offset + BINFILE_ALIGN - 1) / BINFILE_ALIGN * BINFILE_ALIGN;
+            sections[i]._entry._offset = offset;
+            offset += sections[i]._entry._size;
+        }
+        table[i] = sections[i]._entry;
+    }
+
+    Binfile_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header._magic, BINFILE_MAGIC, 4);
+    header._version = BINFILE_VERSION;
+    header._endian = BINFILE_ENDIAN;
+    header._nsections = nsections;
+    header._dataend = pmach->_dataend;
+    header._checksum = binfile_checksum(table, nsections * sizeof(Binfile_Section),
+                                binfile_checksum(&header, sizeof(header), CHECKSUM_INIT));
+
+    // Fichier temporaire renommé à la fin : le fichier d'origine peut être
+    // celui du programme, dont le texte et les données sont projetés
+    char *tmp = malloc(strlen(programfile) + 5);
+    sprintf(tmp, "%s.tmp", programfile);
+    FILE *fd = fopen(tmp, "w");
+    if (fd == NULL) {
+        printf("Erreur lors de la création du fichier %s\n", programfile);
+        exit(1);
+    }
+    fwrite(&header, sizeof(header), 1, fd);
+    fwrite(table, sizeof(Binfile_Section), nsections, fd);
+    for (unsigned i = 0; i < nsections; i++) {
+        if (sections[i]._entry._size == 0)
+            continue;
+        // Bourrage jusqu'à la position alignée
+        while ((uint64_t)ftell(fd) < sections[i]._entry._offset)
+            fputc(0, fd);
+        fwrite(sections[i]._content, 1, sections[i]._entry._size - sections[i]._extrasize, fd);
+        if (sections[i]._extrasize > 0)
+            fwrite(sections[i]._extra, 1, sections[i]._extrasize, fd);
+    }
+    if (fclose(fd) != 0 || rename(tmp, programfile) != 0) {
+        printf("Erreur lors de l'écriture du fichier %s\n", programfile);
+        exit(1);
+    }
+    free(tmp);
+
+    if (data != pmach->_data)
+        free(data);
+    free(decoded);
+    free(symbols);
+    free(names);
+    free(regions);
+    free(strings);
+}
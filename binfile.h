@@ -0,0 +1,182 @@
+#ifndef _BINFILE_H_
+#define _BINFILE_H_
+
+/*!
+ * \file binfile.h
+ * \brief Format de fichier binaire sectionné et versionné.
+ *
+ * Le fichier commence par un en-tête (\link Binfile_Header \endlink) suivi
+ * d'une table de sections (\link Binfile_Section \endlink). Le contenu de
+ * chaque section est aligné sur \c BINFILE_ALIGN octets dans le fichier, ce
+ * qui permet de projeter directement (\c mmap) le texte et les données.
+ *
+ * Sections reconnues :
+ *
+ *   - \c SECTION_TEXT : les instructions (obligatoire) ;
+ *
+ *   - \c SECTION_DATA : le contenu initial du début du segment de données ;
+ *
+ *   - \c SECTION_BSS : nombre de mots à zéro complétant le segment de données
+ *   (pas de contenu dans le fichier : une grande pile ne coûte rien) ;
+ *
+ *   - \c SECTION_SYMBOLS : table des symboles (\link Binfile_Symbol \endlink)
+ *   suivie de leurs noms (chaînes terminées par un zéro) ;
+ *
+ *   - \c SECTION_DECODED : instructions pré-décodées
+ *   (\link Decoded_Instruction \endlink), une par instruction du texte,
+ *   utilisées par le modèle temporel (timing.h) ; ignorée dans un fichier
+ *   de version 1, dont les instructions pré-décodées n'ont pas de registre
+ *   source ;
+ *
+ *   - \c SECTION_BLOCKS : bitmap des débuts de blocs de base, écrite par les
+ *   premières versions et ignorée ;
+ *
+ *   - \c SECTION_REGIONS : régions du segment de données projetées sur des
+ *   fichiers de l'hôte (\link Binfile_Region \endlink, voir region.h)
+ *   suivies de leurs noms et chemins.
+ *
+ * Les sections inconnues sont ignorées, ce qui permet d'ajouter de nouvelles
+ * sections sans changer de version. Tous les entiers sont écrits dans l'ordre
+ * d'octets de la machine qui a produit le fichier ; le champ \c _endian permet
+ * au lecteur de le détecter et, si besoin, de convertir (au prix d'une copie).
+ *
+ * \note Un fichier au format historique ne peut commencer par le nombre
+ * magique qu'avec un segment de texte de plus d'un milliard d'instructions :
+ * la détection est donc sans ambiguïté en pratique.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Variable d'environnement demandant la vérification complète (voir binfile_load())
+#define BINFILE_VERIFY_ENV "SIMUL_VERIFY"
+
+//! Nombre magique du format sectionné
+#define BINFILE_MAGIC "SIMB"
+
+//! Version courante du format (2 : instructions décodées avec registre source)
+#define BINFILE_VERSION 2
+
+//! Plus ancienne version lue (version 1 : section \c SECTION_DECODED ignorée)
+#define BINFILE_VERSION_MIN 1
+
+//! Marque d'ordre des octets (lue 0x0201 si l'ordre est inversé)
+#define BINFILE_ENDIAN 0x0102
+
+//! Alignement du contenu des sections dans le fichier (octets)
+#define BINFILE_ALIGN 4096
+
+//! Types de section
+typedef enum
+{
+    SECTION_TEXT = 1,	//!< Instructions
+    SECTION_DATA,	//!< Contenu initial des données
+    SECTION_BSS,	//!< Données initialisées à zéro (taille seule)
+    SECTION_SYMBOLS,	//!< Table des symboles
+    SECTION_DECODED,	//!< Instructions pré-décodées
+    SECTION_BLOCKS,	//!< Bitmap des débuts de blocs de base (ignorée)
+    SECTION_REGIONS,	//!< Régions projetées sur des fichiers de l'hôte
+} Section_Type;
+
+//! En-tête du fichier
+typedef struct
+{
+    char _magic[4];		//!< \c BINFILE_MAGIC
+    uint16_t _version;		//!< \c BINFILE_VERSION
+    uint16_t _endian;		//!< \c BINFILE_ENDIAN dans l'ordre de l'écrivain
+    uint32_t _nsections;	//!< Nombre d'entrées de la table des sections
+    uint32_t _dataend;		//!< Première adresse libre après les données statiques
+    uint32_t _flags;		//!< Réservé (0)
+    uint32_t _checksum;		//!< Somme de contrôle de l'en-tête et de la table (ce champ à 0)
+    uint32_t _reserved[2];	//!< Réservé (0)
+} Binfile_Header;
+
+//! Entrée de la table des sections
+typedef struct
+{
+    uint32_t _type;		//!< Type de la section (\link Section_Type \endlink)
+    uint32_t _count;		//!< Nombre d'éléments (instructions, mots, symboles...)
+    uint64_t _offset;		//!< Position du contenu dans le fichier (alignée)
+    uint64_t _size;		//!< Taille du contenu dans le fichier (octets)
+    uint32_t _checksum;		//!< Somme de contrôle du contenu
+    uint32_t _flags;		//!< Réservé (0)
+} Binfile_Section;
+
+//! Symbole tel que stocké dans la section \c SECTION_SYMBOLS
+typedef struct
+{
+    uint32_t _address;		//!< Adresse dans le segment
+    uint32_t _text;		//!< 1 pour le texte, 0 pour les données
+    uint32_t _name;		//!< Position du nom après la table des symboles
+} Binfile_Symbol;
+
+//! Région telle que stockée dans la section \c SECTION_REGIONS
+typedef struct
+{
+    uint32_t _base;		//!< Première adresse dans le segment de données
+    uint32_t _size;		//!< Taille en mots (ignorée pour une entrée)
+    uint32_t _mode;		//!< \link Region_Mode \endlink
+    uint32_t _name;		//!< Position du nom après la table des régions
+    uint32_t _path;		//!< Position du chemin après la table des régions
+} Binfile_Region;
+
+//! Valeur initiale d'une somme de contrôle
+#define CHECKSUM_INIT 2166136261u
+
+//! Somme de contrôle FNV-1a (32 bits)
+/*!
+ * La somme peut être calculée en plusieurs fois en passant le résultat
+ * précédent comme valeur initiale.
+ *
+ * \param buf les octets à contrôler
+ * \param size leur nombre
+ * \param hash valeur initiale (\c CHECKSUM_INIT pour une nouvelle somme)
+ * \return la somme de contrôle mise à jour
+ */
+uint32_t binfile_checksum(const void *buf, size_t size, uint32_t hash);
+
+//! Le contenu d'un fichier commence-t-il par le nombre magique ?
+/*!
+ * \param header les premiers octets du fichier
+ * \param size leur nombre
+ * \return vrai si c'est un fichier au format sectionné
+ */
+bool binfile_detect(const void *header, size_t size);
+
+//! Chargement d'un fichier binaire sectionné
+/*!
+ * L'en-tête, la table des sections et les sommes de contrôle sont vérifiés ;
+ * toute incohérence est fatale. Le texte est projeté en lecture seule, les
+ * données en copie sur écriture au-dessus d'une zone anonyme (donc nulle) de
+ * la taille totale du segment de données. La machine est initialisée comme
+ * par load_program().
+ *
+ * Les sommes de contrôle du texte et des données ne sont vérifiées que si la
+ * variable d'environnement \c BINFILE_VERIFY_ENV est définie (et ne vaut pas
+ * \c 0) : les vérifier lirait toutes leurs pages et le chargement ne serait
+ * plus en temps constant. Les autres sections, lues en entier au
+ * chargement, sont toujours vérifiées.
+ *
+ * \param pmach la machine à initialiser
+ * \param fd descripteur du fichier, ouvert en lecture
+ * \param filesize taille du fichier
+ * \param programfile le nom du fichier (pour les messages)
+ */
+void binfile_load(Machine *pmach, int fd, size_t filesize, const char *programfile);
+
+//! Écriture d'un programme au format sectionné
+/*!
+ * Les mots nuls en fin de segment de données (au-delà de \c _dataend) sont
+ * écrits comme section \c SECTION_BSS. Le contenu des régions projetées
+ * n'est pas stocké : seule leur déclaration l'est, elles sont projetées à
+ * nouveau au chargement. La section des instructions pré-décodées est
+ * toujours produite.
+ *
+ * \param pmach la machine dont on écrit le programme
+ * \param programfile le nom du fichier à créer
+ */
+void binfile_write(Machine *pmach, const char *programfile);
+
+#endif
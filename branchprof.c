@@ -0,0 +1,170 @@
+/*!
+ * \file branchprof.c
+ * \brief Profil des branchements conditionnels.
+ */
+
+#include "branchprof.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Prédicteurs simulés (voir timing.h)
+static const char *predictor_names[BRANCHPROF_NPREDICTORS] = { "btfn", "bimodal", "gshare" };
+
+void branchprof_open(Machine *pmach) {
+    if (pmach->_branchprof != NULL)
+        return;
+    Branch_Profile *bp = calloc(1, sizeof(Branch_Profile));
+    bp->_records = calloc(pmach->_textsize, sizeof(Branch_Record));
+    for (unsigned a = 0; a < pmach->_textsize; a++)
+        bp->_records[a]._last = -1;
+    for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++) {
+        const Branch_Predictor *bpred = timing_predictor(predictor_names[p]);
+        bp->_predictors[p] = bpred;
+        bp->_states[p] = bpred->_create != NULL ? bpred->_create(pmach) : NULL;
+    }
+    pmach->_branchprof = bp;
+}
+
+void branchprof_close(Machine *pmach) {
+    Branch_Profile *bp = pmach->_branchprof;
+    if (bp == NULL)
+        return;
+    for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++)
+        free(bp->_states[p]);
+    free(bp->_records);
+    free(bp->_file);
+    free(bp);
+    pmach->_branchprof = NULL;
+}
+
+void branchprof_branch(Machine *pmach, unsigned addr, unsigned target, bool taken) {
+    Branch_Profile *bp = pmach->_branchprof;
+    Branch_Record *r = &bp->_records[addr];
+    if (taken)
+        r->_taken++;
+    else
+        r->_not_taken++;
+    if (r->_last >= 0)
+        r->_transitions[r->_last << 1 | taken]++;
+    r->_last = taken;
+    r->_backward = target <= addr;
+    for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++) {
+        const Branch_Predictor *bpred = bp->_predictors[p];
+        if (bpred->_predict(bp->_states[p], addr, target) != taken)
+            r->_mispredicts[p]++;
+        if (bpred->_update != NULL)
+            bpred->_update(bp->_states[p], addr, taken);
+    }
+}
+
+bool branchprof_save(Machine *pmach, const char *file) {
+    Branch_Profile *bp = pmach->_branchprof;
+    FILE *f = fopen(file, "w");
+    if (f == NULL)
+        return false;
+    fprintf(f, "# adresse pris non-pris NN NT TN TT arrière erreurs-btfn erreurs-bimodal erreurs-gshare\n");
+    for (unsigned a = 0; a < pmach->_textsize; a++) {
+        const Branch_Record *r = &bp->_records[a];
+        if (r->_taken + r->_not_taken == 0)
+            continue;
+        fprintf(f, "0x%04x %llu %llu %llu %llu %llu %llu %d %llu %llu %llu\n", a,
+                r->_taken, r->_not_taken, r->_transitions[0], r->_transitions[1],
+                r->_transitions[2], r->_transitions[3], r->_backward,
+                r->_mispredicts[0], r->_mispredicts[1], r->_mispredicts[2]);
+    }
+    return fclose(f) == 0;
+}
+
+bool branchprof_load(Machine *pmach, const char *file) {
+    FILE *f = fopen(file, "r");
+    if (f == NULL)
+        return false;
+    branchprof_open(pmach);
+    Branch_Profile *bp = pmach->_branchprof;
+    char line[512];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        unsigned addr;
+        int backward;
+        unsigned long long v[9];
+        ok = sscanf(line, "%x %llu %llu %llu %llu %llu %llu %d %llu %llu %llu", &addr,
+                    &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &backward, &v[6], &v[7], &v[8]) == 11
+            && addr < pmach->_textsize;
+        if (!ok)
+            break;
+        Branch_Record *r = &bp->_records[addr];
+        r->_taken += v[0];
+        r->_not_taken += v[1];
+        for (int k = 0; k < 4; k++)
+            r->_transitions[k] += v[2 + k];
+        for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++)
+            r->_mispredicts[p] += v[6 + p];
+        r->_backward = backward;
+    }
+    fclose(f);
+    return ok;
+}
+
+bool branchprof_hot_taken(Machine *pmach, unsigned addr) {
+    Branch_Profile *bp = pmach->_branchprof;
+    return bp != NULL && addr < pmach->_textsize
+        && bp->_records[addr]._taken > bp->_records[addr]._not_taken;
+}
+
+//! Taux en pourcentage
+static double percent(unsigned long long part, unsigned long long total) {
+    return total == 0 ? 0 : 100.0 * part / total;
+}
+
+void branchprof_annotate(Machine *pmach, unsigned addr) {
+    const Branch_Record *r = &pmach->_branchprof->_records[addr];
+    unsigned long long n = r->_taken + r->_not_taken;
+    if (n == 0)
+        return;
+    printf("\t; %s, pris %.1f%% (%llu/%llu), changements %.1f%%, erreurs",
+           r->_backward ? "arrière" : "avant", percent(r->_taken, n), r->_taken, n,
+           percent(r->_transitions[1] + r->_transitions[2],
+                   r->_transitions[0] + r->_transitions[1] + r->_transitions[2] + r->_transitions[3]));
+    for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++)
+        printf(" %s %.1f%%", predictor_names[p], percent(r->_mispredicts[p], n));
+}
+
+void branchprof_report(Machine *pmach, FILE *out, unsigned top) {
+    const Branch_Record *records = pmach->_branchprof->_records;
+    unsigned long long n = 0, taken = 0, miss[BRANCHPROF_NPREDICTORS] = { 0 };
+    unsigned *best = malloc((top + 1) * sizeof(unsigned));
+    unsigned nbest = 0;
+    for (unsigned a = 0; a < pmach->_textsize; a++) {
+        const Branch_Record *r = &records[a];
+        if (r->_taken + r->_not_taken == 0)
+            continue;
+        n += r->_taken + r->_not_taken;
+        taken += r->_taken;
+        for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++)
+            miss[p] += r->_mispredicts[p];
+        unsigned j = nbest < top ? nbest++ : top;
+        while (j > 0 && records[best[j - 1]]._mispredicts[1] < r->_mispredicts[1]) {
+            if (j < top)
+                best[j] = best[j - 1];
+            j--;
+        }
+        if (j < top)
+            best[j] = a;
+    }
+    fprintf(out, "\n*** Branchements ***\n");
+    fprintf(out, "Branchements conditionnels : %llu, pris %.2f%%, erreurs", n, percent(taken, n));
+    for (int p = 0; p < BRANCHPROF_NPREDICTORS; p++)
+        fprintf(out, " %s %.2f%%", predictor_names[p], percent(miss[p], n));
+    fprintf(out, "\n");
+    if (nbest > 0)
+        fprintf(out, "Branchements aux plus nombreuses erreurs (bimodal) :\n");
+    for (unsigned k = 0; k < nbest; k++) {
+        const Branch_Record *r = &records[best[k]];
+        fprintf(out, "  0x%04x exécutions %llu pris %llu erreurs btfn %llu bimodal %llu gshare %llu\n",
+                best[k], r->_taken + r->_not_taken, r->_taken,
+                r->_mispredicts[0], r->_mispredicts[1], r->_mispredicts[2]);
+    }
+    free(best);
+}
@@ -0,0 +1,116 @@
+#ifndef _BRANCHPROF_H_
+#define _BRANCHPROF_H_
+
+/*!
+ * \file branchprof.h
+ * \brief Profil des branchements conditionnels.
+ *
+ * Quand le profil est actif (\c Machine::_branchprof non NULL), chaque
+ * \c BRANCH ou \c CALL conditionnel exécuté (condition autre que \c NC) est
+ * relevé par call_branch() : nombre de fois pris et non pris, transitions
+ * entre deux exécutions successives (pris puis pris, pris puis non pris...),
+ * sens du saut (arrière ou avant) et erreurs de trois prédicteurs simulés
+ * en parallèle : statique \c btfn, \c bimodal et \c gshare (voir timing.h).
+ *
+ * Le profil s'enregistre dans un fichier texte, une ligne par branchement :
+ * <tt>adresse pris non-pris NN NT TN TT arrière erreurs-btfn erreurs-bimodal
+ * erreurs-gshare</tt>. Relu, il s'ajoute au profil courant et donne le sens
+ * dominant de chaque branchement ; le prédicteur \c profile du modèle
+ * temporel (timing.h) prédit ce sens.
+ *
+ * print_program() annote chaque branchement profilé.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "timing.h"
+
+//! Nombre de prédicteurs simulés
+#define BRANCHPROF_NPREDICTORS 3
+
+//! Relevé d'un branchement
+typedef struct
+{
+    unsigned long long _taken;		//!< Exécutions où il est pris
+    unsigned long long _not_taken;	//!< Exécutions où il n'est pas pris
+    unsigned long long _transitions[4]; //!< Issue précédente << 1 | issue : NN, NT, TN, TT
+    unsigned long long _mispredicts[BRANCHPROF_NPREDICTORS]; //!< Erreurs de chaque prédicteur
+    bool _backward;			//!< Saut arrière (cible <= adresse)
+    int8_t _last;			//!< Dernière issue (-1 : aucune)
+} Branch_Record;
+
+//! Profil des branchements d'une machine
+typedef struct Branch_Profile
+{
+    Branch_Record *_records;		//!< Relevés (\c _textsize éléments)
+    const Branch_Predictor *_predictors[BRANCHPROF_NPREDICTORS]; //!< Prédicteurs simulés
+    void *_states[BRANCHPROF_NPREDICTORS]; //!< Leurs états
+    char *_file;			//!< Fichier enregistré à la fin (NULL si aucun)
+} Branch_Profile;
+
+//! Activation du profil (sans effet s'il est déjà actif)
+/*!
+ * \param pmach la machine (programme chargé)
+ */
+void branchprof_open(Machine *pmach);
+
+//! Désactivation du profil
+/*!
+ * \param pmach la machine
+ */
+void branchprof_close(Machine *pmach);
+
+//! Branchement conditionnel exécuté
+/*!
+ * Appelée par call_branch() quand \c Machine::_branchprof n'est pas NULL.
+ *
+ * \param pmach la machine
+ * \param addr adresse du branchement
+ * \param target sa cible
+ * \param taken vrai s'il est pris
+ */
+void branchprof_branch(Machine *pmach, unsigned addr, unsigned target, bool taken);
+
+//! Enregistrement du profil
+/*!
+ * \param pmach la machine (profil actif)
+ * \param file le fichier
+ * \return faux si le fichier ne peut être écrit
+ */
+bool branchprof_save(Machine *pmach, const char *file);
+
+//! Lecture d'un profil, ajouté au profil courant (activé si besoin)
+/*!
+ * \param pmach la machine
+ * \param file le fichier
+ * \return faux si le fichier est illisible ou incorrect
+ */
+bool branchprof_load(Machine *pmach, const char *file);
+
+//! Le branchement est-il le plus souvent pris ?
+/*!
+ * \param pmach la machine
+ * \param addr adresse du branchement
+ * \return vrai s'il a été plus souvent pris que non pris (faux sans profil)
+ */
+bool branchprof_hot_taken(Machine *pmach, unsigned addr);
+
+//! Annotation d'une instruction dans le listage (rien si elle n'est pas profilée)
+/*!
+ * \param pmach la machine (profil actif)
+ * \param addr adresse de l'instruction
+ */
+void branchprof_annotate(Machine *pmach, unsigned addr);
+
+//! Affichage des branchements les plus souvent mal prédits (par bimodal)
+/*!
+ * \param pmach la machine (profil actif)
+ * \param out le flot de sortie
+ * \param top le nombre de branchements listés
+ */
+void branchprof_report(Machine *pmach, FILE *out, unsigned top);
+
+#endif
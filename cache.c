@@ -0,0 +1,244 @@
+/*!
+ * \file cache.c
+ * \brief Simulation d'une hiérarchie de caches de données.
+ */
+
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! Forme imprimable des politiques
+static const char *policy_names[] = { "lru", "fifo", "random" };
+
+//! Lecture d'une taille (suffixes K et M)
+static bool parse_size(const char **p, unsigned *value) {
+    char *end;
+    unsigned long v = strtoul(*p, &end, 0);
+    if (end == *p)
+        return false;
+    if (*end == 'K' || *end == 'k') {
+        v <<= 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        v <<= 20;
+        end++;
+    }
+    *value = v;
+    *p = end;
+    return true;
+}
+
+//! Le nombre est-il une puissance de 2 ?
+static bool power_of_two(unsigned n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+//! Lecture de la configuration d'un niveau : TAILLE:VOIES:LIGNE[:POLITIQUE]
+static bool parse_level(const char **p, Cache_Level *l) {
+    if (!parse_size(p, &l->_size) || *(*p)++ != ':'
+        || !parse_size(p, &l->_ways) || *(*p)++ != ':'
+        || !parse_size(p, &l->_line))
+        return false;
+    l->_policy = CACHE_LRU;
+    if (**p == ':') {
+        (*p)++;
+        size_t len = strcspn(*p, ",");
+        unsigned i = 0;
+        while (i < 3 && !(strlen(policy_names[i]) == len && strncmp(*p, policy_names[i], len) == 0))
+            i++;
+        if (i == 3)
+            return false;
+        l->_policy = i;
+        *p += len;
+    }
+    if (!power_of_two(l->_line) || l->_line < 4 || l->_ways == 0
+        || l->_size % (l->_line * l->_ways) != 0 || !power_of_two(l->_size / (l->_line * l->_ways)))
+        return false;
+    l->_line_bits = __builtin_ctz(l->_line);
+    l->_set_bits = __builtin_ctz(l->_size / (l->_line * l->_ways));
+    return true;
+}
+
+bool cache_open(Machine *pmach, const char *spec) {
+    Cache *c = calloc(1, sizeof(Cache));
+    const char *p = spec != NULL ? spec : CACHE_DEFAULT;
+    do {
+        if (c->_nlevels == CACHE_MAXLEVELS || !parse_level(&p, &c->_levels[c->_nlevels])) {
+            free(c);
+            return false;
+        }
+        c->_nlevels++;
+    } while (*p++ == ',');
+    if (p[-1] != '\0') {
+        free(c);
+        return false;
+    }
+    for (unsigned i = 0; i < c->_nlevels; i++) {
+        Cache_Level *l = &c->_levels[i];
+        l->_tags = calloc(l->_size / l->_line, sizeof(uint64_t));
+        l->_pc_stats = calloc(pmach->_textsize, sizeof(Cache_Stats));
+    }
+    c->_random = 0x9e3779b97f4a7c15ull;
+    cache_close(pmach);
+    pmach->_cache = c;
+    return true;
+}
+
+void cache_close(Machine *pmach) {
+    Cache *c = pmach->_cache;
+    if (c == NULL)
+        return;
+    for (unsigned i = 0; i < c->_nlevels; i++) {
+        free(c->_levels[i]._tags);
+        free(c->_levels[i]._pc_stats);
+    }
+    free(c);
+    pmach->_cache = NULL;
+}
+
+//! Accès à une ligne au niveau lvl (et aux suivants en cas de défaut)
+/*!
+ * \param c le modèle
+ * \param lvl le niveau
+ * \param byte une adresse (en octets) de la ligne
+ * \param write vrai pour une écriture
+ * \param pc l'instruction à l'origine de l'accès
+ */
+static void access_line(Cache *c, unsigned lvl, uint64_t byte, bool write, unsigned pc) {
+    Cache_Level *l = &c->_levels[lvl];
+    Cache_Stats *ps = &l->_pc_stats[pc];
+    uint64_t line = byte >> l->_line_bits;
+    unsigned set = line & ((1u << l->_set_bits) - 1);
+    uint64_t want = (line >> l->_set_bits) << 2 | 1;
+    uint64_t *ways = l->_tags + (size_t)set * l->_ways;
+    unsigned i = 0;
+    while (i < l->_ways && (ways[i] & ~(uint64_t)2) != want)
+        i++;
+    if (i < l->_ways) { // succès
+        l->_stats._hits++;
+        ps->_hits++;
+        uint64_t e = ways[i] | (uint64_t)write << 1;
+        if (l->_policy == CACHE_LRU) { // en tête de l'ensemble
+            memmove(ways + 1, ways, i * sizeof(uint64_t));
+            ways[0] = e;
+        } else {
+            ways[i] = e;
+        }
+        return;
+    }
+
+    // Défaut : choix de la victime (la dernière, sauf politique aléatoire)
+    l->_stats._misses++;
+    ps->_misses++;
+    unsigned v = l->_ways - 1;
+    if (l->_policy == CACHE_RANDOM) {
+        v = 0;
+        while (v < l->_ways && (ways[v] & 1))
+            v++;
+        if (v == l->_ways) {
+            c->_random ^= c->_random << 13;
+            c->_random ^= c->_random >> 7;
+            c->_random ^= c->_random << 17;
+            v = c->_random % l->_ways;
+        }
+    }
+    uint64_t old = ways[v];
+    if (old & 1) {
+        l->_stats._evictions++;
+        ps->_evictions++;
+        if (old & 2) {
+            l->_stats._writebacks++;
+            ps->_writebacks++;
+            if (lvl + 1 < c->_nlevels)
+                access_line(c, lvl + 1, ((old >> 2) << l->_set_bits | set) << l->_line_bits, true, pc);
+        }
+    }
+    if (lvl + 1 < c->_nlevels)
+        access_line(c, lvl + 1, byte, false, pc);
+    uint64_t e = want | (uint64_t)write << 1;
+    if (l->_policy == CACHE_RANDOM) {
+        ways[v] = e;
+    } else {
+        memmove(ways + 1, ways, v * sizeof(uint64_t));
+        ways[0] = e;
+    }
+}
+
+void cache_flush(Machine *pmach) {
+    Cache *c = pmach->_cache;
+    Cache_Level *l1 = &c->_levels[0];
+    unsigned line_words = l1->_line / 4;
+    for (unsigned i = 0; i < c->_nstream; i++) {
+        const Cache_Access *a = &c->_stream[i];
+        unsigned pc = a->_pc >> 1;
+        bool write = a->_pc & 1;
+        unsigned addr = a->_addr, n = a->_count;
+        if (write)
+            c->_writes += n;
+        else
+            c->_reads += n;
+        while (n > 0) { // une ligne du premier niveau à la fois
+            unsigned k = line_words - addr % line_words;
+            if (k > n)
+                k = n;
+            access_line(c, 0, (uint64_t)addr * 4, write, pc);
+            l1->_stats._hits += k - 1; // les autres mots de la ligne
+            l1->_pc_stats[pc]._hits += k - 1;
+            addr += k;
+            n -= k;
+        }
+    }
+    c->_nstream = 0;
+}
+
+//! Taux en pourcentage
+static double percent(unsigned long long part, unsigned long long total) {
+    return total == 0 ? 0 : 100.0 * part / total;
+}
+
+void cache_report(Machine *pmach, FILE *out, unsigned top) {
+    Cache *c = pmach->_cache;
+    cache_flush(pmach);
+    fprintf(out, "\n*** Cache ***\n");
+    fprintf(out, "Mots lus : %llu, mots écrits : %llu\n", c->_reads, c->_writes);
+    for (unsigned i = 0; i < c->_nlevels; i++) {
+        const Cache_Level *l = &c->_levels[i];
+        const Cache_Stats *s = &l->_stats;
+        unsigned long long total = s->_hits + s->_misses;
+        fprintf(out, "L%u %u:%u:%u:%s : accès %llu, succès %llu (%.2f%%), défauts %llu (%.2f%%), "
+                "évictions %llu, écritures différées %llu\n",
+                i + 1, l->_size, l->_ways, l->_line, policy_names[l->_policy],
+                total, s->_hits, percent(s->_hits, total), s->_misses, percent(s->_misses, total),
+                s->_evictions, s->_writebacks);
+    }
+
+    // Sélection des instructions aux plus nombreux défauts L1
+    const Cache_Stats *pcs = c->_levels[0]._pc_stats;
+    unsigned *best = malloc((top + 1) * sizeof(unsigned));
+    unsigned nbest = 0;
+    for (unsigned pc = 0; pc < pmach->_textsize; pc++) {
+        if (pcs[pc]._misses == 0)
+            continue;
+        unsigned j = nbest < top ? nbest++ : top;
+        while (j > 0 && pcs[best[j - 1]]._misses < pcs[pc]._misses) {
+            if (j < top)
+                best[j] = best[j - 1];
+            j--;
+        }
+        if (j < top)
+            best[j] = pc;
+    }
+    if (nbest > 0)
+        fprintf(out, "Instructions aux plus nombreux défauts L1 :\n");
+    for (unsigned k = 0; k < nbest; k++) {
+        unsigned pc = best[k];
+        fprintf(out, "  0x%04x", pc);
+        for (unsigned i = 0; i < c->_nlevels; i++) {
+            const Cache_Stats *s = &c->_levels[i]._pc_stats[pc];
+            fprintf(out, "  L%u succès %llu défauts %llu évictions %llu", i + 1,
+                    s->_hits, s->_misses, s->_evictions);
+        }
+        fprintf(out, "\n");
+    }
+    free(best);
+}
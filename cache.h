@@ -0,0 +1,158 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*!
+ * \file cache.h
+ * \brief Simulation d'une hiérarchie de caches de données.
+ *
+ * Quand le modèle est actif (\c Machine::_cache non NULL), exec.c lui
+ * transmet chaque accès aux données d'une instruction : opérandes de
+ * \c LOAD, \c ADD, \c SUB..., \c STORE, \c PUSH / \c POP, trafic de pile de
+ * \c CALL / \c RET et instructions de bloc (un accès par bloc, compté mot à
+ * mot). Les accès sont d'abord rangés dans un tampon de \c CACHE_BATCH
+ * entrées (adresse, longueur, instruction, lecture ou écriture) ; le modèle
+ * ne les traite que lorsque le tampon est plein, dans une boucle serrée, ce
+ * qui garde le surcoût par accès à quelques écritures en mémoire.
+ *
+ * Chaque niveau est un cache associatif par ensembles, en écriture différée
+ * avec allocation sur écriture. Une ligne occupe un seul mot de 64 bits du
+ * tableau des étiquettes (étiquette, bit de validité, bit de modification) ;
+ * les lignes d'un ensemble sont rangées de la plus récente à la plus
+ * ancienne (ordre d'usage pour LRU, d'insertion pour FIFO). Un défaut au
+ * niveau \a i est une lecture au niveau \a i+1, l'éviction d'une ligne
+ * modifiée une écriture au niveau \a i+1 (hiérarchie non inclusive).
+ *
+ * Les adresses sont celles du segment de données, un mot occupant 4 octets
+ * (comme dans gdbstub.h). Les statistiques (accès, succès, défauts,
+ * évictions, écritures différées) sont tenues par niveau et par instruction.
+ * Le retour arrière (history.h) ré-exécute ses intervalles modèles détachés
+ * et ne retire pas les instructions annulées des statistiques : seules les
+ * instructions exécutées à nouveau après la reprise sont comptées deux fois.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+
+//! Nombre maximal de niveaux
+#define CACHE_MAXLEVELS 4
+
+//! Taille du tampon des accès (en entrées)
+#define CACHE_BATCH 1024
+
+//! Configuration par défaut : 4 Kio, 4 voies, lignes de 32 octets, LRU
+#define CACHE_DEFAULT "4K:4:32:lru"
+
+//! Politique de remplacement
+typedef enum
+{
+    CACHE_LRU,		//!< Ligne la moins récemment utilisée
+    CACHE_FIFO,		//!< Ligne la plus anciennement chargée
+    CACHE_RANDOM,	//!< Ligne tirée au hasard
+} Cache_Policy;
+
+//! Compteurs d'un niveau
+typedef struct
+{
+    unsigned long long _hits;		//!< Succès
+    unsigned long long _misses;		//!< Défauts
+    unsigned long long _evictions;	//!< Lignes valides remplacées
+    unsigned long long _writebacks;	//!< Lignes modifiées réécrites au niveau suivant
+} Cache_Stats;
+
+//! Un niveau de cache
+typedef struct
+{
+    unsigned _size;		//!< Taille (octets)
+    unsigned _ways;		//!< Associativité
+    unsigned _line;		//!< Taille d'une ligne (octets)
+    Cache_Policy _policy;	//!< Politique de remplacement
+    unsigned _line_bits;	//!< log2(_line)
+    unsigned _set_bits;		//!< log2(nombre d'ensembles)
+    uint64_t *_tags;		//!< Étiquettes : (étiquette << 2) | modifiée << 1 | valide
+    Cache_Stats _stats;		//!< Compteurs du niveau
+    Cache_Stats *_pc_stats;	//!< Compteurs par instruction (\c _textsize éléments)
+} Cache_Level;
+
+//! Accès en attente dans le tampon
+typedef struct
+{
+    uint32_t _addr;		//!< Adresse du premier mot
+    uint32_t _count;		//!< Nombre de mots
+    uint32_t _pc;		//!< Adresse de l'instruction << 1 | écriture
+} Cache_Access;
+
+//! Modèle de cache d'une machine
+typedef struct Cache
+{
+    Cache_Level _levels[CACHE_MAXLEVELS]; //!< Niveaux, du plus proche au plus lointain
+    unsigned _nlevels;		//!< Nombre de niveaux
+    unsigned long long _reads;	//!< Mots lus par les instructions
+    unsigned long long _writes;	//!< Mots écrits par les instructions
+    uint64_t _random;		//!< État du générateur (politique aléatoire)
+    unsigned _nstream;		//!< Nombre d'accès en attente
+    Cache_Access _stream[CACHE_BATCH]; //!< Accès en attente
+} Cache;
+
+//! Activation du modèle
+/*!
+ * La configuration est une liste de niveaux séparés par des virgules, chacun
+ * de la forme <tt>TAILLE:VOIES:LIGNE[:lru|fifo|random]</tt> (tailles en
+ * octets, suffixes \c K et \c M acceptés), par exemple
+ * <tt>8K:2:32,64K:8:64:fifo</tt>. La ligne doit être une puissance de 2 d'au
+ * moins 4 octets et le nombre d'ensembles une puissance de 2. Le modèle
+ * précédent éventuel est remplacé.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param spec la configuration (NULL : \c CACHE_DEFAULT)
+ * \return faux si la configuration est invalide (le modèle est alors inchangé)
+ */
+bool cache_open(Machine *pmach, const char *spec);
+
+//! Désactivation du modèle
+/*!
+ * \param pmach la machine
+ */
+void cache_close(Machine *pmach);
+
+//! Traitement des accès en attente
+/*!
+ * \param pmach la machine (modèle actif)
+ */
+void cache_flush(Machine *pmach);
+
+//! Affichage des statistiques
+/*!
+ * Compteurs de chaque niveau puis les \a top instructions qui provoquent le
+ * plus de défauts au premier niveau. Les accès en attente sont traités
+ * d'abord.
+ *
+ * \param pmach la machine (modèle actif)
+ * \param out le flot de sortie
+ * \param top le nombre d'instructions listées
+ */
+void cache_report(Machine *pmach, FILE *out, unsigned top);
+
+//! Accès d'une instruction à n mots consécutifs
+/*!
+ * Appelée par exec.c quand \c Machine::_cache n'est pas NULL, avant que
+ * l'instruction ne modifie \c _pc (\c _pc - 1 est l'instruction en cours).
+ *
+ * \param pmach la machine
+ * \param addr l'adresse du premier mot
+ * \param n le nombre de mots
+ * \param write vrai pour une écriture
+ */
+static inline void cache_access(Machine *pmach, unsigned addr, unsigned n, bool write) {
+    Cache *c = pmach->_cache;
+    Cache_Access *a = &c->_stream[c->_nstream];
+    a->_addr = addr;
+    a->_count = n;
+    a->_pc = (pmach->_pc - 1) << 1 | write;
+    if (++c->_nstream == CACHE_BATCH)
+        cache_flush(pmach);
+}
+
+#endif
@@ -0,0 +1,346 @@
+/*!
+ * \file checkpoint.c
+ * \brief Points de reprise incrémentaux sur disque.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // pthread, fdatasync(), truncate()
+
+#include "checkpoint.h"
+#include "binfile.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+//! En-tête d'un enregistrement du journal
+typedef struct
+{
+    char _magic[4];		//!< "CKPT"
+    uint32_t _sequence;		//!< Numéro du point de reprise dans la session
+    uint64_t _retired;		//!< Nombre d'instructions exécutées
+    uint32_t _pc;		//!< Compteur ordinal
+    uint32_t _cc;		//!< Code condition
+    Word _registers[NREGISTERS];//!< Registres généraux
+    uint32_t _textsize;		//!< Taille du texte (vérification à la reprise)
+    uint32_t _datasize;		//!< Taille des données (vérification à la reprise)
+    uint32_t _dataend;		//!< Fin des données statiques (vérification à la reprise)
+    uint32_t _npages;		//!< Nombre de pages qui suivent
+} Record_Header;
+
+//! En-tête d'une page dans un enregistrement
+typedef struct
+{
+    uint32_t _index;		//!< Numéro de la page
+    uint32_t _count;		//!< Nombre de mots (la dernière page peut être incomplète)
+} Page_Header;
+
+//! Fin d'un enregistrement
+typedef struct
+{
+    uint32_t _checksum;		//!< Somme de contrôle de l'en-tête et des pages
+    char _end[4];		//!< "DONE"
+} Record_Trailer;
+
+//! Enregistrement prêt à être écrit
+typedef struct
+{
+    char *_bytes;		//!< Contenu
+    size_t _size;		//!< Taille en octets
+} Record;
+
+//! État des points de reprise d'une machine
+struct Checkpoint
+{
+    int _fd;				//!< Journal
+    unsigned long long _interval;	//!< Instructions entre deux points de reprise
+    unsigned long long _next;		//!< Prochain point de reprise (en instructions)
+    uint32_t _sequence;			//!< Numéro du prochain enregistrement
+    unsigned _npages;			//!< Nombre de pages du segment de données
+
+    pthread_t _writer;			//!< Thread d'écriture
+    pthread_mutex_t _lock;		//!< Protège la file et \c _closing
+    pthread_cond_t _ready;		//!< Un enregistrement est disponible
+    pthread_cond_t _space;		//!< Une place s'est libérée dans la file
+    Record _queue[CHECKPOINT_QUEUE];	//!< File des enregistrements à écrire
+    unsigned _head;			//!< Premier élément de la file
+    unsigned _count;			//!< Nombre d'éléments dans la file
+    bool _closing;			//!< Fermeture demandée
+};
+
+//! Nombre de pages couvrant le segment de données
+/*!
+ * On compte une page de plus que nécessaire : check_overflow() tolère l'accès
+ * à l'adresse \c _datasize.
+ */
+static unsigned page_count(Machine *pmach) {
+    return pmach->_datasize / CHECKPOINT_PAGE + 1;
+}
+
+//! Nombre de mots effectifs d'une page
+static uint32_t page_words(Machine *pmach, unsigned page) {
+    unsigned base = page * CHECKPOINT_PAGE;
+    if (base >= pmach->_datasize)
+        return 0;
+    unsigned n = pmach->_datasize - base;
+    return n < CHECKPOINT_PAGE ? n : CHECKPOINT_PAGE;
+}
+
+//! La page doit-elle figurer dans le point de reprise ?
+/*!
+ * Un point complet contient toutes les pages présentes : une page absente
+ * d'une mémoire paginée n'a jamais été écrite et vaut zéro comme au
+ * chargement. Les pages en lecture seule (régions d'entrée) ne changent pas
+ * et sont projetées à nouveau à la reprise.
+ */
+static bool must_save(Machine *pmach, unsigned page, bool full) {
+    if (page_words(pmach, page) == 0 || memory_page_readonly(pmach, page))
+        return false;
+    if (full)
+        return memory_page_present(pmach, page);
+    return (pmach->_dirty[page / 64] >> (page % 64)) & 1;
+}
+
+//! Écriture complète d'un tampon
+static void write_all(int fd, const char *buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, buf, size);
+        if (n < 0) {
+            printf("Erreur d'écriture du point de reprise\n");
+            exit(1);
+        }
+        buf += n;
+        size -= n;
+    }
+}
+
+//! Thread d'écriture : vide la file dans le journal
+static void *writer(void *arg) {
+    struct Checkpoint *c = arg;
+    pthread_mutex_lock(&c->_lock);
+    while (true) {
+        while (c->_count == 0 && !c->_closing)
+            pthread_cond_wait(&c->_ready, &c->_lock);
+        if (c->_count == 0)
+            break;
+        Record r = c->_queue[c->_head];
+        pthread_mutex_unlock(&c->_lock);
+
+        write_all(c->_fd, r._bytes, r._size);
+        fdatasync(c->_fd);
+        free(r._bytes);
+
+        pthread_mutex_lock(&c->_lock);
+        c->_head = (c->_head + 1) % CHECKPOINT_QUEUE;
+        c->_count--;
+        pthread_cond_signal(&c->_space);
+    }
+    pthread_mutex_unlock(&c->_lock);
+    return NULL;
+}
+
+//! Construction d'un point de reprise et remise à zéro des pages modifiées
+/*!
+ * \param pmach la machine
+ * \param full vrai pour inclure toutes les pages
+ */
+static void take_checkpoint(Machine *pmach, bool full) {
+    struct Checkpoint *c = pmach->_checkpoint;
+
+    // Pages à sauvegarder
+    unsigned npages = 0;
+    size_t size = sizeof(Record_Header) + sizeof(Record_Trailer);
+    for (unsigned p = 0; p < c->_npages; p++)
+        if (must_save(pmach, p, full)) {
+            npages++;
+            size += sizeof(Page_Header) + page_words(pmach, p) * sizeof(Word);
+        }
+
+    char *buf = malloc(size);
+    Record_Header *h = (Record_Header *)buf;
+    memcpy(h->_magic, "CKPT", 4);
+    h->_sequence = c->_sequence++;
+    h->_retired = pmach->_retired;
+    h->_pc = pmach->_pc;
+    h->_cc = pmach->_cc;
+    memcpy(h->_registers, pmach->_registers, sizeof(h->_registers));
+    h->_textsize = pmach->_textsize;
+    h->_datasize = pmach->_datasize;
+    h->_dataend = pmach->_dataend;
+    h->_npages = npages;
+
+    char *p = buf + sizeof(Record_Header);
+    for (unsigned page = 0; page < c->_npages; page++) {
+        if (must_save(pmach, page, full)) {
+            uint32_t n = page_words(pmach, page);
+            Page_Header ph = { page, n };
+            memcpy(p, &ph, sizeof(ph));
+            read_block(pmach, page * CHECKPOINT_PAGE, (Word *)(p + sizeof(ph)), n);
+            p += sizeof(ph) + n * sizeof(Word);
+        }
+    }
+    memset(pmach->_dirty, 0, (c->_npages + 63) / 64 * sizeof(uint64_t));
+
+    Record_Trailer t;
+    t._checksum = binfile_checksum(buf, p - buf, CHECKSUM_INIT);
+    memcpy(t._end, "DONE", 4);
+    memcpy(p, &t, sizeof(t));
+
+    // Mise en file (on attend s'il y a déjà trop de points en attente)
+    pthread_mutex_lock(&c->_lock);
+    while (c->_count == CHECKPOINT_QUEUE)
+        pthread_cond_wait(&c->_space, &c->_lock);
+    c->_queue[(c->_head + c->_count) % CHECKPOINT_QUEUE] = (Record){ buf, size };
+    c->_count++;
+    pthread_cond_signal(&c->_ready);
+    pthread_mutex_unlock(&c->_lock);
+}
+
+void checkpoint_open(Machine *pmach, const char *file, unsigned long long interval) {
+    struct Checkpoint *c = malloc(sizeof(struct Checkpoint));
+    c->_fd = open(file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (c->_fd < 0) {
+        printf("Erreur lors de l'ouverture du journal %s\n", file);
+        exit(1);
+    }
+    c->_interval = interval > 0 ? interval : 1;
+    c->_next = pmach->_retired + c->_interval;
+    c->_sequence = 0;
+    c->_npages = page_count(pmach);
+    c->_head = c->_count = 0;
+    c->_closing = false;
+    pthread_mutex_init(&c->_lock, NULL);
+    pthread_cond_init(&c->_ready, NULL);
+    pthread_cond_init(&c->_space, NULL);
+    if (pthread_create(&c->_writer, NULL, writer, c) != 0) {
+        printf("Erreur lors de la création du thread d'écriture\n");
+        exit(1);
+    }
+
+    pmach->_dirty = calloc((c->_npages + 63) / 64, sizeof(uint64_t));
+    pmach->_checkpoint = c;
+    take_checkpoint(pmach, true);
+}
+
+void checkpoint_step(Machine *pmach) {
+    struct Checkpoint *c = pmach->_checkpoint;
+    if (pmach->_retired < c->_next)
+        return;
+    c->_next = pmach->_retired + c->_interval;
+    take_checkpoint(pmach, false);
+}
+
+void checkpoint_close(Machine *pmach) {
+    struct Checkpoint *c = pmach->_checkpoint;
+    pthread_mutex_lock(&c->_lock);
+    c->_closing = true;
+    pthread_cond_signal(&c->_ready);
+    pthread_mutex_unlock(&c->_lock);
+    pthread_join(c->_writer, NULL);
+
+    close(c->_fd);
+    pthread_mutex_destroy(&c->_lock);
+    pthread_cond_destroy(&c->_ready);
+    pthread_cond_destroy(&c->_space);
+    free(c);
+    free(pmach->_dirty);
+    pmach->_dirty = NULL;
+    pmach->_checkpoint = NULL;
+}
+
+unsigned checkpoint_resume(Machine *pmach, const char *file) {
+    FILE *fd = fopen(file, "r");
+    if (fd == NULL) {
+        printf("Erreur lors de l'ouverture du journal %s\n", file);
+        exit(1);
+    }
+
+    unsigned applied = 0;
+    long good = 0; // fin du dernier enregistrement appliqué
+    char *buf = NULL;
+    while (true) {
+        // En-tête
+        Record_Header h;
+        if (fread(&h, sizeof(h), 1, fd) != 1 || memcmp(h._magic, "CKPT", 4) != 0)
+            break;
+        if (h._textsize != pmach->_textsize || h._datasize != pmach->_datasize
+            || h._dataend != pmach->_dataend) {
+            printf("Erreur: le journal %s ne correspond pas au programme chargé\n", file);
+            exit(1);
+        }
+        if (h._npages > page_count(pmach))
+            break;
+        buf = realloc(buf, sizeof(h) + (size_t)h._npages
+                           * (sizeof(Page_Header) + CHECKPOINT_PAGE * sizeof(Word)));
+        memcpy(buf, &h, sizeof(h));
+
+        // Pages : l'enregistrement entier est lu et vérifié avant d'être appliqué
+        char *p = buf + sizeof(h);
+        bool complete = true;
+        for (unsigned i = 0; i < h._npages && complete; i++) {
+            Page_Header *ph = (Page_Header *)p;
+            complete = fread(ph, sizeof(*ph), 1, fd) == 1
+                    && ph->_index < page_count(pmach)
+                    && ph->_count == page_words(pmach, ph->_index) && ph->_count > 0
+                    && fread(p + sizeof(*ph), sizeof(Word), ph->_count, fd) == ph->_count;
+            if (complete)
+                p += sizeof(*ph) + ph->_count * sizeof(Word);
+        }
+        Record_Trailer t;
+        if (!complete || fread(&t, sizeof(t), 1, fd) != 1 || memcmp(t._end, "DONE", 4) != 0
+            || t._checksum != binfile_checksum(buf, p - buf, CHECKSUM_INIT))
+            break;
+
+        // Application
+        pmach->_retired = h._retired;
+        pmach->_pc = h._pc;
+        pmach->_cc = h._cc;
+        memcpy(pmach->_registers, h._registers, sizeof(h._registers));
+        p = buf + sizeof(h);
+        for (unsigned i = 0; i < h._npages; i++) {
+            Page_Header *ph = (Page_Header *)p;
+            write_block(pmach, ph->_index * CHECKPOINT_PAGE, (const Word *)(p + sizeof(*ph)),
+                        ph->_count);
+            p += sizeof(*ph) + ph->_count * sizeof(Word);
+        }
+        applied++;
+        good = ftell(fd);
+    }
+    free(buf);
+
+    // Suppression de la fin interrompue : les points suivants la suivraient
+    fseek(fd, 0, SEEK_END);
+    bool torn = ftell(fd) > good;
+    fclose(fd);
+    if (torn && truncate(file, good) < 0) {
+        printf("Erreur lors de la troncature du journal %s\n", file);
+        exit(1);
+    }
+    return applied;
+}
+
+void checkpoint_from_env(Machine *pmach) {
+    const char *env = getenv(CHECKPOINT_ENV);
+    if (pmach->_checkpoint != NULL || env == NULL || env[0] == '\0')
+        return;
+    char *file = strcpy(malloc(strlen(env) + 1), env), *colon = strrchr(file, ':'), *end;
+    unsigned long long interval = CHECKPOINT_INTERVAL;
+    if (colon != NULL && colon[1] != '\0') {
+        interval = strtoull(colon + 1, &end, 10);
+        if (*end == '\0')
+            *colon = '\0';
+        else
+            interval = CHECKPOINT_INTERVAL;
+    }
+    struct stat st;
+    if (stat(file, &st) == 0 && st.st_size > 0) {
+        unsigned applied = checkpoint_resume(pmach, file);
+        printf("Reprise : %u point(s) de reprise appliqué(s), pc 0x%04x après %llu instructions\n",
+               applied, pmach->_pc, (unsigned long long)pmach->_retired);
+    }
+    checkpoint_open(pmach, file, interval);
+    free(file);
+}
@@ -0,0 +1,107 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+/*!
+ * \file checkpoint.h
+ * \brief Points de reprise incrémentaux sur disque.
+ *
+ * Toutes les \a N instructions, l'état du processeur (registres, \c _pc,
+ * \c _cc, nombre d'instructions exécutées) et les seules pages du segment de
+ * données modifiées depuis le point précédent sont ajoutés à un journal. Le
+ * premier point de reprise d'une session contient toutes les pages.
+ *
+ * Les écritures de données sont suivies par logiciel : les chemins \c STORE,
+ * \c PUSH, \c POP et \c CALL de exec.c écrivent par write_data(), qui marque
+ * la page concernée dans \c Machine::_dirty. Au moment du point de reprise,
+ * la boucle de simulation copie les pages modifiées dans un tampon et le
+ * confie à un thread d'écriture qui l'ajoute au journal et le force sur
+ * disque ; la simulation
+ * ne reprend qu'après la copie, pas après l'écriture. Au plus
+ * \c CHECKPOINT_QUEUE points de reprise peuvent être en attente d'écriture,
+ * au-delà la simulation attend le thread d'écriture.
+ *
+ * Chaque enregistrement du journal se termine par une somme de contrôle et
+ * une marque de fin : un enregistrement interrompu (arrêt brutal pendant
+ * l'écriture) est ignoré à la reprise, qui restaure donc le dernier état
+ * cohérent. La reprise tronque le journal après le dernier enregistrement
+ * appliqué, pour que les points de reprise de la session suivante ne
+ * suivent pas un enregistrement interrompu.
+ *
+ * Depuis simul(), les points de reprise et la reprise sont activés par la
+ * variable d'environnement \c CHECKPOINT_ENV (voir checkpoint_from_env()).
+ */
+
+#include "machine.h"
+#include "memory.h"
+
+//! Taille d'une page de données suivie (en mots)
+#define CHECKPOINT_PAGE MEMORY_PAGE
+
+//! Nombre maximal de points de reprise en attente d'écriture
+#define CHECKPOINT_QUEUE 2
+
+//! Nombre d'instructions entre deux points de reprise par défaut
+#define CHECKPOINT_INTERVAL 10000000ull
+
+//! Variable d'environnement donnant le journal (voir checkpoint_from_env())
+#define CHECKPOINT_ENV "SIMUL_CHECKPOINT"
+
+//! Démarrage des points de reprise périodiques
+/*!
+ * Le journal \a file est ouvert en ajout (il est créé s'il n'existe pas),
+ * le suivi des pages modifiées est activé et un premier point de reprise
+ * complet est produit immédiatement.
+ *
+ * \param pmach la machine à surveiller (programme déjà chargé)
+ * \param file le nom du journal
+ * \param interval nombre d'instructions entre deux points de reprise
+ */
+void checkpoint_open(Machine *pmach, const char *file, unsigned long long interval);
+
+//! Point de reprise si l'intervalle est écoulé
+/*!
+ * Appelée par simul() après chaque instruction quand les points de reprise
+ * sont actifs.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void checkpoint_step(Machine *pmach);
+
+//! Arrêt des points de reprise
+/*!
+ * Attend l'écriture des points de reprise en attente, ferme le journal et
+ * désactive le suivi des pages modifiées.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void checkpoint_close(Machine *pmach);
+
+//! Reprise au dernier état cohérent d'un journal
+/*!
+ * Le programme correspondant doit avoir été chargé au préalable (le texte
+ * n'est pas sauvegardé) : les tailles des segments sont vérifiées. Les
+ * enregistrements complets sont appliqués dans l'ordre ; la lecture s'arrête
+ * au premier enregistrement tronqué ou corrompu, et le journal est tronqué
+ * à la fin du dernier enregistrement appliqué.
+ *
+ * \param pmach la machine à restaurer
+ * \param file le nom du journal
+ * \return le nombre d'enregistrements appliqués (0 si aucun)
+ */
+unsigned checkpoint_resume(Machine *pmach, const char *file);
+
+//! Reprise et points de reprise selon la variable d'environnement \c CHECKPOINT_ENV
+/*!
+ * La variable a la forme <tt>FICHIER[:N]</tt> (\a N instructions entre
+ * deux points de reprise, \c CHECKPOINT_INTERVAL par défaut). Si le journal
+ * existe et n'est pas vide, la machine reprend à son dernier état cohérent
+ * (checkpoint_resume()) ; les points de reprise sont ensuite ajoutés au même
+ * journal (checkpoint_open()). Appelée au début de simul() ; sans effet si
+ * la variable est absente ou vide, ou si les points de reprise sont déjà
+ * actifs.
+ *
+ * \param pmach la machine (programme chargé)
+ */
+void checkpoint_from_env(Machine *pmach);
+
+#endif
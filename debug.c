@@ -4,52 +4,428 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "debug.h"
+#include "watch.h"
+#include "history.h"
+#include "gdbstub.h"
+#include "cache.h"
+#include "timing.h"
+#include "branchprof.h"
+#include "metrics.h"
+#include "sampler.h"
+#include "memprof.h"
+#include "telemetry.h"
+#include <unistd.h>
 
 //! Affichage toutes les commandes pour aider
 
 void print_help(){
     printf("Available commands:");
     printf("\t h \t help\n");
-    printf("\t c \t continue (exit interactive debug mode)\n");
+    printf("\t c \t continue (until next breakpoint)\n");
+    printf("\t q \t quit interactive debug mode (run to the end)\n");
     printf("\t s \t step by step (next instruction)\n");
     printf("\t RET \t step by step (next instruction)\n");
+    printf("\t n N \t run N instructions\n");
+    printf("\t u A \t run until address A\n");
+    printf("\t f \t run until return from current subroutine\n");
+    printf("\t b A \t set breakpoint at address A\n");
+    printf("\t k A \t remove breakpoint at address A\n");
+    printf("\t w W \t watch data W = A[:N] [r|w|a] [==|!=|<|> V]\n");
+    printf("\t W I \t remove watchpoint number I\n");
+    printf("\t l \t list breakpoints and watchpoints\n");
+    printf("\t H \t record execution (H [N [K]]: snapshot every N instr., K KiB budget)\n");
+    printf("\t B \t reverse step (previous instruction)\n");
+    printf("\t C \t reverse continue (previous breakpoint or watchpoint)\n");
+    printf("\t j N \t jump to instruction number N (backwards or forwards)\n");
+    printf("\t g S \t serve GDB remote protocol on S = [host:]port | unix:path\n");
+    printf("\t K \t data cache model (K [SIZE:WAYS:LINE[:lru|fifo|random],...]: configure)\n");
+    printf("\t T \t pipeline timing model (T [F]: configure from file F)\n");
+    printf("\t P \t branch profile (P save F: save now and at halt, P load F: merge)\n");
+    printf("\t A \t data access heatmap and stack usage (A [BITS]: one counter per 2^BITS words, default scaled to the data segment)\n");
+    printf("\t S \t sampled simulation of the active models (S [PERIOD:WARMUP:WINDOW[:random[:SEED]]])\n");
+    printf("\t V \t publish live status to shared memory (V [NAME]: default /simul.PID, V off: stop)\n");
+    printf("\t M \t simulator metrics as JSON (M F: export to F, Prometheus unless F ends in .json)\n");
+    printf("\t x F \t read commands from file F\n");
     printf("\t r \t print registers\n");
     printf("\t d \t print data memory\n");
     printf("\t t \t print text (program) memory\n");
     printf("\t p \t print text (program) memory\n");
     printf("\t m \t print registers and data memory\n");
+    printf("Addresses are numbers (0x.. for hex) or text labels.\n");
+}
+
+//! Mise à jour de l'indicateur des conditions d'arrêt actives
+static void update_armed(Debugger *dbg) {
+    dbg->_armed = dbg->_step || dbg->_stop_at != 0 || dbg->_until || dbg->_finish;
+}
+
+Debugger *debug_attach(Machine *pmach, bool step) {
+    Debugger *dbg = pmach->_debugger;
+    if (dbg == NULL) {
+        dbg = calloc(1, sizeof(Debugger));
+        dbg->_breakpoints = calloc(pmach->_textsize / 32 + 1, sizeof(uint32_t));
+        pmach->_debugger = dbg;
+    }
+    dbg->_step = dbg->_step || step;
+    update_armed(dbg);
+    return dbg;
+}
+
+void debug_detach(Machine *pmach) {
+    Debugger *dbg = pmach->_debugger;
+    if (dbg == NULL)
+        return;
+    if (dbg->_script != NULL)
+        fclose(dbg->_script);
+    free(dbg->_breakpoints);
+    free(dbg);
+    pmach->_debugger = NULL;
+}
+
+bool debug_breakpoint(Machine *pmach, unsigned addr, bool set) {
+    Debugger *dbg = pmach->_debugger;
+    if (addr >= pmach->_textsize)
+        return false;
+    if (set)
+        dbg->_breakpoints[addr / 32] |= 1u << (addr % 32);
+    else
+        dbg->_breakpoints[addr / 32] &= ~(1u << (addr % 32));
+    return true;
+}
+
+bool debug_script(Machine *pmach, const char *file) {
+    Debugger *dbg = debug_attach(pmach, false);
+    FILE *f = fopen(file, "r");
+    if (f == NULL)
+        return false;
+    if (dbg->_script != NULL)
+        fclose(dbg->_script);
+    dbg->_script = f;
+    return true;
+}
+
+bool debug_condition(Machine *pmach) {
+    Debugger *dbg = pmach->_debugger;
+    if (dbg->_finish) {
+        // Retour du sous-programme : un RET qui laisse la pile au-dessus de
+        // son niveau d'entrée (un POP ou un ADD sur SP ne suffit pas)
+        unsigned last = dbg->_finish_pc;
+        dbg->_finish_pc = pmach->_pc;
+        if (last < pmach->_textsize && pmach->_text[last].instr_generic._cop == RET
+            && pmach->_sp > dbg->_finish_sp)
+            return true;
+    }
+    return __atomic_load_n(&dbg->_step, __ATOMIC_RELAXED)
+        || (dbg->_stop_at != 0 && pmach->_retired >= dbg->_stop_at)
+        || (dbg->_until && pmach->_pc == dbg->_until_pc);
+}
+
+//! Lecture d'une commande (fichier de commandes puis entrée standard)
+/*!
+ * \return faux en fin d'entrée standard
+ */
+static bool read_command(Debugger *dbg, char *line, size_t size) {
+    while (dbg->_script != NULL) {
+        if (fgets(line, size, dbg->_script) != NULL) {
+            printf("%s", line); // écho pour les sessions en différé
+            if (strchr(line, '\n') == NULL)
+                printf("\n");
+            return true;
+        }
+        fclose(dbg->_script);
+        dbg->_script = NULL;
+    }
+    return fgets(line, size, stdin) != NULL;
+}
+
+//! Lecture d'une adresse du texte : nombre ou étiquette
+static bool parse_address(Machine *pmach, const char *arg, unsigned *addr) {
+    char *end;
+    unsigned long v = strtoul(arg, &end, 0);
+    if (end != arg && *end == '\0') {
+        *addr = v;
+        return v < pmach->_textsize;
+    }
+    for (unsigned s = 0; s < pmach->_nsymbols; s++)
+        if (pmach->_symbols[s]._text && strcmp(pmach->_symbols[s]._name, arg) == 0) {
+            *addr = pmach->_symbols[s]._address;
+            return true;
+        }
+    return false;
+}
+
+//! Affichage de l'instruction à une adresse du texte
+static void print_at(Machine *pmach, unsigned addr) {
+    if (addr < pmach->_textsize) {
+        printf("0x%04x: ", addr);
+        print_instruction(pmach->_text[addr], addr);
+        printf("\n");
+    }
+}
+
+//! Y a-t-il un point d'arrêt à cette adresse ?
+static bool has_breakpoint(Machine *pmach, unsigned addr) {
+    return addr < pmach->_textsize
+        && (pmach->_debugger->_breakpoints[addr / 32] >> (addr % 32)) & 1;
+}
+
+//! Arrêt du retour arrière : point d'arrêt ou de surveillance
+static bool reverse_stop(Machine *pmach) {
+    bool watched = pmach->_watch != NULL && pmach->_watch->_nhits != 0 && watch_triggered(pmach);
+    return has_breakpoint(pmach, pmach->_pc) || watched;
+}
+
+//! Les commandes de retour arrière exigent l'enregistrement
+static bool check_history(Machine *pmach) {
+    if (pmach->_history == NULL)
+        printf("Enregistrement inactif (commande H)\n");
+    return pmach->_history != NULL;
+}
+
+//! Arrêt de la simulation échantillonnée avant de lire ou de remplacer un modèle
+/*!
+ * Pendant l'avance rapide les modèles sont détachés (sampler.h) : sans cet
+ * arrêt, K, T, P et A en ouvriraient de nouveaux, vides, que le prochain
+ * rattachement écraserait.
+ */
+static void stop_sampler(Machine *pmach, bool replace) {
+    if (pmach->_sampler != NULL && replace) {
+        sampler_close(pmach); // modèles rattachés
+        printf("Simulation échantillonnée arrêtée\n");
+    }
 }
 
 //! Dialogue de mise au point interactive pour l'instruction courante.
 /*!
- * Cette fonction gère le dialogue pour l'option \c -d (debug). Dans ce mode,
- * elle est invoquée après l'exécution de chaque instruction.  Elle affiche le
- * menu de mise au point et on exécute le choix de l'utilisateur. Si cette
- * fonction retourne faux, on abandonne le mode de mise au point interactive
- * pour les instructions suivantes et jusqu'à la fin du programme.
+ * Cette fonction gère le dialogue pour l'option \c -d (debug). Elle est
+ * invoquée à chaque arrêt (après chaque instruction en pas à pas). Elle
+ * affiche le menu de mise au point et on exécute le choix de l'utilisateur.
+ * Si cette fonction retourne faux, on abandonne le mode de mise au point
+ * interactive pour les instructions suivantes et jusqu'à la fin du programme.
  *
  * \param mach la machine/programme en cours de simulation
  * \return vrai si l'on doit continuer en mode debug, faux sinon
  */
 
 bool debug_ask(Machine *pmach){
-    //char* s=malloc(2*sizeof(char));
+    Debugger *dbg = debug_attach(pmach, false);
+    if (pmach->_gdb != NULL) // Client GDB connecté : il sert l'arrêt
+        return gdb_stop(pmach);
+    if (has_breakpoint(pmach, pmach->_pc))
+        printf("Point d'arrêt en 0x%04x (%llu instructions exécutées)\n", pmach->_pc, pmach->_retired);
+    // Toute commande d'exécution bornée se termine à l'arrêt
+    dbg->_step = false;
+    dbg->_stop_at = 0;
+    dbg->_until = false;
+    dbg->_finish = false;
+    update_armed(dbg);
+    print_at(pmach, pmach->_pc);
+
         while(true){
             printf("DEBUG? ");
-            char c=getchar();
-            while(getchar() != '\n'){}
-            //scanf("%s",s);
+            char line[256], arg[256] = "";
+            if (!read_command(dbg, line, sizeof(line)))
+                return false;   // Fin de l'entrée : on quitte le mode debug
+            char c = line[0];
+            sscanf(line + (c == '\n' ? 0 : 1), " %255s", arg);
+            unsigned addr;
+            unsigned long long n;
             switch (c) {
             case 'h':   // Imprimer les informations
                 print_help();
                 break;
-            case 'c':   // Quit le mode debug
+            case 'c':   // Continuer jusqu'au prochain point d'arrêt
+                return true;
+            case 'q':   // Quit le mode debug
                 return false;
             case 's':   // Continue a la commande prochaine
+            case 'R':
+            case '\n':
+                dbg->_step = true;
+                update_armed(dbg);
+                return true;
+            case 'n':   // Exécuter N instructions
+                n = strtoull(arg, NULL, 0);
+                if (n == 0) {
+                    printf("Usage: n N (N > 0)\n");
+                    break;
+                }
+                dbg->_stop_at = pmach->_retired + n;
+                update_armed(dbg);
                 return true;
-            case 'R':   // Rien fait
+            case 'u':   // Exécuter jusqu'à une adresse
+                if (!parse_address(pmach, arg, &addr)) {
+                    printf("Adresse invalide: %s\n", arg);
+                    break;
+                }
+                dbg->_until = true;
+                dbg->_until_pc = addr;
+                update_armed(dbg);
                 return true;
+            case 'f':   // Exécuter jusqu'au retour du sous-programme
+                dbg->_finish = true;
+                dbg->_finish_sp = pmach->_sp;
+                dbg->_finish_pc = pmach->_pc;
+                update_armed(dbg);
+                return true;
+            case 'b':   // Poser / retirer un point d'arrêt
+            case 'k':
+                if (!parse_address(pmach, arg, &addr)) {
+                    printf("Adresse invalide: %s\n", arg);
+                    break;
+                }
+                debug_breakpoint(pmach, addr, c == 'b');
+                break;
+            case 'w':   // Poser un point de surveillance des données
+                if ((n = watch_parse(pmach, line + 1)) == 0) {
+                    printf("Usage: w ADRESSE[:N] [r|w|a] [==|!=|<|> VALEUR]\n");
+                    break;
+                }
+                printf("Point de surveillance #%llu\n", n);
+                break;
+            case 'W':   // Retirer un point de surveillance
+                if (!watch_remove(pmach, strtoul(arg, NULL, 0)))
+                    printf("Point de surveillance inconnu: %s\n", arg);
+                break;
+            case 'l':   // Lister les points d'arrêt et de surveillance
+                for (unsigned a = 0; a < pmach->_textsize; a++)
+                    if (has_breakpoint(pmach, a))
+                        print_at(pmach, a);
+                watch_list(pmach);
+                break;
+            case 'H':   // Enregistrer l'exécution
+                if (pmach->_history == NULL) {
+                    unsigned long long interval = 0, kib = 0;
+                    sscanf(line + 1, "%llu %llu", &interval, &kib);
+                    history_open(pmach, interval, kib << 10);
+                }
+                history_print(pmach);
+                break;
+            case 'B':   // Revenir à l'instruction précédente
+                if (!check_history(pmach))
+                    break;
+                if (pmach->_retired == 0 || !history_goto(pmach, pmach->_retired - 1))
+                    printf("Début de l'historique\n");
+                printf("%llu instructions exécutées\n", pmach->_retired);
+                print_at(pmach, pmach->_pc);
+                break;
+            case 'C':   // Revenir au point d'arrêt ou de surveillance précédent
+                if (!check_history(pmach))
+                    break;
+                if (!history_reverse(pmach, reverse_stop))
+                    printf("Début de l'historique\n");
+                printf("%llu instructions exécutées\n", pmach->_retired);
+                print_at(pmach, pmach->_pc);
+                break;
+            case 'j':   // Aller à l'instruction numéro N
+                if (!check_history(pmach))
+                    break;
+                n = strtoull(arg, NULL, 0);
+                if (n < history_first(pmach))
+                    printf("Instruction %llu hors de l'historique (début : %llu)\n",
+                           n, history_first(pmach));
+                else if (!history_goto(pmach, n))
+                    printf("Arrêt avant HALT : instruction %llu non atteinte\n", n);
+                printf("%llu instructions exécutées\n", pmach->_retired);
+                print_at(pmach, pmach->_pc);
+                break;
+            case 'g':   // Passer la main à un client GDB
+                if (arg[0] == '\0') {
+                    printf("Usage: g [HÔTE:]PORT | g unix:CHEMIN\n");
+                    break;
+                }
+                return gdb_listen(pmach, arg);
+            case 'K':   // Modèle de cache : configuration et bilan
+                stop_sampler(pmach, arg[0] != '\0' || pmach->_cache == NULL);
+                if ((arg[0] != '\0' || pmach->_cache == NULL)
+                    && !cache_open(pmach, arg[0] != '\0' ? arg : NULL)) {
+                    printf("Usage: K TAILLE:VOIES:LIGNE[:lru|fifo|random][,...]\n");
+                    break;
+                }
+                cache_report(pmach, stdout, 10);
+                break;
+            case 'T':   // Modèle temporel : configuration et bilan
+                stop_sampler(pmach, arg[0] != '\0' || pmach->_timing == NULL);
+                if ((arg[0] != '\0' || pmach->_timing == NULL)
+                    && !timing_open(pmach, arg[0] != '\0' ? arg : NULL))
+                    break;
+                timing_report(pmach, stdout, 10);
+                break;
+            case 'P': { // Profil des branchements : listage annoté et bilan
+                char file[256] = "";
+                sscanf(line + 1, " %*s %255s", file);
+                stop_sampler(pmach, strcmp(arg, "load") == 0 || pmach->_branchprof == NULL);
+                if (strcmp(arg, "save") == 0 && file[0] != '\0') {
+                    branchprof_open(pmach);
+                    if (!branchprof_save(pmach, file)) {
+                        printf("Erreur: %s: écriture impossible\n", file);
+                        break;
+                    }
+                    free(pmach->_branchprof->_file);
+                    pmach->_branchprof->_file = strcpy(malloc(strlen(file) + 1), file);
+                    break;
+                } else if (strcmp(arg, "load") == 0 && file[0] != '\0') {
+                    if (!branchprof_load(pmach, file)) {
+                        printf("Erreur: %s: profil illisible\n", file);
+                        break;
+                    }
+                } else if (arg[0] != '\0') {
+                    printf("Usage: P [save FICHIER | load FICHIER]\n");
+                    break;
+                }
+                branchprof_open(pmach);
+                print_program(pmach);
+                branchprof_report(pmach, stdout, 10);
+                break;
+            }
+            case 'A':   // Profil des accès aux données : activation et bilan
+                stop_sampler(pmach, arg[0] != '\0' || pmach->_memprof == NULL);
+                if ((arg[0] != '\0' || pmach->_memprof == NULL)
+                    && !memprof_open(pmach, arg[0] != '\0' ? strtoul(arg, NULL, 0) : MEMPROF_AUTO)) {
+                    printf("Erreur: profil des accès non activé\n");
+                    break;
+                }
+                memprof_report(pmach, stdout, 10);
+                break;
+            case 'S':   // Simulation échantillonnée : configuration et estimations
+                if ((arg[0] != '\0' || pmach->_sampler == NULL)
+                    && !sampler_open(pmach, arg[0] != '\0' ? arg : NULL)) {
+                    printf("Usage: S PÉRIODE:PRÉCHAUFFAGE:FENÊTRE[:random[:GRAINE]] (modèles actifs)\n");
+                    break;
+                }
+                sampler_report(pmach, stdout);
+                break;
+            case 'V': { // Publication de l'état pour l'outil monitor
+                char name[64];
+                if (strcmp(arg, "off") == 0) {
+                    telemetry_close(pmach);
+                    break;
+                }
+                snprintf(name, sizeof(name), "/simul.%ld", (long)getpid());
+                if (!telemetry_open(pmach, arg[0] != '\0' ? arg : name)) {
+                    printf("Erreur: %s: publication de l'état impossible\n", arg[0] != '\0' ? arg : name);
+                    break;
+                }
+                printf("État publié dans %s (monitor %s)\n", pmach->_telemetry->_name,
+                       pmach->_telemetry->_name);
+                break;
+            }
+            case 'M':   // Métriques du simulateur
+                if (arg[0] == '\0')
+                    metrics_write_json(stdout);
+                else if (!metrics_export(arg))
+                    printf("Erreur: %s: écriture impossible\n", arg);
+                break;
+            case 'x':   // Lire les commandes dans un fichier
+                if (arg[0] == '\0') {
+                    printf("Usage: x FICHIER\n");
+                    break;
+                }
+                if (!debug_script(pmach, arg))
+                    printf("Erreur: %s: fichier de commandes illisible\n", arg);
+                break;
             case 'r':   // Imprimer les registres
                 print_cpu(pmach);
                 break;
@@ -64,8 +440,6 @@ bool debug_ask(Machine *pmach){
                 print_cpu(pmach);
                 print_data(pmach);
                 break;
-            case '\n':
-                return true;
             default:
                 printf("Commande inconnu! 'h' pour voir HELP\n");
                 break;
@@ -74,4 +448,3 @@ bool debug_ask(Machine *pmach){
     }
     return true;
 }
-
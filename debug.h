@@ -4,20 +4,107 @@
 /*!
  * \file debug.h
  * \brief Fonctions de mise au point interactive.
+ *
+ * Le débogueur est attaché à la machine (\c Machine::_debugger) par l'option
+ * \c -d ou par debug_attach(). La boucle de simulation appelle debug_stop()
+ * après chaque instruction ; en dehors du pas à pas et des commandes
+ * d'exécution bornée, ce test se réduit à la lecture d'un bit dans la bitmap
+ * des points d'arrêt (un bit par adresse du texte) : entre deux arrêts,
+ * l'exécution se fait donc à pleine vitesse.
+ *
+ * Les points de surveillance des données (commandes \c w et \c W, voir
+ * watch.h) provoquent aussi l'arrêt. Quand l'exécution est enregistrée
+ * (commande \c H, voir history.h), les commandes \c B, \c C et \c j
+ * remontent le temps. La commande \c g (ou gdb_listen()) confie les arrêts à un
+ * client GDB (voir gdbstub.h).
+ *
+ * Les commandes peuvent être lues dans un fichier (debug_script() ou
+ * commande \c x), puis de nouveau sur l'entrée standard quand il est épuisé.
  */
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include "machine.h"
 
+//! État du débogueur
+typedef struct Debugger
+{
+    uint32_t *_breakpoints;	//!< Bitmap des points d'arrêt (un bit par adresse du texte)
+    bool _armed;		//!< Une condition d'arrêt autre que les points d'arrêt est active
+    bool _step;			//!< Pas à pas : arrêt après chaque instruction
+    unsigned long long _stop_at;//!< Arrêt quand \c _retired atteint cette valeur (0 : inactif)
+    bool _until;		//!< Arrêt à l'adresse \c _until_pc ?
+    unsigned _until_pc;		//!< Adresse d'arrêt temporaire
+    bool _finish;		//!< Arrêt au retour du sous-programme courant ?
+    Word _finish_sp;		//!< Pointeur de pile à l'entrée de la commande
+    unsigned _finish_pc;	//!< Adresse de la dernière instruction exécutée pendant la commande
+    FILE *_script;		//!< Fichier de commandes en cours (NULL : entrée standard)
+} Debugger;
+
+//! Attachement du débogueur à une machine (sans effet s'il l'est déjà)
+/*!
+ * \param pmach la machine (programme chargé)
+ * \param step arrêt après la prochaine instruction ?
+ * \return le débogueur
+ */
+Debugger *debug_attach(Machine *pmach, bool step);
+
+//! Détachement du débogueur : la simulation continue sans arrêt
+/*!
+ * \param pmach la machine
+ */
+void debug_detach(Machine *pmach);
+
+//! Pose ou retrait d'un point d'arrêt
+/*!
+ * \param pmach la machine (débogueur attaché)
+ * \param addr l'adresse dans le texte
+ * \param set vrai pour poser, faux pour retirer
+ * \return faux si l'adresse est hors du texte
+ */
+bool debug_breakpoint(Machine *pmach, unsigned addr, bool set);
+
+//! Lecture des prochaines commandes dans un fichier
+/*!
+ * Le débogueur est attaché si besoin.
+ *
+ * \param pmach la machine
+ * \param file le fichier de commandes
+ * \return faux si le fichier est illisible (les commandes en cours continuent)
+ */
+bool debug_script(Machine *pmach, const char *file);
+
+//! Test des conditions d'arrêt autres que les points d'arrêt
+/*!
+ * \param pmach la machine (débogueur attaché et armé)
+ * \return vrai s'il faut s'arrêter
+ */
+bool debug_condition(Machine *pmach);
+
+//! Faut-il s'arrêter avant l'instruction suivante ?
+/*!
+ * \param pmach la machine (débogueur attaché)
+ * \return vrai si un point d'arrêt ou une condition d'arrêt est atteint
+ */
+static inline bool debug_stop(Machine *pmach) {
+    Debugger *dbg = pmach->_debugger;
+    unsigned pc = pmach->_pc;
+    if (pc < pmach->_textsize && (dbg->_breakpoints[pc / 32] >> (pc % 32)) & 1)
+        return true;
+    // _armed et _step peuvent être écrits par le thread d'interruption (gdbstub.c)
+    return __atomic_load_n(&dbg->_armed, __ATOMIC_RELAXED) && debug_condition(pmach);
+}
+
 //! Dialogue de mise au point interactive pour l'instruction courante.
 /*!
- * Cette fonction gère le dialogue pour l'option \c -d (debug). Dans ce mode,
- * elle est invoquée après l'exécution de chaque instruction.  Elle affiche le
- * menu de mise au point et on exécute le choix de l'utilisateur. Si cette
- * fonction retourne faux, on abandonne le mode de mise au point interactive
- * pour les instructions suivantes et jusqu'à la fin du programme.
- * 
- * \param mach la machine/programme en cours de simulation
+ * Cette fonction est invoquée quand debug_stop() demande un arrêt (après
+ * chaque instruction en pas à pas). Elle affiche l'instruction suivante, lit
+ * les commandes et les exécute jusqu'à une commande qui relance l'exécution.
+ * Si cette fonction retourne faux, on abandonne le mode de mise au point
+ * interactive pour les instructions suivantes et jusqu'à la fin du programme.
+ *
+ * \param pmach la machine/programme en cours de simulation
  * \return vrai si l'on doit continuer en mode debug, faux sinon
  */
 bool debug_ask(Machine *pmach);
@@ -3,8 +3,17 @@
 */
 #include<stdio.h>
 #include "error.h"
+#include "metrics.h"
+#include "telemetry.h"
+#include "gdbstub.h"
 
 #define MAX 100
+
+//! Fonction appelée avant la fin du simulateur sur erreur (NULL : aucune)
+static Error_Hook error_hook = NULL;
+
+//! Fonction prévenue des erreurs fatales (voir set_error_observer())
+static Error_Hook error_observer = NULL;
 /*
 * Afficher un warning:
 * \param warn code du warning
@@ -24,30 +33,54 @@ void error(Error err, unsigned addr){
     case ERR_NOERROR:
         printf("ERROR: NO ERROR at address 0x%x\n", addr);
         break;
-    case ERR_UNKNOWN:   // Une instruction inconnu ( COP>=12 || COP<0 )
+    case ERR_UNKNOWN:   // Une instruction inconnu ( COP>LAST_COP )
         printf("ERROR: UNKNOWN INSTRUCTION at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_ILLEGAL:   // Une instruction illegal ( COP==0 )
         printf("ERROR: ILLEGAL INSTRUCTION at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_CONDITION: // Une condition illegal
         printf("ERROR: ILLEGAL CONDITION at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_IMMEDIATE: // Une condition illegal ( I/X != true/false comme prevu)
         printf("ERROR: FORBIDDEN VALUE at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_SEGTEXT:   // Le numero de registre est trop leve
         printf("ERROR: TEXT SEGMENT VIOLATION at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_SEGDATA:   // Le segment de data
         printf("ERROR: DATA SEGMENT VIOLATION at address 0x%x\n", addr);
-        exit(1);
+        break;
     case ERR_SEGSTACK:  // On push ou pull trop dans une pile
         printf("ERROR: STACK SEGMENT VIOLATION at address 0x%x\n", addr);
-        exit(1);
+        break;
+    case ERR_DIVZERO:   // DIV ou MOD avec un diviseur nul
+        printf("ERROR: DIVISION BY ZERO at address 0x%x\n", addr);
+        break;
+    case ERR_LOOP:      // Retour à un état déjà vu : le programme ne s'arrêtera pas
+        printf("ERROR: INFINITE LOOP at address 0x%x\n", addr);
+        break;
     default:
         exit(0);
     }
-    exit(0);
+    if (err != ERR_NOERROR)
+        metrics_fault(err);
+    if (err != ERR_NOERROR && error_observer != NULL)
+        error_observer(err, addr);
+    if (err != ERR_NOERROR && error_hook != NULL)
+        error_hook(err, addr); // ne revient pas s'il reprend la simulation
+    if (err != ERR_NOERROR) {
+        telemetry_fault(err, addr); // l'erreur n'a pas été rattrapée : fin du processus
+        gdb_fault(err, addr);
+    }
+    exit(err == ERR_NOERROR ? 0 : 1);
+}
+
+void set_error_hook(Error_Hook hook){
+    error_hook = hook;
+}
+
+void set_error_observer(Error_Hook observer){
+    error_observer = observer;
 }
 
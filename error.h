@@ -25,10 +25,12 @@ typedef enum
     ERR_SEGTEXT,	//!< Violation de taille du segment de texte
     ERR_SEGDATA,	//!< Violation de taille du segment de données
     ERR_SEGSTACK,	//!< Violation de taille du segment de pile
+    ERR_DIVZERO,	//!< Division par zéro (\c DIV, \c MOD)
+    ERR_LOOP,		//!< Boucle infinie détectée (voir loopcheck.h)
 } Error; 
 
 //! Dernière valeur possible du code d'erreur
-static const unsigned LAST_ERROR = ERR_SEGSTACK;
+static const unsigned LAST_ERROR = ERR_LOOP;
 
 //! Codes d'avertissement
 /*!
@@ -58,6 +60,27 @@ void error(Error err, unsigned addr) __attribute__((noreturn));
 void error(Error err, unsigned addr);
 #endif
 
+//! Fonction appelée sur erreur fatale, après le message
+/*!
+ * Elle permet à un module de reprendre la main (par \c longjmp) au lieu de
+ * terminer le simulateur ; si elle revient, le simulateur se termine.
+ */
+typedef void (*Error_Hook)(Error err, unsigned addr);
+
+//! Installation de la fonction appelée sur erreur fatale
+/*!
+ * \param hook la fonction (NULL pour revenir à la terminaison immédiate)
+ */
+void set_error_hook(Error_Hook hook);
+
+//! Installation d'une fonction prévenue de chaque erreur fatale
+/*!
+ * Appelée après le message et avant la fonction de set_error_hook() ; elle
+ * doit revenir (voir hooks.h).
+ *
+ * \param observer la fonction (NULL pour la retirer)
+ */
+void set_error_observer(Error_Hook observer);
 
 //! Affichage d'un avertissement
 /*!
@@ -5,8 +5,112 @@
 
 #include "exec.h"
 #include "error.h"
+#include "memory.h"
+#include "watch.h"
+#include "history.h"
+#include "loopcheck.h"
+#include "cache.h"
+#include "branchprof.h"
+#include "hooks.h"
 #include <stdio.h>
 
+/*\
+ * \fn Word load_data(Machine *pmach, unsigned ad_Data)
+ * \brief Lecture d'une donnée par une instruction (points de surveillance,
+ * modèle de cache, greffons)
+ * \param pmach la machine/programme en cours d'exécution
+ * \param ad_Data l'adresse de la donnée
+ * \return le mot lu
+ * Sans point de surveillance, cache ni greffon, le surcoût se réduit au test
+ * de Machine::_watch, Machine::_cache et Machine::_hooks.
+ */
+static inline Word load_data(Machine *pmach, unsigned ad_Data) {
+	if (pmach->_watch != NULL)
+		watch_access(pmach, ad_Data, 1, WATCH_READ);
+	if (pmach->_cache != NULL)
+		cache_access(pmach, ad_Data, 1, false);
+	if (HOOKS_ACTIVE(pmach))
+		hooks_event(pmach, HOOK_READ, pmach->_pc - 1, ad_Data, 1);
+	return read_data(pmach, ad_Data);
+}
+
+/*\
+ * \fn void store_data(Machine *pmach, unsigned ad_Data, Word value)
+ * \brief Écriture d'une donnée par une instruction (points de surveillance,
+ * enregistrement, détection des boucles, modèle de cache, greffons)
+ * \param pmach la machine/programme en cours d'exécution
+ * \param ad_Data l'adresse de la donnée
+ * \param value le mot à écrire
+ */
+static inline void store_data(Machine *pmach, unsigned ad_Data, Word value) {
+	if (pmach->_watch != NULL)
+		watch_access(pmach, ad_Data, 1, WATCH_WRITE);
+	if (pmach->_cache != NULL)
+		cache_access(pmach, ad_Data, 1, true);
+	if (pmach->_history != NULL)
+		history_write(pmach, ad_Data, 1);
+	if (pmach->_loopcheck != NULL) {
+		loopcheck_data(pmach, ad_Data, 1, false);
+		write_data(pmach, ad_Data, value);
+		loopcheck_data(pmach, ad_Data, 1, true);
+	} else {
+		write_data(pmach, ad_Data, value);
+	}
+	if (HOOKS_ACTIVE(pmach))
+		hooks_event(pmach, HOOK_WRITE, pmach->_pc - 1, ad_Data, 1);
+}
+
+/*\
+ * \fn void watch_block(Machine *pmach, unsigned ad_Data, unsigned n, Watch_Kind kind)
+ * \brief Accès d'une instruction de bloc à n mots (points de surveillance,
+ * modèle de cache, enregistrement des écritures, retrait de l'empreinte des
+ * mots écrits, lectures des greffons)
+ * \param pmach la machine/programme en cours d'exécution
+ * \param ad_Data l'adresse du début du bloc
+ * \param n la longueur du bloc
+ * \param kind lecture ou écriture
+ */
+static inline void watch_block(Machine *pmach, unsigned ad_Data, unsigned n, Watch_Kind kind) {
+	if (pmach->_watch != NULL)
+		watch_access(pmach, ad_Data, n, kind);
+	if (pmach->_cache != NULL && n > 0)
+		cache_access(pmach, ad_Data, n, kind == WATCH_WRITE);
+	if (kind == WATCH_WRITE && pmach->_history != NULL)
+		history_write(pmach, ad_Data, n);
+	if (kind == WATCH_WRITE && pmach->_loopcheck != NULL)
+		loopcheck_data(pmach, ad_Data, n, false);
+	if (kind == WATCH_READ && HOOKS_ACTIVE(pmach))
+		hooks_event(pmach, HOOK_READ, pmach->_pc - 1, ad_Data, n);
+}
+
+/*\
+ * \fn void block_written(Machine *pmach, unsigned ad_Data, unsigned n)
+ * \brief Fin de l'écriture d'un bloc de n mots (empreinte des mots écrits,
+ * écritures des greffons)
+ * \param pmach la machine/programme en cours d'exécution
+ * \param ad_Data l'adresse du début du bloc
+ * \param n la longueur du bloc
+ */
+static inline void block_written(Machine *pmach, unsigned ad_Data, unsigned n) {
+	if (pmach->_loopcheck != NULL)
+		loopcheck_data(pmach, ad_Data, n, true);
+	if (HOOKS_ACTIVE(pmach))
+		hooks_event(pmach, HOOK_WRITE, pmach->_pc - 1, ad_Data, n);
+}
+
+/*\
+ * \fn void cover(Machine *pmach)
+ * \brief Couverture de l'arc qui mène à la prochaine instruction (voir exec.h)
+ * \param pmach la machine/programme en cours d'exécution
+ */
+static inline void cover(Machine *pmach) {
+	if (pmach->_coverage != NULL) {
+		unsigned loc = (pmach->_pc * 0x9e3779b1u) >> (32 - COVERAGE_BITS);
+		pmach->_coverage[loc ^ pmach->_prev_loc]++;
+		pmach->_prev_loc = loc >> 1;
+	}
+}
+
 /*\
  * \fn void check_stack(Machine *pmach, unsigned ad_Data, unsigned ad_Instr)
  * \brief Vérifie qu'on reste bien dans la pile
@@ -59,12 +163,12 @@ unsigned int get_adress(Machine *pmach, Instruction instr) {
 }
 
 /*\
- * \fn void refresh_condition(Machine *pmach, unsigned int regcond)
+ * \fn void refresh_condition(Machine *pmach, int32_t regcond)
  * \brief après chaque modification du contenu des registres on remet les conditions à jour
  * \param pmach la machine/programme en cours d'exécution
- * \param regcond contenu du registre
+ * \param regcond contenu du registre (interprété comme un entier signé)
  */
-void refresh_condition(Machine *pmach, unsigned int regcond) {
+void refresh_condition(Machine *pmach, int32_t regcond) {
 	if (regcond < 0) {
 		pmach->_cc = CC_N;
 	} else if (regcond == 0) {
@@ -115,7 +219,7 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 	check_not_immediate(instr, addr);
 	ad_Data = get_adress(pmach, instr);
 	check_overflow(pmach, ad_Data, addr);
-	pmach->_data[ad_Data] = pmach->_registers[instr.instr_generic._regcond]; // Data[Addr] <- R
+	store_data(pmach, ad_Data, pmach->_registers[instr.instr_generic._regcond]); // Data[Addr] <- R
 	return true;
 }
 
@@ -136,7 +240,7 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 			ad_Data = get_adress(pmach, instr);
 			check_overflow(pmach, ad_Data, addr);
 			pmach->_registers[instr.instr_generic._regcond] =
-					pmach->_data[ad_Data]; // R <- Data[Addr]
+					load_data(pmach, ad_Data); // R <- Data[Addr]
 		}
 	} else { // instruction ADD et SUB; si cop == -1 -> SUB, si cop == 1 -> ADD
 		if (instr.instr_generic._immediate) { // Si adressage immédiat
@@ -146,7 +250,7 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 			ad_Data = get_adress(pmach, instr);
 			check_overflow(pmach, ad_Data, addr);
 			pmach->_registers[instr.instr_generic._regcond] +=
-					pmach->_data[ad_Data] * cop; // (R) <- R + Data[Addr]
+					load_data(pmach, ad_Data) * cop; // (R) <- R + Data[Addr]
 		}
 	}
 	refresh_condition(pmach, pmach->_registers[instr.instr_generic._regcond]);
@@ -156,6 +260,71 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 
 
 
+/*\
+ * \fn Word get_operand(Machine *pmach, Instruction instr, unsigned addr)
+ * \brief Récupère la valeur immédiate ou le contenu du mot de données désigné
+ * \param pmach la machine/programme en cours d'exécution
+ * \param instr l'instruction à exécuter
+ * \param addr adresse de l'instruction
+ * \return la valeur de l'opérande
+ */
+Word get_operand(Machine *pmach, Instruction instr, unsigned addr) {
+	unsigned ad_Data;
+	if (instr.instr_generic._immediate) // si adressage immédiat
+		return instr.instr_immediate._value; // Val
+	ad_Data = get_adress(pmach, instr);
+	check_overflow(pmach, ad_Data, addr);
+	return load_data(pmach, ad_Data); // Data[Addr]
+}
+
+/*\
+ * \fn bool alu(Machine *pmach, Instruction instr, unsigned addr, Code_Op cop)
+ * \brief Décodage et exécution des instructions MUL, DIV, MOD, AND, OR, XOR, SHL, SHR et SAR
+ * \param pmach la machine/programme en cours d'exécution
+ * \param instr l'instruction à exécuter
+ * \param addr adresse de l'instruction
+ * \param cop le code opération
+ * \return true
+ */bool alu(Machine *pmach, Instruction instr, unsigned addr, Code_Op cop) {
+	Word *reg = &pmach->_registers[instr.instr_generic._regcond];
+	Word value = get_operand(pmach, instr, addr);
+	int32_t a = (int32_t)*reg, b = (int32_t)value;
+	switch (cop) {
+	case MUL: // R <- (R) * Op (modulo 2^32)
+		*reg *= value;
+		break;
+	case DIV: // R <- (R) / Op (quotient tronqué vers zéro)
+	case MOD: // R <- (R) % Op (du signe du dividende)
+		if (b == 0)
+			error(ERR_DIVZERO, addr);
+		if (b == -1) // évite le débordement de INT32_MIN / -1 sur l'hôte
+			*reg = cop == DIV ? -(Word)a : 0;
+		else
+			*reg = cop == DIV ? (Word)(a / b) : (Word)(a % b);
+		break;
+	case AND:
+		*reg &= value;
+		break;
+	case OR:
+		*reg |= value;
+		break;
+	case XOR:
+		*reg ^= value;
+		break;
+	case SHL: // le nombre de décalages est pris modulo 32
+		*reg <<= value & 31;
+		break;
+	case SHR:
+		*reg >>= value & 31;
+		break;
+	default: // SAR : recopie du bit de signe
+		*reg = a < 0 ? ~(~*reg >> (value & 31)) : *reg >> (value & 31);
+		break;
+	}
+	refresh_condition(pmach, *reg);
+	return true;
+}
+
 /*\
  * \fn bool call_branch(Machine *pmach, Instruction instr, unsigned addr)
  * \brief Décodage et exécution des instructions CALL et BRANCH
@@ -165,14 +334,22 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
  * \return true
  */bool call_branch(Machine *pmach, Instruction instr, unsigned addr, Code_Op cop) {
 	check_not_immediate(instr, addr);
-	if (check_condition(pmach, instr, addr)) {
+	bool taken = check_condition(pmach, instr, addr);
+	if (pmach->_branchprof != NULL && instr.instr_generic._regcond != NC)
+		branchprof_branch(pmach, addr, get_adress(pmach, instr), taken);
+	if (taken) {
 		if(cop == CALL){
 			check_overflow(pmach, pmach->_sp, addr);
-			pmach->_data[pmach->_sp] = pmach->_pc; // Data[SP] <- PC
+			store_data(pmach, pmach->_sp, pmach->_pc); // Data[SP] <- PC
 			check_stack(pmach, pmach->_sp--, addr); // on décrémente sp et verifie qu'on ne sort pas de la pile
 		}
 		pmach->_pc = get_adress(pmach, instr); // PC <- Addr
+		if (pmach->_loopcheck != NULL && pmach->_pc <= addr)
+			loopcheck_branch(pmach, addr); // branchement arrière : échantillon
+		if (HOOKS_ACTIVE(pmach))
+			hooks_event(pmach, cop == CALL ? HOOK_CALL : HOOK_BRANCH, addr, pmach->_pc, 0);
 	}
+	cover(pmach); // arc pris ou non
 	return true;
 }
 
@@ -185,7 +362,12 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
  * \return true
  */bool ret(Machine *pmach, Instruction instr, unsigned addr) {
 	check_overflow(pmach, pmach->_sp++, addr); // on incrémente sp et verifie qu'on ne sort pas de la pile
-	pmach->_pc = pmach->_data[pmach->_sp]; // PC <- Data[SP]
+	pmach->_pc = load_data(pmach, pmach->_sp); // PC <- Data[SP]
+	if (pmach->_loopcheck != NULL && pmach->_pc <= addr)
+		loopcheck_branch(pmach, addr); // retour en arrière : échantillon
+	if (HOOKS_ACTIVE(pmach))
+		hooks_event(pmach, HOOK_RETURN, addr, pmach->_pc, 0);
+	cover(pmach);
 	return true;
 }
 
@@ -200,12 +382,12 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 	unsigned ad_Data;
 	if (instr.instr_generic._immediate) { // si adressage immédiat
 		check_overflow(pmach, pmach->_sp, addr);
-		pmach->_data[pmach->_sp] = instr.instr_immediate._value; // Data[SP] <- Val
+		store_data(pmach, pmach->_sp, instr.instr_immediate._value); // Data[SP] <- Val
 	} else {
 		check_overflow(pmach, pmach->_sp, addr);
 		ad_Data = get_adress(pmach, instr);
 		check_overflow(pmach, ad_Data, addr);
-		pmach->_data[pmach->_sp] = pmach->_data[ad_Data]; // Data[SP] <- Data[Addr]
+		store_data(pmach, pmach->_sp, load_data(pmach, ad_Data)); // Data[SP] <- Data[Addr]
 	}
 	check_stack(pmach, pmach->_sp--, addr); // on décrémente sp et verifie qu'on ne sort pas de la pile
 	return true;
@@ -226,8 +408,65 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 	ad_Data = get_adress(pmach, instr);
 	check_overflow(pmach, ad_Data, addr);
 	check_overflow(pmach, pmach->_sp, addr);
-	pmach->_data[ad_Data] = pmach->_data[pmach->_sp]; // Data[Addr] <- Data[SP]
+	store_data(pmach, ad_Data, load_data(pmach, pmach->_sp)); // Data[Addr] <- Data[SP]
+
+	return true;
+}
+
+/*\
+ * \fn void check_block(Machine *pmach, unsigned ad_Data, unsigned n, unsigned ad_Instr)
+ * \brief Vérifie qu'un bloc de n mots tient dans le segment de données
+ * \param pmach la machine/programme en cours d'exécution
+ * \param ad_Data l'adresse du début du bloc
+ * \param n la longueur du bloc
+ * \param ad_Instr l'adresse de l'instruction en cours d'execution
+ */
+void check_block(Machine *pmach, unsigned ad_Data, unsigned n, unsigned ad_Instr) {
+	if ((uint64_t)ad_Data + n > pmach->_datasize) // une seule vérification pour tout le bloc
+		error(ERR_SEGDATA, ad_Instr);
+}
 
+/*\
+ * \fn bool block(Machine *pmach, Instruction instr, unsigned addr, Code_Op cop)
+ * \brief Décodage et exécution des instructions BMOVE, BFILL et BCMP
+ * \param pmach la machine/programme en cours d'exécution
+ * \param instr l'instruction à exécuter
+ * \param addr adresse de l'instruction
+ * \param cop le code opération
+ * \return true
+ */bool block(Machine *pmach, Instruction instr, unsigned addr, Code_Op cop) {
+	unsigned dst, n, src;
+	int cmp;
+	check_not_immediate(instr, addr);
+	if (instr.instr_block._indexed) { // destination : (R[index]) + déplacement
+		dst = pmach->_registers[instr.instr_block._rindex] + instr.instr_block._offset;
+	} else { // destination absolue sur 12 bits
+		dst = instr.instr_block._offset & 0xfff;
+	}
+	n = pmach->_registers[instr.instr_block._regcond];
+	src = pmach->_registers[instr.instr_block._rsource];
+	check_block(pmach, dst, n, addr);
+	switch (cop) {
+	case BMOVE:
+		check_block(pmach, src, n, addr);
+		watch_block(pmach, src, n, WATCH_READ);
+		watch_block(pmach, dst, n, WATCH_WRITE);
+		move_block(pmach, dst, src, n); // Data[dst..dst+n[ <- Data[src..src+n[
+		block_written(pmach, dst, n);
+		break;
+	case BFILL:
+		watch_block(pmach, dst, n, WATCH_WRITE);
+		fill_block(pmach, dst, src, n); // Data[dst..dst+n[ <- (R[source])
+		block_written(pmach, dst, n);
+		break;
+	default: // BCMP
+		check_block(pmach, src, n, addr);
+		watch_block(pmach, dst, n, WATCH_READ);
+		watch_block(pmach, src, n, WATCH_READ);
+		cmp = compare_block(pmach, dst, src, n);
+		pmach->_cc = cmp < 0 ? CC_N : cmp == 0 ? CC_Z : CC_P;
+		break;
+	}
 	return true;
 }
 
@@ -265,6 +504,20 @@ void refresh_condition(Machine *pmach, unsigned int regcond) {
 	case HALT:
 		printf("\tWARNING: HALT signal at address 0x%x\n", addr);
 		return false;
+	case BMOVE:
+	case BFILL:
+	case BCMP:
+		return block(pmach, instr, addr, instr.instr_block._cop);
+	case MUL:
+	case DIV:
+	case MOD:
+	case AND:
+	case OR:
+	case XOR:
+	case SHL:
+	case SHR:
+	case SAR:
+		return alu(pmach, instr, addr, instr.instr_generic._cop);
 	default:
 		error(ERR_UNKNOWN, addr);
 		return true;
@@ -8,6 +8,17 @@
 
 #include "machine.h"
 
+//! Taille (en bits d'index) de la bitmap de couverture des arcs
+/*!
+ * Quand \c Machine::_coverage n'est pas NULL, chaque transfert de contrôle
+ * (\c BRANCH pris ou non, \c CALL, \c RET) incrémente l'octet d'index
+ * <tt>h(destination) ^ (h(origine) >> 1)</tt> d'une bitmap de
+ * <tt>1 << COVERAGE_BITS</tt> octets, à la manière d'AFL ; \c h est un
+ * hachage de l'adresse dans le texte et \c Machine::_prev_loc garde
+ * <tt>h(origine) >> 1</tt> d'un transfert au suivant.
+ */
+#define COVERAGE_BITS 16
+
 //! Décodage et exécution d'une instruction
 /*!
  * \param pmach la machine/programme en cours d'exécution
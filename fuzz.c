@@ -0,0 +1,443 @@
+/*!
+ * \file fuzz.c
+ * \brief Fuzzing guidé par la couverture (outil autonome).
+ *
+ * Usage : <tt>fuzz [-i germes] -o sortie [-l limite] [-L] [-n exécutions]
+ * [-t secondes] [-s graine] programme</tt>
+ *
+ * Les données d'entrée du programme (<tt>[0, dataend[</tt>) sont mutées et
+ * le programme est exécuté dans le processus même, au plus \a limite
+ * instructions par cas (10000 par défaut). Entre deux cas, seules les pages
+ * de données modifiées (suivi de \c Machine::_dirty) sont restaurées et les
+ * registres remis à zéro.
+ *
+ * La couverture des arcs est relevée par exec.c (\c Machine::_coverage, voir
+ * exec.h) et comparée, compteurs regroupés par tranches, à la couverture
+ * cumulée comme dans AFL. Un cas qui découvre un arc ou une tranche est
+ * ajouté au corpus et écrit dans <tt>sortie/queue</tt> ; un cas qui provoque
+ * une erreur d'exécution encore jamais vue (code et adresse) est écrit dans
+ * <tt>sortie/crashes</tt>. Les erreurs sont interceptées par set_error_hook()
+ * et \c longjmp : elles ne terminent pas l'outil. Avec \c -L, les boucles
+ * infinies sont détectées (loopcheck.h) et comptées comme erreurs
+ * (\c ERR_LOOP) au lieu d'épuiser la limite.
+ *
+ * Le corpus initial est formé des fichiers du répertoire \a germes (images
+ * brutes des données, en mots de 32 bits ; les mots manquants sont ceux du
+ * programme) ou, à défaut, des données du programme. Chaque cas est dérivé
+ * d'un élément du corpus (tour à tour) par 1 à 16 mutations : bit, octet,
+ * valeur remarquable, petit incrément, mot aléatoire, recopie interne ou
+ * greffe d'un autre élément.
+ *
+ * Les messages du simulateur (sortie standard) sont jetés ; les statistiques
+ * sont affichées sur la sortie d'erreur.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mkdir(), opendir(), clock_gettime(), sigaction()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "machine.h"
+#include "exec.h"
+#include "error.h"
+#include "memory.h"
+#include "loopcheck.h"
+
+//! Taille de la bitmap de couverture
+#define MAP_SIZE (1u << COVERAGE_BITS)
+
+//! Nombre maximal d'erreurs distinctes conservées
+#define MAX_CRASHES 1024
+
+//! Issue d'un cas
+typedef enum
+{
+    CASE_HALT,		//!< Arrêt normal sur HALT
+    CASE_ERROR,		//!< Erreur d'exécution
+    CASE_LIMIT,		//!< Limite d'instructions atteinte
+} Case_Status;
+
+//! Élément du corpus
+typedef struct
+{
+    Word *_input;	//!< Données d'entrée (dataend mots)
+} Entry;
+
+//! Machine simulée
+static Machine mach;
+//! Données initiales du programme (pour la restauration)
+static Word *initial;
+//! Nombre de mots de la bitmap des pages modifiées
+static size_t dirty_words;
+
+//! Couverture du cas courant
+static uint8_t trace_bits[MAP_SIZE] __attribute__((aligned(8)));
+//! Tranches de compteurs jamais vues (AFL : virgin bits)
+static uint8_t virgin_bits[MAP_SIZE] __attribute__((aligned(8)));
+//! Tranche de chaque valeur de compteur
+static uint8_t buckets[256];
+
+//! Corpus
+static Entry *corpus;
+static unsigned ncorpus, capcorpus;
+
+//! Erreurs déjà rencontrées : code << 32 | adresse
+static uint64_t crashes[MAX_CRASHES];
+static unsigned ncrashes;
+
+//! Retour d'une erreur d'exécution
+static jmp_buf fault;
+static Error fault_error;
+static unsigned fault_addr;
+
+//! Arrêt demandé (SIGINT)
+static volatile sig_atomic_t interrupted = 0;
+
+//! Générateur pseudo-aléatoire (xorshift64*)
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+//! Nombre pseudo-aléatoire dans [0, n[
+static unsigned below(unsigned n) {
+    return (unsigned)((rng() >> 32) * n >> 32);
+}
+
+//! Valeurs remarquables
+static const int32_t interesting[] = {
+    0, 1, -1, 2, 7, 8, 16, 32, 64, 100, 127, 128, 255, 256, 1000, 1024, 4096,
+    32767, 32768, 65535, 65536, -128, -129, -32768, -32769, INT32_MAX, INT32_MIN,
+};
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-i germes] -o sortie [-l limite] [-L] [-n exécutions] [-t secondes] [-s graine] programme\n", prog);
+    exit(1);
+}
+
+static void on_sigint(int sig) {
+    interrupted = 1;
+}
+
+static void on_error(Error err, unsigned addr) {
+    fault_error = err;
+    fault_addr = addr;
+    longjmp(fault, 1);
+}
+
+//! Création d'un répertoire (déjà existant accepté)
+static void make_dir(const char *dir) {
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Erreur: %s: création impossible (%s)\n", dir, strerror(errno));
+        exit(1);
+    }
+}
+
+//! Écriture d'un cas dans un fichier
+static void save_case(const char *file, const Word *input) {
+    FILE *f = fopen(file, "wb");
+    if (f == NULL || fwrite(input, sizeof(Word), mach._dataend, f) != mach._dataend) {
+        fprintf(stderr, "Erreur: %s: écriture impossible\n", file);
+        exit(1);
+    }
+    fclose(f);
+}
+
+//! Ajout d'une copie de l'entrée au corpus
+static void add_entry(const Word *input) {
+    if (ncorpus == capcorpus) {
+        capcorpus = capcorpus == 0 ? 64 : 2 * capcorpus;
+        corpus = realloc(corpus, capcorpus * sizeof(Entry));
+    }
+    corpus[ncorpus]._input = malloc(mach._dataend * sizeof(Word));
+    memcpy(corpus[ncorpus]._input, input, mach._dataend * sizeof(Word));
+    ncorpus++;
+}
+
+//! Exécution d'un cas
+static Case_Status run_case(const Word *input, unsigned long long limit) {
+    // Restauration des seules pages modifiées par le cas précédent
+    for (size_t i = 0; i < dirty_words; i++)
+        for (uint64_t bits = mach._dirty[i]; bits != 0; bits &= bits - 1) {
+            unsigned page = i * 64 + __builtin_ctzll(bits);
+            unsigned first = page << MEMORY_PAGE_BITS;
+            unsigned n = mach._datasize - first < MEMORY_PAGE ? mach._datasize - first : MEMORY_PAGE;
+            write_block(&mach, first, initial + first, n);
+        }
+    write_block(&mach, 0, input, mach._dataend);
+    memset(mach._dirty, 0, dirty_words * sizeof(uint64_t));	// [0, dataend[ est réécrit à chaque cas
+
+    memset(mach._registers, 0, sizeof(mach._registers));
+    mach._pc = 0;
+    mach._sp = mach._datasize - 1;
+    mach._cc = CC_U;
+    mach._retired = 0;
+    mach._prev_loc = 0;
+    if (mach._loopcheck != NULL)
+        loopcheck_reset(&mach);
+    memset(trace_bits, 0, sizeof(trace_bits));
+
+    if (setjmp(fault) != 0)
+        return CASE_ERROR;
+    while (mach._retired < limit) {
+        if (mach._pc >= mach._textsize)
+            error(ERR_SEGTEXT, mach._pc - 1);
+        if (!decode_execute(&mach, mach._text[mach._pc++]))
+            return CASE_HALT;
+        mach._retired++;
+    }
+    return CASE_LIMIT;
+}
+
+//! La couverture du cas courant contient-elle une tranche nouvelle ?
+/*!
+ * Les compteurs sont remplacés par leur tranche et les tranches nouvelles
+ * retirées de \c virgin_bits.
+ */
+static bool new_coverage(void) {
+    uint64_t *t = (uint64_t *)trace_bits, *v = (uint64_t *)virgin_bits;
+    bool found = false;
+    for (unsigned i = 0; i < MAP_SIZE / 8; i++) {
+        if (t[i] == 0)
+            continue;
+        uint8_t *b = (uint8_t *)&t[i];
+        for (int k = 0; k < 8; k++)
+            b[k] = buckets[b[k]];
+        if (t[i] & v[i]) {
+            v[i] &= ~t[i];
+            found = true;
+        }
+    }
+    return found;
+}
+
+//! Nombre d'arcs couverts
+static unsigned count_edges(void) {
+    unsigned n = 0;
+    for (unsigned i = 0; i < MAP_SIZE; i++)
+        n += virgin_bits[i] != 0xff;
+    return n;
+}
+
+//! Mutation d'une entrée (1 à 16 transformations)
+static void mutate(Word *input, unsigned n) {
+    unsigned count = 1u << below(5);
+    for (unsigned k = 0; k < count; k++) {
+        unsigned at = below(n);
+        switch (below(8)) {
+        case 0: // bit
+            input[at] ^= 1u << below(32);
+            break;
+        case 1: // octet
+            input[at] ^= (1u + below(255)) << (8 * below(4));
+            break;
+        case 2: // valeur remarquable
+            input[at] = interesting[below(sizeof(interesting) / sizeof(interesting[0]))];
+            break;
+        case 3: // petit incrément
+            input[at] += below(2) ? 1 + below(35) : -(1 + below(35));
+            break;
+        case 4: // mot aléatoire
+            input[at] = rng();
+            break;
+        case 5: { // recopie interne
+            unsigned from = below(n), len = 1 + below(n - (at > from ? at : from));
+            memmove(input + at, input + from, len * sizeof(Word));
+            break;
+        }
+        case 6: { // greffe d'un autre élément du corpus
+            const Word *other = corpus[below(ncorpus)]._input;
+            unsigned len = 1 + below(n - at);
+            memcpy(input + at, other + at, len * sizeof(Word));
+            break;
+        }
+        default: // petit entier
+            input[at] = below(17);
+            break;
+        }
+    }
+}
+
+//! Lecture des germes d'un répertoire
+static void load_seeds(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "Erreur: %s: répertoire illisible\n", dir);
+        exit(1);
+    }
+    Word *input = malloc(mach._dataend * sizeof(Word));
+    char path[4096];
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+            continue;
+        FILE *f = fopen(path, "rb");
+        if (f == NULL)
+            continue;
+        memcpy(input, initial, mach._dataend * sizeof(Word));
+        size_t n = fread(input, sizeof(Word), mach._dataend, f);
+        fclose(f);
+        if (n > 0)
+            add_entry(input);
+    }
+    closedir(d);
+    free(input);
+}
+
+//! Temps écoulé en secondes
+static double elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *seeds = NULL, *outdir = NULL;
+    unsigned long long limit = 10000, maxruns = 0;
+    double maxtime = 0;
+    bool loops = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:o:l:Ln:t:s:")) != -1) {
+        switch (opt) {
+        case 'i':
+            seeds = optarg;
+            break;
+        case 'o':
+            outdir = optarg;
+            break;
+        case 'l':
+            limit = strtoull(optarg, NULL, 0);
+            break;
+        case 'L':
+            loops = true;
+            break;
+        case 'n':
+            maxruns = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            maxtime = strtod(optarg, NULL);
+            break;
+        case 's':
+            rng_state = strtoull(optarg, NULL, 0) | 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1 || outdir == NULL)
+        usage(argv[0]);
+
+    read_program(&mach, argv[optind]);
+    if (mach._dataend == 0) {
+        fprintf(stderr, "Erreur: %s: pas de données d'entrée à muter\n", argv[optind]);
+        return 1;
+    }
+    if (mach._datasize > (1u << 24) || (initial = malloc((size_t)mach._datasize * sizeof(Word))) == NULL) {
+        fprintf(stderr, "Erreur: segment de données trop grand pour le fuzzing\n");
+        return 1;
+    }
+    read_block(&mach, 0, initial, mach._datasize);
+    dirty_words = (mach._datasize >> MEMORY_PAGE_BITS) / 64 + 1;
+    mach._dirty = calloc(dirty_words, sizeof(uint64_t));
+    mach._coverage = trace_bits;
+    if (loops)
+        loopcheck_open(&mach);
+    for (unsigned c = 0; c < 256; c++)
+        buckets[c] = c == 0 ? 0 : c == 1 ? 1 : c == 2 ? 2 : c == 3 ? 4 : c < 8 ? 8
+            : c < 16 ? 16 : c < 32 ? 32 : c < 128 ? 64 : 128;
+    memset(virgin_bits, 0xff, sizeof(virgin_bits));
+
+    char path[4096];
+    make_dir(outdir);
+    snprintf(path, sizeof(path), "%s/queue", outdir);
+    make_dir(path);
+    snprintf(path, sizeof(path), "%s/crashes", outdir);
+    make_dir(path);
+
+    if (seeds != NULL)
+        load_seeds(seeds);
+    if (ncorpus == 0)
+        add_entry(initial);
+
+    // Messages du simulateur jetés ; erreurs interceptées
+    if (freopen("/dev/null", "w", stdout) == NULL)
+        return 1;
+    set_error_hook(on_error);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned long long runs = 0, errors = 0, limits = 0;
+    unsigned nqueue = 0, seeds_count = ncorpus;
+    double last_report = 0;
+    Word *input = malloc(mach._dataend * sizeof(Word));
+
+    for (unsigned long long round = 0; !interrupted; round++) {
+        // Germes d'abord (sans mutation), puis cas dérivés du corpus tour à tour
+        if (round < seeds_count)
+            memcpy(input, corpus[round]._input, mach._dataend * sizeof(Word));
+        else {
+            memcpy(input, corpus[(round / 64) % ncorpus]._input, mach._dataend * sizeof(Word));
+            mutate(input, mach._dataend);
+        }
+        Case_Status status = run_case(input, limit);
+        runs++;
+        bool fresh = new_coverage();
+        if (status == CASE_ERROR) {
+            errors++;
+            uint64_t key = (uint64_t)fault_error << 32 | fault_addr;
+            unsigned i = 0;
+            while (i < ncrashes && crashes[i] != key)
+                i++;
+            if (i == ncrashes && ncrashes < MAX_CRASHES) {
+                crashes[ncrashes++] = key;
+                snprintf(path, sizeof(path), "%s/crashes/id:%06u,err:%u,addr:%04x",
+                         outdir, ncrashes - 1, fault_error, fault_addr);
+                save_case(path, input);
+            }
+        } else if (status == CASE_LIMIT) {
+            limits++;
+        }
+        if (fresh && round >= seeds_count) {
+            add_entry(input);
+            snprintf(path, sizeof(path), "%s/queue/id:%06u", outdir, nqueue++);
+            save_case(path, input);
+        }
+        if ((runs & 1023) == 0 || interrupted) {
+            double t = elapsed(&start);
+            if (t - last_report >= 1 || interrupted) {
+                fprintf(stderr, "%8.1fs  exécutions %llu (%.0f/s)  corpus %u  erreurs %llu (%u distinctes)  limites %llu  arcs %u\n",
+                        t, runs, runs / t, ncorpus, errors, ncrashes, limits, count_edges());
+                last_report = t;
+            }
+            if ((maxtime > 0 && t >= maxtime))
+                break;
+        }
+        if (maxruns != 0 && runs >= maxruns)
+            break;
+    }
+
+    double t = elapsed(&start);
+    fprintf(stderr, "Bilan : %llu exécutions en %.1f s (%.0f/s), corpus %u (%u nouveaux), "
+            "%u erreurs distinctes, %llu limites atteintes, %u arcs\n",
+            runs, t, runs / (t > 0 ? t : 1), ncorpus, nqueue, ncrashes, limits, count_edges());
+    free(input);
+    return ncrashes != 0;
+}
@@ -0,0 +1,635 @@
+/*!
+ * \file gdbstub.c
+ * \brief Serveur du protocole distant de GDB (<em>remote serial protocol</em>).
+ */
+
+#define _POSIX_C_SOURCE 200809L  // getaddrinfo(), pthread
+
+#include "gdbstub.h"
+#include "debug.h"
+#include "history.h"
+#include "memory.h"
+#include "watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+//! Taille maximale d'un paquet (annoncée par qSupported)
+#define GDB_PACKET 4096
+
+//! Nombre de registres transmis : R0-R15, PC, CC
+#define GDB_NREGS (NREGISTERS + 2)
+
+//! État de la connexion avec le client
+struct Gdb_Stub
+{
+    int _fd;			//!< Connexion
+    int _wake[2];		//!< Tube de réveil du thread d'interruption
+    pthread_t _watcher;		//!< Thread d'attente de l'interruption
+    bool _watching;		//!< Le thread est lancé
+    int _interrupted;		//!< Interruption reçue pendant l'exécution
+    bool _running;		//!< Exécution relancée : un compte rendu d'arrêt est dû
+    bool _noack;		//!< Mode sans acquittement (QStartNoAckMode)
+    char _in[GDB_PACKET];	//!< Tampon de réception
+    size_t _inpos;		//!< Prochain octet à lire dans le tampon
+    size_t _inlen;		//!< Octets présents dans le tampon
+};
+
+typedef struct Gdb_Stub Gdb_Stub;
+
+//! Machine dont le client est connecté (erreurs fatales, voir gdb_fault())
+static Machine *current = NULL;
+
+//! Chiffres hexadécimaux
+static const char hexdigits[] = "0123456789abcdef";
+
+//! Valeur d'un chiffre hexadécimal (-1 si ce n'en est pas un)
+static int hexval(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//! Lecture d'un nombre hexadécimal ; *end désigne le caractère suivant
+static unsigned long long parse_hex(const char *s, const char **end) {
+    unsigned long long v = 0;
+    int d;
+    while ((d = hexval(*s)) >= 0) {
+        v = v << 4 | d;
+        s++;
+    }
+    *end = s;
+    return v;
+}
+
+//! Écriture d'un mot de 32 bits en hexadécimal petit-boutiste
+static char *put_word(char *out, uint32_t w) {
+    for (int i = 0; i < 4; i++, w >>= 8) {
+        *out++ = hexdigits[(w >> 4) & 0xf];
+        *out++ = hexdigits[w & 0xf];
+    }
+    return out;
+}
+
+//! Lecture d'un mot de 32 bits en hexadécimal petit-boutiste
+static bool get_word(const char *in, uint32_t *w) {
+    *w = 0;
+    for (int i = 0; i < 4; i++) {
+        int hi = hexval(in[2 * i]), lo = hexval(in[2 * i + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        *w |= (uint32_t)(hi << 4 | lo) << (8 * i);
+    }
+    return true;
+}
+
+//! Lecture d'un octet de la connexion (-1 en fin de connexion)
+static int get_char(Gdb_Stub *g) {
+    if (g->_inpos == g->_inlen) {
+        ssize_t n;
+        while ((n = read(g->_fd, g->_in, sizeof(g->_in))) < 0 && errno == EINTR)
+            ;
+        if (n <= 0)
+            return -1;
+        g->_inpos = 0;
+        g->_inlen = n;
+    }
+    return (unsigned char)g->_in[g->_inpos++];
+}
+
+//! Envoi d'octets bruts
+static void put_bytes(Gdb_Stub *g, const char *bytes, size_t n) {
+    while (n > 0) {
+        ssize_t k = send(g->_fd, bytes, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k <= 0)
+            return; // client parti : la lecture suivante le constatera
+        bytes += k;
+        n -= k;
+    }
+}
+
+//! Envoi d'un paquet ; en mode acquitté, réémission tant que le client refuse
+static void put_packet(Gdb_Stub *g, const char *data) {
+    size_t len = strlen(data);
+    char *frame = malloc(len + 4);
+    unsigned char sum = 0;
+    frame[0] = '$';
+    for (size_t i = 0; i < len; i++)
+        sum += (unsigned char)(frame[i + 1] = data[i]);
+    frame[len + 1] = '#';
+    frame[len + 2] = hexdigits[sum >> 4];
+    frame[len + 3] = hexdigits[sum & 0xf];
+    int c;
+    do {
+        put_bytes(g, frame, len + 4);
+        if (g->_noack)
+            break;
+        while ((c = get_char(g)) >= 0 && c != '+' && c != '-')
+            ;
+    } while (c == '-');
+    free(frame);
+}
+
+//! Réception d'un paquet (sans '$', '#' ni somme de contrôle)
+/*!
+ * \return faux en fin de connexion
+ */
+static bool get_packet(Gdb_Stub *g, char *buf, size_t size) {
+    for (;;) {
+        int c;
+        while ((c = get_char(g)) >= 0 && c != '$')
+            ; // acquittements et interruptions tardives ignorés
+        if (c < 0)
+            return false;
+        size_t len = 0;
+        unsigned char sum = 0;
+        while ((c = get_char(g)) >= 0 && c != '#') {
+            if (len < size - 1)
+                buf[len++] = c;
+            sum += c;
+        }
+        int hi = get_char(g), lo = get_char(g);
+        if (c < 0 || hi < 0 || lo < 0)
+            return false;
+        buf[len] = '\0';
+        if (g->_noack)
+            return true;
+        if (hexval(hi) << 4 == (sum & 0xf0) && hexval(lo) == (sum & 0xf)) {
+            put_bytes(g, "+", 1);
+            return true;
+        }
+        put_bytes(g, "-", 1);
+    }
+}
+
+//! Attente de l'interruption pendant l'exécution libre
+static void *watch_interrupt(void *arg) {
+    Machine *pmach = arg;
+    Gdb_Stub *g = pmach->_gdb;
+    struct pollfd fds[2] = { { g->_fd, POLLIN, 0 }, { g->_wake[0], POLLIN, 0 } };
+    while (poll(fds, 2, -1) < 0 && errno == EINTR)
+        ;
+    if (fds[0].revents != 0) {
+        // Arrêt après l'instruction en cours : la boucle teste _armed
+        Debugger *dbg = pmach->_debugger;
+        __atomic_store_n(&g->_interrupted, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&dbg->_step, true, __ATOMIC_RELAXED);
+        __atomic_store_n(&dbg->_armed, true, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+//! Arrêt du thread d'interruption
+static void stop_watcher(Gdb_Stub *g) {
+    if (!g->_watching)
+        return;
+    char c = 0;
+    if (write(g->_wake[1], &c, 1) < 0)
+        perror("gdb");
+    pthread_join(g->_watcher, NULL);
+    if (read(g->_wake[0], &c, 1) < 0)
+        perror("gdb");
+    g->_watching = false;
+}
+
+//! Fin des commandes d'exécution bornée du débogueur
+static void halt_debugger(Debugger *dbg) {
+    dbg->_step = false;
+    dbg->_stop_at = 0;
+    dbg->_until = false;
+    dbg->_finish = false;
+    dbg->_armed = false;
+}
+
+//! Fermeture de la connexion
+static void disconnect(Machine *pmach) {
+    Gdb_Stub *g = pmach->_gdb;
+    stop_watcher(g);
+    close(g->_fd);
+    close(g->_wake[0]);
+    close(g->_wake[1]);
+    free(g);
+    pmach->_gdb = NULL;
+    if (current == pmach)
+        current = NULL;
+}
+
+//! Valeur d'un registre dans la numérotation du client
+static uint32_t get_register(Machine *pmach, unsigned n) {
+    if (n < NREGISTERS)
+        return pmach->_registers[n];
+    return n == NREGISTERS ? pmach->_pc : (uint32_t)pmach->_cc;
+}
+
+//! Modification d'un registre ; l'historique éventuel repart de l'état modifié
+static bool set_register(Machine *pmach, unsigned n, uint32_t value) {
+    if (n < NREGISTERS)
+        pmach->_registers[n] = value;
+    else if (n == NREGISTERS)
+        pmach->_pc = value;
+    else if (value <= LAST_CC)
+        pmach->_cc = value;
+    else
+        return false;
+    return true;
+}
+
+//! L'état a été modifié par le client : l'historique enregistré n'est plus valide
+static void state_edited(Machine *pmach) {
+    History *h = pmach->_history;
+    if (h == NULL)
+        return;
+    unsigned long long interval = h->_interval;
+    size_t budget = h->_budget;
+    history_close(pmach);
+    history_open(pmach, interval, budget);
+}
+
+//! Document de description de la cible
+static size_t target_xml(char *buf, size_t size) {
+    size_t n = snprintf(buf, size,
+                        "<?xml version=\"1.0\"?>"
+                        "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                        "<target version=\"1.0\"><feature name=\"org.simul.cpu\">");
+    for (unsigned r = 0; r < NREGISTERS; r++)
+        n += snprintf(buf + n, size - n, "<reg name=\"r%u\" bitsize=\"32\" type=\"%s\" regnum=\"%u\"/>",
+                      r, r == NREGISTERS - 1 ? "data_ptr" : "int32", r);
+    n += snprintf(buf + n, size - n,
+                  "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\" regnum=\"%u\"/>"
+                  "<reg name=\"cc\" bitsize=\"32\" type=\"int32\" regnum=\"%u\"/>"
+                  "</feature></target>", NREGISTERS, NREGISTERS + 1);
+    return n;
+}
+
+//! Lecture de mémoire : octets [addr, addr+len[ du segment de données
+static void read_memory(Machine *pmach, const char *args, char *reply) {
+    const char *p;
+    unsigned long long addr = parse_hex(args, &p), len = 0;
+    if (*p == ',')
+        len = parse_hex(p + 1, &p);
+    if (len > (GDB_PACKET - 8) / 2)
+        len = (GDB_PACKET - 8) / 2;
+    if (addr + len > 4ull * pmach->_datasize) {
+        strcpy(reply, "E01");
+        return;
+    }
+    for (unsigned long long b = addr; b < addr + len; b++) {
+        unsigned byte = (read_data(pmach, b / 4) >> (8 * (b % 4))) & 0xff;
+        *reply++ = hexdigits[byte >> 4];
+        *reply++ = hexdigits[byte & 0xf];
+    }
+    *reply = '\0';
+}
+
+//! Écriture de mémoire (paquet M addr,len:octets)
+static void write_memory(Machine *pmach, const char *args, char *reply) {
+    const char *p;
+    unsigned long long addr = parse_hex(args, &p), len = 0;
+    if (*p == ',')
+        len = parse_hex(p + 1, &p);
+    if (*p != ':' || strlen(p + 1) < 2 * len || addr + len > 4ull * pmach->_datasize) {
+        strcpy(reply, "E01");
+        return;
+    }
+    for (unsigned long long b = addr; b < addr + len; b++)
+        if (pmach->_memory != NULL && memory_page_readonly(pmach, (b / 4) >> MEMORY_PAGE_BITS)) {
+            strcpy(reply, "E02");
+            return;
+        }
+    state_edited(pmach);
+    p++;
+    for (unsigned long long b = addr; b < addr + len; b++, p += 2) {
+        int hi = hexval(p[0]), lo = hexval(p[1]);
+        if (hi < 0 || lo < 0) {
+            strcpy(reply, "E01");
+            return;
+        }
+        unsigned shift = 8 * (b % 4);
+        Word w = read_data(pmach, b / 4);
+        w = (w & ~(0xffu << shift)) | (uint32_t)(hi << 4 | lo) << shift;
+        write_data(pmach, b / 4, w);
+    }
+    strcpy(reply, "OK");
+}
+
+//! Lecture d'un fragment de target.xml (qXfer:features:read:target.xml:off,len)
+static void read_features(const char *args, char *reply) {
+    static char xml[4096];
+    static size_t xmllen = 0;
+    if (xmllen == 0)
+        xmllen = target_xml(xml, sizeof(xml));
+    if (strncmp(args, "target.xml:", 11) != 0) {
+        strcpy(reply, "E00");
+        return;
+    }
+    const char *p;
+    unsigned long long off = parse_hex(args + 11, &p), len = 0;
+    if (*p == ',')
+        len = parse_hex(p + 1, &p);
+    if (len > GDB_PACKET - 8)
+        len = GDB_PACKET - 8;
+    if (off >= xmllen) {
+        strcpy(reply, "l");
+        return;
+    }
+    if (len > xmllen - off)
+        len = xmllen - off;
+    reply[0] = off + len < xmllen ? 'm' : 'l';
+    memcpy(reply + 1, xml + off, len);
+    reply[len + 1] = '\0';
+}
+
+//! Arrêt du retour arrière : point d'arrêt ou de surveillance
+static bool reverse_stop(Machine *pmach) {
+    bool watched = pmach->_watch != NULL && pmach->_watch->_nhits != 0 && watch_triggered(pmach);
+    unsigned pc = pmach->_pc;
+    return (pc < pmach->_textsize && (pmach->_debugger->_breakpoints[pc / 32] >> (pc % 32)) & 1)
+        || watched;
+}
+
+//! Traitement des paquets jusqu'à la reprise de l'exécution
+static bool serve(Machine *pmach) {
+    Gdb_Stub *g = pmach->_gdb;
+    Debugger *dbg = pmach->_debugger;
+    static char packet[GDB_PACKET], reply[GDB_PACKET];
+    for (;;) {
+        if (!get_packet(g, packet, sizeof(packet))) {
+            disconnect(pmach);
+            return false;
+        }
+        const char *p;
+        unsigned long long n;
+        uint32_t w;
+        reply[0] = '\0';
+        switch (packet[0]) {
+        case '?':
+            strcpy(reply, "S05");
+            break;
+        case 'g':
+            for (unsigned r = 0; r < GDB_NREGS; r++)
+                put_word(reply + 8 * r, get_register(pmach, r));
+            reply[8 * GDB_NREGS] = '\0';
+            break;
+        case 'G':
+            state_edited(pmach);
+            strcpy(reply, "OK");
+            for (unsigned r = 0; r < GDB_NREGS && get_word(packet + 1 + 8 * r, &w); r++)
+                if (!set_register(pmach, r, w))
+                    strcpy(reply, "E01");
+            break;
+        case 'p':
+            n = parse_hex(packet + 1, &p);
+            if (n < GDB_NREGS)
+                *put_word(reply, get_register(pmach, n)) = '\0';
+            else
+                strcpy(reply, "E01");
+            break;
+        case 'P':
+            n = parse_hex(packet + 1, &p);
+            if (*p != '=' || n >= GDB_NREGS || !get_word(p + 1, &w)) {
+                strcpy(reply, "E01");
+                break;
+            }
+            state_edited(pmach);
+            strcpy(reply, set_register(pmach, n, w) ? "OK" : "E01");
+            break;
+        case 'm':
+            read_memory(pmach, packet + 1, reply);
+            break;
+        case 'M':
+            write_memory(pmach, packet + 1, reply);
+            break;
+        case 'c':   // Reprise jusqu'au prochain arrêt
+        case 's':   // Une instruction
+            if (packet[1] != '\0') {
+                state_edited(pmach);
+                pmach->_pc = parse_hex(packet + 1, &p);
+            }
+            g->_running = true;
+            g->_interrupted = 0;
+            if (packet[0] == 's') {
+                dbg->_step = true;
+                dbg->_armed = true;
+            } else if (pthread_create(&g->_watcher, NULL, watch_interrupt, pmach) == 0) {
+                g->_watching = true;
+            }
+            return true;
+        case 'b':   // Retour arrière (bs, bc)
+            if (pmach->_history == NULL || (packet[1] != 's' && packet[1] != 'c')) {
+                strcpy(reply, "E01");
+                break;
+            }
+            if (packet[1] == 's')
+                history_goto(pmach, pmach->_retired > 0 ? pmach->_retired - 1 : 0);
+            else
+                history_reverse(pmach, reverse_stop);
+            strcpy(reply, "S05");
+            break;
+        case 'Z':   // Point d'arrêt logiciel
+        case 'z':
+            if (packet[1] != '0' || packet[2] != ',') {
+                break; // autres sortes non gérées : réponse vide
+            }
+            n = parse_hex(packet + 3, &p);
+            strcpy(reply, debug_breakpoint(pmach, n, packet[0] == 'Z') ? "OK" : "E01");
+            break;
+        case 'D':   // Détachement : la simulation continue librement
+            put_packet(g, "OK");
+            disconnect(pmach);
+            return false;
+        case 'k':   // Fin de la simulation
+            disconnect(pmach);
+            exit(0);
+        case 'H':
+        case 'T':
+            strcpy(reply, "OK");
+            break;
+        case 'q':
+            if (strncmp(packet, "qSupported", 10) == 0)
+                snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+%s",
+                         GDB_PACKET, pmach->_history != NULL ? ";ReverseStep+;ReverseContinue+" : "");
+            else if (strncmp(packet, "qXfer:features:read:", 20) == 0)
+                read_features(packet + 20, reply);
+            else if (strcmp(packet, "qAttached") == 0)
+                strcpy(reply, "1");
+            else if (strcmp(packet, "qC") == 0)
+                strcpy(reply, "QC1");
+            else if (strcmp(packet, "qfThreadInfo") == 0)
+                strcpy(reply, "m1");
+            else if (strcmp(packet, "qsThreadInfo") == 0)
+                strcpy(reply, "l");
+            else if (strcmp(packet, "qOffsets") == 0)
+                strcpy(reply, "Text=0;Data=0;Bss=0");
+            break;
+        case 'Q':
+            if (strcmp(packet, "QStartNoAckMode") == 0) {
+                put_packet(g, "OK");
+                g->_noack = true;
+                continue;
+            }
+            break;
+        default:    // Paquet non géré : réponse vide
+            break;
+        }
+        put_packet(g, reply);
+    }
+}
+
+//! Ouverture de la socket d'écoute
+static int open_listener(const char *spec) {
+    int fd;
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un sun;
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        if (strlen(spec + 5) >= sizeof(sun.sun_path)) {
+            printf("Erreur: %s: chemin trop long\n", spec);
+            exit(1);
+        }
+        strcpy(sun.sun_path, spec + 5);
+        unlink(sun.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(fd, 1) < 0) {
+            printf("Erreur: %s: écoute impossible (%s)\n", spec, strerror(errno));
+            exit(1);
+        }
+        return fd;
+    }
+    char host[256] = "127.0.0.1";
+    const char *port = spec, *colon = strrchr(spec, ':');
+    if (colon != NULL) {
+        if ((size_t)(colon - spec) >= sizeof(host) || colon == spec) {
+            printf("Erreur: %s: adresse invalide\n", spec);
+            exit(1);
+        }
+        memcpy(host, spec, colon - spec);
+        host[colon - spec] = '\0';
+        port = colon + 1;
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        printf("Erreur: %s: adresse invalide\n", spec);
+        exit(1);
+    }
+    int one = 1;
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 1) < 0) {
+        printf("Erreur: %s: écoute impossible (%s)\n", spec, strerror(errno));
+        exit(1);
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+bool gdb_listen(Machine *pmach, const char *spec) {
+    int lfd = open_listener(spec);
+    printf("Attente d'un client GDB sur %s\n", spec);
+    fflush(stdout);
+    int fd;
+    while ((fd = accept(lfd, NULL, NULL)) < 0 && errno == EINTR)
+        ;
+    if (fd < 0) {
+        printf("Erreur: %s: connexion impossible (%s)\n", spec, strerror(errno));
+        exit(1);
+    }
+    close(lfd);
+    if (strncmp(spec, "unix:", 5) == 0)
+        unlink(spec + 5);
+    else
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+    if (pmach->_gdb != NULL)
+        disconnect(pmach);
+    Gdb_Stub *g = calloc(1, sizeof(Gdb_Stub));
+    g->_fd = fd;
+    if (pipe(g->_wake) < 0) {
+        printf("Erreur: gdb: %s\n", strerror(errno));
+        exit(1);
+    }
+    pmach->_gdb = g;
+    current = pmach;
+    halt_debugger(debug_attach(pmach, false));
+    return serve(pmach);
+}
+
+bool gdb_stop(Machine *pmach) {
+    Gdb_Stub *g = pmach->_gdb;
+    stop_watcher(g);
+    halt_debugger(pmach->_debugger);
+    if (g->_running) {
+        put_packet(g, g->_interrupted ? "S02" : "S05");
+        g->_running = false;
+    }
+    return serve(pmach);
+}
+
+//! Signal (numérotation de GDB) rapporté au client pour une erreur
+static unsigned fault_signal(Error err) {
+    switch (err) {
+    case ERR_UNKNOWN:
+    case ERR_ILLEGAL:
+    case ERR_CONDITION:
+    case ERR_IMMEDIATE:
+        return 4;   // SIGILL
+    case ERR_DIVZERO:
+        return 8;   // SIGFPE
+    case ERR_LOOP:
+        return 24;  // SIGXCPU
+    default:
+        return 11;  // SIGSEGV
+    }
+}
+
+void gdb_fault(Error err, unsigned addr) {
+    Machine *pmach = current;
+    if (pmach == NULL || pmach->_gdb == NULL)
+        return;
+    Gdb_Stub *g = pmach->_gdb;
+    char reply[8];
+    snprintf(reply, sizeof(reply), "S%02x", fault_signal(err));
+    stop_watcher(g);
+    halt_debugger(pmach->_debugger);
+    // Arrêt sur l'erreur : le client examine l'état, puis fin du processus
+    if (g->_running) {
+        put_packet(g, reply);
+        g->_running = false;
+        if (!serve(pmach))
+            return;
+        stop_watcher(g);
+    }
+    reply[0] = 'X';
+    put_packet(g, reply);
+    disconnect(pmach);
+}
+
+void gdb_close(Machine *pmach, int status) {
+    Gdb_Stub *g = pmach->_gdb;
+    if (g == NULL)
+        return;
+    stop_watcher(g);
+    char reply[8];
+    snprintf(reply, sizeof(reply), "W%02x", status & 0xff);
+    put_packet(g, reply);
+    disconnect(pmach);
+}
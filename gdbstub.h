@@ -0,0 +1,77 @@
+#ifndef _GDBSTUB_H_
+#define _GDBSTUB_H_
+
+/*!
+ * \file gdbstub.h
+ * \brief Serveur du protocole distant de GDB (<em>remote serial protocol</em>).
+ *
+ * gdb_listen() attend la connexion d'un client (GDB ou un outil parlant le
+ * même protocole) sur un port TCP local ou une socket Unix, puis lui donne la
+ * main : les arrêts de la simulation (points d'arrêt, pas à pas, points de
+ * surveillance) sont dès lors servis par le client au lieu du menu de
+ * debug_ask().
+ *
+ * Conventions :
+ *
+ *   - registres : \c r0 à \c r15 (\c r15 est \c sp), \c pc puis \c cc (valeur
+ *   de \c Condition_Code), 32 bits petit-boutiste, décrits par le document
+ *   \c target.xml (\c qXfer:features:read) ;
+ *   - mémoire : le segment de données, le mot d'adresse \a a occupant les
+ *   octets \a 4a à \a 4a+3 (petit-boutiste) ;
+ *   - points d'arrêt logiciels (\c Z0 / \c z0) : adresses du texte, dans
+ *   l'unité de \c pc (une instruction) ; ils partagent la bitmap du débogueur ;
+ *   - \c c, \c s, interruption (octet 0x03), \c D, \c k ; \c bs et \c bc
+ *   (retour arrière) quand l'exécution est enregistrée (history.h).
+ *
+ * Pendant l'exécution libre, la boucle de simulation ne consulte pas la
+ * connexion : un thread attend l'interruption et arme alors l'arrêt du
+ * débogueur (\c Debugger::_armed), testé de toute façon après chaque
+ * instruction.
+ */
+
+#include "machine.h"
+#include "error.h"
+
+//! Attente d'un client et premier dialogue
+/*!
+ * Le débogueur est attaché si besoin ; le client a la main jusqu'à ce qu'il
+ * relance l'exécution. Une adresse invalide ou une socket inutilisable est une
+ * erreur fatale.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param spec \c port, \c hôte:port ou \c unix:chemin
+ * \return faux si le client s'est détaché (exécution libre sans débogueur)
+ */
+bool gdb_listen(Machine *pmach, const char *spec);
+
+//! Arrêt servi par le client connecté
+/*!
+ * Appelée par debug_ask() quand \c Machine::_gdb n'est pas NULL : envoie le
+ * compte rendu d'arrêt puis traite les paquets jusqu'à la reprise.
+ *
+ * \param pmach la machine
+ * \return faux si le client s'est détaché
+ */
+bool gdb_stop(Machine *pmach);
+
+//! Fin du programme : compte rendu au client et fermeture de la connexion
+/*!
+ * \param pmach la machine
+ * \param status le code de fin transmis au client
+ */
+void gdb_close(Machine *pmach, int status);
+
+//! Erreur fatale : compte rendu au client et fermeture de la connexion
+/*!
+ * Appelée par error() avant la fin du simulateur ; sans effet si aucun
+ * client n'est connecté. Le client reçoit un arrêt sur le signal
+ * correspondant à l'erreur (\c SIGILL, \c SIGFPE, \c SIGSEGV ou
+ * \c SIGXCPU) et peut examiner l'état ; à la reprise de l'exécution, il
+ * reçoit la fin du processus sur ce signal (\c X).
+ *
+ * \param err le code de l'erreur
+ * \param addr son adresse
+ */
+void gdb_fault(Error err, unsigned addr);
+
+#endif
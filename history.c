@@ -0,0 +1,400 @@
+/*!
+ * \file history.c
+ * \brief Enregistrement de l'exécution et retour arrière (débogage temporel).
+ */
+
+#include "history.h"
+#include "debug.h"
+#include "error.h"
+#include "exec.h"
+#include "memory.h"
+#include "watch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Le registre de l'instruction a été modifié
+#define UNDO_REG (1u << 8)
+
+//! Le pointeur de pile a été modifié
+#define UNDO_SP (1u << 9)
+
+//! Point de reprise de simul() sur erreur (voir history_catch())
+static jmp_buf *fault_target = NULL;
+
+//! Machine simulée par simul()
+static Machine *fault_machine = NULL;
+
+//! Reprise de la simulation sur erreur d'exécution pendant l'enregistrement
+static void on_error(Error err, unsigned addr) {
+    if (fault_target != NULL && fault_machine->_history != NULL)
+        longjmp(*fault_target, 1);
+}
+
+//! Nombre de mots de la bitmap des pages sauvegardées
+static size_t saved_words(Machine *pmach) {
+    return (pmach->_datasize >> MEMORY_PAGE_BITS) / 64 + 1;
+}
+
+//! Taille d'une image de page (un segment plus petit qu'une page n'en a qu'une)
+static unsigned image_words(Machine *pmach) {
+    return pmach->_datasize < MEMORY_PAGE ? pmach->_datasize : MEMORY_PAGE;
+}
+
+//! Mémoire utilisée (images de pages et journal), en octets
+static size_t history_used(History *h) {
+    return h->_used + h->_nundo * sizeof(Word);
+}
+
+//! Réservation de n mots dans le journal d'annulation
+static void reserve(History *h, size_t n) {
+    if (h->_nundo + n <= h->_capundo)
+        return;
+    while (h->_nundo + n > h->_capundo)
+        h->_capundo = h->_capundo == 0 ? 4096 : 2 * h->_capundo;
+    h->_undo = realloc(h->_undo, h->_capundo * sizeof(Word));
+    if (h->_undo == NULL) {
+        printf("Erreur: mémoire insuffisante pour l'historique\n");
+        exit(1);
+    }
+}
+
+//! Libération des images de pages d'un instantané
+static void release(Machine *pmach, Snapshot *snap) {
+    History *h = pmach->_history;
+    h->_used -= (size_t)snap->_npages * image_words(pmach) * sizeof(Word);
+    free(snap->_pages);
+    free(snap->_images);
+    snap->_pages = NULL;
+    snap->_images = NULL;
+    snap->_npages = snap->_cappages = 0;
+}
+
+//! Nouvel instantané de l'état courant ; le journal d'annulation est vidé
+static void take_snapshot(Machine *pmach) {
+    History *h = pmach->_history;
+    if (h->_nsnapshots == h->_capsnapshots) {
+        h->_capsnapshots = h->_capsnapshots == 0 ? 16 : 2 * h->_capsnapshots;
+        h->_snapshots = realloc(h->_snapshots, h->_capsnapshots * sizeof(Snapshot));
+    }
+    Snapshot *snap = &h->_snapshots[h->_nsnapshots++];
+    memset(snap, 0, sizeof(Snapshot));
+    snap->_retired = pmach->_retired;
+    snap->_pc = pmach->_pc;
+    snap->_cc = pmach->_cc;
+    memcpy(snap->_registers, pmach->_registers, sizeof(snap->_registers));
+    memset(h->_saved, 0, saved_words(pmach) * sizeof(uint64_t));
+    h->_nundo = 0;
+}
+
+//! Abandon du plus ancien instantané (l'historique raccourcit)
+static void drop_oldest(Machine *pmach) {
+    History *h = pmach->_history;
+    release(pmach, &h->_snapshots[0]);
+    memmove(h->_snapshots, h->_snapshots + 1, --h->_nsnapshots * sizeof(Snapshot));
+}
+
+//! Nombre de mots d'une page dans le segment de données
+static unsigned page_words(Machine *pmach, unsigned page) {
+    unsigned base = page << MEMORY_PAGE_BITS;
+    if (base >= pmach->_datasize)
+        return 0;
+    return pmach->_datasize - base < MEMORY_PAGE ? pmach->_datasize - base : MEMORY_PAGE;
+}
+
+//! Sauvegarde d'une page avant sa première modification dans l'intervalle
+static void save_page(Machine *pmach, unsigned page) {
+    History *h = pmach->_history;
+    Snapshot *snap = &h->_snapshots[h->_nsnapshots - 1];
+    h->_saved[page / 64] |= (uint64_t)1 << (page % 64);
+    unsigned len = page_words(pmach, page);
+    if (len == 0)
+        return;
+    if (snap->_npages == snap->_cappages) {
+        snap->_cappages = snap->_cappages == 0 ? 8 : 2 * snap->_cappages;
+        snap->_pages = realloc(snap->_pages, snap->_cappages * sizeof(unsigned));
+        snap->_images = realloc(snap->_images, (size_t)snap->_cappages * image_words(pmach) * sizeof(Word));
+        if (snap->_pages == NULL || snap->_images == NULL) {
+            printf("Erreur: mémoire insuffisante pour l'historique\n");
+            exit(1);
+        }
+    }
+    read_block(pmach, page << MEMORY_PAGE_BITS, &snap->_images[(size_t)snap->_npages * image_words(pmach)], len);
+    snap->_pages[snap->_npages++] = page;
+    h->_used += image_words(pmach) * sizeof(Word);
+}
+
+//! Annulation des écritures du journal jusqu'à la marque
+static void undo_writes(Machine *pmach, size_t mark) {
+    History *h = pmach->_history;
+    while (h->_nundo > mark) {
+        Word old = h->_undo[--h->_nundo];
+        unsigned addr = h->_undo[--h->_nundo];
+        if (read_data(pmach, addr) != old) // une écriture refusée n'a rien changé
+            write_data(pmach, addr, old);
+    }
+}
+
+//! Annulation de la dernière instruction du journal
+static void undo_one(Machine *pmach) {
+    History *h = pmach->_history;
+    Word info = h->_undo[--h->_nundo];
+    size_t nwrites = h->_undo[--h->_nundo];
+    pmach->_pc = h->_undo[--h->_nundo];
+    if (info & UNDO_SP)
+        pmach->_sp = h->_undo[--h->_nundo];
+    if (info & UNDO_REG)
+        pmach->_registers[(info >> 4) & 0xf] = h->_undo[--h->_nundo];
+    undo_writes(pmach, h->_nundo - 2 * nwrites);
+    pmach->_cc = info & 0xf;
+    pmach->_retired--;
+}
+
+//! Restauration de l'instantané s ; les instantanés suivants sont abandonnés
+static void restore(Machine *pmach, unsigned s) {
+    History *h = pmach->_history;
+    // Du plus récent au plus ancien : chaque page retrouve son état le plus ancien
+    for (unsigned k = h->_nsnapshots; k-- > s; ) {
+        Snapshot *snap = &h->_snapshots[k];
+        for (unsigned i = 0; i < snap->_npages; i++)
+            write_block(pmach, snap->_pages[i] << MEMORY_PAGE_BITS,
+                        &snap->_images[(size_t)i * image_words(pmach)], page_words(pmach, snap->_pages[i]));
+        release(pmach, snap);
+    }
+    h->_nsnapshots = s + 1;
+    Snapshot *snap = &h->_snapshots[s];
+    pmach->_retired = snap->_retired;
+    pmach->_pc = snap->_pc;
+    pmach->_cc = snap->_cc;
+    memcpy(pmach->_registers, snap->_registers, sizeof(snap->_registers));
+    memset(h->_saved, 0, saved_words(pmach) * sizeof(uint64_t));
+    h->_nundo = 0;
+}
+
+//! Modèles détachés pendant une ré-exécution (voir replay())
+static struct
+{
+    bool _detached;			//!< Ré-exécution en cours
+    struct Cache *_cache;		//!< Modèle de cache
+    struct Timing *_timing;		//!< Modèle temporel
+    struct Branch_Profile *_branchprof;	//!< Profil des branchements
+    struct Hooks *_hooks;		//!< Greffons (dont memprof)
+    struct Loop_Check *_loopcheck;	//!< Détection des boucles
+    uint8_t *_coverage;			//!< Couverture des arcs
+    unsigned _prev_loc;			//!< Origine du dernier transfert de contrôle
+} models;
+
+//! Détachement des modèles : les instructions ré-exécutées ne sont pas recomptées
+static void detach_models(Machine *pmach) {
+    models._detached = true;
+    models._cache = pmach->_cache;
+    models._timing = pmach->_timing;
+    models._branchprof = pmach->_branchprof;
+    models._hooks = pmach->_hooks;
+    models._loopcheck = pmach->_loopcheck;
+    models._coverage = pmach->_coverage;
+    models._prev_loc = pmach->_prev_loc;
+    pmach->_cache = NULL;
+    pmach->_timing = NULL;
+    pmach->_branchprof = NULL;
+    pmach->_hooks = NULL;
+    pmach->_loopcheck = NULL;
+    pmach->_coverage = NULL;
+}
+
+//! Rattachement des modèles (aussi après une erreur pendant la ré-exécution)
+static void attach_models(Machine *pmach) {
+    if (!models._detached)
+        return;
+    models._detached = false;
+    pmach->_cache = models._cache;
+    pmach->_timing = models._timing;
+    pmach->_branchprof = models._branchprof;
+    pmach->_hooks = models._hooks;
+    pmach->_loopcheck = models._loopcheck;
+    pmach->_coverage = models._coverage;
+    pmach->_prev_loc = models._prev_loc;
+}
+
+//! Ré-exécution jusqu'à l'instruction numéro n
+/*!
+ * \param pmach la machine
+ * \param n le numéro visé
+ * \param stop prédicat d'arrêt (NULL : aucun)
+ * \param before seuls les états antérieurs à ce numéro sont retenus
+ * \param found dernier état retenu (inchangé si aucun)
+ * \return faux si un \c HALT ou la fin du texte est atteint avant \a n
+ */
+static bool replay(Machine *pmach, unsigned long long n, bool (*stop)(Machine *pmach),
+                   unsigned long long before, unsigned long long *found) {
+    detach_models(pmach);
+    bool reached = true;
+    while (pmach->_retired < n) {
+        if (pmach->_pc >= pmach->_textsize || pmach->_text[pmach->_pc].instr_generic._cop == HALT) {
+            reached = false;
+            break;
+        }
+        history_begin(pmach);
+        decode_execute(pmach, pmach->_text[pmach->_pc++]);
+        pmach->_retired++;
+        history_end(pmach);
+        if (stop != NULL && pmach->_retired < before && stop(pmach))
+            *found = pmach->_retired;
+        if (pmach->_watch != NULL)
+            pmach->_watch->_nhits = 0;
+    }
+
+    attach_models(pmach);
+    return reached;
+}
+
+void history_open(Machine *pmach, unsigned long long interval, size_t budget) {
+    if (pmach->_history != NULL)
+        return;
+    History *h = calloc(1, sizeof(History));
+    h->_interval = interval != 0 ? interval : HISTORY_INTERVAL;
+    h->_budget = budget != 0 ? budget : HISTORY_BUDGET;
+    h->_saved = calloc(saved_words(pmach), sizeof(uint64_t));
+    pmach->_history = h;
+    take_snapshot(pmach);
+    set_error_hook(on_error);
+}
+
+void history_close(Machine *pmach) {
+    History *h = pmach->_history;
+    if (h == NULL)
+        return;
+    for (unsigned k = 0; k < h->_nsnapshots; k++)
+        release(pmach, &h->_snapshots[k]);
+    free(h->_snapshots);
+    free(h->_saved);
+    free(h->_undo);
+    free(h);
+    pmach->_history = NULL;
+    set_error_hook(NULL);
+}
+
+void history_catch(Machine *pmach, jmp_buf *target) {
+    fault_machine = pmach;
+    fault_target = target;
+}
+
+bool history_fault(Machine *pmach) {
+    History *h = pmach->_history;
+    attach_models(pmach);
+    if (h->_pending) { // Annulation de l'instruction fautive
+        undo_writes(pmach, h->_pend_mark);
+        pmach->_registers[h->_pend_reg] = h->_pend_value;
+        pmach->_sp = h->_pend_sp;
+        pmach->_pc = h->_pend_pc;
+        pmach->_cc = h->_pend_cc;
+        h->_pending = false;
+    }
+    if (pmach->_watch != NULL)
+        pmach->_watch->_nhits = 0;
+    printf("Exécution arrêtée avant l'instruction fautive (%llu instructions exécutées, "
+           "historique depuis l'instruction %llu)\n", pmach->_retired, history_first(pmach));
+    return debug_ask(pmach);
+}
+
+void history_begin(Machine *pmach) {
+    History *h = pmach->_history;
+    h->_pending = true;
+    h->_pend_pc = pmach->_pc;
+    h->_pend_cc = pmach->_cc;
+    h->_pend_reg = pmach->_text[pmach->_pc].instr_generic._regcond;
+    h->_pend_value = pmach->_registers[h->_pend_reg];
+    h->_pend_sp = pmach->_sp;
+    h->_pend_mark = h->_nundo;
+}
+
+void history_end(Machine *pmach) {
+    History *h = pmach->_history;
+    Word nwrites = (h->_nundo - h->_pend_mark) / 2;
+    Word info = h->_pend_cc | h->_pend_reg << 4;
+    reserve(h, 5);
+    if (pmach->_registers[h->_pend_reg] != h->_pend_value) {
+        h->_undo[h->_nundo++] = h->_pend_value;
+        info |= UNDO_REG;
+    }
+    if (pmach->_sp != h->_pend_sp) {
+        h->_undo[h->_nundo++] = h->_pend_sp;
+        info |= UNDO_SP;
+    }
+    h->_undo[h->_nundo++] = h->_pend_pc;
+    h->_undo[h->_nundo++] = nwrites;
+    h->_undo[h->_nundo++] = info;
+    h->_pending = false;
+
+    Snapshot *last = &h->_snapshots[h->_nsnapshots - 1];
+    if (pmach->_retired - last->_retired >= h->_interval || history_used(h) > h->_budget) {
+        take_snapshot(pmach);
+        while (h->_nsnapshots > 1 && history_used(h) > h->_budget)
+            drop_oldest(pmach);
+    }
+}
+
+void history_write(Machine *pmach, unsigned addr, unsigned n) {
+    History *h = pmach->_history;
+    reserve(h, 2 * (size_t)n);
+    for (unsigned i = 0; i < n; i++) {
+        h->_undo[h->_nundo++] = addr + i;
+        h->_undo[h->_nundo++] = read_data(pmach, addr + i);
+    }
+    if (n == 0)
+        return;
+    unsigned last = (addr + n - 1) >> MEMORY_PAGE_BITS;
+    for (unsigned page = addr >> MEMORY_PAGE_BITS; page <= last; page++)
+        if (!((h->_saved[page / 64] >> (page % 64)) & 1))
+            save_page(pmach, page);
+}
+
+unsigned long long history_first(Machine *pmach) {
+    return pmach->_history->_snapshots[0]._retired;
+}
+
+bool history_goto(Machine *pmach, unsigned long long n) {
+    History *h = pmach->_history;
+    if (n < history_first(pmach))
+        return false;
+    if (n >= pmach->_retired)
+        return replay(pmach, n, NULL, 0, NULL);
+    if (n >= h->_snapshots[h->_nsnapshots - 1]._retired) {
+        // Dans l'intervalle courant : le journal suffit
+        while (pmach->_retired > n)
+            undo_one(pmach);
+        return true;
+    }
+    unsigned s = h->_nsnapshots - 1;
+    while (h->_snapshots[s]._retired > n)
+        s--;
+    restore(pmach, s);
+    return replay(pmach, n, NULL, 0, NULL);
+}
+
+bool history_reverse(Machine *pmach, bool (*stop)(Machine *pmach)) {
+    History *h = pmach->_history;
+    unsigned long long before = pmach->_retired, end = before, found = 0;
+    // Intervalles en remontant : ré-exécution de chacun, dernier arrêt retenu
+    for (unsigned s = h->_nsnapshots; s-- > 0 && found == 0; ) {
+        unsigned long long start = h->_snapshots[s]._retired;
+        if (start >= end)
+            continue;
+        history_goto(pmach, start);
+        replay(pmach, end, stop, before, &found);
+        end = start;
+    }
+    history_goto(pmach, found != 0 ? found : history_first(pmach));
+    return found != 0;
+}
+
+void history_print(Machine *pmach) {
+    History *h = pmach->_history;
+    if (h == NULL) {
+        printf("Enregistrement inactif\n");
+        return;
+    }
+    printf("Enregistrement : instructions %llu à %llu, %u instantanés (intervalle %llu), "
+           "%zu Kio sur %zu\n", history_first(pmach), pmach->_retired, h->_nsnapshots,
+           h->_interval, history_used(h) >> 10, h->_budget >> 10);
+}
@@ -0,0 +1,187 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+/*!
+ * \file history.h
+ * \brief Enregistrement de l'exécution et retour arrière (débogage temporel).
+ *
+ * En mode enregistrement (\c Machine::_history non NULL), la simulation
+ * conserve :
+ *
+ *   - des <b>instantanés</b> pris toutes les \a N instructions : l'état du
+ *   processeur et, pour chaque page de données modifiée pendant l'intervalle
+ *   qui suit, son contenu au moment de l'instantané (copie à la première
+ *   écriture dans la page) ;
+ *   - un <b>journal d'annulation</b> de l'intervalle courant : pour chaque
+ *   instruction, \c _pc, \c _cc, l'ancienne valeur du seul registre modifié
+ *   (registre de l'instruction ou \c SP) et l'ancienne valeur de chaque mot
+ *   écrit. Un enregistrement sans écriture tient en 3 à 5 mots.
+ *
+ * Revenir à l'instruction numéro \a n dans l'intervalle courant dépile le
+ * journal ; plus loin, on restaure l'instantané qui précède \a n en appliquant
+ * les images des pages des intervalles plus récents, puis on ré-exécute au
+ * plus \a N instructions. Le retour arrière jusqu'au point d'arrêt ou de
+ * surveillance précédent ré-exécute les intervalles un à un en remontant, soit
+ * au plus deux intervalles par intervalle parcouru. Pendant la ré-exécution,
+ * les modèles de cache et de pipeline, le profil des branchements, les
+ * greffons (dont memprof), la couverture et la détection des boucles sont
+ * détachés : ils ne comptent pas deux fois les mêmes instructions.
+ *
+ * La mémoire des instantanés et du journal est bornée par un budget : au-delà,
+ * un instantané est pris et les plus anciens sont abandonnés (l'historique
+ * accessible raccourcit). L'intervalle \a N règle le compromis entre coût de
+ * l'enregistrement (nombre d'images de pages) et coût du retour arrière.
+ *
+ * Pendant l'enregistrement, une erreur d'exécution (voir error.h) ne termine
+ * plus le simulateur : l'instruction fautive est annulée et le débogueur prend
+ * la main, ce qui permet de remonter vers l'origine de la faute.
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Intervalle par défaut entre deux instantanés (en instructions)
+#define HISTORY_INTERVAL 4096
+
+//! Budget mémoire par défaut (en octets)
+#define HISTORY_BUDGET (64u << 20)
+
+//! Instantané : état au début d'un intervalle
+typedef struct
+{
+    unsigned long long _retired;	//!< Numéro de l'instruction suivante
+    unsigned _pc;			//!< Compteur ordinal
+    Condition_Code _cc;			//!< Code condition
+    Word _registers[NREGISTERS];	//!< Registres
+    unsigned *_pages;			//!< Pages modifiées pendant l'intervalle
+    Word *_images;			//!< Leur contenu au début de l'intervalle
+    unsigned _npages;			//!< Nombre de pages sauvegardées
+    unsigned _cappages;			//!< Capacité des deux tableaux
+} Snapshot;
+
+//! Historique d'exécution d'une machine
+typedef struct History
+{
+    unsigned long long _interval;	//!< Instructions entre deux instantanés
+    size_t _budget;			//!< Budget mémoire (octets)
+    size_t _used;			//!< Mémoire des images de pages (octets)
+    Snapshot *_snapshots;		//!< Instantanés, du plus ancien au plus récent
+    unsigned _nsnapshots;		//!< Nombre d'instantanés
+    unsigned _capsnapshots;		//!< Capacité du tableau
+    uint64_t *_saved;			//!< Pages déjà sauvegardées dans l'intervalle courant
+    Word *_undo;			//!< Journal d'annulation de l'intervalle courant
+    size_t _nundo;			//!< Nombre de mots du journal
+    size_t _capundo;			//!< Capacité du journal
+
+    // Instruction en cours (entre history_begin() et history_end())
+    bool _pending;			//!< Une instruction est en cours
+    unsigned _pend_pc;			//!< Son adresse
+    Condition_Code _pend_cc;		//!< Code condition avant l'instruction
+    unsigned _pend_reg;			//!< Registre de l'instruction
+    Word _pend_value;			//!< Sa valeur avant l'instruction
+    Word _pend_sp;			//!< SP avant l'instruction
+    size_t _pend_mark;			//!< Début de ses écritures dans le journal
+} History;
+
+//! Démarrage de l'enregistrement
+/*!
+ * Un premier instantané est pris immédiatement. Sans effet si
+ * l'enregistrement est déjà actif.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param interval instructions entre deux instantanés (0 : valeur par défaut)
+ * \param budget mémoire maximale en octets (0 : valeur par défaut)
+ */
+void history_open(Machine *pmach, unsigned long long interval, size_t budget);
+
+//! Arrêt de l'enregistrement et libération de l'historique
+/*!
+ * \param pmach la machine
+ */
+void history_close(Machine *pmach);
+
+//! Reprise de simul() sur erreur d'exécution
+/*!
+ * simul() désigne par cette fonction le point de reprise (\c setjmp) auquel
+ * revient une erreur d'exécution pendant l'enregistrement.
+ *
+ * \param pmach la machine simulée
+ * \param target le point de reprise (NULL en fin de simulation)
+ */
+void history_catch(Machine *pmach, jmp_buf *target);
+
+//! Traitement d'une erreur d'exécution pendant l'enregistrement
+/*!
+ * Annule l'instruction fautive et entre dans le débogueur.
+ *
+ * \param pmach la machine
+ * \return faux si l'utilisateur abandonne la mise au point
+ */
+bool history_fault(Machine *pmach);
+
+//! Début d'une instruction enregistrée (avant son exécution)
+/*!
+ * \param pmach la machine
+ */
+void history_begin(Machine *pmach);
+
+//! Fin d'une instruction enregistrée (après incrément de \c _retired)
+/*!
+ * Empile l'enregistrement d'annulation et prend un instantané si
+ * l'intervalle est écoulé ou le budget dépassé.
+ *
+ * \param pmach la machine
+ */
+void history_end(Machine *pmach);
+
+//! Écriture de n mots de données (avant l'écriture)
+/*!
+ * Appelée par exec.c quand \c Machine::_history n'est pas NULL.
+ *
+ * \param pmach la machine
+ * \param addr la première adresse écrite
+ * \param n le nombre de mots
+ */
+void history_write(Machine *pmach, unsigned addr, unsigned n);
+
+//! Première instruction encore accessible dans l'historique
+/*!
+ * \param pmach la machine (enregistrement actif)
+ * \return le numéro de l'instruction du plus ancien instantané
+ */
+unsigned long long history_first(Machine *pmach);
+
+//! Retour (ou avance) à l'état précédant l'instruction numéro n
+/*!
+ * L'avance ré-exécute le programme et s'arrête avant un \c HALT.
+ *
+ * \param pmach la machine (enregistrement actif)
+ * \param n le numéro d'instruction visé (nombre d'instructions exécutées)
+ * \return faux si \a n n'est plus (ou pas) accessible
+ */
+bool history_goto(Machine *pmach, unsigned long long n);
+
+//! Retour au dernier arrêt antérieur
+/*!
+ * Remonte jusqu'au dernier état antérieur à l'état courant pour lequel
+ * \a stop est vrai (appelé après chaque instruction ré-exécutée, les points
+ * de surveillance déclenchés étant notés dans \c Machine::_watch). À défaut,
+ * la machine est ramenée au début de l'historique.
+ *
+ * \param pmach la machine (enregistrement actif)
+ * \param stop le prédicat d'arrêt
+ * \return vrai si un arrêt a été trouvé
+ */
+bool history_reverse(Machine *pmach, bool (*stop)(Machine *pmach));
+
+//! Affichage de l'état de l'enregistrement
+/*!
+ * \param pmach la machine
+ */
+void history_print(Machine *pmach);
+
+#endif
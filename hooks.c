@@ -0,0 +1,117 @@
+/*!
+ * \file hooks.c
+ * \brief Interface d'instrumentation : greffons appelés pendant l'exécution.
+ */
+
+#include "hooks.h"
+#include <stdlib.h>
+
+//! Machine prévenue des erreurs fatales (la dernière instrumentée)
+static Machine *fault_machine = NULL;
+
+#ifndef NO_HOOKS
+//! Transmission d'une erreur fatale aux greffons
+static void on_error(Error err, unsigned addr) {
+    if (fault_machine != NULL && fault_machine->_hooks != NULL)
+        hooks_event(fault_machine, HOOK_FAULT, addr, err, 0);
+}
+#endif
+
+//! Événements observés par un greffon
+static unsigned plugin_mask(const Hook_Plugin *p) {
+    return (p->_retire != NULL) << HOOK_RETIRE
+        | (p->_read != NULL) << HOOK_READ
+        | (p->_write != NULL) << HOOK_WRITE
+        | (p->_branch != NULL) << HOOK_BRANCH
+        | (p->_call != NULL) << HOOK_CALL
+        | (p->_return != NULL) << HOOK_RETURN
+        | (p->_fault != NULL) << HOOK_FAULT;
+}
+
+bool hooks_register(Machine *pmach, const Hook_Plugin *plugin) {
+#ifdef NO_HOOKS
+    return false;
+#else
+    Hooks *h = pmach->_hooks;
+    if (h == NULL)
+        h = calloc(1, sizeof(Hooks));
+    for (unsigned i = 0; i < h->_nplugins; i++)
+        if (h->_plugins[i] == plugin)
+            return false;
+    if (h->_nplugins == HOOKS_MAX)
+        return false;
+    h->_plugins[h->_nplugins++] = plugin;
+    h->_mask |= plugin_mask(plugin);
+    pmach->_hooks = h;
+    fault_machine = pmach;
+    set_error_observer(on_error);
+    return true;
+#endif
+}
+
+bool hooks_unregister(Machine *pmach, const Hook_Plugin *plugin) {
+    Hooks *h = pmach->_hooks;
+    if (h == NULL)
+        return false;
+    unsigned i = 0;
+    while (i < h->_nplugins && h->_plugins[i] != plugin)
+        i++;
+    if (i == h->_nplugins)
+        return false;
+    h->_nplugins--;
+    h->_mask = 0;
+    for (unsigned k = 0; k < h->_nplugins; k++) {
+        if (k >= i)
+            h->_plugins[k] = h->_plugins[k + 1];
+        h->_mask |= plugin_mask(h->_plugins[k]);
+    }
+    if (h->_nplugins == 0)
+        hooks_close(pmach);
+    return true;
+}
+
+void hooks_close(Machine *pmach) {
+    free(pmach->_hooks);
+    pmach->_hooks = NULL;
+    if (fault_machine == pmach) {
+        fault_machine = NULL;
+        set_error_observer(NULL);
+    }
+}
+
+void hooks_dispatch(Machine *pmach, Hook_Kind kind, unsigned pc, unsigned a1, unsigned a2) {
+    const Hooks *h = pmach->_hooks;
+    for (unsigned i = 0; i < h->_nplugins; i++) {
+        const Hook_Plugin *p = h->_plugins[i];
+        switch (kind) {
+        case HOOK_RETIRE:
+            if (p->_retire != NULL)
+                p->_retire(pmach, p->_data, pc, pmach->_text[pc]);
+            break;
+        case HOOK_READ:
+            if (p->_read != NULL)
+                p->_read(pmach, p->_data, pc, a1, a2);
+            break;
+        case HOOK_WRITE:
+            if (p->_write != NULL)
+                p->_write(pmach, p->_data, pc, a1, a2);
+            break;
+        case HOOK_BRANCH:
+            if (p->_branch != NULL)
+                p->_branch(pmach, p->_data, pc, a1);
+            break;
+        case HOOK_CALL:
+            if (p->_call != NULL)
+                p->_call(pmach, p->_data, pc, a1);
+            break;
+        case HOOK_RETURN:
+            if (p->_return != NULL)
+                p->_return(pmach, p->_data, pc, a1);
+            break;
+        case HOOK_FAULT:
+            if (p->_fault != NULL)
+                p->_fault(pmach, p->_data, pc, a1);
+            break;
+        }
+    }
+}
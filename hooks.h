@@ -0,0 +1,139 @@
+#ifndef _HOOKS_H_
+#define _HOOKS_H_
+
+/*!
+ * \file hooks.h
+ * \brief Interface d'instrumentation : greffons appelés pendant l'exécution.
+ *
+ * Un greffon (\link Hook_Plugin \endlink) fournit des fonctions de rappel
+ * pour tout ou partie des événements suivants :
+ *
+ *   - \c _retire : une instruction vient d'être exécutée (y compris \c HALT) ;
+ *
+ *   - \c _read et \c _write : une instruction lit ou écrit \a n mots de
+ *   données à partir de \a addr (lecture avant, écriture après l'accès :
+ *   la mémoire contient les valeurs concernées) ;
+ *
+ *   - \c _branch, \c _call et \c _return : transfert de contrôle effectif
+ *   (\c BRANCH ou \c CALL pris, \c RET) vers \a target ;
+ *
+ *   - \c _fault : erreur d'exécution fatale, avant la reprise ou la fin du
+ *   simulateur (voir set_error_observer()).
+ *
+ * Chaque rappel reçoit la machine, la donnée privée du greffon et l'adresse
+ * (\a pc) de l'instruction en cause. Plusieurs greffons peuvent être inscrits
+ * à la fois (au plus \c HOOKS_MAX) ; ils sont appelés dans l'ordre
+ * d'inscription.
+ *
+ * Les appels sont faits par les fonctions d'accès aux données de exec.c et
+ * par simul(), sans modifier les traitements des instructions de
+ * decode_execute(). Sans greffon inscrit, \c Machine::_hooks est NULL et
+ * chaque point d'appel se réduit à ce test ; compilé avec \c -DNO_HOOKS,
+ * \c HOOKS_ACTIVE() est constamment faux, les points d'appel disparaissent
+ * et hooks_register() échoue.
+ */
+
+#include <stdbool.h>
+
+#include "machine.h"
+#include "error.h"
+
+//! Nombre maximal de greffons inscrits
+#define HOOKS_MAX 8
+
+//! Événements observables (numéros de bit de \c Hooks::_mask)
+typedef enum
+{
+    HOOK_RETIRE = 0,	//!< Instruction exécutée
+    HOOK_READ,		//!< Lecture de données
+    HOOK_WRITE,		//!< Écriture de données
+    HOOK_BRANCH,	//!< BRANCH pris
+    HOOK_CALL,		//!< CALL pris
+    HOOK_RETURN,	//!< RET
+    HOOK_FAULT,		//!< Erreur d'exécution
+} Hook_Kind;
+
+//! Greffon d'instrumentation
+/*!
+ * Les rappels inutiles sont à NULL. Le greffon reste la propriété de
+ * l'appelant et doit rester valide tant qu'il est inscrit.
+ */
+typedef struct
+{
+    const char *_name;		//!< Nom du greffon
+    void *_data;		//!< Donnée privée passée à chaque rappel
+    void (*_retire)(Machine *pmach, void *data, unsigned pc, Instruction instr);
+    void (*_read)(Machine *pmach, void *data, unsigned pc, unsigned addr, unsigned n);
+    void (*_write)(Machine *pmach, void *data, unsigned pc, unsigned addr, unsigned n);
+    void (*_branch)(Machine *pmach, void *data, unsigned pc, unsigned target);
+    void (*_call)(Machine *pmach, void *data, unsigned pc, unsigned target);
+    void (*_return)(Machine *pmach, void *data, unsigned pc, unsigned target);
+    void (*_fault)(Machine *pmach, void *data, unsigned pc, Error err);
+} Hook_Plugin;
+
+//! Greffons inscrits sur une machine
+typedef struct Hooks
+{
+    unsigned _nplugins;				//!< Nombre de greffons
+    const Hook_Plugin *_plugins[HOOKS_MAX];	//!< Greffons dans l'ordre d'inscription
+    unsigned _mask;				//!< Événements observés par au moins un greffon
+} Hooks;
+
+//! Des greffons sont-ils inscrits ?
+#ifdef NO_HOOKS
+#   define HOOKS_ACTIVE(pmach) false
+#else
+#   define HOOKS_ACTIVE(pmach) ((pmach)->_hooks != NULL)
+#endif
+
+//! Inscription d'un greffon
+/*!
+ * \param pmach la machine
+ * \param plugin le greffon
+ * \return faux s'il y a déjà \c HOOKS_MAX greffons, si le greffon est déjà
+ * inscrit ou si l'instrumentation est exclue de la compilation
+ */
+bool hooks_register(Machine *pmach, const Hook_Plugin *plugin);
+
+//! Retrait d'un greffon
+/*!
+ * Le dernier retrait remet \c Machine::_hooks à NULL.
+ *
+ * \param pmach la machine
+ * \param plugin le greffon
+ * \return faux s'il n'était pas inscrit
+ */
+bool hooks_unregister(Machine *pmach, const Hook_Plugin *plugin);
+
+//! Retrait de tous les greffons
+/*!
+ * \param pmach la machine
+ */
+void hooks_close(Machine *pmach);
+
+//! Appel des greffons pour un événement
+/*!
+ * \param pmach la machine (greffons inscrits)
+ * \param kind l'événement
+ * \param pc l'adresse de l'instruction
+ * \param a1 premier opérande : adresse des données, cible ou erreur (\c HOOK_FAULT)
+ * \param a2 second opérande : nombre de mots (\c HOOK_READ, \c HOOK_WRITE)
+ */
+void hooks_dispatch(Machine *pmach, Hook_Kind kind, unsigned pc, unsigned a1, unsigned a2);
+
+//! Appel des greffons si l'un d'eux observe l'événement
+/*!
+ * Test d'un bit par point d'appel quand aucun greffon n'observe l'événement.
+ *
+ * \param pmach la machine (greffons inscrits)
+ * \param kind l'événement
+ * \param pc l'adresse de l'instruction
+ * \param a1 premier opérande : adresse des données, cible ou erreur (\c HOOK_FAULT)
+ * \param a2 second opérande : nombre de mots (\c HOOK_READ, \c HOOK_WRITE)
+ */
+static inline void hooks_event(Machine *pmach, Hook_Kind kind, unsigned pc, unsigned a1, unsigned a2) {
+    if (pmach->_hooks->_mask & (1u << kind))
+        hooks_dispatch(pmach, kind, pc, a1, a2);
+}
+
+#endif
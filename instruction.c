@@ -9,7 +9,8 @@
 #include "instruction.h"
 
 //! Forme imprimable des codes operations
-const char* cop_names[] = { "ILLOP", "NOP", "LOAD", "STORE", "ADD", "SUB", "BRANCH", "CALL", "RET", "PUSH", "POP", "HALT" };
+const char* cop_names[] = { "ILLOP", "NOP", "LOAD", "STORE", "ADD", "SUB", "BRANCH", "CALL", "RET", "PUSH", "POP", "HALT",
+                            "BMOVE", "BFILL", "BCMP", "MUL", "DIV", "MOD", "AND", "OR", "XOR", "SHL", "SHR", "SAR" };
 
 //! Forme imprimable des conditions
 const char* condition_names[] = { "NC", "EQ", "NE", "GT", "GE", "LT", "LE" };
@@ -46,6 +47,10 @@ void print_operande(Instruction instr) {
 void print_instruction(Instruction instr, unsigned addr) {
     //affiche le nom de l'opération en utilisant le code opération de l'instruction pour le réccupérer dans
     //le tableau cop_names
+    if (instr.instr_generic._cop > LAST_COP) {
+        printf("??? (cop %d)", instr.instr_generic._cop);
+        return;
+    }
     printf("%s ", cop_names[instr.instr_generic._cop]);
     int reg = instr.instr_generic._regcond;
 
@@ -62,6 +67,15 @@ void print_instruction(Instruction instr, unsigned addr) {
         case STORE:
         case ADD:
         case SUB:
+        case MUL:
+        case DIV:
+        case MOD:
+        case AND:
+        case OR:
+        case XOR:
+        case SHL:
+        case SHR:
+        case SAR:
             //affiche registre d'instr sous forme intelligible.
             printf("R%02d, ", reg);
             //appel de print_operande
@@ -82,5 +96,48 @@ void print_instruction(Instruction instr, unsigned addr) {
             //appel de print_operande
             print_operande(instr);
             break;
+
+        //Operations sur des blocs : longueur, destination, source
+        case BMOVE:
+        case BFILL:
+        case BCMP:
+            printf("R%02d, ", reg);
+            if (instr.instr_generic._indexed)
+                printf("%+d[R%02d]", instr.instr_block._offset, instr.instr_block._rindex);
+            else
+                printf("@%04x", instr.instr_block._offset & 0xfff);
+            printf(", R%02d", instr.instr_block._rsource);
+            break;
+    }
+}
+
+//! Pré-décodage d'une instruction
+/*!
+ * \param instr l'instruction a décoder
+ * \return la forme pré-décodée de l'instruction
+ */
+Decoded_Instruction decode_instruction(Instruction instr) {
+    Decoded_Instruction d;
+    d._cop = instr.instr_generic._cop;
+    d._regcond = instr.instr_generic._regcond;
+    d._flags = 0;
+    d._rindex = 0;
+    d._rsource = 0;
+    d._pad[0] = d._pad[1] = d._pad[2] = 0;
+    if (d._cop == BMOVE || d._cop == BFILL || d._cop == BCMP) {
+        d._flags = instr.instr_generic._indexed ? DECODED_INDEXED : 0;
+        d._rindex = instr.instr_block._rindex;
+        d._rsource = instr.instr_block._rsource;
+        d._operand = instr.instr_block._offset;
+    } else if (instr.instr_generic._immediate) {
+        d._flags |= DECODED_IMMEDIATE;
+        d._operand = instr.instr_immediate._value;
+    } else if (instr.instr_generic._indexed) {
+        d._flags |= DECODED_INDEXED;
+        d._rindex = instr.instr_indexed._rindex;
+        d._operand = instr.instr_indexed._offset;
+    } else {
+        d._operand = instr.instr_absolute._address;
     }
+    return d;
 }
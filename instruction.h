@@ -24,10 +24,22 @@ typedef enum
     PUSH,	//!< Empilement sur la pile d'exécution 
     POP,	//!< Dépilement de la pile d'exécution
     HALT,	//!< Arrêt (normal) du programme
+    BMOVE,	//!< Copie d'un bloc de mots
+    BFILL,	//!< Remplissage d'un bloc de mots
+    BCMP,	//!< Comparaison de deux blocs de mots
+    MUL,	//!< Multiplication d'un registre
+    DIV,	//!< Division (entière, signée) d'un registre
+    MOD,	//!< Reste de la division (signée) d'un registre
+    AND,	//!< Et bit à bit
+    OR,		//!< Ou bit à bit
+    XOR,	//!< Ou exclusif bit à bit
+    SHL,	//!< Décalage à gauche
+    SHR,	//!< Décalage logique à droite
+    SAR,	//!< Décalage arithmétique à droite
 } Code_Op;
 
 //! Dernière valeur possible du code opération
-const static unsigned LAST_COP = HALT;
+const static unsigned LAST_COP = SAR;
 
 
 //! Structure d'une instruction 
@@ -95,6 +107,25 @@ typedef union Instruction
         signed int _offset : 16;//!< Déplacement
     } instr_indexed;
 
+    //! Format d'une instruction de bloc (\c BMOVE, \c BFILL, \c BCMP)
+    /*!
+     * Le bloc destination commence à l'adresse <tt>(R[_rindex]) + _offset</tt>
+     * si l'adressage est indexé, à l'adresse \c _offset (lue sur 12 bits non
+     * signés) sinon ; sa longueur (en mots) est dans le registre \c _regcond. Le registre \c _rsource
+     * contient l'adresse du bloc source (\c BMOVE, \c BCMP) ou la valeur de
+     * remplissage (\c BFILL).
+     */
+    struct
+    {
+        Code_Op _cop : 6; 	//!< Code opération
+        bool _immediate : 1;	//!< Adressage immédiat ? (interdit)
+        bool _indexed : 1;	//!< Adressage indirect ?
+        unsigned _regcond : 4;	//!< Registre contenant la longueur
+        unsigned _rindex : 4;   //!< Numéro du registre d'index de la destination
+        unsigned _rsource : 4;  //!< Registre source (adresse ou valeur)
+        signed int _offset : 12;//!< Déplacement de la destination
+    } instr_block;
+
 } Instruction;
 
 //! Conditions
@@ -123,6 +154,30 @@ static const unsigned LAST_CONDITION = LE;
 //! Type d'un mot de donnée
 typedef uint32_t Word;
 
+//! Instruction pré-décodée
+/*!
+ * Forme « à plat » d'une instruction où les champs de bits ont déjà été
+ * extraits. L'opérande unique \c _operand contient la valeur immédiate
+ * (étendue en signe), l'adresse absolue ou le déplacement selon le mode
+ * d'adressage. Un tableau de telles instructions peut être précalculé et
+ * stocké dans un fichier binaire sectionné (voir binfile.h).
+ */
+typedef struct
+{
+    uint8_t _cop;		//!< Code opération
+    uint8_t _flags;		//!< \c DECODED_IMMEDIATE et/ou \c DECODED_INDEXED
+    uint8_t _regcond;		//!< Numéro de registre ou condition
+    uint8_t _rindex;		//!< Numéro du registre d'index (adressage indexé)
+    uint8_t _rsource;		//!< Registre source (instructions de bloc)
+    uint8_t _pad[3];		//!< Inutilisé (0)
+    int32_t _operand;		//!< Valeur, adresse ou déplacement
+} Decoded_Instruction;
+
+//! Drapeau d'adressage immédiat d'une instruction pré-décodée
+#define DECODED_IMMEDIATE 0x1
+//! Drapeau d'adressage indexé d'une instruction pré-décodée
+#define DECODED_INDEXED 0x2
+
 //! Forme imprimable des codes opérations
 extern const char *cop_names[];
 
@@ -136,4 +191,11 @@ extern const char *condition_names[];
  */
 void print_instruction(Instruction instr, unsigned addr);
 
+//! Pré-décodage d'une instruction
+/*!
+ * \param instr l'instruction à décoder
+ * \return la forme pré-décodée de l'instruction
+ */
+Decoded_Instruction decode_instruction(Instruction instr);
+
 #endif
@@ -0,0 +1,96 @@
+/*!
+ * \file loopcheck.c
+ * \brief Détection des boucles infinies par hachage de l'état de la machine.
+ */
+
+#include "loopcheck.h"
+#include "error.h"
+#include "memory.h"
+#include <stdlib.h>
+
+//! Constantes de mélange des deux moitiés de l'empreinte
+static const uint64_t lane_seeds[2] = { 0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full };
+
+//! Mélange d'une valeur de 64 bits (finaliseur de splitmix64)
+static inline uint64_t mix(uint64_t x, uint64_t seed) {
+    x += seed;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+//! Terme d'un mot dans l'empreinte (nul pour un mot nul)
+static inline uint64_t term(unsigned addr, Word value, int lane) {
+    return value == 0 ? 0 : mix((uint64_t)addr << 32 | (uint32_t)value, lane_seeds[lane]);
+}
+
+void loopcheck_open(Machine *pmach) {
+    if (pmach->_loopcheck != NULL)
+        return;
+    pmach->_loopcheck = calloc(1, sizeof(Loop_Check));
+    loopcheck_reset(pmach);
+}
+
+void loopcheck_close(Machine *pmach) {
+    free(pmach->_loopcheck);
+    pmach->_loopcheck = NULL;
+}
+
+void loopcheck_reset(Machine *pmach) {
+    Loop_Check *lc = pmach->_loopcheck;
+    static Word frame[MEMORY_PAGE];
+    lc->_memory[0] = lc->_memory[1] = 0;
+    unsigned npages = (pmach->_datasize + MEMORY_PAGE - 1) >> MEMORY_PAGE_BITS;
+    for (unsigned page = 0; page < npages; page++) {
+        if (!memory_page_present(pmach, page)) // page absente : que des zéros
+            continue;
+        unsigned first = page << MEMORY_PAGE_BITS;
+        unsigned n = pmach->_datasize - first < MEMORY_PAGE ? pmach->_datasize - first : MEMORY_PAGE;
+        read_block(pmach, first, frame, n);
+        for (unsigned i = 0; i < n; i++)
+            if (frame[i] != 0) {
+                lc->_memory[0] += term(first + i, frame[i], 0);
+                lc->_memory[1] += term(first + i, frame[i], 1);
+            }
+    }
+    lc->_valid = false;
+    lc->_power = 1;
+    lc->_count = 0;
+}
+
+void loopcheck_data(Machine *pmach, unsigned addr, unsigned n, bool add) {
+    Loop_Check *lc = pmach->_loopcheck;
+    for (unsigned i = 0; i < n; i++) {
+        Word value = read_data(pmach, addr + i);
+        if (value == 0)
+            continue;
+        if (add) {
+            lc->_memory[0] += term(addr + i, value, 0);
+            lc->_memory[1] += term(addr + i, value, 1);
+        } else {
+            lc->_memory[0] -= term(addr + i, value, 0);
+            lc->_memory[1] -= term(addr + i, value, 1);
+        }
+    }
+}
+
+void loopcheck_branch(Machine *pmach, unsigned addr) {
+    Loop_Check *lc = pmach->_loopcheck;
+    uint64_t h[2];
+    for (int lane = 0; lane < 2; lane++) {
+        uint64_t x = mix(lc->_memory[lane] ^ ((uint64_t)pmach->_pc << 2 | pmach->_cc), lane_seeds[lane]);
+        for (unsigned r = 0; r < NREGISTERS; r++)
+            x = mix(x ^ (uint32_t)pmach->_registers[r], lane_seeds[lane]);
+        h[lane] = x;
+    }
+    if (lc->_valid && h[0] == lc->_saved[0] && h[1] == lc->_saved[1])
+        error(ERR_LOOP, addr);
+    // Algorithme de Brent : nouvel échantillon après 1, 2, 4... comparaisons
+    if (!lc->_valid || ++lc->_count == lc->_power) {
+        lc->_saved[0] = h[0];
+        lc->_saved[1] = h[1];
+        lc->_valid = true;
+        lc->_power *= 2;
+        lc->_count = 0;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef _LOOPCHECK_H_
+#define _LOOPCHECK_H_
+
+/*!
+ * \file loopcheck.h
+ * \brief Détection des boucles infinies par hachage de l'état de la machine.
+ *
+ * Quand la détection est active (\c Machine::_loopcheck non NULL), la machine
+ * entretient une empreinte de 128 bits de son segment de données : la somme,
+ * pour chaque mot non nul, d'un mélange de son adresse et de sa valeur. Chaque
+ * écriture par une instruction (exec.c) retranche le terme de l'ancienne
+ * valeur et ajoute celui de la nouvelle ; le coût ne dépend donc pas de la
+ * taille du segment.
+ *
+ * À chaque branchement arrière pris (\c BRANCH, \c CALL ou \c RET vers une
+ * adresse inférieure ou égale ; toute boucle en contient un), l'empreinte est complétée par \c pc, \c cc et les
+ * registres (dont \c SP) et comparée à un échantillon conservé, renouvelé
+ * selon l'algorithme de Brent (après 1, 2, 4, 8... échantillons). La machine
+ * étant déterministe et sans entrée, retrouver exactement un état déjà vu
+ * prouve que le programme ne s'arrêtera jamais (à une collision de 2^-128
+ * près) : l'exécution se termine sur l'erreur \c ERR_LOOP. Un cycle de
+ * \a L branchements arrière commençant après \a M est détecté au plus tard
+ * après environ 2(\a M + \a L) branchements arrière.
+ *
+ * Une boucle dont l'état progresse (compteur qui croît sans fin) n'est pas
+ * détectée. Toute modification de l'état hors des instructions (débogueur,
+ * retour arrière, client GDB) doit être suivie de loopcheck_reset().
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! État du détecteur
+typedef struct Loop_Check
+{
+    uint64_t _memory[2];	//!< Empreinte du segment de données
+    uint64_t _saved[2];		//!< Empreinte de l'échantillon conservé
+    bool _valid;		//!< Un échantillon est conservé
+    unsigned long long _power;	//!< Échantillons avant renouvellement (puissance de 2)
+    unsigned long long _count;	//!< Échantillons depuis le dernier renouvellement
+} Loop_Check;
+
+//! Activation de la détection (sans effet si elle est déjà active)
+/*!
+ * \param pmach la machine (programme chargé)
+ */
+void loopcheck_open(Machine *pmach);
+
+//! Désactivation de la détection
+/*!
+ * \param pmach la machine
+ */
+void loopcheck_close(Machine *pmach);
+
+//! Recalcul de l'empreinte et oubli de l'échantillon conservé
+/*!
+ * \param pmach la machine (détection active)
+ */
+void loopcheck_reset(Machine *pmach);
+
+//! Écriture de n mots de données
+/*!
+ * Appelée par exec.c quand \c Machine::_loopcheck n'est pas NULL, avant
+ * l'écriture (\a add faux) puis après (\a add vrai).
+ *
+ * \param pmach la machine
+ * \param addr la première adresse écrite
+ * \param n le nombre de mots
+ * \param add ajout (vrai) ou retrait (faux) des termes des mots
+ */
+void loopcheck_data(Machine *pmach, unsigned addr, unsigned n, bool add);
+
+//! Échantillon sur un branchement ou un retour arrière (après mise à jour de \c pc)
+/*!
+ * Termine l'exécution par error(ERR_LOOP, \a addr) si l'état a déjà été vu.
+ *
+ * \param pmach la machine
+ * \param addr adresse du branchement
+ */
+void loopcheck_branch(Machine *pmach, unsigned addr);
+
+#endif
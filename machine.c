@@ -3,15 +3,41 @@
  * \brief Description de la structure du processeur et de sa mémoire
  */
 
+#define _POSIX_C_SOURCE 200809L  // pread(), mmap()
+
 #include "machine.h"
 #include "exec.h"
 #include "debug.h"
 #include "error.h"
+#include "binfile.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "region.h"
+#include "watch.h"
+#include "history.h"
+#include "gdbstub.h"
+#include "loopcheck.h"
+#include "cache.h"
+#include "timing.h"
+#include "branchprof.h"
+#include "hooks.h"
+#include "metrics.h"
+#include "sampler.h"
+#include "memprof.h"
+#include "telemetry.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Format du fichier dump.prog (voir set_dump_format)
+static Program_Format dump_format = FORMAT_RAW;
 
 //! Load Program
 /*! 
@@ -32,70 +58,133 @@ void load_program(Machine *pmach,
     pmach->_dataend=dataend;
     pmach->_text=text;
     pmach->_data=data;
+    pmach->_memory=NULL;
+    pmach->_regions=NULL;
     pmach->_cc=CC_U;
     pmach->_pc=0;
     pmach->_sp=datasize-1;
+
+    pmach->_symbols=NULL;
+    pmach->_nsymbols=0;
+    pmach->_decoded=NULL;
+
+    pmach->_retired=0;
+    pmach->_dirty=NULL;
+    pmach->_checkpoint=NULL;
+    pmach->_debugger=NULL;
+    pmach->_watch=NULL;
+    pmach->_history=NULL;
+    pmach->_gdb=NULL;
+    pmach->_loopcheck=NULL;
+    pmach->_cache=NULL;
+    pmach->_timing=NULL;
+    pmach->_branchprof=NULL;
+    pmach->_hooks=NULL;
+    pmach->_sampler=NULL;
+    pmach->_memprof=NULL;
+    pmach->_telemetry=NULL;
+    pmach->_coverage=NULL;
+    pmach->_prev_loc=0;
 }
 
 //! Read Program
 /*! 
- * Lis le fichier binaire "programfile" et initialise la machine en alouant correctement
- * les variables
+ * Projette le fichier binaire "programfile" en mémoire (mmap) et initialise la
+ * machine.
+ *
+ * L'en-tête est validé contre la taille réelle du fichier avant toute
+ * projection. Le segment de texte est utilisé sur place, en lecture seule ; le
+ * segment de données est une projection privée (copie sur écriture) : le
+ * fichier n'est jamais modifié et seules les pages effectivement touchées par
+ * le programme sont lues puis, le cas échéant, copiées. Le chargement se fait
+ * donc en temps constant quelle que soit la taille des segments.
  *
+ * Un fichier au format sectionné (voir binfile.h) est reconnu à son nombre
+ * magique et chargé par binfile_load().
  */
 void read_program(Machine *mach, const char *programfile) {
 
     int fd=open(programfile,O_RDONLY);
     if (fd<0) {
-        printf("Erreur lors de l'ouverture du fichier");
+        printf("Erreur lors de l'ouverture du fichier %s\n", programfile);
         exit(1);
     }
-    unsigned int textsize,datasize,dataend;
+    read_program_fd(mach,fd,programfile);
+}
 
-    int n = read(fd,&textsize,sizeof(Word));
-    if (n!=sizeof(Word)) {
-        printf("Erreur de lecture des bits");
+//! Read Program (descripteur déjà ouvert)
+/*!
+ * Corps de read_program() ; le descripteur est fermé après projection.
+ */
+void read_program_fd(Machine *mach, int fd, const char *programfile) {
+
+    metrics_from_env();
+    uint64_t start=metrics_now();
+    struct stat st;
+    if (fstat(fd,&st)<0) {
+        printf("Erreur lors de l'examen du fichier %s\n", programfile);
         exit(1);
     }
-    n = read(fd,&datasize,sizeof(Word));
-    if (n!=sizeof(Word)) {
-        printf("Erreur de lecture des bits");
+    size_t filesize=st.st_size;
+
+    // En-tête : textsize, datasize, dataend
+    Word header[3];
+    if (filesize<sizeof(header) || pread(fd,header,sizeof(header),0)!=sizeof(header)) {
+        printf("Erreur: en-tête du fichier %s tronqué\n", programfile);
         exit(1);
     }
-    n = read(fd,&dataend,sizeof(Word));
-    if (n!=sizeof(Word)) {
-        printf("Erreur de lecture des bits");
+
+    // Format sectionné ?
+    if (binfile_detect(header,sizeof(header))) {
+        binfile_load(mach,fd,filesize,programfile);
+        close(fd);
+        metrics_record(METRICS_LOAD,start);
+        return;
+    }
+    unsigned textsize=header[0], datasize=header[1], dataend=header[2];
+
+    // Validation de l'en-tête (calculs en 64 bits : pas de débordement possible)
+    uint64_t expected=sizeof(header)
+                     +(uint64_t)textsize*sizeof(Instruction)
+                     +(uint64_t)datasize*sizeof(Word);
+    if (expected>filesize) {
+        printf("Erreur: le fichier %s fait %zu octets, l'en-tête en annonce %llu\n",
+               programfile, filesize, (unsigned long long)expected);
+        exit(1);
+    }
+    if (dataend>datasize) {
+        printf("Erreur: dataend (%u) > datasize (%u) dans %s\n",
+               dataend, datasize, programfile);
         exit(1);
     }
-    mach->_textsize=textsize;
-    mach->_datasize=datasize;
-    mach->_dataend=dataend;
 
-    Instruction* instr = malloc(textsize*sizeof(Instruction));
-        n = read(fd,instr,textsize*sizeof(Instruction));
-        if (n!=textsize*sizeof(Instruction)) {
-            printf("erreur de lecture des bits");
+    // Texte : projection partagée en lecture seule, utilisée sur place
+    char *image=NULL;
+    if (textsize>0) {
+        image=mmap(NULL,expected,PROT_READ,MAP_SHARED,fd,0);
+        if (image==MAP_FAILED) {
+            printf("Erreur de projection du segment de texte\n");
             exit(1);
         }
+    }
 
-    Word* data = malloc(datasize*sizeof(Word));
-        n = read(fd,data,datasize*sizeof(Word));
-        if (n!=datasize*sizeof(Word)) {
-            printf("Erreur de lecture des bits");
+    // Données : projection privée en copie sur écriture
+    char *dimage=NULL;
+    if (datasize>0) {
+        dimage=mmap(NULL,expected,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+        if (dimage==MAP_FAILED) {
+            printf("Erreur de projection du segment de données\n");
             exit(1);
         }
-
-    //RaZ des registres
-    for(int i = 0 ; i < NREGISTERS ; i++)
-        mach->_registers[i] = 0;
-
-    mach->_text=instr;
-    mach->_data=data;
-    mach->_pc=0;
-    mach->_cc=CC_U;
-    mach->_sp=datasize-1;
+    }
+    // Les projections restent valides après la fermeture du descripteur
     close(fd);
 
+    Instruction *text=image?(Instruction *)(image+sizeof(header)):NULL;
+    Word *data=dimage?(Word *)(dimage+sizeof(header)+(size_t)textsize*sizeof(Instruction)):NULL;
+
+    load_program(mach,textsize,text,datasize,data,dataend);
+    metrics_record(METRICS_LOAD,start);
 }
 
 //! Dump memory
@@ -105,6 +194,7 @@ void read_program(Machine *mach, const char *programfile) {
  */
 void dump_memory(Machine *pmach) {
 
+    uint64_t start=metrics_now();
     printf("Instruction text[] = {\n");
     for(int i = 0 ; i < pmach->_textsize ; i++)
     {
@@ -122,7 +212,7 @@ void dump_memory(Machine *pmach) {
     //Affichage des données au format binaire:
     for(int i = 0 ; i < pmach->_datasize ; i++)
     {
-      printf("0x%08x, ", pmach->_data[i]);
+      printf("0x%08x, ", read_data(pmach, i));
       if (i % 4 == 3)
         printf("\n");
     }
@@ -132,14 +222,53 @@ void dump_memory(Machine *pmach) {
     printf("unsigned datasize = %d\n", pmach->_datasize);
     printf("unsigned dataend = %d\n", pmach->_dataend);
 
-    FILE* fd=fopen("dump.prog","w");
+    write_program(pmach,"dump.prog",dump_format);
+    metrics_record(METRICS_DUMP,start);
+}
+
+//! Set Dump Format
+/*!
+ * Choisit le format du fichier dump.prog écrit par dump_memory
+ */
+void set_dump_format(Program_Format format) {
+    dump_format=format;
+}
+
+//! Write Program
+/*!
+ * Écrit le programme dans un fichier binaire relisible par read_program
+ */
+void write_program(Machine *pmach, const char *programfile, Program_Format format) {
+    if (format==FORMAT_SECTIONED) {
+        binfile_write(pmach,programfile);
+        return;
+    }
+
+    // Écriture dans un fichier temporaire renommé à la fin : le fichier
+    // d'origine peut être celui du programme, encore projeté en mémoire
+    char *tmp=malloc(strlen(programfile)+5);
+    sprintf(tmp,"%s.tmp",programfile);
+    FILE* fd=fopen(tmp,"w");
+    if (fd==NULL) {
+        printf("Erreur lors de la création du fichier %s\n", programfile);
+        exit(1);
+    }
     fwrite(&pmach->_textsize,1,sizeof(pmach->_textsize),fd);
     fwrite(&pmach->_datasize,1,sizeof(pmach->_datasize),fd);
     fwrite(&pmach->_dataend,1,sizeof(pmach->_dataend),fd);
     fwrite(pmach->_text,pmach->_textsize,sizeof(Instruction),fd);
-    fwrite(pmach->_data,pmach->_datasize,sizeof(Word),fd);
-    fclose(fd);
-
+    // Données : par pages (la mémoire peut être paginée)
+    Word page[MEMORY_PAGE];
+    for (unsigned base=0; base<pmach->_datasize; base+=MEMORY_PAGE) {
+        unsigned n=pmach->_datasize-base<MEMORY_PAGE ? pmach->_datasize-base : MEMORY_PAGE;
+        read_block(pmach,base,page,n);
+        fwrite(page,n,sizeof(Word),fd);
+    }
+    if (fclose(fd)!=0 || rename(tmp,programfile)!=0) {
+        printf("Erreur lors de l'écriture du fichier %s\n", programfile);
+        exit(1);
+    }
+    free(tmp);
 }
 
 //! Print Program
@@ -153,10 +282,17 @@ void print_program(Machine *pmach) {
     printf("\n*** Impression du programme (instructions) (Textsize= %d) ***\n\n",pmach->_textsize);
     for(int i = 0 ; i < pmach->_textsize ; i++)
       {
+        //Affichage des étiquettes éventuelles
+        for (unsigned s = 0 ; s < pmach->_nsymbols ; s++)
+            if (pmach->_symbols[s]._text && pmach->_symbols[s]._address == i)
+                printf("%s:\n", pmach->_symbols[s]._name);
         //Affichage du code de l'instruction en hexadecimal
         printf("0x%04x: 0x%08x\t", i, pmach->_text[i]._raw);
         //Affichage de l'instruction
         print_instruction(pmach->_text[i],pmach->_text[i].instr_absolute._address);
+        //Annotation des branchements profilés
+        if (pmach->_branchprof != NULL)
+            branchprof_annotate(pmach, i);
         printf("\n");
       }
 }
@@ -170,7 +306,8 @@ void print_program(Machine *pmach) {
 void print_data(Machine *pmach) {
     printf("\n*** DATA Datasize= %d, end= 0x%08x (%d) ***\n\n",pmach->_datasize,pmach->_dataend,pmach->_dataend);
     for (int i=0;i<pmach->_datasize;i++) {
-        printf("0x%04x: 0x%08x %d \t",i,pmach->_data[i],pmach->_data[i]);
+        Word w=read_data(pmach,i);
+        printf("0x%04x: 0x%08x %d \t",i,w,w);
         if (i%3==0) printf("\n");
     }
     printf("\n");
@@ -214,9 +351,35 @@ void print_cpu(Machine *pmach) {
 /*! 
  * Methode principale qui va executer toutes les instructions
  * Si le mode debug est true, on va afficher les instructions une par une
+ * (voir debug.h pour les points d'arrêt et l'exécution jusqu'à un point donné,
+ * watch.h pour les points de surveillance des données, history.h pour
+ * l'enregistrement et le retour arrière, loopcheck.h pour la détection des
+ * boucles infinies, cache.h et timing.h pour les modèles de cache et de
+ * pipeline, branchprof.h pour le profil des branchements, dont le bilan est
+ * affiché à la fin, hooks.h pour les greffons d'instrumentation (dont le
+ * profil des accès aux données de memprof.h), sampler.h pour la simulation
+ * échantillonnée, checkpoint.h pour les points de reprise, memory.h et
+ * region.h pour la mémoire paginée et les régions projetées ; la durée
+ * et le nombre d'instructions vont aux métriques de metrics.h)
  *
  */
 void simul(Machine *pmach, bool debug) {
+    memory_from_env(pmach);
+    region_from_env(pmach);
+    if (debug)
+        debug_attach(pmach, true);
+    checkpoint_from_env(pmach);
+    telemetry_from_env(pmach);
+    uint64_t start = metrics_run_begin(pmach);
+    // Erreur pendant l'enregistrement : retour ici, avant l'instruction fautive
+    jmp_buf fault;
+    if (setjmp(fault) != 0) {
+        if (!history_fault(pmach))
+            exit(1);
+        if (pmach->_loopcheck != NULL)
+            loopcheck_reset(pmach);
+    }
+    history_catch(pmach, &fault);
     //Boucle sur les instructions
     while (1) {
 
@@ -226,11 +389,75 @@ void simul(Machine *pmach, bool debug) {
 
         trace("Execution de", pmach, pmach->_text[pmach->_pc], pmach->_pc);
 
+        if (pmach->_history != NULL)
+            history_begin(pmach);
+        unsigned pc = pmach->_pc;
         //Condition d'arret du programme
         if (!decode_execute(pmach, pmach->_text[pmach->_pc++])) {
             printf("\\!/ Arrêt du programme \\!/ \n");
+            if (pmach->_sampler != NULL) { // modèles rattachés pour leurs bilans
+                sampler_report(pmach, stdout);
+                sampler_close(pmach);
+            }
+            if (HOOKS_ACTIVE(pmach))
+                hooks_event(pmach, HOOK_RETIRE, pc, 0, 0);
+            if (pmach->_timing != NULL) {
+                timing_event(pmach, pc);
+                timing_report(pmach, stdout, 10);
+                timing_close(pmach);
+            }
+            history_catch(pmach, NULL);
+            history_close(pmach);
+            gdb_close(pmach, 0);
+            loopcheck_close(pmach);
+            if (pmach->_cache != NULL) {
+                cache_report(pmach, stdout, 10);
+                cache_close(pmach);
+            }
+            if (pmach->_branchprof != NULL) {
+                branchprof_report(pmach, stdout, 10);
+                if (pmach->_branchprof->_file != NULL
+                    && !branchprof_save(pmach, pmach->_branchprof->_file))
+                    printf("Erreur: %s: écriture impossible\n", pmach->_branchprof->_file);
+                branchprof_close(pmach);
+            }
+            if (pmach->_memprof != NULL) {
+                memprof_report(pmach, stdout, 10);
+                memprof_close(pmach);
+            }
+            if (pmach->_checkpoint != NULL)
+                checkpoint_close(pmach);
+            region_sync(pmach);
+            metrics_run_end(pmach, start);
+            if (pmach->_telemetry != NULL) {
+                telemetry_publish(pmach, TELEMETRY_HALTED, TELEMETRY_HALT, pc, 0);
+                telemetry_close(pmach);
+            }
             break;
         }
-        if (debug) debug = debug_ask(pmach);
+        pmach->_retired++;
+        if (HOOKS_ACTIVE(pmach))
+            hooks_event(pmach, HOOK_RETIRE, pc, 0, 0);
+        if (pmach->_timing != NULL)
+            timing_event(pmach, pc);
+        if (pmach->_history != NULL)
+            history_end(pmach);
+        if (pmach->_checkpoint != NULL)
+            checkpoint_step(pmach);
+        if (pmach->_sampler != NULL)
+            sampler_tick(pmach);
+        if (pmach->_telemetry != NULL)
+            telemetry_tick(pmach);
+        // Mise au point : hors pas à pas, un seul test de bit par instruction
+        bool stop = pmach->_watch != NULL && pmach->_watch->_nhits != 0 && watch_report(pmach);
+        stop = (pmach->_debugger != NULL && debug_stop(pmach)) || stop;
+        if (stop && pmach->_telemetry != NULL)
+            telemetry_publish(pmach, TELEMETRY_STOPPED, TELEMETRY_STOP, pmach->_pc, 0);
+        if (stop && !debug_ask(pmach)) {
+            debug_detach(pmach);
+            watch_clear(pmach);
+        }
+        if (stop && pmach->_loopcheck != NULL) // l'état a pu être modifié
+            loopcheck_reset(pmach);
     }
 }
@@ -7,6 +7,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "instruction.h"
 
@@ -37,6 +38,26 @@ static const unsigned LAST_CC = CC_N;
 //! Taille minimale de la pile d'exécution
 static const unsigned MINSTACKSIZE = 10;
 
+//! Symbole (étiquette) d'un programme
+/*!
+ * Les symboles ne servent qu'à l'affichage et à la mise au point ; ils
+ * proviennent de la section des symboles d'un fichier binaire sectionné (voir
+ * binfile.h).
+ */
+typedef struct
+{
+    const char *_name;		//!< Nom du symbole
+    unsigned _address;		//!< Adresse dans le segment
+    bool _text;			//!< Vrai pour le segment de texte, faux pour les données
+} Symbol;
+
+//! Format des fichiers binaires de programme
+typedef enum
+{
+    FORMAT_RAW = 0,	//!< Format historique : 3 mots d'en-tête, texte, données
+    FORMAT_SECTIONED,	//!< Format sectionné et versionné (voir binfile.h)
+} Program_Format;
+
 //! Structure générale de la machine.
 /*!
  * Cette machine simple est composée de mémoire et d'un processeur. 
@@ -73,11 +94,37 @@ typedef struct
     Instruction *_text;		//!< Mémoire pour les instructions
     unsigned int _textsize;	//!< Taille utilisée pour les instructions
 
-    Word *_data;		//!< Mémoire de données
+    Word *_data;		//!< Mémoire de données (NULL si paginée)
+    struct Paged_Memory *_memory; //!< Mémoire de données paginée (NULL si à plat, voir memory.h)
+    struct Region *_regions;	//!< Régions projetées sur des fichiers (voir region.h)
     unsigned int _datasize;	//!< Taille utilisée pour les données
 
     unsigned int _dataend;      //!< Première adresse libre après les données statiques
 
+    // Informations facultatives sur le programme (NULL si absentes)
+    Symbol *_symbols;		//!< Table des symboles
+    unsigned int _nsymbols;	//!< Nombre de symboles
+    const Decoded_Instruction *_decoded; //!< Instructions pré-décodées (\c _textsize éléments)
+
+    // Suivi de l'exécution
+    unsigned long long _retired;//!< Nombre d'instructions exécutées depuis le chargement
+    uint64_t *_dirty;		//!< Bitmap des pages de données modifiées (NULL si pas de suivi)
+    struct Checkpoint *_checkpoint; //!< Points de reprise périodiques (NULL si inactifs)
+    struct Debugger *_debugger;	//!< État du débogueur (NULL si inactif)
+    struct Watch *_watch;	//!< Points de surveillance des données (NULL si aucun)
+    struct History *_history;	//!< Enregistrement de l'exécution (NULL si inactif)
+    struct Gdb_Stub *_gdb;	//!< Connexion d'un client GDB (NULL si aucune)
+    struct Loop_Check *_loopcheck; //!< Détection des boucles infinies (NULL si inactive)
+    struct Cache *_cache;	//!< Modèle de cache des données (NULL si inactif)
+    struct Timing *_timing;	//!< Modèle temporel du pipeline (NULL si inactif)
+    struct Branch_Profile *_branchprof; //!< Profil des branchements (NULL si inactif)
+    struct Hooks *_hooks;	//!< Greffons d'instrumentation (NULL si aucun, voir hooks.h)
+    struct Sampler *_sampler;	//!< Simulation échantillonnée (NULL si inactive)
+    struct Mem_Profile *_memprof; //!< Profil des accès aux données (NULL si inactif)
+    struct Telemetry *_telemetry; //!< Publication de l'état en mémoire partagée (NULL si inactive)
+    uint8_t *_coverage;		//!< Bitmap de couverture des arcs (NULL si inactive, voir exec.h)
+    unsigned _prev_loc;		//!< Origine hachée du dernier transfert de contrôle
+
     // Registres de l'unité centrale
     unsigned _pc;		//!< Compteur ordinal
     Condition_Code _cc;		//!< Code condition : signe de la dernière opération
@@ -104,7 +151,8 @@ void load_program(Machine *pmach,
 
 //! Lecture d'un programme depuis un fichier binaire
 /*!
- * Le fichier binaire a le format suivant :
+ * Deux formats sont reconnus automatiquement : le format sectionné décrit dans
+ * binfile.h (reconnu à son nombre magique) et le format historique suivant :
  * 
  *    - 3 entiers non signés, la taille du segment de texte (\c textsize),
  *    celle du segment de données (\c datasize) et la première adresse libre de
@@ -119,11 +167,28 @@ void load_program(Machine *pmach,
  * Tous les entiers font 32 bits et les adresses de chaque segment commencent à
  * 0. La fonction initialise complétement la machine.
  *
+ * Le fichier est projeté en mémoire (\c mmap) : le texte est utilisé sur place
+ * en lecture seule et les données sont une projection privée en copie sur
+ * écriture. L'en-tête est vérifié contre la taille du fichier et l'on exige
+ * <tt>dataend <= datasize</tt> ; toute incohérence est fatale.
+ *
  * \param pmach la machine à simuler
  * \param programfile le nom du fichier binaire
  *
  */
 void read_program(Machine *mach, const char *programfile);  
+
+//! Lecture d'un programme depuis un fichier déjà ouvert
+/*!
+ * Comme read_program(), mais le fichier est lu sur le descripteur \a fd
+ * (ouvert en lecture, par exemple par le chargeur de prefetch.h), qui est
+ * fermé une fois le programme chargé.
+ *
+ * \param pmach la machine à simuler
+ * \param fd le descripteur du fichier binaire
+ * \param programfile le nom du fichier (messages d'erreur)
+ */
+void read_program_fd(Machine *mach, int fd, const char *programfile);
  
 //! Affichage du programme et des données
 /*!
@@ -132,12 +197,32 @@ void read_program(Machine *mach, const char *programfile);
  *
  * Pendant qu'on y est, on produit aussi un dump binaire dans le fichier
  * dump.prog. Le format de ce fichier est compatible avec l'option -b de
- * test_simul.
+ * test_simul ; il est choisi par set_dump_format() (historique par défaut).
  *
  * \param pmach la machine en cours d'exécution
  */
 void dump_memory(Machine *pmach);
 
+//! Choix du format du fichier dump.prog produit par dump_memory()
+/*!
+ * \param format le format à utiliser pour les prochains dumps
+ */
+void set_dump_format(Program_Format format);
+
+//! Écriture du programme dans un fichier binaire
+/*!
+ * Le programme (texte, données, \c dataend et, pour le format sectionné,
+ * symboles, instructions pré-décodées et blocs de base) est écrit dans le
+ * fichier \a programfile, relisible par read_program(). Le fichier est écrit
+ * sous un nom temporaire puis renommé : \a programfile peut être le fichier
+ * dont le programme a été lu (et reste projeté).
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param programfile le nom du fichier binaire
+ * \param format le format du fichier
+ */
+void write_program(Machine *pmach, const char *programfile, Program_Format format);
+
 //! Affichage des instructions du programme
 /*!
  * Les instructions sont affichées sous forme symbolique, précédées de leur adresse.
@@ -0,0 +1,372 @@
+/*!
+ * \file memory.c
+ * \brief Accès au segment de données, à plat ou paginé à la demande.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mmap()
+#define _DEFAULT_SOURCE          // MAP_ANONYMOUS, madvise()
+
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+//! Page de zéros partagée par toutes les pages absentes (lecture seule)
+static const Word zero_page[MEMORY_PAGE];
+
+//! Numéro de page invalide (les TLB sont vides)
+static const unsigned NO_PAGE = ~0u;
+
+//! Test d'un bit d'une bitmap de table
+static bool test_bit(const uint32_t *bits, unsigned index) {
+    return (bits[index / 32] >> (index % 32)) & 1;
+}
+
+//! Regroupement d'une table dense en un bloc contigu
+/*!
+ * Toutes les pages de la table deviennent présentes ; le bloc est projeté de
+ * façon anonyme (donc nul et alloué paresseusement par le système) et
+ * signalé comme candidat aux grandes pages. Les pages fournies de l'extérieur
+ * restent en place.
+ */
+static void make_huge(Paged_Memory *mem, Page_Table *table) {
+    size_t size = (size_t)MEMORY_TABLESIZE * MEMORY_PAGE * sizeof(Word);
+    Word *block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED)
+        return; // On reste en pages ordinaires
+#ifdef MADV_HUGEPAGE
+    madvise(block, size, MADV_HUGEPAGE);
+#endif
+    for (unsigned i = 0; i < MEMORY_TABLESIZE; i++) {
+        Word *frame = block + (size_t)i * MEMORY_PAGE;
+        if (test_bit(table->_external, i))
+            continue;
+        if (table->_frames[i] != NULL) {
+            memcpy(frame, table->_frames[i], MEMORY_PAGE * sizeof(Word));
+            free(table->_frames[i]);
+        } else {
+            mem->_npages++;
+        }
+        table->_frames[i] = frame;
+    }
+    table->_count = MEMORY_TABLESIZE;
+    table->_block = block;
+    mem->_rtlb_page = mem->_wtlb_page = NO_PAGE;
+}
+
+const Word *memory_read_miss(Paged_Memory *mem, unsigned page) {
+    Page_Table *table = mem->_directory[page >> MEMORY_TABLE_BITS];
+    const Word *frame = table ? table->_frames[page & (MEMORY_TABLESIZE - 1)] : NULL;
+    mem->_rtlb_page = page;
+    mem->_rtlb_frame = frame ? frame : zero_page;
+    return mem->_rtlb_frame;
+}
+
+Word *memory_write_miss(Paged_Memory *mem, unsigned page) {
+    Page_Table **slot = &mem->_directory[page >> MEMORY_TABLE_BITS];
+    if (*slot == NULL)
+        *slot = calloc(1, sizeof(Page_Table));
+    Page_Table *table = *slot;
+    unsigned index = page & (MEMORY_TABLESIZE - 1);
+
+    if (test_bit(table->_readonly, index))
+        return NULL;
+    if (table->_frames[index] == NULL) {
+        table->_frames[index] = calloc(MEMORY_PAGE, sizeof(Word));
+        if (table->_frames[index] == NULL) {
+            printf("Erreur: plus de mémoire pour le segment de données\n");
+            exit(1);
+        }
+        table->_count++;
+        mem->_npages++;
+        if (mem->_huge && table->_block == NULL && table->_count >= MEMORY_HUGE_THRESHOLD)
+            make_huge(mem, table);
+        // La page lue jusqu'ici était la page de zéros
+        if (mem->_rtlb_page == page)
+            mem->_rtlb_frame = table->_frames[index];
+    }
+    mem->_wtlb_page = page;
+    mem->_wtlb_frame = table->_frames[index];
+    return mem->_wtlb_frame;
+}
+
+void memory_attach(Machine *pmach, unsigned datasize, bool huge) {
+    if (pmach->_memory != NULL)
+        return;
+    Paged_Memory *mem = calloc(1, sizeof(Paged_Memory));
+    mem->_rtlb_page = mem->_wtlb_page = NO_PAGE;
+    mem->_huge = huge;
+
+    // Recopie des pages non nulles du segment à plat
+    for (unsigned base = 0; base < pmach->_datasize; base += MEMORY_PAGE) {
+        unsigned n = pmach->_datasize - base < MEMORY_PAGE ? pmach->_datasize - base : MEMORY_PAGE;
+        bool empty = true;
+        for (unsigned i = 0; i < n && empty; i++)
+            empty = pmach->_data[base + i] == 0;
+        if (!empty)
+            memcpy(memory_write_miss(mem, base >> MEMORY_PAGE_BITS), pmach->_data + base,
+                   n * sizeof(Word));
+    }
+
+    pmach->_memory = mem;
+    pmach->_data = NULL;
+    if (datasize > pmach->_datasize) {
+        pmach->_datasize = datasize;
+        pmach->_sp = datasize - 1;
+    }
+}
+
+void memory_from_env(Machine *pmach) {
+    const char *env = getenv(MEMORY_ENV);
+    if (pmach->_memory != NULL || env == NULL || env[0] == '\0')
+        return;
+    char *end;
+    unsigned long long datasize = strtoull(env, &end, 0);
+    bool huge = strcmp(end, ":huge") == 0;
+    if (end == env || (*end != '\0' && !huge) || datasize > UINT32_MAX) {
+        printf("Erreur: %s=%s: taille du segment de données invalide\n", MEMORY_ENV, env);
+        exit(1);
+    }
+    memory_attach(pmach, datasize, huge);
+}
+
+void memory_map_pages(Machine *pmach, unsigned first, unsigned npages, Word *frames, bool readonly) {
+    if (pmach->_memory == NULL)
+        memory_attach(pmach, pmach->_datasize, false);
+    Paged_Memory *mem = pmach->_memory;
+    for (unsigned i = 0; i < npages; i++) {
+        unsigned page = first + i;
+        Page_Table **slot = &mem->_directory[page >> MEMORY_TABLE_BITS];
+        if (*slot == NULL)
+            *slot = calloc(1, sizeof(Page_Table));
+        Page_Table *table = *slot;
+        unsigned index = page & (MEMORY_TABLESIZE - 1);
+        uint32_t bit = 1u << (index % 32);
+
+        if (table->_frames[index] == NULL) {
+            table->_count++;
+        } else if (table->_block == NULL && !test_bit(table->_external, index)) {
+            free(table->_frames[index]);
+            mem->_npages--;
+        }
+        table->_frames[index] = frames + (size_t)i * MEMORY_PAGE;
+        table->_external[index / 32] |= bit;
+        if (readonly)
+            table->_readonly[index / 32] |= bit;
+        else
+            table->_readonly[index / 32] &= ~bit;
+    }
+    mem->_rtlb_page = mem->_wtlb_page = NO_PAGE;
+}
+
+bool memory_page_readonly(Machine *pmach, unsigned page) {
+    Paged_Memory *mem = pmach->_memory;
+    if (mem == NULL)
+        return false;
+    Page_Table *table = mem->_directory[page >> MEMORY_TABLE_BITS];
+    return table != NULL && test_bit(table->_readonly, page & (MEMORY_TABLESIZE - 1));
+}
+
+bool memory_page_present(Machine *pmach, unsigned page) {
+    Paged_Memory *mem = pmach->_memory;
+    if (mem == NULL)
+        return true;
+    Page_Table *table = mem->_directory[page >> MEMORY_TABLE_BITS];
+    return table != NULL && table->_frames[page & (MEMORY_TABLESIZE - 1)] != NULL;
+}
+
+//! Marquage des pages modifiées d'un intervalle (points de reprise)
+static void mark_dirty(Machine *pmach, unsigned ad_Data, unsigned n) {
+    if (pmach->_dirty == NULL || n == 0)
+        return;
+    unsigned last = (ad_Data + n - 1) >> MEMORY_PAGE_BITS;
+    for (unsigned page = ad_Data >> MEMORY_PAGE_BITS; page <= last; page++)
+        pmach->_dirty[page / 64] |= (uint64_t)1 << (page % 64);
+}
+
+//! Page destination d'une écriture par bloc
+static Word *block_frame(Machine *pmach, unsigned ad_Data) {
+    Word *frame = memory_write_miss(pmach->_memory, ad_Data >> MEMORY_PAGE_BITS);
+    if (frame == NULL)
+        error(ERR_SEGDATA, pmach->_pc - 1);
+    return frame;
+}
+
+//! Plus petit de trois entiers
+static unsigned min3(unsigned a, unsigned b, unsigned c) {
+    unsigned m = a < b ? a : b;
+    return m < c ? m : c;
+}
+
+void read_block(Machine *pmach, unsigned ad_Data, Word *dst, unsigned n) {
+    if (pmach->_memory == NULL) {
+        memcpy(dst, pmach->_data + ad_Data, n * sizeof(Word));
+        return;
+    }
+    while (n > 0) {
+        unsigned offset = ad_Data & (MEMORY_PAGE - 1);
+        unsigned chunk = MEMORY_PAGE - offset < n ? MEMORY_PAGE - offset : n;
+        const Word *frame = memory_read_miss(pmach->_memory, ad_Data >> MEMORY_PAGE_BITS);
+        memcpy(dst, frame + offset, chunk * sizeof(Word));
+        dst += chunk;
+        ad_Data += chunk;
+        n -= chunk;
+    }
+}
+
+void write_block(Machine *pmach, unsigned ad_Data, const Word *src, unsigned n) {
+    mark_dirty(pmach, ad_Data, n);
+    if (pmach->_memory == NULL) {
+        memcpy(pmach->_data + ad_Data, src, n * sizeof(Word));
+    } else {
+        while (n > 0) {
+            unsigned offset = ad_Data & (MEMORY_PAGE - 1);
+            unsigned chunk = MEMORY_PAGE - offset < n ? MEMORY_PAGE - offset : n;
+            Word *frame = block_frame(pmach, ad_Data);
+            memcpy(frame + offset, src, chunk * sizeof(Word));
+            src += chunk;
+            ad_Data += chunk;
+            n -= chunk;
+        }
+    }
+}
+
+// Noyaux vectoriels : une version AVX2 est choisie à l'exécution si le
+// processeur hôte la supporte (le reste du simulateur est compilé sans
+// option particulière).
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+__attribute__((target("avx2")))
+static void fill_words_avx2(Word *dst, Word value, size_t n) {
+    __m256i v = _mm256_set1_epi32(value);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    for (; i < n; i++)
+        dst[i] = value;
+}
+
+__attribute__((target("avx2")))
+static size_t mismatch_words_avx2(const Word *a, const Word *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi32(x, y));
+        if (mask != 0xffffffffu)
+            return i + __builtin_ctz(~mask) / 4;
+    }
+    for (; i < n && a[i] == b[i]; i++)
+        ;
+    return i;
+}
+
+//! Le processeur hôte supporte-t-il AVX2 ?
+static bool host_avx2(void) {
+    static int supported = -1;
+    if (supported < 0)
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    return supported;
+}
+#else
+static bool host_avx2(void) {
+    return false;
+}
+#define fill_words_avx2(dst, value, n) ((void)0)
+#define mismatch_words_avx2(a, b, n) ((size_t)0)
+#endif
+
+//! Remplissage d'un tableau de mots
+static void fill_words(Word *dst, Word value, size_t n) {
+    if (host_avx2()) {
+        fill_words_avx2(dst, value, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        dst[i] = value;
+}
+
+//! Position de la première différence entre deux tableaux (n si égaux)
+static size_t mismatch_words(const Word *a, const Word *b, size_t n) {
+    if (host_avx2())
+        return mismatch_words_avx2(a, b, n);
+    size_t i = 0;
+    while (i < n && a[i] == b[i])
+        i++;
+    return i;
+}
+
+void move_block(Machine *pmach, unsigned dst, unsigned src, unsigned n) {
+    mark_dirty(pmach, dst, n);
+    if (pmach->_memory == NULL) {
+        memmove(pmach->_data + dst, pmach->_data + src, (size_t)n * sizeof(Word));
+        return;
+    }
+    if (dst > src && dst - src < n) {
+        // Chevauchement avec destination plus haute : copie depuis la fin
+        unsigned dend = dst + n, send = src + n;
+        while (n > 0) {
+            unsigned chunk = min3(n, (dend - 1) % MEMORY_PAGE + 1, (send - 1) % MEMORY_PAGE + 1);
+            dend -= chunk;
+            send -= chunk;
+            Word *to = block_frame(pmach, dend) + dend % MEMORY_PAGE;
+            const Word *from = memory_read_miss(pmach->_memory, send >> MEMORY_PAGE_BITS)
+                             + send % MEMORY_PAGE;
+            memmove(to, from, chunk * sizeof(Word));
+            n -= chunk;
+        }
+        return;
+    }
+    while (n > 0) {
+        unsigned chunk = min3(n, MEMORY_PAGE - dst % MEMORY_PAGE, MEMORY_PAGE - src % MEMORY_PAGE);
+        // La page destination d'abord : son allocation peut déplacer les pages
+        Word *to = block_frame(pmach, dst) + dst % MEMORY_PAGE;
+        const Word *from = memory_read_miss(pmach->_memory, src >> MEMORY_PAGE_BITS)
+                         + src % MEMORY_PAGE;
+        memmove(to, from, chunk * sizeof(Word));
+        dst += chunk;
+        src += chunk;
+        n -= chunk;
+    }
+}
+
+void fill_block(Machine *pmach, unsigned dst, Word value, unsigned n) {
+    mark_dirty(pmach, dst, n);
+    if (pmach->_memory == NULL) {
+        fill_words(pmach->_data + dst, value, n);
+        return;
+    }
+    while (n > 0) {
+        unsigned chunk = MEMORY_PAGE - dst % MEMORY_PAGE;
+        if (chunk > n)
+            chunk = n;
+        fill_words(block_frame(pmach, dst) + dst % MEMORY_PAGE, value, chunk);
+        dst += chunk;
+        n -= chunk;
+    }
+}
+
+int compare_block(Machine *pmach, unsigned a, unsigned b, unsigned n) {
+    while (n > 0) {
+        const Word *x, *y;
+        unsigned chunk;
+        if (pmach->_memory == NULL) {
+            x = pmach->_data + a;
+            y = pmach->_data + b;
+            chunk = n;
+        } else {
+            chunk = min3(n, MEMORY_PAGE - a % MEMORY_PAGE, MEMORY_PAGE - b % MEMORY_PAGE);
+            x = memory_read_miss(pmach->_memory, a >> MEMORY_PAGE_BITS) + a % MEMORY_PAGE;
+            y = memory_read_miss(pmach->_memory, b >> MEMORY_PAGE_BITS) + b % MEMORY_PAGE;
+        }
+        size_t i = mismatch_words(x, y, chunk);
+        if (i < chunk)
+            return (int32_t)x[i] < (int32_t)y[i] ? -1 : 1;
+        a += chunk;
+        b += chunk;
+        n -= chunk;
+    }
+    return 0;
+}
@@ -0,0 +1,245 @@
+#ifndef _MEMORY_H_
+#define _MEMORY_H_
+
+/*!
+ * \file memory.h
+ * \brief Accès au segment de données, à plat ou paginé à la demande.
+ *
+ * Par défaut le segment de données est un tableau de \c _datasize mots
+ * (\c Machine::_data). La mémoire paginée (\link Paged_Memory \endlink)
+ * le remplace pour les programmes qui adressent un grand espace de façon
+ * clairsemée (grande pile, tableaux dispersés) : elle est découpée en pages
+ * de \c MEMORY_PAGE mots allouées et mises à zéro à la première écriture.
+ * Une page jamais écrite se lit comme des zéros sans être allouée.
+ *
+ * La table des pages a deux niveaux (répertoire de \c MEMORY_DIRSIZE tables
+ * de \c MEMORY_TABLESIZE pages) et couvre les 32 bits d'adresse. Un TLB d'une
+ * entrée pour la lecture et d'une entrée pour l'écriture évite le parcours de
+ * la table tant que l'on reste dans la même page. En option, une table dont
+ * plus de \c MEMORY_HUGE_THRESHOLD pages sont présentes (région dense) est
+ * regroupée en un seul bloc contigu candidat aux grandes pages du système.
+ *
+ * Des pages peuvent aussi être fournies de l'extérieur, par exemple par la
+ * projection d'un fichier de l'hôte (voir region.h) : elles ne sont jamais
+ * libérées ni regroupées et peuvent être en lecture seule ; écrire dans une
+ * page en lecture seule est une violation du segment de données.
+ *
+ * Toutes les lectures et écritures du simulateur passent par read_data() et
+ * write_data() ; les vérifications de segment (check_overflow(),
+ * check_stack()) restent faites par l'appelant, sur \c _datasize, et ont donc
+ * la même sémantique dans les deux représentations.
+ *
+ * Depuis simul(), la mémoire paginée et la taille du segment sont choisies
+ * par la variable d'environnement \c MEMORY_ENV (voir memory_from_env()).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+#include "error.h"
+
+//! Nombre de bits d'adresse dans une page
+#define MEMORY_PAGE_BITS 10
+//! Taille d'une page (en mots)
+#define MEMORY_PAGE (1u << MEMORY_PAGE_BITS)
+//! Nombre de bits du numéro de page dans une table
+#define MEMORY_TABLE_BITS 10
+//! Nombre de pages par table
+#define MEMORY_TABLESIZE (1u << MEMORY_TABLE_BITS)
+//! Nombre de tables dans le répertoire (couvre 32 bits d'adresse)
+#define MEMORY_DIRSIZE (1u << (32 - MEMORY_TABLE_BITS - MEMORY_PAGE_BITS))
+//! Nombre de pages présentes à partir duquel une table devient un bloc unique
+#define MEMORY_HUGE_THRESHOLD (MEMORY_TABLESIZE / 8)
+
+//! Variable d'environnement demandant la mémoire paginée (voir memory_from_env())
+#define MEMORY_ENV "SIMUL_MEMORY"
+
+//! Table des pages de second niveau
+typedef struct
+{
+    Word *_frames[MEMORY_TABLESIZE];	//!< Pages présentes (NULL sinon)
+    unsigned _count;			//!< Nombre de pages présentes
+    Word *_block;			//!< Bloc contigu regroupant toutes les pages (ou NULL)
+    uint32_t _external[MEMORY_TABLESIZE / 32]; //!< Pages fournies de l'extérieur
+    uint32_t _readonly[MEMORY_TABLESIZE / 32]; //!< Pages en lecture seule
+} Page_Table;
+
+//! Mémoire de données paginée à la demande
+typedef struct Paged_Memory
+{
+    unsigned _rtlb_page;		//!< TLB de lecture : numéro de page
+    const Word *_rtlb_frame;		//!< TLB de lecture : page correspondante
+    unsigned _wtlb_page;		//!< TLB d'écriture : numéro de page
+    Word *_wtlb_frame;			//!< TLB d'écriture : page correspondante
+    bool _huge;				//!< Regroupement des régions denses ?
+    unsigned long _npages;		//!< Nombre de pages allouées
+    Page_Table *_directory[MEMORY_DIRSIZE]; //!< Répertoire des tables
+} Paged_Memory;
+
+//! Passage d'une machine en mémoire paginée
+/*!
+ * Le contenu actuel du segment de données est recopié (seules les pages non
+ * nulles sont allouées) ; \c _data devient NULL. La taille du segment peut
+ * être augmentée : la pile est alors replacée au sommet du nouveau segment.
+ * À appeler après le chargement du programme, avant son exécution.
+ *
+ * \param pmach la machine
+ * \param datasize la nouvelle taille du segment de données (au moins l'actuelle)
+ * \param huge regroupement des régions denses en grandes pages
+ */
+void memory_attach(Machine *pmach, unsigned datasize, bool huge);
+
+//! Mémoire paginée selon la variable d'environnement \c MEMORY_ENV
+/*!
+ * La variable a la forme <tt>TAILLE[:huge]</tt> : la machine passe en
+ * mémoire paginée avec un segment de données de \a TAILLE mots (au moins
+ * la taille actuelle ; décimal ou hexadécimal en \c 0x), avec
+ * regroupement des régions denses si \c :huge est donné. Appelée au début
+ * de simul(), avant tout autre outil ; sans effet si la variable est
+ * absente ou vide, ou si la machine est déjà en mémoire paginée.
+ *
+ * \param pmach la machine (programme chargé)
+ */
+void memory_from_env(Machine *pmach);
+
+//! Recherche d'une page pour la lecture (défaut de TLB)
+/*!
+ * \param mem la mémoire paginée
+ * \param page le numéro de page
+ * \return la page, ou une page de zéros partagée si elle est absente
+ */
+const Word *memory_read_miss(Paged_Memory *mem, unsigned page);
+
+//! Recherche d'une page pour l'écriture (défaut de TLB), allouée si besoin
+/*!
+ * \param mem la mémoire paginée
+ * \param page le numéro de page
+ * \return la page, ou NULL si elle est en lecture seule
+ */
+Word *memory_write_miss(Paged_Memory *mem, unsigned page);
+
+//! Installation de pages fournies de l'extérieur
+/*!
+ * La machine passe en mémoire paginée si besoin. Les pages
+ * <tt>first .. first + npages - 1</tt> sont remplacées par les pages
+ * successives de \a frames (leur ancien contenu est perdu).
+ *
+ * \param pmach la machine
+ * \param first numéro de la première page
+ * \param npages nombre de pages
+ * \param frames le contenu des pages (\a npages * \c MEMORY_PAGE mots contigus)
+ * \param readonly les pages sont-elles en lecture seule ?
+ */
+void memory_map_pages(Machine *pmach, unsigned first, unsigned npages, Word *frames, bool readonly);
+
+//! La page est-elle en lecture seule ?
+/*!
+ * \param pmach la machine
+ * \param page numéro de page (de \c MEMORY_PAGE mots)
+ */
+bool memory_page_readonly(Machine *pmach, unsigned page);
+
+//! La page est-elle présente (toujours vrai pour une mémoire à plat) ?
+/*!
+ * \param pmach la machine
+ * \param page numéro de page (de \c MEMORY_PAGE mots)
+ */
+bool memory_page_present(Machine *pmach, unsigned page);
+
+//! Lecture d'un mot de données
+/*!
+ * \param pmach la machine
+ * \param ad_Data l'adresse (déjà vérifiée par l'appelant)
+ * \return le contenu du mot
+ */
+static inline Word read_data(Machine *pmach, unsigned ad_Data) {
+    Paged_Memory *mem = pmach->_memory;
+    if (mem == NULL)
+        return pmach->_data[ad_Data];
+    unsigned page = ad_Data >> MEMORY_PAGE_BITS;
+    if (page != mem->_rtlb_page)
+        memory_read_miss(mem, page);
+    return mem->_rtlb_frame[ad_Data & (MEMORY_PAGE - 1)];
+}
+
+//! Écriture d'un mot de données
+/*!
+ * Marque la page modifiée si le suivi des pages est actif (points de reprise).
+ * L'écriture dans une page en lecture seule provoque \c ERR_SEGDATA à
+ * l'adresse de l'instruction en cours.
+ *
+ * \param pmach la machine
+ * \param ad_Data l'adresse (déjà vérifiée par l'appelant)
+ * \param value la valeur à écrire
+ */
+static inline void write_data(Machine *pmach, unsigned ad_Data, Word value) {
+    Paged_Memory *mem = pmach->_memory;
+    if (mem == NULL) {
+        pmach->_data[ad_Data] = value;
+    } else {
+        unsigned page = ad_Data >> MEMORY_PAGE_BITS;
+        if (page != mem->_wtlb_page && memory_write_miss(mem, page) == NULL)
+            error(ERR_SEGDATA, pmach->_pc - 1);
+        mem->_wtlb_frame[ad_Data & (MEMORY_PAGE - 1)] = value;
+    }
+    if (pmach->_dirty != NULL) {
+        unsigned page = ad_Data >> MEMORY_PAGE_BITS;
+        pmach->_dirty[page / 64] |= (uint64_t)1 << (page % 64);
+    }
+}
+
+//! Lecture d'une suite de mots de données
+/*!
+ * \param pmach la machine
+ * \param ad_Data la première adresse
+ * \param dst le tableau résultat
+ * \param n le nombre de mots
+ */
+void read_block(Machine *pmach, unsigned ad_Data, Word *dst, unsigned n);
+
+//! Écriture d'une suite de mots de données
+/*!
+ * \param pmach la machine
+ * \param ad_Data la première adresse
+ * \param src les valeurs à écrire
+ * \param n le nombre de mots
+ */
+void write_block(Machine *pmach, unsigned ad_Data, const Word *src, unsigned n);
+
+//! Copie d'un bloc de mots (les blocs peuvent se chevaucher)
+/*!
+ * Les bornes des deux blocs sont vérifiées par l'appelant.
+ *
+ * \param pmach la machine
+ * \param dst l'adresse du bloc destination
+ * \param src l'adresse du bloc source
+ * \param n le nombre de mots
+ */
+void move_block(Machine *pmach, unsigned dst, unsigned src, unsigned n);
+
+//! Remplissage d'un bloc de mots
+/*!
+ * \param pmach la machine
+ * \param dst l'adresse du bloc (bornes vérifiées par l'appelant)
+ * \param value la valeur de remplissage
+ * \param n le nombre de mots
+ */
+void fill_block(Machine *pmach, unsigned dst, Word value, unsigned n);
+
+//! Comparaison de deux blocs de mots
+/*!
+ * Les mots sont comparés comme des entiers signés, dans l'ordre des adresses
+ * croissantes, jusqu'à la première différence.
+ *
+ * \param pmach la machine
+ * \param a l'adresse du premier bloc (bornes vérifiées par l'appelant)
+ * \param b l'adresse du second bloc
+ * \param n le nombre de mots
+ * \return un entier négatif, nul ou positif selon que le premier bloc est
+ * inférieur, égal ou supérieur au second
+ */
+int compare_block(Machine *pmach, unsigned a, unsigned b, unsigned n);
+
+#endif
@@ -0,0 +1,176 @@
+/*!
+ * \file memprof.c
+ * \brief Profil des accès au segment de données et de la pile.
+ */
+
+#include "memprof.h"
+#include <stdlib.h>
+
+//! Niveaux de la carte des accès, du plus faible au plus fort
+static const char heat[] = " .:-=+*#%@";
+
+//! Nombre de bits significatifs
+static unsigned bit_length(unsigned long long n) {
+    return n == 0 ? 0 : 64 - __builtin_clzll(n);
+}
+
+static void on_retire(Machine *pmach, void *data, unsigned pc, Instruction instr) {
+    Mem_Profile *mp = data;
+    if (pmach->_sp < mp->_min_sp)
+        mp->_min_sp = pmach->_sp;
+}
+
+//! Fin des données accédées hors pile
+static inline void data_access(Machine *pmach, Mem_Profile *mp, unsigned addr, unsigned n) {
+    if (addr < pmach->_sp && addr + n > mp->_data_top)
+        mp->_data_top = addr + n < pmach->_sp ? addr + n : pmach->_sp;
+}
+
+static void on_read(Machine *pmach, void *data, unsigned pc, unsigned addr, unsigned n) {
+    Mem_Profile *mp = data;
+    data_access(pmach, mp, addr, n);
+    for (unsigned a = addr; a < addr + n; a++)
+        mp->_blocks[a >> mp->_bits]._reads++;
+}
+
+static void on_write(Machine *pmach, void *data, unsigned pc, unsigned addr, unsigned n) {
+    Mem_Profile *mp = data;
+    data_access(pmach, mp, addr, n);
+    for (unsigned a = addr; a < addr + n; a++)
+        mp->_blocks[a >> mp->_bits]._writes++;
+}
+
+static void on_call(Machine *pmach, void *data, unsigned pc, unsigned target) {
+    Mem_Profile *mp = data;
+    if (++mp->_depth > mp->_max_depth)
+        mp->_max_depth = mp->_depth;
+}
+
+static void on_return(Machine *pmach, void *data, unsigned pc, unsigned target) {
+    Mem_Profile *mp = data;
+    if (mp->_depth > 0)
+        mp->_depth--;
+}
+
+bool memprof_open(Machine *pmach, unsigned bits) {
+    if (bits == MEMPROF_AUTO)
+        for (bits = 0; (pmach->_datasize >> bits) >= MEMPROF_MAXBLOCKS; bits++)
+            ;
+    Mem_Profile *mp = calloc(1, sizeof(Mem_Profile));
+    mp->_bits = bits < 31 ? bits : 31;
+    size_t nblocks = (pmach->_datasize >> mp->_bits) + 1;
+    mp->_blocks = calloc(nblocks, sizeof(Mem_Counters));
+    if (mp->_blocks == NULL) {
+        printf("Erreur: mémoire insuffisante pour le profil des accès (%zu blocs de %u mots)\n",
+               nblocks, 1u << mp->_bits);
+        free(mp);
+        return false;
+    }
+    mp->_min_sp = pmach->_sp;
+    mp->_plugin = (Hook_Plugin) {
+        "memprof", mp, on_retire, on_read, on_write, NULL, on_call, on_return, NULL
+    };
+    memprof_close(pmach);
+    if (!hooks_register(pmach, &mp->_plugin)) {
+        free(mp->_blocks);
+        free(mp);
+        return false;
+    }
+    pmach->_memprof = mp;
+    return true;
+}
+
+void memprof_close(Machine *pmach) {
+    Mem_Profile *mp = pmach->_memprof;
+    if (mp == NULL)
+        return;
+    hooks_unregister(pmach, &mp->_plugin);
+    free(mp->_blocks);
+    free(mp);
+    pmach->_memprof = NULL;
+}
+
+//! Première adresse de la pile utilisée (\c _datasize si elle n'a pas servi)
+static unsigned stack_low(Machine *pmach) {
+    unsigned low = pmach->_memprof->_min_sp + 1;
+    return low < pmach->_datasize ? low : pmach->_datasize;
+}
+
+unsigned memprof_safe_datasize(Machine *pmach) {
+    unsigned top = pmach->_memprof->_data_top, depth = pmach->_datasize - stack_low(pmach);
+    if (top < pmach->_dataend)
+        top = pmach->_dataend;
+    return top + (depth > MINSTACKSIZE ? depth : MINSTACKSIZE);
+}
+
+void memprof_report(Machine *pmach, FILE *out, unsigned top) {
+    const Mem_Profile *mp = pmach->_memprof;
+    unsigned nblocks = (pmach->_datasize >> mp->_bits) + 1, size = 1u << mp->_bits;
+    unsigned long long reads = 0, writes = 0, hottest = 0;
+    for (unsigned b = 0; b < nblocks; b++) {
+        reads += mp->_blocks[b]._reads;
+        writes += mp->_blocks[b]._writes;
+    }
+    unsigned safe = memprof_safe_datasize(pmach);
+    fprintf(out, "\n*** Accès aux données ***\n");
+    fprintf(out, "Mots lus : %llu, mots écrits : %llu\n", reads, writes);
+    fprintf(out, "Pile : %u mots au plus (SP minimal 0x%04x), %u appels imbriqués au plus\n",
+            pmach->_datasize - stack_low(pmach), mp->_min_sp, mp->_max_depth);
+    fprintf(out, "Données : statiques jusqu'à 0x%04x, accédées hors pile jusqu'à 0x%04x\n",
+            pmach->_dataend, mp->_data_top);
+    fprintf(out, "Taille suffisante du segment de données : %u mots (datasize actuel %u",
+            safe, pmach->_datasize);
+    if (safe < pmach->_datasize)
+        fprintf(out, ", %.1f%% de moins", 100.0 * (pmach->_datasize - safe) / pmach->_datasize);
+    fprintf(out, ")\n");
+
+    // Carte : MEMPROF_ROWS lignes de MEMPROF_COLUMNS cases au plus
+    unsigned per_cell = (pmach->_datasize + MEMPROF_ROWS * MEMPROF_COLUMNS - 1) / (MEMPROF_ROWS * MEMPROF_COLUMNS);
+    if (per_cell < size)
+        per_cell = size;
+    unsigned ncells = (pmach->_datasize + per_cell - 1) / per_cell;
+    unsigned long long *cells = calloc(ncells + 1, sizeof(unsigned long long));
+    for (unsigned b = 0; b < nblocks && ncells > 0; b++) {
+        unsigned long long c = ((unsigned long long)b << mp->_bits) / per_cell;
+        cells[c < ncells ? c : ncells - 1] += mp->_blocks[b]._reads + mp->_blocks[b]._writes;
+    }
+    for (unsigned c = 0; c < ncells; c++)
+        if (cells[c] > hottest)
+            hottest = cells[c];
+    unsigned scale = bit_length(hottest) > 1 ? bit_length(hottest) - 1 : 1;
+    fprintf(out, "Carte des accès (%u mots par case, '%c' aucun, '%c' à '%c' de 1 à %llu accès) :\n",
+            per_cell, heat[0], heat[1], heat[sizeof(heat) - 2], hottest);
+    for (unsigned c = 0; c < ncells; c++) {
+        if (c % MEMPROF_COLUMNS == 0)
+            fprintf(out, "  0x%04x |", c * per_cell);
+        unsigned level = cells[c] == 0 ? 0 : 1 + (bit_length(cells[c]) - 1) * (sizeof(heat) - 3) / scale;
+        fputc(heat[level], out);
+        if (c % MEMPROF_COLUMNS == MEMPROF_COLUMNS - 1 || c == ncells - 1)
+            fprintf(out, "|\n");
+    }
+    free(cells);
+
+    // Sélection des blocs les plus accédés
+    unsigned *best = malloc((top + 1) * sizeof(unsigned));
+    unsigned nbest = 0;
+#define ACCESSES(b) (mp->_blocks[b]._reads + mp->_blocks[b]._writes)
+    for (unsigned b = 0; b < nblocks; b++) {
+        if (ACCESSES(b) == 0)
+            continue;
+        unsigned j = nbest < top ? nbest++ : top;
+        while (j > 0 && ACCESSES(best[j - 1]) < ACCESSES(b)) {
+            if (j < top)
+                best[j] = best[j - 1];
+            j--;
+        }
+        if (j < top)
+            best[j] = b;
+    }
+#undef ACCESSES
+    if (nbest > 0)
+        fprintf(out, "Blocs de %u mot(s) les plus accédés :\n", size);
+    for (unsigned k = 0; k < nbest; k++)
+        fprintf(out, "  0x%04x lectures %llu écritures %llu\n", best[k] << mp->_bits,
+                mp->_blocks[best[k]]._reads, mp->_blocks[best[k]]._writes);
+    free(best);
+}
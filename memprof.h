@@ -0,0 +1,97 @@
+#ifndef _MEMPROF_H_
+#define _MEMPROF_H_
+
+/*!
+ * \file memprof.h
+ * \brief Profil des accès au segment de données et de la pile.
+ *
+ * Le profil est un greffon d'instrumentation (voir hooks.h) : actif
+ * (\c Machine::_memprof non NULL), il compte les lectures et les écritures
+ * de chaque bloc de 2^\a bits mots du segment de données, relève la plus
+ * petite valeur prise par \c _sp après chaque instruction et la plus grande
+ * profondeur d'imbrication des \c CALL.
+ *
+ * Le bilan (affiché à la fin de simul()) donne la profondeur de pile
+ * utilisée, la plus haute adresse accédée hors de la pile, une carte des
+ * accès sur tout le segment et la plus petite taille de segment de données
+ * qui aurait suffi à cette exécution : fin des données (statiques ou plus
+ * haute adresse accédée hors pile) plus la profondeur de pile, au moins
+ * \c MINSTACKSIZE. Un accès à une adresse au moins égale à la valeur
+ * courante de \c _sp est un accès à la pile.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "hooks.h"
+
+//! Largeur de la carte des accès (en caractères)
+#define MEMPROF_COLUMNS 64
+
+//! Hauteur maximale de la carte des accès (en lignes)
+#define MEMPROF_ROWS 16
+
+//! Nombre maximal de blocs avec la taille de bloc par défaut
+#define MEMPROF_MAXBLOCKS (1u << 20)
+
+//! Taille de bloc par défaut : la plus petite donnant au plus \c MEMPROF_MAXBLOCKS blocs
+#define MEMPROF_AUTO ((unsigned)-1)
+
+//! Compteurs d'un bloc
+typedef struct
+{
+    unsigned long long _reads;		//!< Mots lus
+    unsigned long long _writes;		//!< Mots écrits
+} Mem_Counters;
+
+//! Profil des accès d'une machine
+typedef struct Mem_Profile
+{
+    unsigned _bits;			//!< Un bloc fait 2^_bits mots
+    Mem_Counters *_blocks;		//!< Compteurs par bloc
+    unsigned _min_sp;			//!< Plus petite valeur de \c _sp
+    unsigned _data_top;			//!< Fin des données accédées hors pile
+    unsigned _depth;			//!< Imbrication courante des appels
+    unsigned _max_depth;		//!< Imbrication maximale
+    Hook_Plugin _plugin;		//!< Greffon inscrit
+} Mem_Profile;
+
+//! Activation du profil
+/*!
+ * Un profil déjà actif est remplacé.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param bits un bloc fait 2^bits mots (0 : un compteur par mot,
+ * \c MEMPROF_AUTO : taille adaptée à \c _datasize)
+ * \return faux si les compteurs ne peuvent être alloués (message affiché) ou
+ * si le greffon ne peut être inscrit (voir hooks_register()) ; un profil déjà
+ * actif n'est remplacé qu'une fois les compteurs alloués
+ */
+bool memprof_open(Machine *pmach, unsigned bits);
+
+//! Désactivation du profil
+/*!
+ * \param pmach la machine
+ */
+void memprof_close(Machine *pmach);
+
+//! Plus petite taille de segment de données suffisante pour l'exécution
+/*!
+ * \param pmach la machine (profil actif)
+ * \return la taille en mots
+ */
+unsigned memprof_safe_datasize(Machine *pmach);
+
+//! Affichage du bilan
+/*!
+ * Pile, taille suffisante, carte des accès puis les \a top blocs les plus
+ * accédés.
+ *
+ * \param pmach la machine (profil actif)
+ * \param out le flot de sortie
+ * \param top le nombre de blocs listés
+ */
+void memprof_report(Machine *pmach, FILE *out, unsigned top);
+
+#endif
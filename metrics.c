@@ -0,0 +1,319 @@
+/*!
+ * \file metrics.c
+ * \brief Métriques de fonctionnement du simulateur et leur export.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // pthread, clock_gettime(), nanosleep()
+
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+//! Compteurs d'un thread
+typedef struct Metrics_Shard
+{
+    uint64_t _retired;				//!< Instructions exécutées
+    uint64_t _faults[METRICS_NERRORS];		//!< Erreurs par code
+    Metrics_Histogram _phases[METRICS_NPHASES];	//!< Durées par phase
+    const Machine *_running;			//!< Machine en cours d'exécution (NULL si aucune)
+    unsigned long long _counted;		//!< Ses instructions déjà comptées
+    struct Metrics_Shard *_next;		//!< Thread suivant
+} Metrics_Shard;
+
+//! Noms des phases (export)
+static const char *phase_names[METRICS_NPHASES] = { "load", "run", "dump" };
+
+//! Noms des codes d'erreur (export)
+static const char *error_names[METRICS_NERRORS] = {
+    "noerror", "unknown", "illegal", "condition", "immediate",
+    "segtext", "segdata", "segstack", "divzero", "loop",
+};
+
+//! Compteurs de tous les threads (ajout en tête sans verrou, jamais de retrait)
+static Metrics_Shard *shards = NULL;
+
+//! Compteurs du thread courant
+static __thread Metrics_Shard *shard = NULL;
+
+//! Export périodique : fichier, période et thread
+static struct
+{
+    pthread_mutex_t _lock;	//!< Protège le fichier et la période, sérialise les exports
+    char *_file;		//!< Fichier (NULL si aucun)
+    unsigned _period;		//!< Période en secondes (0 : seulement à la fin)
+    bool _at_exit;		//!< L'export final est prévu
+    bool _thread;		//!< Le thread d'export est lancé
+} periodic = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, false, false };
+
+//! Compteurs du thread courant, créés au premier appel
+static Metrics_Shard *local(void) {
+    if (shard == NULL) {
+        shard = calloc(1, sizeof(Metrics_Shard));
+        shard->_next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&shards, &shard->_next, shard, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+    }
+    return shard;
+}
+
+//! Ajout à un compteur dont le thread courant est le seul écrivain
+static inline void add(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+//! Lecture d'un compteur d'un autre thread
+static inline uint64_t get(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+//! Intervalle d'une durée
+static unsigned bucket(uint64_t ns) {
+    if (ns < METRICS_SUB)
+        return ns;
+    unsigned e = 63 - __builtin_clzll(ns); // 2 <= e <= 63
+    return (e - 1) * METRICS_SUB + ((ns >> (e - 2)) & (METRICS_SUB - 1));
+}
+
+//! Plus grande durée (ns) d'un intervalle
+static uint64_t bucket_upper(unsigned b) {
+    if (b < METRICS_SUB)
+        return b;
+    unsigned e = b / METRICS_SUB + 1, sub = b % METRICS_SUB;
+    return ((uint64_t)(METRICS_SUB + sub + 1) << (e - 2)) - 1;
+}
+
+uint64_t metrics_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+void metrics_record(Metrics_Phase phase, uint64_t start) {
+    uint64_t ns = metrics_now() - start;
+    Metrics_Histogram *h = &local()->_phases[phase];
+    add(&h->_count, 1);
+    add(&h->_sum, ns);
+    if (ns > h->_max)
+        __atomic_store_n(&h->_max, ns, __ATOMIC_RELAXED);
+    add(&h->_buckets[bucket(ns)], 1);
+}
+
+uint64_t metrics_run_begin(const Machine *pmach) {
+    Metrics_Shard *s = local();
+    s->_running = pmach;
+    s->_counted = pmach->_retired;
+    return metrics_now();
+}
+
+//! Comptage des instructions de l'exécution en cours
+static void count_retired(Metrics_Shard *s) {
+    add(&s->_retired, s->_running->_retired - s->_counted);
+    s->_counted = s->_running->_retired;
+}
+
+void metrics_run_end(const Machine *pmach, uint64_t start) {
+    Metrics_Shard *s = local();
+    if (s->_running == pmach)
+        count_retired(s);
+    s->_running = NULL;
+    metrics_record(METRICS_RUN, start);
+}
+
+void metrics_fault(Error err) {
+    Metrics_Shard *s = local();
+    if (err < METRICS_NERRORS)
+        add(&s->_faults[err], 1);
+    if (s->_running != NULL)
+        count_retired(s);
+}
+
+void metrics_histogram(Metrics_Phase phase, Metrics_Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    for (const Metrics_Shard *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s != NULL; s = s->_next) {
+        const Metrics_Histogram *p = &s->_phases[phase];
+        h->_count += get(&p->_count);
+        h->_sum += get(&p->_sum);
+        if (get(&p->_max) > h->_max)
+            h->_max = get(&p->_max);
+        for (unsigned b = 0; b < METRICS_BUCKETS; b++)
+            h->_buckets[b] += get(&p->_buckets[b]);
+    }
+}
+
+uint64_t metrics_quantile(const Metrics_Histogram *h, double q) {
+    uint64_t total = 0, rank = q * h->_count;
+    for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+        total += h->_buckets[b];
+        if (total > rank)
+            return bucket_upper(b) < h->_max ? bucket_upper(b) : h->_max;
+    }
+    return 0;
+}
+
+//! Sommes des compteurs de tous les threads
+static void totals(uint64_t *retired, uint64_t faults[METRICS_NERRORS]) {
+    *retired = 0;
+    memset(faults, 0, METRICS_NERRORS * sizeof(uint64_t));
+    for (const Metrics_Shard *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s != NULL; s = s->_next) {
+        *retired += get(&s->_retired);
+        for (unsigned e = 0; e < METRICS_NERRORS; e++)
+            faults[e] += get(&s->_faults[e]);
+    }
+}
+
+void metrics_write_json(FILE *out) {
+    uint64_t retired, faults[METRICS_NERRORS];
+    Metrics_Histogram h;
+    totals(&retired, faults);
+    metrics_histogram(METRICS_LOAD, &h);
+    fprintf(out, "{\n  \"programs_loaded\": %llu,\n  \"instructions_retired\": %llu,\n  \"faults\": {",
+            (unsigned long long)h._count, (unsigned long long)retired);
+    for (unsigned e = 1; e < METRICS_NERRORS; e++)
+        fprintf(out, "%s\"%s\": %llu", e > 1 ? ", " : "", error_names[e], (unsigned long long)faults[e]);
+    fprintf(out, "},\n  \"phases\": {");
+    for (unsigned p = 0; p < METRICS_NPHASES; p++) {
+        metrics_histogram(p, &h);
+        fprintf(out, "%s\n    \"%s\": {\"count\": %llu, \"sum_ns\": %llu, \"max_ns\": %llu, "
+                "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"buckets\": [",
+                p > 0 ? "," : "", phase_names[p], (unsigned long long)h._count,
+                (unsigned long long)h._sum, (unsigned long long)h._max,
+                (unsigned long long)metrics_quantile(&h, 0.5),
+                (unsigned long long)metrics_quantile(&h, 0.9),
+                (unsigned long long)metrics_quantile(&h, 0.99));
+        bool first = true;
+        for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+            if (h._buckets[b] == 0)
+                continue;
+            fprintf(out, "%s[%llu, %llu]", first ? "" : ", ",
+                    (unsigned long long)bucket_upper(b), (unsigned long long)h._buckets[b]);
+            first = false;
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n  }\n}\n");
+}
+
+void metrics_write_prometheus(FILE *out) {
+    uint64_t retired, faults[METRICS_NERRORS];
+    Metrics_Histogram h;
+    totals(&retired, faults);
+    metrics_histogram(METRICS_LOAD, &h);
+    fprintf(out, "# HELP simul_programs_loaded_total Programs loaded by read_program().\n"
+            "# TYPE simul_programs_loaded_total counter\n"
+            "simul_programs_loaded_total %llu\n", (unsigned long long)h._count);
+    fprintf(out, "# HELP simul_instructions_retired_total Instructions executed by simul().\n"
+            "# TYPE simul_instructions_retired_total counter\n"
+            "simul_instructions_retired_total %llu\n", (unsigned long long)retired);
+    fprintf(out, "# HELP simul_faults_total Fatal execution errors by error code.\n"
+            "# TYPE simul_faults_total counter\n");
+    for (unsigned e = 1; e < METRICS_NERRORS; e++)
+        fprintf(out, "simul_faults_total{error=\"%s\"} %llu\n", error_names[e], (unsigned long long)faults[e]);
+    fprintf(out, "# HELP simul_phase_duration_seconds Duration of the load, run and dump phases.\n"
+            "# TYPE simul_phase_duration_seconds histogram\n");
+    for (unsigned p = 0; p < METRICS_NPHASES; p++) {
+        metrics_histogram(p, &h);
+        uint64_t cumulated = 0;
+        for (unsigned b = 0; b < METRICS_BUCKETS; b++) {
+            if (h._buckets[b] == 0)
+                continue;
+            cumulated += h._buckets[b];
+            fprintf(out, "simul_phase_duration_seconds_bucket{phase=\"%s\",le=\"%.9g\"} %llu\n",
+                    phase_names[p], bucket_upper(b) / 1e9, (unsigned long long)cumulated);
+        }
+        fprintf(out, "simul_phase_duration_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n",
+                phase_names[p], (unsigned long long)h._count);
+        fprintf(out, "simul_phase_duration_seconds_sum{phase=\"%s\"} %.9f\n", phase_names[p], h._sum / 1e9);
+        fprintf(out, "simul_phase_duration_seconds_count{phase=\"%s\"} %llu\n",
+                phase_names[p], (unsigned long long)h._count);
+    }
+}
+
+//! Export dans un fichier, appelant détenteur de periodic._lock
+static bool export_locked(const char *file) {
+    size_t len = strlen(file);
+    char *tmp = malloc(len + 5);
+    sprintf(tmp, "%s.tmp", file);
+    FILE *out = fopen(tmp, "w");
+    bool ok = out != NULL;
+    if (ok) {
+        if (len >= 5 && strcmp(file + len - 5, ".json") == 0)
+            metrics_write_json(out);
+        else
+            metrics_write_prometheus(out);
+        ok = fclose(out) == 0 && rename(tmp, file) == 0;
+    }
+    free(tmp);
+    return ok;
+}
+
+bool metrics_export(const char *file) {
+    pthread_mutex_lock(&periodic._lock);
+    bool ok = export_locked(file);
+    pthread_mutex_unlock(&periodic._lock);
+    return ok;
+}
+
+//! Export périodique (thread)
+static void *exporter(void *arg) {
+    while (true) {
+        pthread_mutex_lock(&periodic._lock);
+        unsigned period = periodic._period;
+        pthread_mutex_unlock(&periodic._lock);
+        struct timespec t = { period > 0 ? period : 1, 0 };
+        nanosleep(&t, NULL);
+        pthread_mutex_lock(&periodic._lock);
+        if (period > 0 && periodic._period > 0)
+            export_locked(periodic._file);
+        pthread_mutex_unlock(&periodic._lock);
+    }
+    return NULL;
+}
+
+//! Export final à la fin du processus
+static void export_at_exit(void) {
+    pthread_mutex_lock(&periodic._lock);
+    if (periodic._file != NULL)
+        export_locked(periodic._file);
+    pthread_mutex_unlock(&periodic._lock);
+}
+
+bool metrics_open(const char *file, unsigned period) {
+    pthread_mutex_lock(&periodic._lock);
+    free(periodic._file);
+    periodic._file = strcpy(malloc(strlen(file) + 1), file);
+    periodic._period = period;
+    if (!periodic._at_exit)
+        periodic._at_exit = atexit(export_at_exit) == 0;
+    bool ok = true;
+    if (period > 0 && !periodic._thread) {
+        pthread_t thread;
+        ok = periodic._thread = pthread_create(&thread, NULL, exporter, NULL) == 0;
+        if (ok)
+            pthread_detach(thread);
+    }
+    pthread_mutex_unlock(&periodic._lock);
+    return ok;
+}
+
+void metrics_from_env(void) {
+    static bool done = false;
+    const char *env = getenv("SIMUL_METRICS");
+    if (done || env == NULL || env[0] == '\0')
+        return;
+    done = true;
+    char *file = strcpy(malloc(strlen(env) + 1), env), *colon = strrchr(file, ':'), *end;
+    unsigned period = 0;
+    if (colon != NULL && colon[1] != '\0') {
+        period = strtoul(colon + 1, &end, 10);
+        if (*end == '\0')
+            *colon = '\0';
+        else
+            period = 0;
+    }
+    if (!metrics_open(file, period))
+        printf("Erreur: %s: export des métriques impossible\n", file);
+    free(file);
+}
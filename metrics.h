@@ -0,0 +1,157 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/*!
+ * \file metrics.h
+ * \brief Métriques de fonctionnement du simulateur et leur export.
+ *
+ * Le simulateur tient en permanence, pour tout le processus :
+ *
+ *   - le nombre de programmes chargés et d'instructions exécutées ;
+ *
+ *   - le nombre d'erreurs d'exécution par code d'erreur (\link Error \endlink) ;
+ *
+ *   - un histogramme des durées de chacune des phases : chargement
+ *   (read_program()), exécution (simul()) et vidage (dump_memory()).
+ *
+ * Chaque thread a ses propres compteurs, qu'il est seul à modifier : aucun
+ * verrou ni instruction atomique à verrouillage sur le chemin d'exécution.
+ * L'export fait la somme des compteurs de tous les threads. Le coût est de
+ * deux lectures d'horloge par phase et d'une addition par exécution : rien
+ * n'est fait par instruction.
+ *
+ * Les histogrammes sont log-linéaires : les durées (en nanosecondes) sont
+ * réparties par puissance de 2, chacune divisée en \c METRICS_SUB
+ * intervalles égaux, soit une erreur relative d'au plus 25 % sur toute la
+ * plage.
+ *
+ * L'export se fait à la demande (metrics_write_json(),
+ * metrics_write_prometheus(), metrics_export()) ou périodiquement dans un
+ * fichier (metrics_open()), au format JSON si son nom se termine par
+ * \c .json et au format texte de Prometheus sinon. Le fichier est remplacé
+ * atomiquement (écriture d'un fichier temporaire puis renommage) : un
+ * collecteur ne lit jamais un fichier incomplet. Si la variable
+ * d'environnement \c SIMUL_METRICS vaut <tt>FICHIER[:PÉRIODE]</tt>,
+ * metrics_open() est appelée au premier chargement de programme.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "error.h"
+
+//! Nombre d'intervalles par puissance de 2 dans un histogramme
+#define METRICS_SUB 4
+
+//! Nombre d'intervalles d'un histogramme (durées sur 64 bits)
+#define METRICS_BUCKETS (62 * METRICS_SUB + METRICS_SUB)
+
+//! Nombre de codes d'erreur comptés
+#define METRICS_NERRORS (ERR_LOOP + 1)
+
+//! Phases chronométrées
+typedef enum
+{
+    METRICS_LOAD = 0,	//!< Chargement (read_program())
+    METRICS_RUN,	//!< Exécution (simul())
+    METRICS_DUMP,	//!< Vidage (dump_memory())
+    METRICS_NPHASES,	//!< Nombre de phases
+} Metrics_Phase;
+
+//! Histogramme log-linéaire des durées d'une phase
+typedef struct
+{
+    uint64_t _count;			//!< Nombre de mesures
+    uint64_t _sum;			//!< Somme des durées (ns)
+    uint64_t _max;			//!< Plus longue durée (ns)
+    uint64_t _buckets[METRICS_BUCKETS];	//!< Nombre de mesures par intervalle
+} Metrics_Histogram;
+
+//! Heure courante (horloge monotone, en nanosecondes)
+uint64_t metrics_now(void);
+
+//! Fin d'une phase
+/*!
+ * \param phase la phase
+ * \param start l'heure de son début (metrics_now())
+ */
+void metrics_record(Metrics_Phase phase, uint64_t start);
+
+//! Début d'une exécution (appelée par simul())
+/*!
+ * \param pmach la machine
+ * \return l'heure du début
+ */
+uint64_t metrics_run_begin(const Machine *pmach);
+
+//! Fin d'une exécution : durée et instructions exécutées
+/*!
+ * \param pmach la machine
+ * \param start l'heure du début (metrics_run_begin())
+ */
+void metrics_run_end(const Machine *pmach, uint64_t start);
+
+//! Erreur d'exécution (appelée par error())
+/*!
+ * Les instructions de l'exécution en cours dans le thread sont comptées
+ * jusque-là : une erreur fatale termine le processus sans retour à simul().
+ *
+ * \param err le code de l'erreur
+ */
+void metrics_fault(Error err);
+
+//! Somme des histogrammes de tous les threads pour une phase
+/*!
+ * \param phase la phase
+ * \param h l'histogramme résultat
+ */
+void metrics_histogram(Metrics_Phase phase, Metrics_Histogram *h);
+
+//! Quantile d'un histogramme
+/*!
+ * \param h l'histogramme
+ * \param q le quantile (entre 0 et 1)
+ * \return la borne supérieure (ns) de l'intervalle qui le contient (0 si vide)
+ */
+uint64_t metrics_quantile(const Metrics_Histogram *h, double q);
+
+//! Export au format JSON
+/*!
+ * \param out le flot de sortie
+ */
+void metrics_write_json(FILE *out);
+
+//! Export au format texte de Prometheus
+/*!
+ * \param out le flot de sortie
+ */
+void metrics_write_prometheus(FILE *out);
+
+//! Export dans un fichier (JSON si son nom se termine par .json)
+/*!
+ * \param file le fichier, remplacé atomiquement
+ * \return faux si le fichier ne peut être écrit
+ */
+bool metrics_export(const char *file);
+
+//! Export périodique dans un fichier
+/*!
+ * Un thread exporte toutes les \a period secondes (aucun si \a period est
+ * nul) ; un dernier export a lieu à la fin du processus, y compris sur
+ * erreur fatale. Un appel ultérieur change de fichier et de période.
+ *
+ * \param file le fichier
+ * \param period la période en secondes (0 : seulement à la fin)
+ * \return faux si le thread d'export n'a pu être créé
+ */
+bool metrics_open(const char *file, unsigned period);
+
+//! Export selon la variable d'environnement SIMUL_METRICS (au premier appel seulement)
+/*!
+ * Appelée par read_program().
+ */
+void metrics_from_env(void);
+
+#endif
@@ -0,0 +1,252 @@
+/*!
+ * \file monitor.c
+ * \brief Observation en direct d'une simulation (outil autonome).
+ *
+ * Usage : <tt>monitor [-i millisecondes] [-n N] [-w] [-1] nom</tt>
+ *
+ * Le segment de mémoire partagée \a nom, publié par une simulation (voir
+ * telemetry.h : variable d'environnement \c SIMUL_TELEMETRY ou commande
+ * \c V de la mise au point), est projeté en lecture seule : l'outil ne
+ * ralentit ni ne perturbe la simulation observée. Avec \c -w, il attend
+ * que le segment soit créé.
+ *
+ * Toutes les \a millisecondes (500 par défaut), l'outil affiche l'état
+ * courant (\c pc, \c cc, \c sp et sommet de pile), le nombre
+ * d'instructions exécutées et le débit (sur le dernier intervalle et depuis
+ * le début de l'observation), les \a N adresses (10 par défaut) les plus
+ * souvent échantillonnées depuis le début de l'observation et les derniers
+ * arrêts ou erreurs. Il s'arrête à la fin de la simulation ou du processus
+ * observé ; avec \c -1, après un seul affichage.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // getopt(), shm_open(), kill(), nanosleep()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+
+//! Nombre de derniers arrêts et erreurs affichés
+#define RECENT 5
+
+//! Lecture atomique relâchée
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+//! Copie cohérente de l'état publié
+typedef struct
+{
+    uint64_t _retired;
+    uint32_t _pc, _cc, _stack, _tos, _state;
+} Status;
+
+static const char *state_names[] = { "en cours", "arrêtée (mise au point)", "terminée", "erreur" };
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-i millisecondes] [-n N] [-w] [-1] nom\n", prog);
+    exit(1);
+}
+
+//! Heure courante (secondes)
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void pause_ms(unsigned ms) {
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+//! Projection du segment (NULL s'il n'existe pas ou n'est pas valide)
+static const Telemetry_Block *attach(const char *name) {
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    const Telemetry_Block *b = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Telemetry_Block))
+        b = mmap(NULL, sizeof(Telemetry_Block), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (b == MAP_FAILED)
+        return NULL;
+    if (__atomic_load_n(&b->_magic, __ATOMIC_ACQUIRE) != TELEMETRY_MAGIC
+        || b->_version != TELEMETRY_VERSION || b->_ring != TELEMETRY_RING) {
+        munmap((void *)b, sizeof(Telemetry_Block));
+        return NULL;
+    }
+    return b;
+}
+
+//! Lecture de l'état (compteur de séquence)
+/*!
+ * \return faux si l'écrivain l'a modifié à chaque essai
+ */
+static bool snapshot(const Telemetry_Block *b, Status *s) {
+    for (unsigned tries = 0; tries < 1000; tries++) {
+        uint64_t seq = __atomic_load_n(&b->_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        s->_retired = LOAD(b->_retired);
+        s->_pc = LOAD(b->_pc);
+        s->_cc = LOAD(b->_cc);
+        s->_stack = LOAD(b->_stack);
+        s->_tos = LOAD(b->_tos);
+        s->_state = LOAD(b->_state);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (LOAD(b->_seq) == seq)
+            return true;
+    }
+    return false;
+}
+
+//! Lecture d'un événement (faux s'il a été écrasé ou est en cours d'écriture)
+static bool read_event(const Telemetry_Block *b, uint64_t n, Telemetry_Event *e) {
+    const Telemetry_Event *slot = &b->_events[n % TELEMETRY_RING];
+    if (__atomic_load_n(&slot->_seq, __ATOMIC_ACQUIRE) != n + 1)
+        return false;
+    e->_retired = LOAD(slot->_retired);
+    e->_kind = LOAD(slot->_kind);
+    e->_pc = LOAD(slot->_pc);
+    e->_arg = LOAD(slot->_arg);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return LOAD(slot->_seq) == n + 1;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned period = 500, top = 10;
+    bool wait = false, once = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:w1")) != -1) {
+        switch (opt) {
+        case 'i':
+            period = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            top = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            wait = true;
+            break;
+        case '1':
+            once = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1)
+        usage(argv[0]);
+    char *name = malloc(strlen(argv[optind]) + 2);
+    sprintf(name, "%s%s", argv[optind][0] == '/' ? "" : "/", argv[optind]);
+
+    const Telemetry_Block *b;
+    while ((b = attach(name)) == NULL) {
+        if (!wait) {
+            printf("Erreur: %s: aucune simulation publiée\n", name);
+            return 1;
+        }
+        pause_ms(period);
+    }
+
+    unsigned textsize = b->_textsize;
+    unsigned long long *hot = calloc(textsize + 1, sizeof(unsigned long long));
+    unsigned long long samples = 0, lost = 0;
+    Telemetry_Event recent[RECENT];
+    unsigned nrecent = 0;
+    unsigned *best = malloc((top + 1) * sizeof(unsigned));
+    bool tty = isatty(STDOUT_FILENO);
+    Status s, first;
+    if (!snapshot(b, &first))
+        first = (Status) { 0 };
+    uint64_t last = 0, retired = first._retired;
+    double start = now(), previous = start;
+
+    while (true) {
+        if (!once)
+            pause_ms(period);
+        Status prev = { ._retired = retired };
+        if (!snapshot(b, &s))
+            s = prev;
+
+        // Nouveaux événements ; ceux déjà écrasés sont perdus
+        uint64_t head = __atomic_load_n(&b->_head, __ATOMIC_ACQUIRE);
+        if (head - last > TELEMETRY_RING) {
+            lost += head - last - TELEMETRY_RING;
+            last = head - TELEMETRY_RING;
+        }
+        for (; last < head; last++) {
+            Telemetry_Event e;
+            if (!read_event(b, last, &e)) {
+                lost++;
+                continue;
+            }
+            if (e._kind == TELEMETRY_SAMPLE) {
+                hot[e._pc < textsize ? e._pc : textsize]++;
+                samples++;
+            } else {
+                if (nrecent == RECENT)
+                    memmove(recent, recent + 1, (RECENT - 1) * sizeof(Telemetry_Event));
+                recent[nrecent < RECENT ? nrecent++ : RECENT - 1] = e;
+            }
+        }
+
+        // Adresses les plus échantillonnées
+        unsigned nbest = 0;
+        for (unsigned a = 0; a < textsize; a++) {
+            if (hot[a] == 0)
+                continue;
+            unsigned j = nbest < top ? nbest++ : top;
+            while (j > 0 && hot[best[j - 1]] < hot[a]) {
+                if (j < top)
+                    best[j] = best[j - 1];
+                j--;
+            }
+            if (j < top)
+                best[j] = a;
+        }
+
+        double t = now();
+        if (tty)
+            printf("\033[H\033[J");
+        printf("Simulation %s (processus %u) : %s\n", name, b->_pid,
+               s._state < 4 ? state_names[s._state] : "?");
+        printf("pc 0x%04x  cc %c  sp 0x%04x  sommet 0x%08x\n",
+               s._pc, "UZPN"[s._cc & 3], s._stack, s._tos);
+        printf("Instructions : %llu (%.2f M/s, %.2f M/s en moyenne)\n",
+               (unsigned long long)s._retired,
+               t > previous ? (s._retired - retired) / (t - previous) / 1e6 : 0.0,
+               t > start ? (s._retired - first._retired) / (t - start) / 1e6 : 0.0);
+        printf("Échantillons : %llu (%llu perdus)\n", samples, lost);
+        for (unsigned k = 0; k < nbest; k++)
+            printf("  0x%04x %6.2f%%\n", best[k], 100.0 * hot[best[k]] / samples);
+        for (unsigned k = 0; k < nrecent; k++) {
+            const Telemetry_Event *e = &recent[k];
+            printf("  %s en 0x%04x après %llu instructions",
+                   e->_kind == TELEMETRY_STOP ? "arrêt" : e->_kind == TELEMETRY_HALT ? "fin" : "erreur",
+                   e->_pc, (unsigned long long)e->_retired);
+            if (e->_kind == TELEMETRY_FAULT)
+                printf(" (code %u)", e->_arg);
+            printf("\n");
+        }
+        fflush(stdout);
+        retired = s._retired;
+        previous = t;
+
+        if (once || s._state == TELEMETRY_HALTED || s._state == TELEMETRY_FAILED)
+            break;
+        if (kill(b->_pid, 0) < 0 && errno == ESRCH) {
+            printf("Processus %u terminé\n", b->_pid);
+            return 1;
+        }
+    }
+    return 0;
+}
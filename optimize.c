@@ -0,0 +1,267 @@
+/*!
+ * \file optimize.c
+ * \brief Optimiseur de programmes binaires (outil autonome).
+ *
+ * Usage : <tt>optimize [-c] [-l limite] [-S] [-r région]... entrée sortie</tt>
+ *
+ * Le programme \a entrée (lu par read_program()) est optimisé par
+ * peephole_optimize() et écrit dans \a sortie, au format historique ou au
+ * format sectionné (\c -S) ; les symboles du texte sont relogés. Un bilan des
+ * transformations est affiché.
+ *
+ * Chaque \c -r ajoute au programme écrit une région projetée sur un fichier
+ * de l'hôte, déclarée au format de region_parse() (voir region.h) ; elle
+ * n'est conservée qu'au format sectionné. Le fichier n'est pas touché par
+ * l'optimiseur : il est projeté au chargement du programme.
+ *
+ * Avec \c -c, les deux programmes sont ensuite exécutés (chacun dans un
+ * processus fils, sans trace, au plus \a limite instructions) et leurs états
+ * finals comparés : issue (arrêt sur \c HALT ou erreur, avec le code de
+ * l'erreur et son adresse, relogée), registres, code
+ * condition et données statiques (<tt>[0, dataend[</tt> ; la pile n'est pas
+ * comparée car elle peut contenir des adresses de retour relogées). Le code
+ * de sortie est 0 si les états sont identiques, 1 sinon, 2 si la limite a
+ * été atteinte.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // fork()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "machine.h"
+#include "exec.h"
+#include "error.h"
+#include "memory.h"
+#include "binfile.h"
+#include "peephole.h"
+#include "region.h"
+
+//! Issue d'une exécution de vérification
+typedef enum
+{
+    RUN_FAILED = 0,	//!< Chargement impossible
+    RUN_HALT,		//!< Arrêt normal sur HALT
+    RUN_ERROR,		//!< Erreur d'exécution
+    RUN_LIMIT,		//!< Limite d'instructions atteinte
+} Run_Status;
+
+//! État final d'une exécution de vérification
+typedef struct
+{
+    Run_Status _status;		//!< Issue
+    unsigned long long _retired;//!< Nombre d'instructions exécutées
+    Condition_Code _cc;		//!< Code condition
+    Word _registers[NREGISTERS];//!< Registres
+    uint32_t _digest;		//!< Somme de contrôle des données statiques
+    Error _error;		//!< Code de l'erreur (RUN_ERROR)
+    unsigned _address;		//!< Adresse de l'erreur (RUN_ERROR)
+} Run_State;
+
+//! Machine du processus fils (pour le rapport à la sortie)
+static Machine *run_machine;
+//! Issue courante du processus fils
+static Run_Status run_status;
+//! Tube vers le processus père
+static int run_fd;
+//! Erreur du processus fils et son adresse
+static Error run_error;
+static unsigned run_address;
+
+//! Envoi de l'état final au processus père (aussi après une erreur fatale)
+static void run_report(void) {
+    Machine *pmach = run_machine;
+    Run_State st;
+    memset(&st, 0, sizeof(st));
+    st._status = run_status;
+    st._retired = pmach->_retired;
+    st._cc = pmach->_cc;
+    memcpy(st._registers, pmach->_registers, sizeof(st._registers));
+    Word *data = malloc(pmach->_dataend * sizeof(Word) + 1);
+    read_block(pmach, 0, data, pmach->_dataend);
+    st._digest = binfile_checksum(data, pmach->_dataend * sizeof(Word), CHECKSUM_INIT);
+    free(data);
+    st._error = run_error;
+    st._address = run_address;
+    if (write(run_fd, &st, sizeof(st)) != sizeof(st))
+        _exit(1);
+}
+
+//! Relevé de l'erreur fatale du processus fils (qui se termine ensuite)
+static void run_on_error(Error err, unsigned addr) {
+    run_error = err;
+    run_address = addr;
+}
+
+//! Exécution d'un programme dans un processus fils
+/*!
+ * \param file le programme
+ * \param limit nombre maximal d'instructions
+ * \param st l'état final
+ */
+static void run(const char *file, unsigned long long limit, Run_State *st) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        static Machine mach;
+        close(fds[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL)
+            _exit(1);
+        read_program(&mach, file);
+        run_machine = &mach;
+        run_fd = fds[1];
+        run_status = RUN_ERROR;	// error() termine le processus par exit()
+        set_error_hook(run_on_error);
+        atexit(run_report);
+        while (mach._retired < limit) {
+            if (mach._pc >= mach._textsize)
+                error(ERR_SEGTEXT, mach._pc - 1);
+            if (!decode_execute(&mach, mach._text[mach._pc++])) {
+                run_status = RUN_HALT;
+                exit(0);
+            }
+            mach._retired++;
+        }
+        run_status = RUN_LIMIT;
+        exit(0);
+    }
+    close(fds[1]);
+    memset(st, 0, sizeof(*st));
+    if (read(fds[0], st, sizeof(*st)) != sizeof(*st))
+        st->_status = RUN_FAILED;
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+}
+
+//! Forme imprimable d'une issue
+static const char *status_names[] = { "chargement impossible", "HALT", "erreur", "limite atteinte" };
+
+//! Vérification : exécution des deux versions et comparaison
+/*!
+ * \param relocation nouvelle adresse de chaque instruction du programme initial
+ * \param textsize taille du texte initial
+ * \param newsize taille du texte optimisé
+ * \return le code de sortie de l'outil
+ */
+static int check(const char *before, const char *after, unsigned long long limit,
+                 const unsigned *relocation, unsigned textsize, unsigned newsize) {
+    Run_State a, b;
+    run(before, limit, &a);
+    run(after, limit, &b);
+    printf("Vérification :\n");
+    printf("  issue                 : %s / %s\n", status_names[a._status], status_names[b._status]);
+    printf("  instructions exécutées: %llu -> %llu", a._retired, b._retired);
+    if (a._retired > 0)
+        printf(" (%+.1f%%)", 100.0 * ((double)b._retired - a._retired) / a._retired);
+    printf("\n");
+    if (a._status == RUN_ERROR || b._status == RUN_ERROR)
+        printf("  erreur                : %u en 0x%x / %u en 0x%x\n",
+               a._error, a._address, b._error, b._address);
+    if (a._status == RUN_LIMIT || b._status == RUN_LIMIT) {
+        printf("  résultat              : non concluant (limite de %llu instructions)\n", limit);
+        return 2;
+    }
+    bool same = a._status == b._status && a._status != RUN_FAILED;
+    if (same && a._status == RUN_ERROR) {
+        // Adresse au-delà du texte (ERR_SEGTEXT) : même écart à la fin
+        unsigned expected = a._address < textsize ? relocation[a._address]
+                                                  : a._address - textsize + newsize;
+        same = a._error == b._error && b._address == expected;
+    }
+    if (same && a._status == RUN_HALT)
+        same = a._cc == b._cc && a._digest == b._digest
+            && memcmp(a._registers, b._registers, sizeof(a._registers)) == 0;
+    printf("  résultat              : %s\n", same ? "états identiques" : "ÉTATS DIFFÉRENTS");
+    return same ? 0 : 1;
+}
+
+//! Affichage de l'usage et fin
+static void usage(const char *prog) {
+    printf("Usage: %s [-c] [-l limite] [-S] [-r région]... entrée sortie\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    bool check_mode = false;
+    unsigned long long limit = 100000000ULL;
+    Program_Format format = FORMAT_RAW;
+    char **regions = malloc(argc * sizeof(char *));
+    unsigned nregions = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "cl:Sr:")) != -1) {
+        switch (opt) {
+        case 'c':
+            check_mode = true;
+            break;
+        case 'l':
+            limit = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            format = FORMAT_SECTIONED;
+            break;
+        case 'r':
+            regions[nregions++] = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2)
+        usage(argv[0]);
+    const char *input = argv[optind], *output = argv[optind + 1];
+
+    Machine mach;
+    read_program(&mach, input);
+    unsigned textsize = mach._textsize;
+    Instruction *text = malloc(textsize * sizeof(Instruction) + 1);
+    unsigned *relocation = malloc((textsize + 1) * sizeof(unsigned));
+    Peephole_Report report;
+    unsigned newsize = peephole_optimize(textsize, mach._text, text, relocation, &report);
+
+    // Symboles du texte relogés (ceux des instructions supprimées désignent la suivante)
+    Symbol *symbols = mach._symbols;
+    unsigned nsymbols = mach._nsymbols;
+    for (unsigned i = 0; i < nsymbols; i++)
+        if (symbols[i]._text && symbols[i]._address <= textsize)
+            symbols[i]._address = relocation[symbols[i]._address];
+
+    // Nouveau programme : les données sont reprises telles quelles
+    Word *data = malloc(mach._datasize * sizeof(Word) + 1);
+    read_block(&mach, 0, data, mach._datasize);
+    Machine out;
+    load_program(&out, newsize, text, mach._datasize, data, mach._dataend);
+    out._symbols = symbols;
+    out._nsymbols = nsymbols;
+    out._regions = mach._regions;
+    for (unsigned i = 0; i < nregions; i++)
+        if (!region_declare(&out, regions[i])) {
+            printf("Erreur: %s: déclaration de région invalide\n", regions[i]);
+            exit(1);
+        }
+    write_program(&out, output, format);
+
+    printf("%s -> %s\n", input, output);
+    printf("  instructions          : %u -> %u\n", textsize, newsize);
+    printf("  branchements chaînés  : %u\n", report._threaded);
+    printf("  rechargements évités  : %u\n", report._forwarded);
+    printf("  opérations neutres    : %u\n", report._identities);
+    printf("  sauts à la suivante   : %u\n", report._jumps);
+    printf("  NOP                   : %u\n", report._nops);
+    printf("  code inaccessible     : %u\n", report._unreachable);
+    if (report._indirect)
+        printf("  (branchement indexé présent : aucune instruction supprimée)\n");
+
+    return check_mode ? check(input, output, limit, relocation, textsize, newsize) : 0;
+}
@@ -0,0 +1,305 @@
+/*!
+ * \file peephole.c
+ * \brief Optimisation « à lucarne » et élimination du code mort d'un segment de texte.
+ */
+
+#include "peephole.h"
+#include <stdlib.h>
+#include <string.h>
+
+//! État de l'optimisation : texte en cours de réécriture
+typedef struct
+{
+    unsigned _size;		//!< Taille du texte d'origine
+    Instruction *_code;		//!< Instructions (réécrites sur place)
+    bool *_removed;		//!< Instructions supprimées
+    bool *_target;		//!< Adresses cibles d'un branchement
+    Peephole_Report *_report;	//!< Bilan
+} Peephole;
+
+//! Branchement ou appel à adressage absolu avec une condition valide ?
+static bool is_jump(Instruction instr) {
+    return (instr.instr_generic._cop == BRANCH || instr.instr_generic._cop == CALL)
+        && !instr.instr_generic._immediate && !instr.instr_generic._indexed
+        && instr.instr_generic._regcond <= LAST_CONDITION;
+}
+
+//! Branchement inconditionnel à adressage absolu ?
+static bool is_goto(Instruction instr) {
+    return is_jump(instr) && instr.instr_generic._cop == BRANCH && instr.instr_generic._regcond == NC;
+}
+
+//! L'instruction met-elle à jour le code condition ?
+static bool writes_cc(Instruction instr) {
+    switch (instr.instr_generic._cop) {
+    case LOAD: case ADD: case SUB: case BCMP:
+    case MUL: case DIV: case MOD: case AND: case OR: case XOR: case SHL: case SHR: case SAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+//! L'instruction ne fait-elle que mettre à jour le code condition ?
+static bool is_identity(Instruction instr) {
+    if (!instr.instr_generic._immediate)
+        return false;
+    int value = instr.instr_immediate._value;
+    switch (instr.instr_generic._cop) {
+    case ADD: case SUB: case OR: case XOR: case SHL: case SHR: case SAR:
+        return value == 0;
+    case MUL: case DIV:
+        return value == 1;
+    case AND:
+        return value == -1;
+    default:
+        return false;
+    }
+}
+
+//! Première instruction conservée à partir de l'adresse i
+static unsigned next_live(const Peephole *p, unsigned i) {
+    while (i < p->_size && p->_removed[i])
+        i++;
+    return i;
+}
+
+//! Le code condition est-il réécrit avant d'être lu après l'instruction i ?
+static bool cc_dead_after(const Peephole *p, unsigned i) {
+    for (unsigned j = next_live(p, i + 1); j < p->_size; j = next_live(p, j + 1)) {
+        Instruction instr = p->_code[j];
+        if (writes_cc(instr))
+            return true;
+        switch (instr.instr_generic._cop) {
+        case NOP: case STORE: case PUSH: case POP:
+            continue;
+        default: // branchement, appel, retour, arrêt : code condition observable
+            return false;
+        }
+    }
+    return false;
+}
+
+//! Relevé des cibles des branchements et des adresses de retour
+static void find_targets(Peephole *p) {
+    memset(p->_target, 0, p->_size + 1);
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1)) {
+        Instruction instr = p->_code[i];
+        if (is_jump(instr) && instr.instr_absolute._address < p->_size)
+            p->_target[instr.instr_absolute._address] = true;
+        if (instr.instr_generic._cop == CALL)
+            p->_target[i + 1] = true;
+    }
+}
+
+//! Chaînage des branchements vers des branchements inconditionnels
+static bool thread_branches(Peephole *p) {
+    bool changed = false;
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1)) {
+        if (!is_jump(p->_code[i]))
+            continue;
+        unsigned target = p->_code[i].instr_absolute._address;
+        unsigned steps = 0;
+        for (;;) {
+            unsigned u = target < p->_size ? next_live(p, target) : p->_size;
+            while (u < p->_size && p->_code[u].instr_generic._cop == NOP)
+                u = next_live(p, u + 1);
+            if (u >= p->_size || !is_goto(p->_code[u]))
+                break;
+            if (++steps > p->_size) { // boucle de branchements : on n'y touche pas
+                target = p->_code[i].instr_absolute._address;
+                break;
+            }
+            target = p->_code[u].instr_absolute._address;
+        }
+        if (target != p->_code[i].instr_absolute._address) {
+            p->_code[i].instr_absolute._address = target;
+            p->_report->_threaded++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+//! Remplacement d'un rechargement après rangement par ADD R, #0
+static bool forward_loads(Peephole *p) {
+    bool changed = false;
+    find_targets(p);
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1)) {
+        Instruction store = p->_code[i];
+        if (store.instr_generic._cop != STORE || store.instr_generic._immediate)
+            continue;
+        unsigned j = next_live(p, i + 1);
+        while (j < p->_size && p->_code[j].instr_generic._cop == NOP)
+            j = next_live(p, j + 1);
+        if (j >= p->_size)
+            continue;
+        Instruction load = p->_code[j];
+        // Même registre et même adresse : seul le code opération diffère
+        Instruction same = load;
+        same.instr_generic._cop = STORE;
+        if (load.instr_generic._cop != LOAD || same._raw != store._raw)
+            continue;
+        bool entry = false;
+        for (unsigned k = i + 1; k <= j; k++)
+            entry = entry || p->_target[k];
+        if (entry)
+            continue;
+        Instruction add;
+        add._raw = 0;
+        add.instr_immediate._cop = ADD;
+        add.instr_immediate._immediate = true;
+        add.instr_immediate._regcond = load.instr_generic._regcond;
+        add.instr_immediate._value = 0;
+        p->_code[j] = add;
+        p->_report->_forwarded++;
+        changed = true;
+    }
+    return changed;
+}
+
+//! Suppression des opérations neutres dont le code condition est inutile
+static bool remove_identities(Peephole *p) {
+    bool changed = false;
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1))
+        if (is_identity(p->_code[i]) && cc_dead_after(p, i)) {
+            p->_removed[i] = true;
+            p->_report->_identities++;
+            changed = true;
+        }
+    return changed;
+}
+
+//! Suppression des NOP
+static bool remove_nops(Peephole *p) {
+    bool changed = false;
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1))
+        if (p->_code[i].instr_generic._cop == NOP) {
+            p->_removed[i] = true;
+            p->_report->_nops++;
+            changed = true;
+        }
+    return changed;
+}
+
+//! Suppression des branchements vers l'instruction suivante
+static bool remove_jumps_to_next(Peephole *p) {
+    bool changed = false;
+    for (unsigned i = next_live(p, 0); i < p->_size; i = next_live(p, i + 1)) {
+        Instruction instr = p->_code[i];
+        if (!is_jump(instr) || instr.instr_generic._cop != BRANCH
+            || instr.instr_absolute._address >= p->_size)
+            continue;
+        if (next_live(p, instr.instr_absolute._address) == next_live(p, i + 1)) {
+            p->_removed[i] = true;
+            p->_report->_jumps++;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+//! Suppression des instructions inaccessibles depuis l'adresse 0
+static bool remove_unreachable(Peephole *p) {
+    bool *reached = calloc(p->_size + 1, sizeof(bool));
+    unsigned *work = malloc((p->_size + 1) * sizeof(unsigned));
+    unsigned nwork = 0;
+    if (p->_size > 0) {
+        reached[0] = true;
+        work[nwork++] = 0;
+    }
+    while (nwork > 0) {
+        unsigned i = work[--nwork];
+        unsigned succ[2], nsucc = 0;
+        Instruction instr = p->_code[i];
+        bool falls = true;
+        if (!p->_removed[i]) {
+            switch (instr.instr_generic._cop) {
+            case ILLOP: case RET: case HALT:
+                falls = false;
+                break;
+            case BRANCH: case CALL:
+                if (is_jump(instr)) {
+                    if (instr.instr_absolute._address < p->_size)
+                        succ[nsucc++] = instr.instr_absolute._address;
+                    falls = !is_goto(instr);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        if (falls && i + 1 < p->_size)
+            succ[nsucc++] = i + 1;
+        for (unsigned k = 0; k < nsucc; k++)
+            if (!reached[succ[k]]) {
+                reached[succ[k]] = true;
+                work[nwork++] = succ[k];
+            }
+    }
+    bool changed = false;
+    for (unsigned i = 0; i < p->_size; i++)
+        if (!reached[i] && !p->_removed[i]) {
+            p->_removed[i] = true;
+            p->_report->_unreachable++;
+            changed = true;
+        }
+    free(work);
+    free(reached);
+    return changed;
+}
+
+unsigned peephole_optimize(unsigned textsize, const Instruction text[textsize],
+                           Instruction out[], unsigned relocation[],
+                           Peephole_Report *report) {
+    Peephole p;
+    p._size = textsize;
+    p._code = malloc(textsize * sizeof(Instruction) + 1);
+    memcpy(p._code, text, textsize * sizeof(Instruction));
+    p._removed = calloc(textsize + 1, sizeof(bool));
+    p._target = malloc(textsize + 1);
+    p._report = report;
+    memset(report, 0, sizeof(Peephole_Report));
+    for (unsigned i = 0; i < textsize; i++)
+        if ((text[i].instr_generic._cop == BRANCH || text[i].instr_generic._cop == CALL)
+            && text[i].instr_generic._indexed)
+            report->_indirect = true;
+
+    bool changed = true;
+    while (changed) {
+        changed = thread_branches(&p);
+        if (!report->_indirect) {
+            changed |= forward_loads(&p);
+            changed |= remove_identities(&p);
+            changed |= remove_nops(&p);
+            changed |= remove_jumps_to_next(&p);
+            changed |= remove_unreachable(&p);
+        }
+    }
+
+    // Relogement : une adresse supprimée désigne l'instruction conservée suivante
+    unsigned newsize = 0;
+    for (unsigned i = 0; i < textsize; i++) {
+        relocation[i] = newsize;
+        if (!p._removed[i])
+            newsize++;
+    }
+    relocation[textsize] = newsize;
+    for (unsigned i = 0; i < textsize; i++) {
+        if (p._removed[i])
+            continue;
+        Instruction instr = p._code[i];
+        if (is_jump(instr)) {
+            unsigned target = instr.instr_absolute._address;
+            // Une cible hors du texte le reste (ERR_SEGTEXT à l'exécution)
+            instr.instr_absolute._address = target < textsize ? relocation[target]
+                                                              : target - textsize + newsize;
+        }
+        out[relocation[i]] = instr;
+    }
+
+    free(p._target);
+    free(p._removed);
+    free(p._code);
+    return newsize;
+}
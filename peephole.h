@@ -0,0 +1,65 @@
+#ifndef _PEEPHOLE_H_
+#define _PEEPHOLE_H_
+
+/*!
+ * \file peephole.h
+ * \brief Optimisation « à lucarne » et élimination du code mort d'un segment de texte.
+ *
+ * Les transformations suivantes sont appliquées jusqu'à stabilité :
+ *
+ *   - \b chaînage des branchements : un \c BRANCH ou un \c CALL vers un
+ *   <tt>BRANCH NC</tt> est redirigé vers la cible finale ;
+ *
+ *   - \b rechargement après rangement : <tt>STORE R, a</tt> immédiatement
+ *   suivi de <tt>LOAD R, a</tt> (même registre, même adresse, sans point
+ *   d'entrée entre les deux) devient <tt>ADD R, #0</tt>, qui met le code
+ *   condition à jour comme le \c LOAD ;
+ *
+ *   - \b opérations neutres : <tt>ADD R, #0</tt>, <tt>MUL R, #1</tt>,
+ *   <tt>AND R, #-1</tt>... ne modifient que le code condition ; elles sont
+ *   supprimées quand celui-ci est réécrit avant d'être lu ;
+ *
+ *   - \b branchements vers l'instruction suivante et \c NOP supprimés ;
+ *
+ *   - \b code inaccessible depuis l'adresse 0 (après un \c HALT, un \c RET
+ *   ou un <tt>BRANCH NC</tt>) supprimé.
+ *
+ * Les cibles des \c BRANCH et \c CALL à adressage absolu sont ensuite
+ * relogées. Les adresses de retour n'étant produites que par \c CALL, elles
+ * sont correctes par construction. En revanche un branchement indexé a une
+ * cible inconnue : s'il en existe un, aucune instruction n'est supprimée ni
+ * déplacée et seul le chaînage des branchements est appliqué.
+ */
+
+#include <stdbool.h>
+
+#include "instruction.h"
+
+//! Bilan d'une optimisation
+typedef struct
+{
+    unsigned _threaded;		//!< Branchements redirigés
+    unsigned _forwarded;	//!< Rechargements après rangement remplacés
+    unsigned _identities;	//!< Opérations neutres supprimées
+    unsigned _jumps;		//!< Branchements vers l'instruction suivante supprimés
+    unsigned _nops;		//!< \c NOP supprimés
+    unsigned _unreachable;	//!< Instructions inaccessibles supprimées
+    bool _indirect;		//!< Présence d'un branchement indexé (pas de suppression)
+} Peephole_Report;
+
+//! Optimisation d'un segment de texte
+/*!
+ * \param textsize la taille du segment de texte
+ * \param text les instructions d'origine
+ * \param out le segment optimisé (au plus \a textsize instructions)
+ * \param relocation la nouvelle adresse de chaque ancienne adresse
+ * (\a textsize + 1 éléments ; une instruction supprimée est remplacée par
+ * l'instruction conservée qui la suit)
+ * \param report le bilan des transformations
+ * \return la taille du segment optimisé
+ */
+unsigned peephole_optimize(unsigned textsize, const Instruction text[textsize],
+                           Instruction out[], unsigned relocation[],
+                           Peephole_Report *report);
+
+#endif
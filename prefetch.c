@@ -0,0 +1,130 @@
+/*!
+ * \file prefetch.c
+ * \brief Chargement anticipé des programmes d'une exécution en série.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // pthread, mmap(), posix_fadvise()
+
+#include "prefetch.h"
+#include "metrics.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Ouverture et lecture d'un fichier (le contenu reste dans le cache du système)
+/*!
+ * Le fichier est projeté et chaque page est touchée : les pages absentes
+ * sont lues, sans copie vers un tampon.
+ */
+static Prefetch_Image load(const char *path) {
+    Prefetch_Image image = { path, open(path, O_RDONLY), 0 };
+    struct stat st;
+    if (image._fd < 0 || fstat(image._fd, &st) < 0 || st.st_size == 0)
+        return image;
+    posix_fadvise(image._fd, 0, 0, POSIX_FADV_WILLNEED);
+    const volatile char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, image._fd, 0);
+    if (map == MAP_FAILED)
+        return image;
+    long page = sysconf(_SC_PAGESIZE);
+    for (off_t off = 0; off < st.st_size; off += page)
+        (void)map[off];
+    munmap((void *)map, st.st_size);
+    image._size = st.st_size;
+    return image;
+}
+
+//! Thread du chargeur
+static void *loader(void *arg) {
+    Prefetch *pf = arg;
+    for (unsigned i = 0; i < pf->_nfiles; i++) {
+        // Contre-pression : pas plus de _depth programmes d'avance
+        pthread_mutex_lock(&pf->_lock);
+        if (pf->_count == pf->_depth && !pf->_stop) {
+            uint64_t start = metrics_now();
+            while (pf->_count == pf->_depth && !pf->_stop)
+                pthread_cond_wait(&pf->_space, &pf->_lock);
+            pf->_blocked += metrics_now() - start;
+        }
+        bool stop = pf->_stop;
+        pthread_mutex_unlock(&pf->_lock);
+        if (stop)
+            break;
+
+        Prefetch_Image image = load(pf->_files[i]);
+
+        pthread_mutex_lock(&pf->_lock);
+        pf->_queue[(pf->_head + pf->_count) % pf->_depth] = image;
+        pf->_count++;
+        pf->_bytes += image._size;
+        pthread_cond_signal(&pf->_ready);
+        pthread_mutex_unlock(&pf->_lock);
+    }
+    pthread_mutex_lock(&pf->_lock);
+    pf->_done = true;
+    pthread_cond_signal(&pf->_ready);
+    pthread_mutex_unlock(&pf->_lock);
+    return NULL;
+}
+
+Prefetch *prefetch_open(unsigned nfiles, char *const files[], unsigned depth) {
+    Prefetch *pf = calloc(1, sizeof(Prefetch));
+    pf->_nfiles = nfiles;
+    pf->_files = files;
+    pf->_depth = depth > 0 ? depth : 1;
+    pf->_queue = malloc(pf->_depth * sizeof(Prefetch_Image));
+    pthread_mutex_init(&pf->_lock, NULL);
+    pthread_cond_init(&pf->_ready, NULL);
+    pthread_cond_init(&pf->_space, NULL);
+    if (pthread_create(&pf->_thread, NULL, loader, pf) != 0) {
+        printf("Erreur: création du thread de chargement impossible\n");
+        exit(1);
+    }
+    return pf;
+}
+
+bool prefetch_next(Prefetch *pf, Prefetch_Image *image) {
+    pthread_mutex_lock(&pf->_lock);
+    if (pf->_count == 0 && !pf->_done) {
+        uint64_t start = metrics_now();
+        while (pf->_count == 0 && !pf->_done)
+            pthread_cond_wait(&pf->_ready, &pf->_lock);
+        pf->_starved += metrics_now() - start;
+    }
+    bool found = pf->_count > 0;
+    if (found) {
+        *image = pf->_queue[pf->_head];
+        pf->_head = (pf->_head + 1) % pf->_depth;
+        pf->_count--;
+        pf->_next++;
+        pthread_cond_signal(&pf->_space);
+    }
+    pthread_mutex_unlock(&pf->_lock);
+    return found;
+}
+
+void prefetch_close(Prefetch *pf) {
+    pthread_mutex_lock(&pf->_lock);
+    pf->_stop = true;
+    pthread_cond_signal(&pf->_space);
+    pthread_mutex_unlock(&pf->_lock);
+    pthread_join(pf->_thread, NULL);
+    for (; pf->_count > 0; pf->_count--, pf->_head = (pf->_head + 1) % pf->_depth)
+        if (pf->_queue[pf->_head]._fd >= 0)
+            close(pf->_queue[pf->_head]._fd);
+    pthread_cond_destroy(&pf->_space);
+    pthread_cond_destroy(&pf->_ready);
+    pthread_mutex_destroy(&pf->_lock);
+    free(pf->_queue);
+    free(pf);
+}
+
+void prefetch_report(Prefetch *pf, FILE *out) {
+    pthread_mutex_lock(&pf->_lock);
+    fprintf(out, "Préchargement : %u fichier(s) sur %u, %.1f Mio lus, file de %u ; "
+            "attente du chargeur %.3f s, chargeur bloqué (file pleine) %.3f s\n",
+            pf->_next, pf->_nfiles, pf->_bytes / 1048576.0, pf->_depth,
+            pf->_starved / 1e9, pf->_blocked / 1e9);
+    pthread_mutex_unlock(&pf->_lock);
+}
@@ -0,0 +1,105 @@
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+/*!
+ * \file prefetch.h
+ * \brief Chargement anticipé des programmes d'une exécution en série.
+ *
+ * Quand beaucoup de programmes sont exécutés les uns après les autres (voir
+ * l'outil \c regress), chaque read_program() attend ses lectures avant que
+ * simul() puisse commencer : sur un support froid, le processeur attend le
+ * disque. Le chargeur est un thread qui, pendant l'exécution du programme
+ * courant, ouvre les fichiers suivants et les lit en entier (conseil
+ * \c POSIX_FADV_WILLNEED puis projection dont chaque page est touchée) :
+ * leurs pages sont alors dans le cache du système et les projections de
+ * read_program_fd() ne font plus d'entrées sorties.
+ *
+ * Les fichiers prêts (descripteur ouvert, contenu en cache) sont rangés
+ * dans une file bornée de \a depth éléments, consommés dans l'ordre par
+ * prefetch_next(). File pleine, le chargeur s'arrête (contre-pression) : il
+ * ne prend jamais plus de \a depth programmes d'avance, ce qui borne le
+ * nombre de descripteurs ouverts et évite d'évincer du cache les fichiers
+ * pas encore consommés.
+ *
+ * Les temps d'attente relevés disent qui limite le débit : un consommateur
+ * qui attend le chargeur est limité par les entrées sorties, un chargeur
+ * bloqué sur la file pleine par le calcul.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+//! Programme prêt
+typedef struct
+{
+    const char *_path;		//!< Chemin du fichier
+    int _fd;			//!< Descripteur ouvert en lecture (-1 si l'ouverture a échoué)
+    uint64_t _size;		//!< Taille lue (octets)
+} Prefetch_Image;
+
+//! Chargeur et sa file
+typedef struct Prefetch
+{
+    // Fichiers à charger
+    unsigned _nfiles;		//!< Nombre de fichiers
+    char *const *_files;	//!< Chemins des fichiers
+    unsigned _next;		//!< Prochain fichier rendu par prefetch_next()
+
+    // File des programmes prêts
+    unsigned _depth;		//!< Capacité de la file
+    Prefetch_Image *_queue;	//!< File circulaire
+    unsigned _head;		//!< Premier élément
+    unsigned _count;		//!< Nombre d'éléments
+    bool _done;			//!< Tous les fichiers sont chargés
+    bool _stop;			//!< Arrêt demandé
+
+    // Statistiques
+    uint64_t _bytes;		//!< Octets lus
+    uint64_t _starved;		//!< Attente du consommateur, file vide (ns)
+    uint64_t _blocked;		//!< Attente du chargeur, file pleine (ns)
+
+    pthread_t _thread;		//!< Thread du chargeur
+    pthread_mutex_t _lock;	//!< Protège la file et les statistiques
+    pthread_cond_t _ready;	//!< Un programme est prêt (ou fin)
+    pthread_cond_t _space;	//!< Une place s'est libérée (ou arrêt)
+} Prefetch;
+
+//! Démarrage du chargeur
+/*!
+ * \param nfiles le nombre de fichiers
+ * \param files leurs chemins, dans l'ordre de consommation (conservés
+ * jusqu'à prefetch_close())
+ * \param depth la capacité de la file (au moins 1)
+ * \return le chargeur
+ */
+Prefetch *prefetch_open(unsigned nfiles, char *const files[], unsigned depth);
+
+//! Programme suivant
+/*!
+ * Attend, si besoin, que le programme suivant soit prêt. Le descripteur
+ * rendu appartient à l'appelant (voir read_program_fd()).
+ *
+ * \param pf le chargeur
+ * \param image le programme prêt
+ * \return faux quand tous les fichiers ont été rendus
+ */
+bool prefetch_next(Prefetch *pf, Prefetch_Image *image);
+
+//! Arrêt du chargeur
+/*!
+ * Les programmes prêts non consommés sont fermés.
+ *
+ * \param pf le chargeur
+ */
+void prefetch_close(Prefetch *pf);
+
+//! Affichage des statistiques
+/*!
+ * \param pf le chargeur
+ * \param out le flot de sortie
+ */
+void prefetch_report(Prefetch *pf, FILE *out);
+
+#endif
@@ -0,0 +1,201 @@
+/*!
+ * \file region.c
+ * \brief Régions du segment de données projetées sur des fichiers de l'hôte.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // mmap(), ftruncate(), strdup()
+
+#include "region.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Erreur fatale de déclaration d'une région
+#ifdef __GNUC__
+static void region_error(const char *name, const char *msg) __attribute__((noreturn));
+#endif
+static void region_error(const char *name, const char *msg) {
+    printf("Erreur: région %s: %s\n", name, msg);
+    exit(1);
+}
+
+//! Vérification du nom et de l'alignement d'une région
+static void check_base(Machine *pmach, const char *name, unsigned base) {
+    if (region_find(pmach, name) != NULL)
+        region_error(name, "nom déjà utilisé");
+    if (base % MEMORY_PAGE != 0)
+        region_error(name, "adresse de début non alignée sur une page");
+}
+
+//! Vérification des pages occupées par une région de size mots
+/*!
+ * La projection couvre des pages entières : au-delà de la fin du fichier,
+ * la dernière page se lit comme des zéros. Ces pages remplacent celles du
+ * segment, elles ne doivent donc contenir aucune autre donnée.
+ *
+ * \return le nombre de pages
+ */
+static unsigned check_pages(Machine *pmach, const char *name, unsigned base, unsigned size) {
+    if (size == 0)
+        region_error(name, "région vide");
+    unsigned npages = (size + MEMORY_PAGE - 1) / MEMORY_PAGE;
+    uint64_t end = (uint64_t)base + (uint64_t)npages * MEMORY_PAGE;
+    if (end > pmach->_datasize)
+        region_error(name, "déborde du segment de données");
+    if (base < pmach->_dataend)
+        region_error(name, "chevauche les données statiques");
+    if (end > (uint64_t)pmach->_sp + 1)
+        region_error(name, "chevauche la pile");
+    for (Region *r = pmach->_regions; r != NULL; r = r->_next)
+        if (base < r->_base + r->_mapsize / sizeof(Word) && r->_base < end)
+            region_error(name, "chevauche une autre région");
+    return npages;
+}
+
+//! Ajout d'une région à la machine
+static void add_region(Machine *pmach, const char *name, Region_Mode mode, unsigned base,
+                       unsigned size, const char *path, Word *map, size_t mapsize) {
+    Region *r = malloc(sizeof(Region));
+    r->_name = strdup(name);
+    r->_path = strdup(path);
+    r->_base = base;
+    r->_size = size;
+    r->_mode = mode;
+    r->_map = map;
+    r->_mapsize = mapsize;
+    r->_next = pmach->_regions;
+    pmach->_regions = r;
+}
+
+void region_map(Machine *pmach, const char *name, Region_Mode mode,
+                unsigned base, unsigned size, const char *path) {
+    check_base(pmach, name, base);
+    int fd = open(path, mode == REGION_INPUT ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        region_error(name, "ouverture du fichier impossible");
+    if (mode == REGION_INPUT) {
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (uint64_t)st.st_size / sizeof(Word) > UINT32_MAX)
+            region_error(name, "taille du fichier invalide");
+        size = st.st_size / sizeof(Word);
+    }
+    unsigned npages = check_pages(pmach, name, base, size);
+
+    if (mode == REGION_OUTPUT && ftruncate(fd, (off_t)size * sizeof(Word)) < 0)
+        region_error(name, "mise à la taille du fichier impossible");
+    size_t mapsize = (size_t)npages * MEMORY_PAGE * sizeof(Word);
+    Word *map = mmap(NULL, mapsize, mode == REGION_INPUT ? PROT_READ : PROT_READ | PROT_WRITE,
+                     mode == REGION_INPUT ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        region_error(name, "projection du fichier impossible");
+    close(fd);
+
+    memory_map_pages(pmach, base / MEMORY_PAGE, npages, map, mode == REGION_INPUT);
+    add_region(pmach, name, mode, base, size, path, map, mapsize);
+}
+
+//! Lecture d'un nombre dans une déclaration de région
+static bool parse_number(const char *s, const char *end, unsigned *value) {
+    char *stop;
+    unsigned long v = strtoul(s, &stop, 0);
+    if (stop != end || s == end || v > UINT32_MAX)
+        return false;
+    *value = v;
+    return true;
+}
+
+//! Analyse d'une déclaration de région (voir region_parse())
+/*!
+ * \param name le nom lu (au plus 255 caractères)
+ * \param path le fichier, dernier champ de \a spec
+ * \return faux si la déclaration est mal formée
+ */
+static bool parse_spec(const char *spec, char name[256], Region_Mode *mode,
+                       unsigned *base, unsigned *size, const char **path) {
+    // Découpage en champs séparés par ':' (le fichier est le dernier champ
+    // et peut lui-même contenir des ':')
+    const char *field[5];
+    unsigned nfields = 0;
+    const char *p = spec;
+    field[nfields++] = p;
+    while (nfields < 5 && (p = strchr(p, ':')) != NULL)
+        field[nfields++] = ++p;
+    if (nfields < 4)
+        return false;
+
+    size_t len = field[1] - field[0] - 1;
+    if (len == 0 || len >= 256)
+        return false;
+    memcpy(name, field[0], len);
+    name[len] = '\0';
+
+    *size = 0;
+    if (strncmp(field[1], "in:", 3) == 0) {
+        *mode = REGION_INPUT;
+        *path = field[3];
+        return parse_number(field[2], field[3] - 1, base);
+    }
+    if (strncmp(field[1], "out:", 4) == 0 && nfields == 5) {
+        *mode = REGION_OUTPUT;
+        *path = field[4];
+        return parse_number(field[2], field[3] - 1, base)
+            && parse_number(field[3], field[4] - 1, size);
+    }
+    return false;
+}
+
+bool region_parse(Machine *pmach, const char *spec) {
+    char name[256];
+    Region_Mode mode;
+    unsigned base, size;
+    const char *path;
+    if (!parse_spec(spec, name, &mode, &base, &size, &path))
+        return false;
+    region_map(pmach, name, mode, base, size, path);
+    return true;
+}
+
+bool region_declare(Machine *pmach, const char *spec) {
+    char name[256];
+    Region_Mode mode;
+    unsigned base, size;
+    const char *path;
+    if (!parse_spec(spec, name, &mode, &base, &size, &path) || path[0] == '\0')
+        return false;
+    check_base(pmach, name, base);
+    // Taille d'une entrée inconnue sans le fichier : au moins une page
+    unsigned npages = check_pages(pmach, name, base, mode == REGION_INPUT ? 1 : size);
+    add_region(pmach, name, mode, base, size, path, NULL, (size_t)npages * MEMORY_PAGE * sizeof(Word));
+    return true;
+}
+
+void region_from_env(Machine *pmach) {
+    const char *env = getenv(REGION_ENV);
+    if (env == NULL || env[0] == '\0')
+        return;
+    char *specs = strdup(env);
+    for (char *spec = strtok(specs, ","); spec != NULL; spec = strtok(NULL, ","))
+        if (!region_parse(pmach, spec)) {
+            printf("Erreur: %s: déclaration de région invalide\n", spec);
+            exit(1);
+        }
+    free(specs);
+}
+
+Region *region_find(Machine *pmach, const char *name) {
+    for (Region *r = pmach->_regions; r != NULL; r = r->_next)
+        if (strcmp(r->_name, name) == 0)
+            return r;
+    return NULL;
+}
+
+void region_sync(Machine *pmach) {
+    for (Region *r = pmach->_regions; r != NULL; r = r->_next)
+        if (r->_mode == REGION_OUTPUT)
+            msync(r->_map, r->_mapsize, MS_SYNC);
+}
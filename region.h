@@ -0,0 +1,131 @@
+#ifndef _REGION_H_
+#define _REGION_H_
+
+/*!
+ * \file region.h
+ * \brief Régions du segment de données projetées sur des fichiers de l'hôte.
+ *
+ * Une région associe un intervalle nommé du segment de données à un fichier
+ * de l'hôte, projeté (\c mmap) directement dans la mémoire paginée de la
+ * machine (voir memory.h) : aucune copie n'est faite et les instructions
+ * \c LOAD, \c STORE et l'adressage indexé y fonctionnent sans changement.
+ *
+ *   - Une région d'\b entrée est projetée en lecture seule ; sa taille est
+ *   celle du fichier (en mots). Une écriture provoque \c ERR_SEGDATA.
+ *
+ *   - Une région de \b sortie est projetée en écriture partagée : le fichier
+ *   est créé ou mis à la taille demandée et reçoit directement les écritures
+ *   du programme.
+ *
+ * Une région commence sur une frontière de page (\c MEMORY_PAGE mots) et
+ * occupe des pages entières, qui remplacent celles du segment : les mots qui
+ * suivent la fin du fichier dans sa dernière page appartiennent à la région
+ * (ils se lisent comme des zéros et sont en lecture seule pour une entrée).
+ * Ces pages doivent donc tenir dans le segment de données et ne chevaucher
+ * ni les données statiques, ni la pile en cours, ni une autre région.
+ *
+ * Les régions sont déclarées par la variable d'environnement \c REGION_ENV
+ * (voir region_from_env()), par l'option \c -r de l'outil \c optimize, qui
+ * les enregistre sans les projeter (region_declare()) dans la section
+ * \c SECTION_REGIONS d'un fichier binaire sectionné, ou par cette section.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "machine.h"
+
+//! Variable d'environnement déclarant des régions (voir region_from_env())
+#define REGION_ENV "SIMUL_REGIONS"
+
+//! Sens d'une région
+typedef enum
+{
+    REGION_INPUT = 0,	//!< Entrée : lecture seule
+    REGION_OUTPUT,	//!< Sortie : écriture dans le fichier
+} Region_Mode;
+
+//! Région projetée
+typedef struct Region
+{
+    char *_name;		//!< Nom de la région
+    char *_path;		//!< Fichier de l'hôte
+    unsigned _base;		//!< Première adresse dans le segment de données
+    unsigned _size;		//!< Taille en mots
+    Region_Mode _mode;		//!< Entrée ou sortie
+    Word *_map;			//!< Projection du fichier (NULL si seulement déclarée)
+    size_t _mapsize;		//!< Taille de la projection ou des pages réservées (octets)
+    struct Region *_next;	//!< Région suivante de la machine
+} Region;
+
+//! Projection d'un fichier dans le segment de données
+/*!
+ * Toute incohérence (alignement, débordement du segment, chevauchement des
+ * pages de la région avec d'autres données, fichier inaccessible) est
+ * fatale.
+ *
+ * \param pmach la machine (programme déjà chargé)
+ * \param name le nom de la région
+ * \param mode entrée ou sortie
+ * \param base la première adresse de la région
+ * \param size la taille en mots (sortie seulement ; ignorée en entrée)
+ * \param path le fichier de l'hôte
+ */
+void region_map(Machine *pmach, const char *name, Region_Mode mode,
+                unsigned base, unsigned size, const char *path);
+
+//! Déclaration d'une région sous forme textuelle (ligne de commande)
+/*!
+ * Syntaxes acceptées (adresses et tailles en décimal ou en hexadécimal
+ * préfixé par \c 0x) :
+ *
+ *   - <tt>nom:in:base:fichier</tt>
+ *   - <tt>nom:out:base:taille:fichier</tt>
+ *
+ * \param pmach la machine (programme déjà chargé)
+ * \param spec la déclaration
+ * \return faux si la déclaration est mal formée
+ */
+bool region_parse(Machine *pmach, const char *spec);
+
+//! Déclaration d'une région sans projection (enregistrement dans un fichier)
+/*!
+ * La déclaration, au format de region_parse(), est vérifiée et ajoutée aux
+ * régions de la machine, pour être écrite dans la section
+ * \c SECTION_REGIONS ; le fichier n'est ni ouvert, ni créé, ni projeté
+ * (il le sera au chargement du programme). La taille d'une entrée, inconnue
+ * sans le fichier, est vérifiée à raison d'une page.
+ *
+ * \param pmach la machine (programme construit, non exécuté)
+ * \param spec la déclaration
+ * \return faux si la déclaration est mal formée
+ */
+bool region_declare(Machine *pmach, const char *spec);
+
+//! Recherche d'une région par son nom
+/*!
+ * \param pmach la machine
+ * \param name le nom cherché
+ * \return la région, ou NULL
+ */
+Region *region_find(Machine *pmach, const char *name);
+
+//! Déclaration des régions de la variable d'environnement \c REGION_ENV
+/*!
+ * La variable contient des déclarations au format de region_parse(),
+ * séparées par des virgules (les fichiers ne peuvent donc pas en contenir) ;
+ * une déclaration mal formée est fatale.
+ * Appelée au début de simul(), après memory_from_env() ; sans effet si la
+ * variable est absente ou vide.
+ *
+ * \param pmach la machine (programme chargé)
+ */
+void region_from_env(Machine *pmach);
+
+//! Écriture sur disque des régions de sortie
+/*!
+ * \param pmach la machine
+ */
+void region_sync(Machine *pmach);
+
+#endif
@@ -0,0 +1,503 @@
+/*!
+ * \file regress.c
+ * \brief Tests de non-régression sur un ensemble de programmes (outil autonome).
+ *
+ * Usage : <tt>regress [-j tâches] [-l limite] [-L] [-p profondeur] [-s pile] [-u] [-v] chemin...</tt>
+ *
+ * Chaque \a chemin est un programme (\c .bin, lu par read_program(), ou
+ * \c .asm, assemblé en mémoire) ou un répertoire dont tous les programmes
+ * sont pris. Chaque programme est exécuté par simul() dans un processus fils,
+ * au plus \a tâches à la fois (par défaut le nombre de processeurs), jusqu'à
+ * \c HALT, une erreur d'exécution ou \a limite instructions (10^8 par défaut,
+ * compte tenu par un greffon, voir hooks.h). Avec
+ * \c -L, un programme bloqué dans une boucle infinie est arrêté dès la
+ * détection (loopcheck.h), sur l'erreur \c ERR_LOOP.
+ *
+ * Pendant les exécutions, un chargeur (prefetch.h) ouvre et lit à l'avance
+ * les programmes suivants, au plus \a profondeur (par défaut deux fois le
+ * nombre de tâches, 0 pour désactiver) : chaque processus fils reçoit un
+ * descripteur ouvert dont le contenu est déjà dans le cache du système.
+ *
+ * L'état final est résumé sous forme texte, un champ par ligne : issue, code
+ * et adresse de l'erreur, nombre d'instructions, \c pc, \c cc, registres et
+ * empreinte (64 bits) du segment de données, suivie de l'empreinte de chaque
+ * page de \c MEMORY_PAGE mots non nulle. Les pages nulles étant ignorées,
+ * l'empreinte ne dépend pas de la représentation de la mémoire (à plat ou
+ * paginée).
+ *
+ * Ce résumé est comparé au fichier de référence \c programme.golden placé à
+ * côté du programme ; les champs qui diffèrent sont affichés. Avec \c -u, les
+ * références sont (ré)écrites. Le code de retour est non nul si un programme
+ * diffère de sa référence ou n'en a pas.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // getopt(), poll(), opendir()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "machine.h"
+#include "error.h"
+#include "memory.h"
+#include "assembler.h"
+#include "loopcheck.h"
+#include "hooks.h"
+#include "prefetch.h"
+
+//! Programme à vérifier
+typedef struct
+{
+    char *_path;		//!< Chemin du programme
+    char *_report;		//!< Résumé de l'état final (NULL avant la fin)
+    size_t _length;		//!< Longueur du résumé
+    size_t _capacity;		//!< Capacité du tampon
+    pid_t _pid;			//!< Processus en cours (0 sinon)
+    int _fd;			//!< Lecture du résumé (-1 sinon)
+} Job;
+
+static Job *jobs;
+static unsigned njobs, capjobs;
+
+//! Machine du processus fils
+static Machine *run_machine;
+//! Sortie du résumé dans le processus fils
+static FILE *run_out;
+
+//! Options de l'exécution
+static unsigned long long limit = 100000000ull;
+static unsigned stacksize = ASM_STACKSIZE;
+static bool loops = false;
+
+//! Chargeur des programmes suivants (NULL si désactivé)
+static Prefetch *prefetch;
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-j tâches] [-l limite] [-L] [-p profondeur] [-s pile] [-u] [-v] chemin...\n", prog);
+    exit(1);
+}
+
+//! Empreinte de n mots (mélange multiplicatif sur 64 bits)
+static uint64_t digest(uint64_t h, const Word *words, unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        h = (h ^ (uint32_t)words[i]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+//! Écriture du résumé de l'état final
+static void report(const char *status, Error err, unsigned addr) {
+    Machine *pmach = run_machine;
+    static const char cc_names[] = "UZPN";
+    FILE *f = run_out;
+    fprintf(f, "issue %s\n", status);
+    fprintf(f, "erreur %u\n", err);
+    fprintf(f, "adresse %04x\n", addr);
+    fprintf(f, "instructions %llu\n", pmach->_retired);
+    fprintf(f, "pc %04x\n", pmach->_pc);
+    fprintf(f, "cc %c\n", cc_names[pmach->_cc & 3]);
+    for (unsigned r = 0; r < NREGISTERS; r++)
+        fprintf(f, "r%02u %08x\n", r, (uint32_t)pmach->_registers[r]);
+
+    // Empreinte par page non nulle, puis des couples (page, empreinte)
+    static Word frame[MEMORY_PAGE];
+    uint64_t total = 0xcbf29ce484222325ull;
+    unsigned npages = (pmach->_datasize + MEMORY_PAGE - 1) >> MEMORY_PAGE_BITS;
+    char *lines = NULL;
+    size_t size = 0;
+    FILE *pf = open_memstream(&lines, &size);
+    for (unsigned page = 0; page < npages; page++) {
+        if (!memory_page_present(pmach, page))
+            continue;
+        unsigned first = page << MEMORY_PAGE_BITS;
+        unsigned n = pmach->_datasize - first < MEMORY_PAGE ? pmach->_datasize - first : MEMORY_PAGE;
+        read_block(pmach, first, frame, n);
+        unsigned k = 0;
+        while (k < n && frame[k] == 0)
+            k++;
+        if (k == n)
+            continue;
+        uint64_t h = digest(0xcbf29ce484222325ull, frame, n);
+        Word pair[3] = { page, (Word)h, (Word)(h >> 32) };
+        total = digest(total, pair, 3);
+        fprintf(pf, "page %05x %016llx\n", page, (unsigned long long)h);
+    }
+    fclose(pf);
+    fprintf(f, "donnees %016llx\n", (unsigned long long)total);
+    fputs(lines, f);
+    free(lines);
+    fflush(f);
+}
+
+static void on_error(Error err, unsigned addr) {
+    report("erreur", err, addr);
+}
+
+//! Arrêt après \c limit instructions exécutées
+static void on_retire(Machine *pmach, void *data, unsigned pc, Instruction instr) {
+    if (pmach->_retired >= limit) {
+        report("limite", ERR_NOERROR, 0);
+        exit(0);
+    }
+}
+
+//! Greffon de la limite d'instructions
+static const Hook_Plugin limiter = { "regress", NULL, on_retire, NULL, NULL, NULL, NULL, NULL, NULL };
+
+//! Exécution d'un programme (processus fils)
+/*!
+ * \param path le chemin du programme
+ * \param fd la sortie du résumé
+ * \param image le programme ouvert par le chargeur (-1 : à ouvrir)
+ */
+static void child(const char *path, int fd, int image) {
+    static Machine mach;
+    run_out = fdopen(fd, "w");
+    if (freopen("/dev/null", "w", stdout) == NULL)
+        _exit(1);
+    const char *dot = strrchr(path, '.');
+    if (dot != NULL && strcmp(dot, ".asm") == 0) {
+        Assembly assembly;
+        if (image >= 0)
+            close(image); // contenu en cache : l'assembleur relit le fichier
+        if (!assemble_file(path, stacksize, &assembly)) {
+            fprintf(run_out, "issue assemblage\nerreurs %u\n", assembly._errors);
+            exit(1);
+        }
+        load_program(&mach, assembly._textsize, assembly._text,
+                     assembly._datasize, assembly._data, assembly._dataend);
+    } else if (image >= 0) {
+        read_program_fd(&mach, image, path);
+    } else {
+        read_program(&mach, path);
+    }
+    run_machine = &mach;
+    set_error_hook(on_error);
+    if (loops)
+        loopcheck_open(&mach);
+    if (!hooks_register(&mach, &limiter)) {
+        fprintf(run_out, "issue greffons indisponibles\n");
+        exit(1);
+    }
+    simul(&mach, false);
+    report("HALT", ERR_NOERROR, 0);
+    exit(0);
+}
+
+//! Ajout d'un programme à vérifier
+static void add_job(const char *path) {
+    if (njobs == capjobs) {
+        capjobs = capjobs == 0 ? 32 : 2 * capjobs;
+        jobs = realloc(jobs, capjobs * sizeof(Job));
+    }
+    jobs[njobs++] = (Job) { ._path = strdup(path), ._fd = -1 };
+}
+
+static bool is_program(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot != NULL && (strcmp(dot, ".bin") == 0 || strcmp(dot, ".asm") == 0);
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+//! Ajout d'un programme ou des programmes d'un répertoire (ordre alphabétique)
+static void add_path(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        printf("Erreur: %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        add_job(path);
+        return;
+    }
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        printf("Erreur: %s: répertoire illisible\n", path);
+        exit(1);
+    }
+    char **names = NULL;
+    unsigned n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (!is_program(e->d_name))
+            continue;
+        if (n == cap) {
+            cap = cap == 0 ? 32 : 2 * cap;
+            names = realloc(names, cap * sizeof(char *));
+        }
+        names[n] = malloc(strlen(path) + strlen(e->d_name) + 2);
+        sprintf(names[n++], "%s/%s", path, e->d_name);
+    }
+    closedir(d);
+    qsort(names, n, sizeof(char *), compare_names);
+    for (unsigned i = 0; i < n; i++) {
+        add_job(names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+//! Lancement d'un programme
+static void start(Job *job) {
+    Prefetch_Image image = { job->_path, -1, 0 };
+    if (prefetch != NULL && !prefetch_next(prefetch, &image)) {
+        printf("Erreur: %s absent du chargeur\n", job->_path);
+        exit(1);
+    }
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        child(job->_path, fds[1], image._fd);
+    }
+    close(fds[1]);
+    if (image._fd >= 0)
+        close(image._fd);
+    job->_pid = pid;
+    job->_fd = fds[0];
+    job->_capacity = 4096;
+    job->_report = malloc(job->_capacity);
+    job->_length = 0;
+}
+
+//! Lecture de la sortie d'un programme ; fin du processus à la fin du fichier
+/*!
+ * \return vrai si le programme est terminé
+ */
+static bool drain(Job *job) {
+    if (job->_capacity - job->_length < 1024) {
+        job->_capacity *= 2;
+        job->_report = realloc(job->_report, job->_capacity);
+    }
+    ssize_t n = read(job->_fd, job->_report + job->_length, job->_capacity - job->_length - 1);
+    if (n > 0) {
+        job->_length += n;
+        return false;
+    }
+    if (n < 0 && errno == EINTR)
+        return false;
+    close(job->_fd);
+    job->_fd = -1;
+    int status;
+    waitpid(job->_pid, &status, 0);
+    job->_pid = 0;
+    if (job->_length == 0) // processus mort sans résumé (signal, chargement impossible)
+        job->_length = sprintf(job->_report, "issue processus\nstatut %d\n", status);
+    job->_report[job->_length] = '\0';
+    return true;
+}
+
+//! Exécution de tous les programmes, au plus ntasks à la fois
+static void run_all(unsigned ntasks) {
+    struct pollfd *fds = malloc(ntasks * sizeof(struct pollfd));
+    unsigned *running = malloc(ntasks * sizeof(unsigned));
+    unsigned next = 0, nrunning = 0;
+    while (next < njobs || nrunning > 0) {
+        while (nrunning < ntasks && next < njobs) {
+            start(&jobs[next]);
+            running[nrunning++] = next++;
+        }
+        for (unsigned i = 0; i < nrunning; i++)
+            fds[i] = (struct pollfd) { .fd = jobs[running[i]]._fd, .events = POLLIN };
+        if (poll(fds, nrunning, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(1);
+        }
+        for (unsigned i = nrunning; i-- > 0; )
+            if (fds[i].revents != 0 && drain(&jobs[running[i]]))
+                running[i] = running[--nrunning];
+    }
+    free(fds);
+    free(running);
+}
+
+//! Champ suivant d'un résumé : clé (premier mot) et valeur (reste de la ligne)
+/*!
+ * Les lignes \c page ont pour clé les deux premiers mots.
+ *
+ * \return le début de la ligne suivante, NULL à la fin
+ */
+static const char *next_field(const char *p, char *key, size_t keysize, const char **value, size_t *vlen) {
+    if (p == NULL || *p == '\0')
+        return NULL;
+    const char *eol = strchr(p, '\n');
+    if (eol == NULL)
+        eol = p + strlen(p);
+    const char *sp = memchr(p, ' ', eol - p);
+    if (sp != NULL && strncmp(p, "page ", 5) == 0) {
+        const char *sp2 = memchr(sp + 1, ' ', eol - sp - 1);
+        sp = sp2 != NULL ? sp2 : sp;
+    }
+    if (sp == NULL)
+        sp = eol;
+    size_t klen = (size_t)(sp - p) < keysize - 1 ? (size_t)(sp - p) : keysize - 1;
+    memcpy(key, p, klen);
+    key[klen] = '\0';
+    *value = sp < eol ? sp + 1 : eol;
+    *vlen = eol - *value;
+    return *eol == '\n' ? eol + 1 : eol;
+}
+
+//! Recherche d'un champ dans un résumé
+static bool find_field(const char *report, const char *key, const char **value, size_t *vlen) {
+    char k[64];
+    for (const char *p = report; (p = next_field(p, k, sizeof(k), value, vlen)) != NULL; )
+        if (strcmp(k, key) == 0)
+            return true;
+    return false;
+}
+
+//! Affichage des champs qui diffèrent
+/*!
+ * \return le nombre de champs différents
+ */
+static unsigned diff(const char *golden, const char *actual) {
+    unsigned ndiff = 0;
+    char key[64];
+    const char *v, *w;
+    size_t vlen, wlen;
+    for (const char *p = golden; (p = next_field(p, key, sizeof(key), &v, &vlen)) != NULL; ) {
+        if (!find_field(actual, key, &w, &wlen)) {
+            printf("    %-14s %.*s (référence) / absent\n", key, (int)vlen, v);
+            ndiff++;
+        } else if (vlen != wlen || memcmp(v, w, vlen) != 0) {
+            printf("    %-14s %.*s (référence) / %.*s\n", key, (int)vlen, v, (int)wlen, w);
+            ndiff++;
+        }
+    }
+    for (const char *p = actual; (p = next_field(p, key, sizeof(key), &w, &wlen)) != NULL; )
+        if (!find_field(golden, key, &v, &vlen)) {
+            printf("    %-14s absent (référence) / %.*s\n", key, (int)wlen, w);
+            ndiff++;
+        }
+    return ndiff;
+}
+
+//! Lecture d'un fichier entier (NULL s'il n'existe pas)
+static char *read_file(const char *file) {
+    FILE *f = fopen(file, "r");
+    if (f == NULL)
+        return NULL;
+    size_t cap = 4096, len = 0, n;
+    char *buf = malloc(cap);
+    while ((n = fread(buf + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (cap - len < 1024)
+            buf = realloc(buf, cap *= 2);
+    }
+    fclose(f);
+    buf[len] = '\0';
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    bool update = false, verbose = false;
+    long ntasks = sysconf(_SC_NPROCESSORS_ONLN), depth = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:l:Lp:s:uv")) != -1) {
+        switch (opt) {
+        case 'j':
+            ntasks = strtol(optarg, NULL, 0);
+            break;
+        case 'l':
+            limit = strtoull(optarg, NULL, 0);
+            break;
+        case 'L':
+            loops = true;
+            break;
+        case 'p':
+            depth = strtol(optarg, NULL, 0);
+            break;
+        case 's':
+            stacksize = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            update = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind < 1)
+        usage(argv[0]);
+    if (ntasks < 1)
+        ntasks = 1;
+    for (int i = optind; i < argc; i++)
+        add_path(argv[i]);
+
+    char **paths = malloc(njobs * sizeof(char *));
+    for (unsigned i = 0; i < njobs; i++)
+        paths[i] = jobs[i]._path;
+    if (depth < 0)
+        depth = 2 * ntasks;
+    if (depth > 0 && njobs > 0)
+        prefetch = prefetch_open(njobs, paths, depth);
+
+    run_all(ntasks);
+
+    if (prefetch != NULL) {
+        if (verbose)
+            prefetch_report(prefetch, stdout);
+        prefetch_close(prefetch);
+    }
+    free(paths);
+
+    unsigned failed = 0, missing = 0, written = 0;
+    char golden_file[4096];
+    for (unsigned i = 0; i < njobs; i++) {
+        Job *job = &jobs[i];
+        snprintf(golden_file, sizeof(golden_file), "%s.golden", job->_path);
+        char *golden = read_file(golden_file);
+        bool same = golden != NULL && strcmp(golden, job->_report) == 0;
+        if (update && !same) {
+            FILE *f = fopen(golden_file, "w");
+            if (f == NULL || fputs(job->_report, f) == EOF) {
+                printf("Erreur: %s: écriture impossible\n", golden_file);
+                exit(1);
+            }
+            fclose(f);
+            printf("%-40s référence %s\n", job->_path, golden == NULL ? "créée" : "mise à jour");
+            written++;
+        } else if (golden == NULL) {
+            printf("%-40s PAS DE RÉFÉRENCE (%s)\n", job->_path, golden_file);
+            missing++;
+        } else if (!same) {
+            printf("%-40s DIFFÉRENT\n", job->_path);
+            diff(golden, job->_report);
+            failed++;
+        } else if (verbose) {
+            printf("%-40s ok\n", job->_path);
+        }
+        free(golden);
+    }
+    printf("%u programme(s) : %u identique(s), %u différent(s), %u sans référence",
+           njobs, njobs - failed - missing - written, failed, missing);
+    if (update)
+        printf(", %u référence(s) écrite(s)", written);
+    printf("\n");
+    return failed != 0 || missing != 0;
+}
@@ -0,0 +1,226 @@
+/*!
+ * \file sampler.c
+ * \brief Simulation échantillonnée : avance rapide et fenêtres de mesure.
+ */
+
+#include "sampler.h"
+#include "cache.h"
+#include "timing.h"
+#include "branchprof.h"
+#include "hooks.h"
+#include "memprof.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Quantiles à 97,5 % de la loi de Student pour 1 à 30 degrés de liberté
+static const double student[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+//! Relevé des compteurs cumulés des modèles attachés
+/*!
+ * \param pmach la machine (modèles attachés)
+ * \param values les valeurs (\c SAMPLER_MAXMETRICS éléments)
+ * \param names leurs noms (NULL si inutiles)
+ * \return le nombre de compteurs
+ */
+static unsigned read_counters(Machine *pmach, double *values, char (*names)[32]) {
+    unsigned n = 0;
+#define COUNTER(value, ...) do { \
+        if (n < SAMPLER_MAXMETRICS) { \
+            if (names != NULL) \
+                snprintf(names[n], sizeof(names[n]), __VA_ARGS__); \
+            values[n++] = (value); \
+        } \
+    } while (0)
+    if (pmach->_timing != NULL) {
+        Timing *t = pmach->_timing;
+        timing_flush(pmach);
+        COUNTER(t->_last, "cycles");
+        COUNTER(t->_total._data + t->_total._control + t->_total._memory, "cycles de suspension");
+        COUNTER(t->_mispredicts, "erreurs de prédiction");
+    }
+    if (pmach->_cache != NULL) {
+        Cache *c = pmach->_cache;
+        cache_flush(pmach);
+        for (unsigned i = 0; i < c->_nlevels; i++) {
+            const Cache_Stats *s = &c->_levels[i]._stats;
+            COUNTER(s->_hits + s->_misses, "accès L%u", i + 1);
+            COUNTER(s->_misses, "défauts L%u", i + 1);
+        }
+    }
+    if (pmach->_branchprof != NULL) {
+        unsigned long long taken = 0, mispredicts = 0;
+        for (unsigned a = 0; a < pmach->_textsize; a++) {
+            taken += pmach->_branchprof->_records[a]._taken;
+            mispredicts += pmach->_branchprof->_records[a]._mispredicts[1];
+        }
+        COUNTER(taken, "branchements pris");
+        COUNTER(mispredicts, "erreurs bimodal");
+    }
+#undef COUNTER
+    return n;
+}
+
+//! Lecture d'un nombre d'instructions (suffixes K, M et G)
+static bool parse_count(const char **p, unsigned long long *value) {
+    char *end;
+    unsigned long long v = strtoull(*p, &end, 10);
+    if (end == *p)
+        return false;
+    if (*end == 'K' || *end == 'k') {
+        v *= 1000;
+        end++;
+    } else if (*end == 'M') {
+        v *= 1000000;
+        end++;
+    } else if (*end == 'G') {
+        v *= 1000000000;
+        end++;
+    }
+    *value = v;
+    *p = end;
+    return true;
+}
+
+//! Attachement des modèles à la machine
+static void attach(Machine *pmach, Sampler *s) {
+    pmach->_cache = s->_cache;
+    pmach->_timing = s->_timing;
+    pmach->_branchprof = s->_branchprof;
+    pmach->_hooks = s->_hooks;
+}
+
+//! Détachement des modèles (avance rapide)
+static void detach(Machine *pmach, Sampler *s) {
+    s->_cache = pmach->_cache;
+    s->_timing = pmach->_timing;
+    s->_branchprof = pmach->_branchprof;
+    s->_hooks = pmach->_hooks;
+    pmach->_cache = NULL;
+    pmach->_timing = NULL;
+    pmach->_branchprof = NULL;
+    pmach->_hooks = NULL;
+    // Le profil des accès couvre toute l'exécution (masque de tous les
+    // greffons : les rappels absents de memprof sont ignorés)
+    if (pmach->_memprof != NULL && s->_hooks != NULL) {
+        s->_forward = (Hooks) { ._nplugins = 1, ._mask = s->_hooks->_mask };
+        s->_forward._plugins[0] = &pmach->_memprof->_plugin;
+        pmach->_hooks = &s->_forward;
+    }
+}
+
+//! Durée de la prochaine avance rapide
+static unsigned long long forward_length(Sampler *s) {
+    unsigned long long f = s->_period - s->_warmup - s->_window;
+    if (!s->_random || f == 0)
+        return f;
+    s->_seed ^= s->_seed << 13;
+    s->_seed ^= s->_seed >> 7;
+    s->_seed ^= s->_seed << 17;
+    return s->_seed % (2 * f + 1);
+}
+
+bool sampler_open(Machine *pmach, const char *spec) {
+    Sampler *s = calloc(1, sizeof(Sampler));
+    const char *p = spec != NULL ? spec : SAMPLER_DEFAULT;
+    s->_seed = 0x9e3779b97f4a7c15ull;
+    bool ok = parse_count(&p, &s->_period) && *p++ == ':'
+        && parse_count(&p, &s->_warmup) && *p++ == ':'
+        && parse_count(&p, &s->_window);
+    if (ok && strncmp(p, ":random", 7) == 0) {
+        s->_random = true;
+        p += 7;
+        if (*p == ':') {
+            p++;
+            ok = parse_count(&p, &s->_seed) && s->_seed != 0;
+        }
+    }
+    ok = ok && *p == '\0' && s->_window > 0 && s->_warmup + s->_window <= s->_period;
+    if (ok)
+        sampler_close(pmach); // modèles rattachés
+    if (!ok || (pmach->_cache == NULL && pmach->_timing == NULL
+                && pmach->_branchprof == NULL && pmach->_hooks == NULL)) {
+        free(s);
+        return false;
+    }
+    double values[SAMPLER_MAXMETRICS];
+    char names[SAMPLER_MAXMETRICS][32];
+    s->_nmetrics = read_counters(pmach, values, names);
+    for (unsigned m = 0; m < s->_nmetrics; m++)
+        strcpy(s->_metrics[m]._name, names[m]);
+    s->_begin = pmach->_retired;
+    s->_phase = SAMPLER_FORWARD;
+    s->_next = pmach->_retired + forward_length(s);
+    detach(pmach, s);
+    pmach->_sampler = s;
+    sampler_step(pmach); // avance rapide nulle
+    return true;
+}
+
+void sampler_close(Machine *pmach) {
+    Sampler *s = pmach->_sampler;
+    if (s == NULL)
+        return;
+    if (s->_phase == SAMPLER_FORWARD)
+        attach(pmach, s);
+    free(s);
+    pmach->_sampler = NULL;
+}
+
+void sampler_step(Machine *pmach) {
+    Sampler *s = pmach->_sampler;
+    double values[SAMPLER_MAXMETRICS];
+    while (pmach->_retired >= s->_next) {
+        switch (s->_phase) {
+        case SAMPLER_FORWARD:
+            attach(pmach, s);
+            s->_phase = SAMPLER_WARMUP;
+            s->_next += s->_warmup;
+            break;
+        case SAMPLER_WARMUP: // début de la mesure
+            read_counters(pmach, values, NULL);
+            for (unsigned m = 0; m < s->_nmetrics; m++)
+                s->_metrics[m]._start = values[m];
+            s->_phase = SAMPLER_MEASURE;
+            s->_next += s->_window;
+            break;
+        case SAMPLER_MEASURE: // taux de la fenêtre (moyenne et variance incrémentales)
+            read_counters(pmach, values, NULL);
+            s->_windows++;
+            for (unsigned m = 0; m < s->_nmetrics; m++) {
+                Sampler_Metric *sm = &s->_metrics[m];
+                double rate = (values[m] - sm->_start) / s->_window, delta = rate - sm->_mean;
+                sm->_mean += delta / s->_windows;
+                sm->_m2 += delta * (rate - sm->_mean);
+            }
+            detach(pmach, s);
+            s->_phase = SAMPLER_FORWARD;
+            s->_next += forward_length(s);
+            break;
+        }
+    }
+}
+
+void sampler_report(Machine *pmach, FILE *out) {
+    const Sampler *s = pmach->_sampler;
+    unsigned long long total = pmach->_retired - s->_begin, k = s->_windows;
+    fprintf(out, "\n*** Échantillonnage ***\n");
+    fprintf(out, "Instructions : %llu, mesurées %llu (%.2f%%) en %llu fenêtres de %llu "
+            "(préchauffage %llu, période %llu%s)\n",
+            total, k * s->_window, total == 0 ? 0.0 : 100.0 * k * s->_window / total,
+            k, s->_window, s->_warmup, s->_period, s->_random ? " aléatoire" : "");
+    if (k == 0)
+        return;
+    double t = k < 2 ? 0 : k <= 31 ? student[k - 2] : 1.96;
+    for (unsigned m = 0; m < s->_nmetrics; m++) {
+        const Sampler_Metric *sm = &s->_metrics[m];
+        double half = k < 2 ? 0 : t * sqrt(sm->_m2 / (k - 1) / k);
+        fprintf(out, "  %s : %.4f ± %.4f par instruction, total estimé %.0f ± %.0f%s\n",
+                sm->_name, sm->_mean, half, sm->_mean * total, half * total,
+                k < 2 ? " (une fenêtre : pas d'intervalle)" : "");
+    }
+}
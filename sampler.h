@@ -0,0 +1,143 @@
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+/*!
+ * \file sampler.h
+ * \brief Simulation échantillonnée : avance rapide et fenêtres de mesure.
+ *
+ * Les modèles détaillés (cache.h, timing.h, branchprof.h) et les greffons
+ * (hooks.h) ralentissent fortement la simulation. Quand l'échantillonnage
+ * est actif (\c Machine::_sampler non NULL), simul() enchaîne des cycles de
+ * trois phases :
+ *
+ *   - <b>avance rapide</b> : les modèles et greffons sont détachés de la
+ *   machine (leurs pointeurs sont mis à NULL), l'exécution ne paie que leurs
+ *   tests ; seul le profil des accès aux données (memprof.h) reste attaché,
+ *   car la pile minimale et la taille suffisante du segment portent sur
+ *   toute l'exécution ;
+ *
+ *   - <b>préchauffage</b> : les modèles sont rattachés et mettent à jour leur
+ *   état (contenu des caches, prédicteurs, disponibilité des registres) sans
+ *   que leurs compteurs soient retenus ;
+ *
+ *   - <b>mesure</b> : les compteurs des modèles sont relevés au début et à la
+ *   fin de la fenêtre ; leur différence rapportée au nombre d'instructions
+ *   donne un taux par instruction (cycles, défauts de cache...).
+ *
+ * La période (somme des trois phases) est fixe ou, en mode aléatoire, la
+ * durée de chaque avance rapide est tirée uniformément entre 0 et le double
+ * de sa valeur nominale, ce qui évite de se synchroniser sur une boucle du
+ * programme.
+ *
+ * À la fin, chaque taux est estimé par la moyenne des fenêtres, avec un
+ * intervalle de confiance à 95 % (loi de Student) ; multiplié par le nombre
+ * total d'instructions, il donne l'estimation pour toute l'exécution. Les
+ * bilans propres des modèles, affichés ensuite, ne portent que sur les
+ * instructions préchauffées et mesurées (sauf celui de memprof).
+ *
+ * Les modèles à échantillonner doivent être actifs avant sampler_open().
+ * La configuration s'écrit <tt>PÉRIODE:PRÉCHAUFFAGE:FENÊTRE[:random[:GRAINE]]</tt>,
+ * en instructions (suffixes \c K, \c M et \c G pour 10^3, 10^6 et 10^9).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "machine.h"
+#include "hooks.h"
+
+//! Configuration par défaut : 1 % de préchauffage et 1 % de mesure
+#define SAMPLER_DEFAULT "1M:10K:10K"
+
+//! Nombre maximal de taux estimés
+#define SAMPLER_MAXMETRICS 16
+
+//! Phase de l'échantillonnage
+typedef enum
+{
+    SAMPLER_FORWARD = 0,	//!< Avance rapide
+    SAMPLER_WARMUP,		//!< Préchauffage
+    SAMPLER_MEASURE,		//!< Mesure
+} Sampler_Phase;
+
+//! Estimation d'un taux par instruction
+typedef struct
+{
+    char _name[32];		//!< Nom du compteur
+    double _start;		//!< Valeur au début de la fenêtre en cours
+    double _mean;		//!< Moyenne des taux des fenêtres
+    double _m2;			//!< Somme des carrés des écarts à la moyenne
+} Sampler_Metric;
+
+//! Échantillonnage d'une machine
+typedef struct Sampler
+{
+    // Configuration
+    unsigned long long _period;		//!< Longueur d'un cycle
+    unsigned long long _warmup;		//!< Longueur du préchauffage
+    unsigned long long _window;		//!< Longueur de la fenêtre de mesure
+    bool _random;			//!< Avance rapide de durée aléatoire
+    unsigned long long _seed;		//!< État du générateur aléatoire
+
+    // État
+    Sampler_Phase _phase;		//!< Phase en cours
+    unsigned long long _next;		//!< Fin de la phase (en instructions exécutées)
+    unsigned long long _begin;		//!< Instructions exécutées à l'activation
+    unsigned long long _windows;	//!< Fenêtres mesurées
+
+    // Modèles détachés pendant l'avance rapide
+    struct Cache *_cache;		//!< Modèle de cache
+    struct Timing *_timing;		//!< Modèle temporel
+    struct Branch_Profile *_branchprof;	//!< Profil des branchements
+    struct Hooks *_hooks;		//!< Greffons
+    Hooks _forward;			//!< Greffons gardés pendant l'avance rapide (memprof)
+
+    unsigned _nmetrics;			//!< Nombre de taux estimés
+    Sampler_Metric _metrics[SAMPLER_MAXMETRICS]; //!< Taux estimés
+} Sampler;
+
+//! Activation de l'échantillonnage
+/*!
+ * Les taux estimés sont ceux des modèles actifs. Un échantillonnage déjà
+ * actif est remplacé ; l'exécution commence par une avance rapide.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param spec la configuration (NULL : \c SAMPLER_DEFAULT)
+ * \return faux si la configuration est incorrecte ou si aucun modèle ni
+ * greffon n'est actif
+ */
+bool sampler_open(Machine *pmach, const char *spec);
+
+//! Désactivation de l'échantillonnage (les modèles sont rattachés)
+/*!
+ * \param pmach la machine
+ */
+void sampler_close(Machine *pmach);
+
+//! Changement de phase (appelée par sampler_tick())
+/*!
+ * \param pmach la machine
+ */
+void sampler_step(Machine *pmach);
+
+//! Affichage des estimations pour les instructions exécutées jusque-là
+/*!
+ * \param pmach la machine (échantillonnage actif)
+ * \param out le flot de sortie
+ */
+void sampler_report(Machine *pmach, FILE *out);
+
+//! Fin d'une instruction
+/*!
+ * Appelée par simul() quand \c Machine::_sampler n'est pas NULL : une
+ * comparaison par instruction hors changement de phase.
+ *
+ * \param pmach la machine
+ */
+static inline void sampler_tick(Machine *pmach) {
+    if (pmach->_retired >= pmach->_sampler->_next)
+        sampler_step(pmach);
+}
+
+#endif
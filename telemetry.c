@@ -0,0 +1,166 @@
+/*!
+ * \file telemetry.c
+ * \brief Publication de l'état de la simulation en mémoire partagée.
+ */
+
+#define _POSIX_C_SOURCE 200809L  // shm_open(), ftruncate(), kill()
+
+#include "telemetry.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Publication en cours du processus (erreurs fatales, fin du processus)
+static Machine *current = NULL;
+
+//! Écriture atomique relâchée
+#define STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+//! Suppression du segment à la fin du processus (sortie sur erreur)
+static void at_exit(void) {
+    if (current != NULL && current->_telemetry != NULL)
+        shm_unlink(current->_telemetry->_name);
+}
+
+//! Intervalle jusqu'à la prochaine publication, entre 1/2 et 3/2 lot
+static uint64_t interval(Telemetry *t) {
+    t->_random ^= t->_random << 13;
+    t->_random ^= t->_random >> 7;
+    t->_random ^= t->_random << 17;
+    return TELEMETRY_BATCH / 2 + t->_random % TELEMETRY_BATCH;
+}
+
+//! Le segment existant peut-il être remplacé ?
+/*!
+ * Oui s'il a été publié par un processus terminé ou par ce processus ; un
+ * segment en cours de création ou d'un autre format n'est pas touché.
+ */
+static bool replaceable(const char *shm) {
+    int fd = shm_open(shm, O_RDONLY, 0);
+    if (fd < 0)
+        return errno == ENOENT;
+    struct stat st;
+    const Telemetry_Block *b = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Telemetry_Block))
+        b = mmap(NULL, sizeof(Telemetry_Block), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (b == MAP_FAILED)
+        return false;
+    pid_t pid = b->_pid;
+    bool stale = __atomic_load_n(&b->_magic, __ATOMIC_ACQUIRE) == TELEMETRY_MAGIC
+        && (pid == getpid() || (kill(pid, 0) < 0 && errno == ESRCH));
+    munmap((void *)b, sizeof(Telemetry_Block));
+    return stale;
+}
+
+bool telemetry_open(Machine *pmach, const char *name) {
+    static bool registered = false;
+    char *shm = malloc(strlen(name) + 2);
+    sprintf(shm, "%s%s", name[0] == '/' ? "" : "/", name);
+    int fd = shm_open(shm, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST && replaceable(shm)) {
+        shm_unlink(shm); // reste d'un processus terminé
+        fd = shm_open(shm, O_RDWR | O_CREAT | O_EXCL, 0644);
+    }
+    if (fd < 0) {
+        free(shm);
+        return false;
+    }
+    Telemetry_Block *b = MAP_FAILED;
+    if (ftruncate(fd, sizeof(Telemetry_Block)) == 0)
+        b = mmap(NULL, sizeof(Telemetry_Block), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (b == MAP_FAILED) {
+        shm_unlink(shm);
+        free(shm);
+        return false;
+    }
+    telemetry_close(pmach);
+
+    // Segment neuf, à zéro : l'en-tête est écrit avant tout lecteur possible
+    b->_pid = getpid();
+    b->_textsize = pmach->_textsize;
+    b->_datasize = pmach->_datasize;
+    b->_ring = TELEMETRY_RING;
+    b->_version = TELEMETRY_VERSION;
+    __atomic_store_n(&b->_magic, TELEMETRY_MAGIC, __ATOMIC_RELEASE);
+
+    Telemetry *t = calloc(1, sizeof(Telemetry));
+    t->_block = b;
+    t->_name = shm;
+    t->_random = 0x9e3779b97f4a7c15ull ^ b->_pid;
+    pmach->_telemetry = t;
+    current = pmach;
+    if (!registered) {
+        atexit(at_exit);
+        registered = true;
+    }
+    telemetry_publish(pmach, TELEMETRY_RUNNING, TELEMETRY_SAMPLE, pmach->_pc, 0);
+    return true;
+}
+
+void telemetry_close(Machine *pmach) {
+    Telemetry *t = pmach->_telemetry;
+    if (t == NULL)
+        return;
+    munmap(t->_block, sizeof(Telemetry_Block));
+    shm_unlink(t->_name);
+    free(t->_name);
+    free(t);
+    pmach->_telemetry = NULL;
+    if (current == pmach)
+        current = NULL;
+}
+
+void telemetry_from_env(Machine *pmach) {
+    const char *env = getenv(TELEMETRY_ENV);
+    if (pmach->_telemetry != NULL || env == NULL || env[0] == '\0')
+        return;
+    if (!telemetry_open(pmach, env))
+        printf("Erreur: %s: publication de l'état impossible\n", env);
+}
+
+void telemetry_publish(Machine *pmach, Telemetry_State state, Telemetry_Kind kind,
+                       unsigned pc, unsigned arg) {
+    Telemetry *t = pmach->_telemetry;
+    Telemetry_Block *b = t->_block;
+    unsigned sp = pmach->_sp;
+
+    // État : compteur impair pendant l'écriture
+    uint64_t seq = b->_seq;
+    STORE(b->_seq, seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    STORE(b->_retired, pmach->_retired);
+    STORE(b->_pc, pmach->_pc);
+    STORE(b->_cc, pmach->_cc);
+    STORE(b->_stack, sp);
+    STORE(b->_tos, sp + 1 < pmach->_datasize ? (uint32_t)read_data(pmach, sp + 1) : 0);
+    STORE(b->_state, state);
+    __atomic_store_n(&b->_seq, seq + 2, __ATOMIC_RELEASE);
+
+    // Événement : case marquée vide pendant l'écriture
+    uint64_t n = b->_head;
+    Telemetry_Event *e = &b->_events[n % TELEMETRY_RING];
+    STORE(e->_seq, 0);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    STORE(e->_retired, pmach->_retired);
+    STORE(e->_kind, kind);
+    STORE(e->_pc, pc);
+    STORE(e->_arg, arg);
+    __atomic_store_n(&e->_seq, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&b->_head, n + 1, __ATOMIC_RELEASE);
+
+    t->_next = pmach->_retired + interval(t);
+}
+
+void telemetry_fault(Error err, unsigned addr) {
+    if (current != NULL && current->_telemetry != NULL)
+        telemetry_publish(current, TELEMETRY_FAILED, TELEMETRY_FAULT, addr, err);
+}
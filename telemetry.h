@@ -0,0 +1,182 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+/*!
+ * \file telemetry.h
+ * \brief Publication de l'état de la simulation en mémoire partagée.
+ *
+ * Quand la publication est active (\c Machine::_telemetry non NULL), la
+ * machine tient à jour un bloc (\link Telemetry_Block \endlink) dans un
+ * segment de mémoire partagée POSIX (\c shm_open), qu'un observateur
+ * externe (l'outil \c monitor) projette en lecture seule : \c pc, nombre
+ * d'instructions exécutées, \c cc, \c sp et sommet de pile, état de la
+ * simulation, et un anneau des événements récents.
+ *
+ * Le bloc n'est écrit que par lots : tous les \c TELEMETRY_BATCH
+ * instructions en moyenne (l'intervalle est tiré entre la moitié et une
+ * fois et demie, pour ne pas se synchroniser sur une boucle), simul() publie
+ * l'état et un événement \c TELEMETRY_SAMPLE portant le \c pc courant ;
+ * la fréquence des \c pc échantillonnés donne les points chauds du
+ * programme. Entre deux lots, le coût est une comparaison par instruction ;
+ * une publication est une dizaine d'écritures atomiques relâchées.
+ *
+ * L'unique écrivain n'attend jamais : l'état est protégé par un compteur de
+ * séquence (impair pendant l'écriture, le lecteur recommence s'il a changé)
+ * et chaque case de l'anneau porte le numéro de l'événement qu'elle
+ * contient (0 pendant l'écriture). Un lecteur trop lent perd les événements
+ * écrasés, sans jamais lire un événement incohérent.
+ *
+ * Les arrêts de la mise au point, la fin du programme et les erreurs
+ * fatales sont aussi publiés. Le segment est supprimé à la fin de la
+ * simulation ou du processus ; un observateur déjà attaché garde l'état
+ * final.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+#include "error.h"
+
+//! Nombre magique du bloc ("TELM")
+#define TELEMETRY_MAGIC 0x4d4c4554u
+
+//! Version du format du bloc
+#define TELEMETRY_VERSION 1
+
+//! Nombre de cases de l'anneau des événements (puissance de 2)
+#define TELEMETRY_RING 1024
+
+//! Nombre moyen d'instructions entre deux publications
+#define TELEMETRY_BATCH 4096
+
+//! Variable d'environnement donnant le nom du segment (voir telemetry_from_env())
+#define TELEMETRY_ENV "SIMUL_TELEMETRY"
+
+//! État de la simulation
+typedef enum
+{
+    TELEMETRY_RUNNING = 0,	//!< En cours
+    TELEMETRY_STOPPED,		//!< Arrêtée par la mise au point
+    TELEMETRY_HALTED,		//!< Terminée sur \c HALT
+    TELEMETRY_FAILED,		//!< Terminée sur une erreur
+} Telemetry_State;
+
+//! Type d'événement
+typedef enum
+{
+    TELEMETRY_SAMPLE = 0,	//!< Échantillon du \c pc
+    TELEMETRY_STOP,		//!< Arrêt de la mise au point
+    TELEMETRY_HALT,		//!< Fin du programme
+    TELEMETRY_FAULT,		//!< Erreur (\c _arg : code \link Error \endlink)
+} Telemetry_Kind;
+
+//! Case de l'anneau des événements
+typedef struct
+{
+    uint64_t _seq;		//!< Numéro de l'événement + 1 (0 pendant l'écriture)
+    uint64_t _retired;		//!< Instructions exécutées
+    uint32_t _kind;		//!< \link Telemetry_Kind \endlink
+    uint32_t _pc;		//!< Adresse
+    uint32_t _arg;		//!< Paramètre (selon le type)
+    uint32_t _pad;		//!< Réservé (0)
+} Telemetry_Event;
+
+//! Bloc publié en mémoire partagée
+typedef struct
+{
+    // En-tête (fixé à l'ouverture)
+    uint32_t _magic;		//!< \c TELEMETRY_MAGIC
+    uint32_t _version;		//!< \c TELEMETRY_VERSION
+    uint32_t _pid;		//!< Processus du simulateur
+    uint32_t _textsize;		//!< Taille du segment de texte
+    uint32_t _datasize;		//!< Taille du segment de données
+    uint32_t _ring;		//!< \c TELEMETRY_RING
+
+    // État (compteur de séquence)
+    uint64_t _seq;		//!< Pair hors écriture
+    uint64_t _retired;		//!< Instructions exécutées
+    uint32_t _pc;		//!< Compteur ordinal
+    uint32_t _cc;		//!< Code condition
+    uint32_t _stack;		//!< Pointeur de pile (\c _sp)
+    uint32_t _tos;		//!< Sommet de pile (0 si la pile est vide)
+    uint32_t _state;		//!< \link Telemetry_State \endlink
+    uint32_t _pad;		//!< Réservé (0)
+
+    // Anneau des événements
+    uint64_t _head;		//!< Nombre d'événements publiés
+    Telemetry_Event _events[TELEMETRY_RING]; //!< Événement n dans la case n % TELEMETRY_RING
+} Telemetry_Block;
+
+//! Publication d'une machine
+typedef struct Telemetry
+{
+    Telemetry_Block *_block;	//!< Bloc projeté
+    char *_name;		//!< Nom du segment
+    uint64_t _next;		//!< Prochaine publication (en instructions exécutées)
+    uint64_t _random;		//!< État du générateur des intervalles
+} Telemetry;
+
+//! Début de la publication
+/*!
+ * Un segment de même nom laissé par un processus terminé (ou par ce
+ * processus) est remplacé ; celui d'une simulation en cours n'est pas
+ * touché. Une publication déjà active est arrêtée.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param name le nom du segment (\c / ajouté en tête s'il manque)
+ * \return faux si le segment ne peut être créé, notamment s'il est publié
+ * par un autre processus vivant
+ */
+bool telemetry_open(Machine *pmach, const char *name);
+
+//! Fin de la publication (le segment est supprimé)
+/*!
+ * \param pmach la machine
+ */
+void telemetry_close(Machine *pmach);
+
+//! Publication selon la variable d'environnement \c TELEMETRY_ENV
+/*!
+ * Appelée au début de simul() ; sans effet si la variable est absente ou
+ * vide, ou si la publication est déjà active.
+ *
+ * \param pmach la machine
+ */
+void telemetry_from_env(Machine *pmach);
+
+//! Publication de l'état et d'un événement
+/*!
+ * \param pmach la machine (publication active)
+ * \param state l'état de la simulation
+ * \param kind le type de l'événement
+ * \param pc son adresse
+ * \param arg son paramètre
+ */
+void telemetry_publish(Machine *pmach, Telemetry_State state, Telemetry_Kind kind,
+                       unsigned pc, unsigned arg);
+
+//! Publication d'une erreur fatale (appelée par error())
+/*!
+ * Appelée après le crochet d'erreur : une erreur rattrapée par le
+ * retour arrière (history.h) ou par fuzz ne publie pas \c TELEMETRY_FAILED.
+ * Sans effet si aucune machine ne publie.
+ *
+ * \param err le code de l'erreur
+ * \param addr son adresse
+ */
+void telemetry_fault(Error err, unsigned addr);
+
+//! Fin d'une instruction
+/*!
+ * Appelée par simul() quand \c Machine::_telemetry n'est pas NULL : une
+ * comparaison par instruction hors publication.
+ *
+ * \param pmach la machine
+ */
+static inline void telemetry_tick(Machine *pmach) {
+    if (pmach->_retired >= pmach->_telemetry->_next)
+        telemetry_publish(pmach, TELEMETRY_RUNNING, TELEMETRY_SAMPLE, pmach->_pc, 0);
+}
+
+#endif
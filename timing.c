@@ -0,0 +1,344 @@
+/*!
+ * \file timing.c
+ * \brief Estimation du temps d'exécution : modèle de pipeline en ordre.
+ */
+
+#include "timing.h"
+#include "instruction.h"
+#include "branchprof.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Nombre de compteurs des prédicteurs à table
+#define PHT_SIZE 4096
+
+//! Table de compteurs à saturation de 2 bits (et historique global)
+typedef struct
+{
+    uint8_t _counters[PHT_SIZE];	//!< Compteurs (pris si >= 2)
+    unsigned _history;			//!< Historique global (gshare)
+} Pattern_Table;
+
+static bool predict_taken(void *state, unsigned pc, unsigned target) {
+    return true;
+}
+
+static bool predict_not_taken(void *state, unsigned pc, unsigned target) {
+    return false;
+}
+
+static bool predict_btfn(void *state, unsigned pc, unsigned target) {
+    return target <= pc;
+}
+
+static void *create_table(Machine *pmach) {
+    Pattern_Table *pt = calloc(1, sizeof(Pattern_Table));
+    memset(pt->_counters, 1, sizeof(pt->_counters)); // faiblement non pris
+    return pt;
+}
+
+static bool predict_bimodal(void *state, unsigned pc, unsigned target) {
+    return ((Pattern_Table *)state)->_counters[pc % PHT_SIZE] >= 2;
+}
+
+//! Mise à jour d'un compteur à saturation
+static void train(uint8_t *counter, bool taken) {
+    if (taken && *counter < 3)
+        (*counter)++;
+    else if (!taken && *counter > 0)
+        (*counter)--;
+}
+
+static void update_bimodal(void *state, unsigned pc, bool taken) {
+    train(&((Pattern_Table *)state)->_counters[pc % PHT_SIZE], taken);
+}
+
+static bool predict_gshare(void *state, unsigned pc, unsigned target) {
+    Pattern_Table *pt = state;
+    return pt->_counters[(pc ^ pt->_history) % PHT_SIZE] >= 2;
+}
+
+static void update_gshare(void *state, unsigned pc, bool taken) {
+    Pattern_Table *pt = state;
+    train(&pt->_counters[(pc ^ pt->_history) % PHT_SIZE], taken);
+    pt->_history = (pt->_history << 1 | taken) % PHT_SIZE;
+}
+
+//! Sens dominant de chaque branchement, figé à la création (NULL sans profil)
+static void *create_hints(Machine *pmach) {
+    if (pmach->_branchprof == NULL)
+        return NULL;
+    uint32_t *hints = calloc(pmach->_textsize / 32 + 1, sizeof(uint32_t));
+    for (unsigned a = 0; a < pmach->_textsize; a++)
+        if (branchprof_hot_taken(pmach, a))
+            hints[a / 32] |= 1u << (a % 32);
+    return hints;
+}
+
+static bool predict_profile(void *state, unsigned pc, unsigned target) {
+    const uint32_t *hints = state;
+    return hints != NULL ? (hints[pc / 32] >> (pc % 32)) & 1 : target <= pc;
+}
+
+//! Prédicteurs prédéfinis
+static const Branch_Predictor predictors[] = {
+    { "taken", NULL, predict_taken, NULL },
+    { "nottaken", NULL, predict_not_taken, NULL },
+    { "btfn", NULL, predict_btfn, NULL },
+    { "bimodal", create_table, predict_bimodal, update_bimodal },
+    { "gshare", create_table, predict_gshare, update_gshare },
+    { "profile", create_hints, predict_profile, NULL },
+};
+
+const Branch_Predictor *timing_predictor(const char *name) {
+    for (unsigned i = 0; i < sizeof(predictors) / sizeof(predictors[0]); i++)
+        if (strcmp(predictors[i]._name, name) == 0)
+            return &predictors[i];
+    return NULL;
+}
+
+void timing_set_predictor(Machine *pmach, const Branch_Predictor *predictor) {
+    Timing *t = pmach->_timing;
+    timing_flush(pmach); // les branchements en attente relèvent de l'ancien
+    free(t->_pstate);
+    t->_predictor = predictor;
+    t->_pstate = predictor->_create != NULL ? predictor->_create(pmach) : NULL;
+}
+
+//! Lecture du fichier de configuration
+static bool read_config(Timing *t, const char *file) {
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        printf("Erreur: %s: fichier illisible\n", file);
+        return false;
+    }
+    char line[256], name[64], value[64];
+    unsigned lineno = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL)
+            *hash = '\0';
+        int n = sscanf(line, " %63s %63s", name, value);
+        if (n <= 0)
+            continue;
+        char *end = NULL;
+        unsigned long v = n == 2 ? strtoul(value, &end, 0) : 0;
+        bool number = n == 2 && *end == '\0';
+        unsigned *field = NULL;
+        if (strcmp(name, "memory") == 0)
+            field = &t->_memory;
+        else if (strcmp(name, "stack") == 0)
+            field = &t->_stack;
+        else if (strcmp(name, "block") == 0)
+            field = &t->_block;
+        else if (strcmp(name, "taken") == 0)
+            field = &t->_taken;
+        else if (strcmp(name, "mispredict") == 0)
+            field = &t->_mispredict;
+        else if (strcmp(name, "depth") == 0)
+            field = &t->_depth;
+        else if (strcmp(name, "predictor") == 0 && n == 2 && timing_predictor(value) != NULL) {
+            t->_predictor = timing_predictor(value);
+            continue;
+        } else {
+            for (unsigned cop = 0; cop < TIMING_NCOPS; cop++) {
+                unsigned k = 0;
+                while (name[k] != '\0' && toupper((unsigned char)name[k]) == cop_names[cop][k])
+                    k++;
+                if (name[k] == '\0' && cop_names[cop][k] == '\0')
+                    field = &t->_latency[cop];
+            }
+        }
+        if (field == NULL || !number) {
+            printf("Erreur: %s:%u: ligne incorrecte\n", file, lineno);
+            ok = false;
+            continue;
+        }
+        *field = v;
+    }
+    fclose(f);
+    return ok;
+}
+
+bool timing_open(Machine *pmach, const char *config) {
+    Timing *t = calloc(1, sizeof(Timing));
+    for (unsigned cop = 0; cop < TIMING_NCOPS; cop++)
+        t->_latency[cop] = 1;
+    t->_latency[MUL] = 3;
+    t->_latency[DIV] = t->_latency[MOD] = 12;
+    t->_memory = 2;
+    t->_stack = 2;
+    t->_block = 1;
+    t->_taken = 1;
+    t->_mispredict = 3;
+    t->_depth = 5;
+    t->_predictor = timing_predictor("bimodal");
+    if (config != NULL && !read_config(t, config)) {
+        free(t);
+        return false;
+    }
+    t->_pstate = t->_predictor->_create != NULL ? t->_predictor->_create(pmach) : NULL;
+    t->_pc_stats = calloc(pmach->_textsize, sizeof(Timing_Stats));
+    timing_close(pmach);
+    pmach->_timing = t;
+    return true;
+}
+
+void timing_close(Machine *pmach) {
+    Timing *t = pmach->_timing;
+    if (t == NULL)
+        return;
+    free(t->_pstate);
+    free(t->_pc_stats);
+    free(t);
+    pmach->_timing = NULL;
+}
+
+//! Attente d'un registre (ou du code condition) par l'instruction émise au plus tôt en *issue
+static inline void wait_for(const Timing *t, unsigned reg, unsigned long long *issue) {
+    if (t->_ready[reg] > *issue)
+        *issue = t->_ready[reg];
+}
+
+void timing_flush(Machine *pmach) {
+    Timing *t = pmach->_timing;
+    for (unsigned i = 0; i < t->_nevents; i++) {
+        const Timing_Event *e = &t->_events[i];
+        Decoded_Instruction d = pmach->_decoded != NULL ? pmach->_decoded[e->_pc]
+                                                        : decode_instruction(pmach->_text[e->_pc]);
+        Timing_Stats *ps = &t->_pc_stats[e->_pc];
+        bool immediate = d._flags & DECODED_IMMEDIATE, indexed = d._flags & DECODED_INDEXED;
+
+        // Émission : après la précédente et ses opérandes disponibles
+        unsigned long long issue = t->_issue;
+        if (indexed)
+            wait_for(t, d._rindex, &issue);
+        switch (d._cop) {
+        case STORE: case ADD: case SUB: case MUL: case DIV: case MOD:
+        case AND: case OR: case XOR: case SHL: case SHR: case SAR:
+            wait_for(t, d._regcond, &issue);
+            break;
+        case BRANCH: case CALL:
+            if (d._regcond != NC)
+                wait_for(t, NREGISTERS, &issue);
+            if (d._cop == CALL)
+                wait_for(t, NREGISTERS - 1, &issue);
+            break;
+        case RET: case PUSH: case POP:
+            wait_for(t, NREGISTERS - 1, &issue);
+            break;
+        case BMOVE: case BFILL: case BCMP:
+            wait_for(t, d._regcond, &issue);
+            wait_for(t, d._rsource, &issue);
+            break;
+        default:
+            break;
+        }
+        ps->_count++;
+        ps->_data += issue - t->_issue;
+        t->_total._count++;
+        t->_total._data += issue - t->_issue;
+
+        // Résultats et coût pour l'instruction suivante
+        unsigned long long memory = 0, control = 0;
+        unsigned long long done = issue + t->_latency[d._cop] + (immediate ? 0 : t->_memory);
+        bool taken = e->_next != e->_pc + 1;
+        switch (d._cop) {
+        case LOAD: case ADD: case SUB: case MUL: case DIV: case MOD:
+        case AND: case OR: case XOR: case SHL: case SHR: case SAR:
+            t->_ready[d._regcond] = done;
+            t->_ready[NREGISTERS] = done; // code condition
+            break;
+        case BRANCH: case CALL:
+            if (d._cop == CALL && taken)
+                t->_ready[NREGISTERS - 1] = issue + 1;
+            if (d._regcond == NC) {
+                control = t->_taken;
+            } else {
+                unsigned target = taken ? e->_next : indexed ? e->_pc + 1 : (unsigned)d._operand;
+                bool predicted = t->_predictor->_predict(t->_pstate, e->_pc, target);
+                if (t->_predictor->_update != NULL)
+                    t->_predictor->_update(t->_pstate, e->_pc, taken);
+                t->_branches++;
+                if (predicted != taken) {
+                    t->_mispredicts++;
+                    control = t->_mispredict;
+                } else if (taken) {
+                    control = t->_taken;
+                }
+            }
+            break;
+        case RET:
+            t->_ready[NREGISTERS - 1] = issue + 1;
+            memory = t->_stack; // adresse de retour lue en pile
+            control = t->_taken;
+            break;
+        case PUSH: case POP:
+            t->_ready[NREGISTERS - 1] = issue + 1;
+            break;
+        case BMOVE: case BFILL: case BCMP:
+            memory = (unsigned long long)e->_aux * t->_block;
+            if (d._cop == BCMP)
+                t->_ready[NREGISTERS] = issue + memory + 1;
+            break;
+        default:
+            break;
+        }
+        ps->_memory += memory;
+        ps->_control += control;
+        t->_total._memory += memory;
+        t->_total._control += control;
+        t->_last = issue;
+        t->_issue = issue + 1 + memory + control;
+    }
+    t->_nevents = 0;
+}
+
+//! Total des suspensions d'une instruction
+static unsigned long long stalls(const Timing_Stats *s) {
+    return s->_data + s->_control + s->_memory;
+}
+
+void timing_report(Machine *pmach, FILE *out, unsigned top) {
+    Timing *t = pmach->_timing;
+    timing_flush(pmach);
+    const Timing_Stats *s = &t->_total;
+    unsigned long long cycles = s->_count == 0 ? 0 : t->_last + t->_depth;
+    fprintf(out, "\n*** Temps ***\n");
+    fprintf(out, "Instructions : %llu, cycles : %llu, CPI : %.3f\n",
+            s->_count, cycles, s->_count == 0 ? 0.0 : (double)cycles / s->_count);
+    fprintf(out, "Suspensions : dépendances %llu, contrôle %llu, mémoire %llu cycles\n",
+            s->_data, s->_control, s->_memory);
+    fprintf(out, "Branchements conditionnels : %llu, mal prédits %llu (%.2f%%, prédicteur %s)\n",
+            t->_branches, t->_mispredicts,
+            t->_branches == 0 ? 0.0 : 100.0 * t->_mispredicts / t->_branches, t->_predictor->_name);
+
+    // Sélection des instructions aux plus nombreuses suspensions
+    unsigned *best = malloc((top + 1) * sizeof(unsigned));
+    unsigned nbest = 0;
+    for (unsigned pc = 0; pc < pmach->_textsize; pc++) {
+        unsigned long long n = stalls(&t->_pc_stats[pc]);
+        if (n == 0)
+            continue;
+        unsigned j = nbest < top ? nbest++ : top;
+        while (j > 0 && stalls(&t->_pc_stats[best[j - 1]]) < n) {
+            if (j < top)
+                best[j] = best[j - 1];
+            j--;
+        }
+        if (j < top)
+            best[j] = pc;
+    }
+    if (nbest > 0)
+        fprintf(out, "Instructions aux plus nombreuses suspensions :\n");
+    for (unsigned k = 0; k < nbest; k++) {
+        const Timing_Stats *ps = &t->_pc_stats[best[k]];
+        fprintf(out, "  0x%04x %-6s exécutions %llu  dépendances %llu  contrôle %llu  mémoire %llu\n",
+                best[k], cop_names[pmach->_text[best[k]].instr_generic._cop],
+                ps->_count, ps->_data, ps->_control, ps->_memory);
+    }
+    free(best);
+}
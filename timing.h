@@ -0,0 +1,191 @@
+#ifndef _TIMING_H_
+#define _TIMING_H_
+
+/*!
+ * \file timing.h
+ * \brief Estimation du temps d'exécution : modèle de pipeline en ordre.
+ *
+ * Quand le modèle est actif (\c Machine::_timing non NULL), la boucle de
+ * simul() range pour chaque instruction exécutée un événement (adresse,
+ * adresse suivante, longueur de bloc) dans un tampon de \c TIMING_BATCH
+ * entrées ; le modèle les traite par lots. L'instruction est relue dans le
+ * segment de texte et décodée au traitement, ce qui laisse à la boucle
+ * d'exécution trois écritures par instruction.
+ *
+ * Le modèle est celui d'un pipeline scalaire en ordre avec tableau de
+ * disponibilité des registres :
+ *
+ *   - une instruction est émise au plus tôt un cycle après la précédente, et
+ *   pas avant que ses registres sources (et le code condition pour un
+ *   branchement conditionnel) soient disponibles : l'attente est une
+ *   suspension de <b>dépendance</b> attribuée à l'instruction qui attend ;
+ *
+ *   - le résultat est disponible \a latence cycles après l'émission (latence
+ *   du code opération), plus \c memory si l'opérande est lu en mémoire
+ *   (suspension chargement-utilisation) ;
+ *
+ *   - un branchement pris coûte \c taken cycles, un branchement conditionnel
+ *   mal prédit \c mispredict cycles ; la prédiction est faite par un
+ *   prédicteur interchangeable (\link Branch_Predictor \endlink) : suspension
+ *   de <b>contrôle</b> ;
+ *
+ *   - \c RET attend son adresse de retour en pile (\c stack cycles) et une
+ *   instruction de bloc occupe le pipeline \c block cycles par mot :
+ *   suspension <b>mémoire</b>.
+ *
+ * Le total ajoute la profondeur du pipeline (\c depth) au cycle d'émission
+ * de la dernière instruction.
+ *
+ * Le fichier de configuration contient des lignes <tt>nom valeur</tt>
+ * (\c # commence un commentaire) : un code opération (\c LOAD, \c MUL...)
+ * suivi de sa latence, \c memory, \c stack, \c block, \c taken,
+ * \c mispredict, \c depth ou <tt>predictor nom</tt>.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "machine.h"
+
+//! Taille du tampon des événements
+#define TIMING_BATCH 4096
+
+//! Nombre de codes opérations
+#define TIMING_NCOPS (SAR + 1)
+
+//! Prédicteur de branchements conditionnels
+/*!
+ * Un prédicteur fournit un état (alloué par \c _create pour une machine,
+ * libéré par \c free(), NULL si sans état), une prédiction et une mise à
+ * jour avec l'issue réelle. La cible est l'adresse du branchement s'il est
+ * pris.
+ */
+typedef struct
+{
+    const char *_name;					//!< Nom (fichier de configuration)
+    void *(*_create)(Machine *pmach);			//!< Création de l'état (ou NULL)
+    bool (*_predict)(void *state, unsigned pc, unsigned target);	//!< Pris ?
+    void (*_update)(void *state, unsigned pc, bool taken);	//!< Issue réelle (ou NULL)
+} Branch_Predictor;
+
+//! Événement : une instruction exécutée
+typedef struct
+{
+    uint32_t _pc;		//!< Adresse de l'instruction
+    uint32_t _next;		//!< Adresse de l'instruction suivante
+    uint32_t _aux;		//!< Longueur du bloc (instructions de bloc)
+} Timing_Event;
+
+//! Compteurs par instruction
+typedef struct
+{
+    unsigned long long _count;		//!< Exécutions
+    unsigned long long _data;		//!< Cycles de suspension de dépendance
+    unsigned long long _control;	//!< Cycles de suspension de contrôle
+    unsigned long long _memory;		//!< Cycles de suspension mémoire
+} Timing_Stats;
+
+//! Modèle temporel d'une machine
+typedef struct Timing
+{
+    // Configuration
+    unsigned _latency[TIMING_NCOPS];	//!< Latence de chaque code opération
+    unsigned _memory;			//!< Latence d'un opérande en mémoire
+    unsigned _stack;			//!< Latence d'une lecture en pile (RET)
+    unsigned _block;			//!< Cycles par mot des instructions de bloc
+    unsigned _taken;			//!< Coût d'un branchement pris
+    unsigned _mispredict;		//!< Coût d'un branchement mal prédit
+    unsigned _depth;			//!< Profondeur du pipeline
+    const Branch_Predictor *_predictor;	//!< Prédicteur
+    void *_pstate;			//!< État du prédicteur
+
+    // État du pipeline
+    unsigned long long _issue;		//!< Cycle d'émission au plus tôt de l'instruction suivante
+    unsigned long long _last;		//!< Cycle d'émission de la dernière instruction
+    unsigned long long _ready[NREGISTERS + 1]; //!< Disponibilité des registres et du code condition
+
+    // Statistiques
+    unsigned long long _branches;	//!< Branchements conditionnels
+    unsigned long long _mispredicts;	//!< Dont mal prédits
+    Timing_Stats _total;		//!< Totaux
+    Timing_Stats *_pc_stats;		//!< Par instruction (\c _textsize éléments)
+
+    unsigned _nevents;			//!< Événements en attente
+    Timing_Event _events[TIMING_BATCH];	//!< Événements en attente
+} Timing;
+
+//! Activation du modèle
+/*!
+ * Les valeurs par défaut (latence 1, 3 pour \c MUL, 12 pour \c DIV et
+ * \c MOD ; \c memory 2, \c stack 2, \c block 1, \c taken 1, \c mispredict 3,
+ * \c depth 5, prédicteur \c bimodal) sont remplacées par celles du fichier
+ * \a config. Un modèle déjà actif est remplacé.
+ *
+ * \param pmach la machine (programme chargé)
+ * \param config le fichier de configuration (NULL : valeurs par défaut)
+ * \return faux si le fichier est illisible ou incorrect (message affiché)
+ */
+bool timing_open(Machine *pmach, const char *config);
+
+//! Désactivation du modèle
+/*!
+ * \param pmach la machine
+ */
+void timing_close(Machine *pmach);
+
+//! Recherche d'un prédicteur prédéfini
+/*!
+ * \c taken, \c nottaken, \c btfn (arrière pris, avant non pris),
+ * \c bimodal (compteurs de 2 bits indexés par l'adresse), \c gshare
+ * (compteurs indexés par l'adresse et l'historique global) et \c profile
+ * (sens dominant du profil des branchements, voir branchprof.h ; \c btfn
+ * sans profil).
+ *
+ * \param name le nom
+ * \return le prédicteur ou NULL
+ */
+const Branch_Predictor *timing_predictor(const char *name);
+
+//! Changement de prédicteur
+/*!
+ * \param pmach la machine (modèle actif)
+ * \param predictor le prédicteur
+ */
+void timing_set_predictor(Machine *pmach, const Branch_Predictor *predictor);
+
+//! Traitement des événements en attente
+/*!
+ * \param pmach la machine (modèle actif)
+ */
+void timing_flush(Machine *pmach);
+
+//! Affichage de l'estimation
+/*!
+ * Cycles, CPI, suspensions par nature, précision du prédicteur puis les
+ * \a top instructions aux plus nombreux cycles de suspension.
+ *
+ * \param pmach la machine (modèle actif)
+ * \param out le flot de sortie
+ * \param top le nombre d'instructions listées
+ */
+void timing_report(Machine *pmach, FILE *out, unsigned top);
+
+//! Événement d'une instruction exécutée
+/*!
+ * Appelée par simul() quand \c Machine::_timing n'est pas NULL, après
+ * l'exécution.
+ *
+ * \param pmach la machine
+ * \param pc l'adresse de l'instruction exécutée
+ */
+static inline void timing_event(Machine *pmach, unsigned pc) {
+    Timing *t = pmach->_timing;
+    Timing_Event *e = &t->_events[t->_nevents];
+    e->_pc = pc;
+    e->_next = pmach->_pc;
+    e->_aux = pmach->_registers[pmach->_text[pc].instr_block._regcond];
+    if (++t->_nevents == TIMING_BATCH)
+        timing_flush(pmach);
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*!
+ * \file watch.c
+ * \brief Points de surveillance des données (lecture, écriture, valeur).
+ */
+
+#include "watch.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Forme imprimable des accès
+static const char *kind_names[] = { "", "lecture", "écriture", "accès" };
+
+//! Forme imprimable des conditions
+static const char *cond_names[] = { "", "==", "!=", "<", ">" };
+
+//! Reconstruction de la bitmap d'ombre à partir des points
+static void rebuild_shadow(Watch *w, unsigned datasize) {
+    memset(w->_shadow, 0, ((datasize >> MEMORY_PAGE_BITS) / 64 + 1) * sizeof(uint64_t));
+    for (unsigned i = 0; i < w->_npoints; i++) {
+        unsigned last = (w->_points[i]._first + w->_points[i]._count - 1) >> MEMORY_PAGE_BITS;
+        for (unsigned page = w->_points[i]._first >> MEMORY_PAGE_BITS; page <= last; page++)
+            w->_shadow[page / 64] |= (uint64_t)1 << (page % 64);
+    }
+}
+
+unsigned watch_add(Machine *pmach, unsigned first, unsigned count,
+                   Watch_Kind kind, Watch_Condition cond, Word value) {
+    if (count == 0 || (uint64_t)first + count > pmach->_datasize)
+        return 0;
+    Watch *w = pmach->_watch;
+    if (w == NULL) {
+        w = calloc(1, sizeof(Watch));
+        w->_shadow = calloc((pmach->_datasize >> MEMORY_PAGE_BITS) / 64 + 1, sizeof(uint64_t));
+        w->_next_id = 1;
+    }
+    w->_points = realloc(w->_points, (w->_npoints + 1) * sizeof(Watchpoint));
+    Watchpoint *p = &w->_points[w->_npoints++];
+    p->_id = w->_next_id++;
+    p->_first = first;
+    p->_count = count;
+    p->_kind = kind;
+    p->_cond = cond;
+    p->_value = value;
+    rebuild_shadow(w, pmach->_datasize);
+    pmach->_watch = w; // armé : exec.c passe par watch_access()
+    return p->_id;
+}
+
+bool watch_remove(Machine *pmach, unsigned id) {
+    Watch *w = pmach->_watch;
+    if (w == NULL)
+        return false;
+    for (unsigned i = 0; i < w->_npoints; i++)
+        if (w->_points[i]._id == id) {
+            w->_points[i] = w->_points[--w->_npoints];
+            if (w->_npoints == 0)
+                watch_clear(pmach);
+            else
+                rebuild_shadow(w, pmach->_datasize);
+            return true;
+        }
+    return false;
+}
+
+void watch_clear(Machine *pmach) {
+    Watch *w = pmach->_watch;
+    if (w == NULL)
+        return;
+    free(w->_shadow);
+    free(w->_points);
+    free(w->_hits);
+    free(w);
+    pmach->_watch = NULL;
+}
+
+//! Lecture d'une adresse de données : nombre ou étiquette
+static bool parse_data_address(Machine *pmach, const char *s, size_t len, unsigned *addr) {
+    char buf[256];
+    if (len == 0 || len >= sizeof(buf))
+        return false;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    char *end;
+    unsigned long v = strtoul(buf, &end, 0);
+    if (end != buf && *end == '\0') {
+        *addr = v;
+        return true;
+    }
+    for (unsigned i = 0; i < pmach->_nsymbols; i++)
+        if (!pmach->_symbols[i]._text && strcmp(pmach->_symbols[i]._name, buf) == 0) {
+            *addr = pmach->_symbols[i]._address;
+            return true;
+        }
+    return false;
+}
+
+unsigned watch_parse(Machine *pmach, const char *spec) {
+    const char *p = spec + strspn(spec, " \t");
+    size_t len = strcspn(p, ": \t\n");
+    unsigned first, count = 1;
+    if (!parse_data_address(pmach, p, len, &first))
+        return 0;
+    p += len;
+    if (*p == ':') {
+        char *end;
+        count = strtoul(p + 1, &end, 0);
+        p = end;
+    }
+    p += strspn(p, " \t");
+    Watch_Kind kind = WATCH_WRITE;
+    if ((*p == 'r' || *p == 'w' || *p == 'a') && (p[1] == '\0' || strchr(" \t\n", p[1]))) {
+        kind = *p == 'r' ? WATCH_READ : *p == 'w' ? WATCH_WRITE : WATCH_ACCESS;
+        p += 1 + strspn(p + 1, " \t");
+    }
+    Watch_Condition cond = WATCH_ALWAYS;
+    long long value = 0;
+    if (*p != '\0' && *p != '\n') {
+        if (strncmp(p, "==", 2) == 0 || strncmp(p, "!=", 2) == 0) {
+            cond = p[0] == '=' ? WATCH_EQ : WATCH_NE;
+            p += 2;
+        } else if (*p == '<' || *p == '>') {
+            cond = *p == '<' ? WATCH_LT : WATCH_GT;
+            p++;
+        } else {
+            return 0;
+        }
+        char *end;
+        value = strtoll(p, &end, 0);
+        if (end == p || end[strspn(end, " \t\n")] != '\0')
+            return 0;
+    }
+    return watch_add(pmach, first, count, kind, cond, (Word)value);
+}
+
+void watch_list(Machine *pmach) {
+    Watch *w = pmach->_watch;
+    for (unsigned i = 0; w != NULL && i < w->_npoints; i++) {
+        Watchpoint *p = &w->_points[i];
+        printf("  #%u: Data[0x%04x", p->_id, p->_first);
+        if (p->_count > 1)
+            printf("..0x%04x", p->_first + p->_count - 1);
+        printf("] %s", kind_names[p->_kind]);
+        if (p->_cond != WATCH_ALWAYS)
+            printf(" si valeur %s %d", cond_names[p->_cond], (int32_t)p->_value);
+        printf("\n");
+    }
+}
+
+void watch_access(Machine *pmach, unsigned addr, unsigned n, Watch_Kind kind) {
+    Watch *w = pmach->_watch;
+    if (n == 0)
+        return;
+    // Filtre rapide : aucune page de l'intervalle n'est surveillée
+    unsigned last = (addr + n - 1) >> MEMORY_PAGE_BITS;
+    bool shadowed = false;
+    for (unsigned page = addr >> MEMORY_PAGE_BITS; page <= last && !shadowed; page++)
+        shadowed = (w->_shadow[page / 64] >> (page % 64)) & 1;
+    if (!shadowed)
+        return;
+    for (unsigned i = 0; i < w->_npoints; i++) {
+        Watchpoint *p = &w->_points[i];
+        if (!(p->_kind & kind) || p->_first >= addr + n || addr >= p->_first + p->_count)
+            continue;
+        // Un point n'est noté qu'une fois par nature d'accès : le premier
+        // accès porte l'ancienne valeur
+        bool seen = false;
+        for (unsigned j = 0; j < w->_nhits && !seen; j++)
+            seen = w->_hits[j]._point == i && w->_hits[j]._kind == kind;
+        if (seen)
+            continue;
+        if (w->_nhits == w->_maxhits) {
+            w->_maxhits = w->_maxhits == 0 ? 4 : 2 * w->_maxhits;
+            w->_hits = realloc(w->_hits, w->_maxhits * sizeof(Watch_Hit));
+        }
+        Watch_Hit *h = &w->_hits[w->_nhits++];
+        h->_point = i;
+        h->_addr = p->_first > addr ? p->_first : addr;
+        h->_kind = kind;
+        h->_old = read_data(pmach, h->_addr);
+        w->_hit_instr = pmach->_pc - 1;
+    }
+}
+
+//! Condition d'un point touché, sur la valeur après l'instruction
+static bool hit_fires(Machine *pmach, const Watch_Hit *h) {
+    Watchpoint *p = &pmach->_watch->_points[h->_point];
+    Word value = read_data(pmach, h->_addr);
+    switch (p->_cond) {
+    case WATCH_EQ:
+        return value == p->_value;
+    case WATCH_NE:
+        return value != p->_value;
+    case WATCH_LT:
+        return (int32_t)value < (int32_t)p->_value;
+    case WATCH_GT:
+        return (int32_t)value > (int32_t)p->_value;
+    default:
+        return true;
+    }
+}
+
+bool watch_triggered(Machine *pmach) {
+    Watch *w = pmach->_watch;
+    bool fired = false;
+    for (unsigned i = 0; i < w->_nhits && !fired; i++)
+        fired = hit_fires(pmach, &w->_hits[i]);
+    w->_nhits = 0;
+    return fired;
+}
+
+bool watch_report(Machine *pmach) {
+    Watch *w = pmach->_watch;
+    bool fired = false;
+    for (unsigned i = 0; i < w->_nhits; i++) {
+        Watch_Hit *h = &w->_hits[i];
+        if (!hit_fires(pmach, h))
+            continue;
+        if (!fired) {
+            printf("Point de surveillance après %llu instructions\n", pmach->_retired);
+            printf("  0x%04x: ", w->_hit_instr);
+            if (w->_hit_instr < pmach->_textsize)
+                print_instruction(pmach->_text[w->_hit_instr], w->_hit_instr);
+            printf("\n");
+        }
+        fired = true;
+        Word value = read_data(pmach, h->_addr);
+        printf("  #%u (%s) Data[0x%04x] : 0x%08x %d -> 0x%08x %d\n",
+               w->_points[h->_point]._id, kind_names[h->_kind], h->_addr,
+               h->_old, (int32_t)h->_old, value, (int32_t)value);
+    }
+    w->_nhits = 0;
+    return fired;
+}
@@ -0,0 +1,163 @@
+#ifndef _WATCH_H_
+#define _WATCH_H_
+
+/*!
+ * \file watch.h
+ * \brief Points de surveillance des données (lecture, écriture, valeur).
+ *
+ * Un point de surveillance porte sur un mot ou un intervalle du segment de
+ * données, en lecture, en écriture ou les deux, avec une condition facultative
+ * sur la valeur du mot après l'instruction. Les accès des instructions
+ * (\c LOAD, \c STORE, opérations arithmétiques, \c PUSH, \c POP, \c CALL,
+ * \c RET et instructions de bloc) passent dans exec.c par des fonctions qui
+ * ne testent que \c Machine::_watch : sans point de surveillance ce pointeur
+ * est NULL et le coût se réduit à ce test.
+ *
+ * Quand des points existent, une bitmap d'ombre (un bit par page de
+ * \c MEMORY_PAGE mots du segment de données) élimine sans recherche les
+ * accès aux pages non surveillées ; seuls les accès aux pages marquées
+ * parcourent la liste des points. Chaque point touché par une instruction
+ * est noté (une fois par nature d'accès) avec l'ancienne valeur du mot ;
+ * après l'instruction, simul() appelle watch_report() qui évalue la condition
+ * de chacun, affiche pour tous ceux qui se déclenchent l'adresse,
+ * l'instruction, l'ancienne et la nouvelle valeur, puis entre dans le
+ * débogueur. Une condition fausse sur un point ne masque donc pas les autres
+ * (deux conditions sur le même mot, lecture puis écriture de \c POP...).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Accès surveillés (combinables)
+typedef enum
+{
+    WATCH_READ = 1,		//!< Lecture
+    WATCH_WRITE = 2,		//!< Écriture
+    WATCH_ACCESS = 3,		//!< Lecture ou écriture
+} Watch_Kind;
+
+//! Condition sur la valeur du mot après l'instruction
+typedef enum
+{
+    WATCH_ALWAYS = 0,		//!< Pas de condition
+    WATCH_EQ,			//!< Valeur égale
+    WATCH_NE,			//!< Valeur différente
+    WATCH_LT,			//!< Valeur inférieure (signée)
+    WATCH_GT,			//!< Valeur supérieure (signée)
+} Watch_Condition;
+
+//! Point de surveillance
+typedef struct
+{
+    unsigned _id;		//!< Numéro (pour le retrait)
+    unsigned _first;		//!< Première adresse surveillée
+    unsigned _count;		//!< Nombre de mots
+    Watch_Kind _kind;		//!< Accès surveillés
+    Watch_Condition _cond;	//!< Condition sur la valeur
+    Word _value;		//!< Valeur de comparaison
+} Watchpoint;
+
+//! Accès à un point de surveillance pendant l'instruction en cours
+typedef struct
+{
+    unsigned _point;		//!< Indice du point touché
+    unsigned _addr;		//!< Adresse de la donnée
+    Watch_Kind _kind;		//!< Nature de l'accès
+    Word _old;			//!< Valeur avant l'accès
+} Watch_Hit;
+
+//! Points de surveillance d'une machine
+typedef struct Watch
+{
+    uint64_t *_shadow;		//!< Bitmap des pages surveillées
+    Watchpoint *_points;	//!< Points de surveillance
+    unsigned _npoints;		//!< Nombre de points
+    unsigned _next_id;		//!< Numéro du prochain point
+
+    // Accès de l'instruction en cours
+    Watch_Hit *_hits;		//!< Points touchés
+    unsigned _nhits;		//!< Nombre de points touchés (0 : aucun)
+    unsigned _maxhits;		//!< Taille allouée de _hits
+    unsigned _hit_instr;	//!< Adresse de l'instruction
+} Watch;
+
+//! Ajout d'un point de surveillance
+/*!
+ * \param pmach la machine
+ * \param first la première adresse
+ * \param count le nombre de mots (au moins 1)
+ * \param kind les accès surveillés
+ * \param cond la condition sur la valeur
+ * \param value la valeur de comparaison
+ * \return le numéro du point, ou 0 si l'intervalle sort du segment de données
+ */
+unsigned watch_add(Machine *pmach, unsigned first, unsigned count,
+                   Watch_Kind kind, Watch_Condition cond, Word value);
+
+//! Retrait d'un point de surveillance
+/*!
+ * Quand il n'en reste plus, \c Machine::_watch redevient NULL.
+ *
+ * \param pmach la machine
+ * \param id le numéro du point
+ * \return faux si ce point n'existe pas
+ */
+bool watch_remove(Machine *pmach, unsigned id);
+
+//! Retrait de tous les points de surveillance
+/*!
+ * \param pmach la machine
+ */
+void watch_clear(Machine *pmach);
+
+//! Déclaration d'un point de surveillance sous forme textuelle
+/*!
+ * Syntaxe : <tt>adresse[:nombre] [r|w|a] [== | != | < | > valeur]</tt>
+ * (écriture par défaut) ; l'adresse est un nombre (\c 0x pour l'hexadécimal)
+ * ou une étiquette des données.
+ *
+ * \param pmach la machine
+ * \param spec la déclaration
+ * \return le numéro du point, ou 0 si la déclaration est invalide
+ */
+unsigned watch_parse(Machine *pmach, const char *spec);
+
+//! Affichage des points de surveillance
+/*!
+ * \param pmach la machine
+ */
+void watch_list(Machine *pmach);
+
+//! Accès surveillé à un intervalle de données (chemin lent)
+/*!
+ * Appelée par exec.c avant l'accès quand \c Machine::_watch n'est pas NULL.
+ *
+ * \param pmach la machine
+ * \param addr la première adresse accédée
+ * \param n le nombre de mots
+ * \param kind lecture ou écriture
+ */
+void watch_access(Machine *pmach, unsigned addr, unsigned n, Watch_Kind kind);
+
+//! Évaluation silencieuse des accès notés pendant l'instruction
+/*!
+ * Les accès notés sont effacés ; sert aussi à la ré-exécution (history.h).
+ *
+ * \param pmach la machine (après l'instruction, \c _watch->_nhits non nul)
+ * \return vrai si la condition d'au moins un point touché est vérifiée
+ */
+bool watch_triggered(Machine *pmach);
+
+//! Compte rendu des points déclenchés pendant l'instruction
+/*!
+ * Chaque point touché dont la condition est vérifiée est affiché ; les accès
+ * notés sont effacés.
+ *
+ * \param pmach la machine (après l'instruction)
+ * \return vrai s'il faut entrer dans le débogueur (au moins un point déclenché)
+ */
+bool watch_report(Machine *pmach);
+
+#endif